@@ -0,0 +1,1554 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+//  Micro-benchmark of the dsp/ kernels.
+//
+//  Every function pointer installed by the dsp initializers (VP8DspInit,
+//  VP8EncDspInit, VP8LDspInit, VP8LEncDspInit, WebPInitUpsamplers,
+//  WebPRescalerDspInit, VP8FiltersInit, ...) is timed in isolation, once per
+//  SIMD tier available on the host. A tier is selected by installing a
+//  VP8GetCPUInfo that only reports the tier's features and re-running the
+//  initializers. Kernels are run on synthetic data and, with '-i', on the
+//  pixels of a PPM image. Results are written as JSON on stdout, together
+//  with the list of kernels that have no specialized version at each tier.
+//
+//  The SSE4.1 and AVX2 tiers are only populated if the library was built
+//  with WEBP_HAVE_SSE41 / WEBP_HAVE_AVX2 (or -msse4.1 / -mavx2 globally).
+//
+//  Usage: dsp_bench [-i image.ppm] [-tiers C,SSE2,...] [-filter str]
+//                   [-t ms] [-r reps] [-s width height]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "../src/dsp/dsp.h"
+#include "../src/dsp/lossless.h"
+#include "../src/dsp/yuv.h"
+#include "../src/dec/common.h"
+#include "../src/enc/cost.h"
+#include "../src/enc/histogram.h"
+#include "../src/enc/vp8enci.h"
+#include "../src/utils/rescaler.h"
+
+//------------------------------------------------------------------------------
+// Timing
+
+static double Now(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double)count.QuadPart / freq.QuadPart;
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// CPU tiers
+
+typedef struct {
+  const char* name;
+  uint32_t features;    // mask of (1 << CPUFeature) reported by the tier
+} Tier;
+
+#define FEAT(f) (1u << (f))
+static const Tier kTiers[] = {
+  { "C", 0 },
+  { "SSE2", FEAT(kSSE2) },
+  { "SSE4.1", FEAT(kSSE2) | FEAT(kSSE3) | FEAT(kSSE4_1) },
+  { "AVX2", FEAT(kSSE2) | FEAT(kSSE3) | FEAT(kSSE4_1) | FEAT(kAVX) |
+            FEAT(kAVX2) },
+  { "NEON", FEAT(kNEON) },
+  { "MIPS32", FEAT(kMIPS32) },
+  { "MIPSdspR2", FEAT(kMIPS32) | FEAT(kMIPSdspR2) },
+  { "MSA", FEAT(kMSA) }
+};
+#define NUM_TIERS ((int)(sizeof(kTiers) / sizeof(kTiers[0])))
+
+static VP8CPUInfo real_cpu_info = NULL;
+static uint32_t tier_features = 0;
+
+static int TierHasFeature(CPUFeature feature) {
+  return ((tier_features & FEAT(feature)) != 0) &&
+         (real_cpu_info != NULL) && real_cpu_info(feature);
+}
+
+// The initializers cache the last VP8GetCPUInfo they saw, so switching tiers
+// must install a different pointer each time: two identical copies are used
+// alternately.
+static int TierCPUInfoA(CPUFeature feature) { return TierHasFeature(feature); }
+static int TierCPUInfoB(CPUFeature feature) { return TierHasFeature(feature); }
+
+static int TierIsAvailable(const Tier* const tier) {
+  int f;
+  if (tier->features == 0) return 1;
+  if (real_cpu_info == NULL) return 0;
+  for (f = kSSE2; f <= kMSA; ++f) {
+    if ((tier->features & FEAT(f)) && !real_cpu_info((CPUFeature)f)) return 0;
+  }
+  return 1;
+}
+
+static void InitAllDsp(void) {
+  VP8DspInit();
+  VP8EncDspInit();
+  VP8EncDspCostInit();
+  VP8SSIMDspInit();
+  VP8LDspInit();
+  VP8LEncDspInit();
+  WebPInitUpsamplers();
+  WebPInitSamplers();
+  WebPInitYUV444Converters();
+  WebPInitConvertARGBToYUV();
+  WebPRescalerDspInit();
+  WebPInitAlphaProcessing();
+  VP8EncDspARGBInit();
+  VP8FiltersInit();
+}
+
+static void SelectTier(const Tier* const tier) {
+  tier_features = tier->features;
+  VP8GetCPUInfo = (VP8GetCPUInfo == TierCPUInfoA) ? TierCPUInfoB
+                                                  : TierCPUInfoA;
+  InitAllDsp();
+}
+
+static void RestoreCPUInfo(void) {
+  VP8GetCPUInfo = real_cpu_info;
+  InitAllDsp();
+}
+
+//------------------------------------------------------------------------------
+// Input data
+
+#define NUM_BLOCKS 32   // number of macroblocks cycled through (power of 2)
+#define TILE_SIZE  32   // tile size for the cross-color statistics
+
+typedef struct {
+  // Macroblock-based data. These come first and have sizes that are multiples
+  // of 16, so that they keep the alignment of the (malloc'd) struct, as the
+  // encoder's SIMD code expects.
+  uint8_t src[NUM_BLOCKS][16 * BPS];
+  uint8_t ref[NUM_BLOCKS][16 * BPS];
+  uint8_t work[NUM_BLOCKS][16 * BPS];
+  uint8_t pred[NUM_BLOCKS][18 * BPS];     // decoder prediction area
+  uint8_t edge[NUM_BLOCKS][96];           // left and top samples (encoder)
+  int16_t coeffs[NUM_BLOCKS][16 * 16];
+  int16_t levels[NUM_BLOCKS][16];
+  uint8_t dither[64];
+  uint8_t pred_out[PRED_SIZE_ENC];
+
+  const char* name;
+  int width, height;             // luma / argb dimensions
+  int uv_width, uv_height;
+  uint8_t* y, *u, *v, *a;        // planes, stride = width or uv_width
+  uint8_t* y2;                   // distorted copy of 'y' (for SSIM)
+  uint8_t* u444, *v444;          // full resolution chroma
+  uint8_t* rgb, *bgr, *rgba;     // packed samples, stride = width * bpp
+  uint16_t* rgba4444;
+  uint32_t* argb;
+  uint16_t* uv_accum;            // accumulated rgba (for RGBA32ToUV)
+
+  // scratch, rewritten by the kernels
+  uint8_t* fy, *fu, *fv;         // copies of y/u/v for in-loop filtering
+  uint8_t* out8;                 // 4 * width * height bytes
+  uint32_t* out32;               // width * height pixels
+
+  // macroblock-based data
+  int blk_x[NUM_BLOCKS], blk_y[NUM_BLOCKS];
+  VP8Residual res[NUM_BLOCKS];
+
+  // lossy encoder state
+  VP8Matrix matrix;
+  VP8EncProba proba;
+
+  // lossless state
+  uint32_t palette[256];
+  uint8_t indices[4096];
+  uint32_t population[2][256];
+  int histo[VP8L_MAX_COLOR_CANDIDATES][256];
+  VP8LHistogram* histos[3];
+} Dataset;
+
+static Dataset* data = NULL;        // dataset being benchmarked
+static volatile double sink = 0.;   // keeps the kernels' results alive
+
+static uint32_t rand_seed = 0x1234567u;
+static uint32_t Random(void) {
+  rand_seed = rand_seed * 1103515245u + 12345u;
+  return rand_seed >> 8;
+}
+
+// Smooth gradients plus noise, a crude model of natural images.
+static void FillSynthetic(uint8_t* const rgb, int width, int height) {
+  int x, y;
+  for (y = 0; y < height; ++y) {
+    for (x = 0; x < width; ++x) {
+      uint8_t* const p = rgb + 3 * (x + y * width);
+      const int noise = (int)(Random() & 31) - 16;
+      const int r = (x * 255) / width + noise;
+      const int g = (y * 255) / height + noise;
+      const int b = ((x ^ y) & 0x3f) * 3 + noise;
+      p[0] = (uint8_t)(r < 0 ? 0 : r > 255 ? 255 : r);
+      p[1] = (uint8_t)(g < 0 ? 0 : g > 255 ? 255 : g);
+      p[2] = (uint8_t)(b < 0 ? 0 : b > 255 ? 255 : b);
+    }
+  }
+}
+
+static int ReadPPMNumber(FILE* const f, int* const value) {
+  int c = fgetc(f);
+  while (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '#') {
+    if (c == '#') {
+      while (c != '\n' && c != EOF) c = fgetc(f);
+    }
+    c = fgetc(f);
+  }
+  *value = 0;
+  if (c < '0' || c > '9') return 0;
+  while (c >= '0' && c <= '9') {
+    *value = *value * 10 + (c - '0');
+    c = fgetc(f);
+  }
+  return 1;
+}
+
+// Reads a binary (P6) 8-bit PPM. Returns NULL on failure.
+static uint8_t* ReadPPM(const char* const filename,
+                        int* const width, int* const height) {
+  uint8_t* rgb = NULL;
+  int max_value;
+  FILE* const f = fopen(filename, "rb");
+  if (f == NULL) return NULL;
+  if (fgetc(f) != 'P' || fgetc(f) != '6' ||
+      !ReadPPMNumber(f, width) || !ReadPPMNumber(f, height) ||
+      !ReadPPMNumber(f, &max_value) || max_value != 255 ||
+      *width <= 0 || *height <= 0 || *width > 16384 || *height > 16384) {
+    fclose(f);
+    return NULL;
+  }
+  rgb = (uint8_t*)malloc(3 * (size_t)*width * *height);
+  if (rgb != NULL &&
+      fread(rgb, 3 * (size_t)*width, *height, f) != (size_t)*height) {
+    free(rgb);
+    rgb = NULL;
+  }
+  fclose(f);
+  return rgb;
+}
+
+static void ExpandMatrix(VP8Matrix* const m, int dc_q, int ac_q) {
+  int i;
+  for (i = 0; i < 16; ++i) {
+    m->q_[i] = (i == 0) ? dc_q : ac_q;
+    m->iq_[i] = (1 << QFIX) / m->q_[i];
+    m->bias_[i] = BIAS((i == 0) ? 96 : 110);
+    m->zthresh_[i] = ((1 << QFIX) - 1 - m->bias_[i]) / m->iq_[i];
+    m->sharpen_[i] = 0;
+  }
+}
+
+static void CopyBlock(const uint8_t* src, int src_stride,
+                      uint8_t* dst, int dst_stride, int w, int h) {
+  int y;
+  for (y = 0; y < h; ++y) {
+    memcpy(dst + y * dst_stride, src + y * src_stride, w);
+  }
+}
+
+static void DeleteDataset(Dataset* const d) {
+  int i;
+  if (d == NULL) return;
+  free(d->y);
+  free(d->u);
+  free(d->v);
+  free(d->a);
+  free(d->y2);
+  free(d->u444);
+  free(d->v444);
+  free(d->rgb);
+  free(d->bgr);
+  free(d->rgba);
+  free(d->rgba4444);
+  free(d->argb);
+  free(d->uv_accum);
+  free(d->fy);
+  free(d->fu);
+  free(d->fv);
+  free(d->out8);
+  free(d->out32);
+  for (i = 0; i < 3; ++i) VP8LFreeHistogram(d->histos[i]);
+  free(d);
+}
+
+// Builds every derived representation from 'rgb'. Takes ownership of 'rgb'.
+// Must be called with the native dsp functions installed.
+static Dataset* NewDataset(const char* const name, uint8_t* const rgb,
+                           int width, int height) {
+  const int W = width & ~1, H = height & ~1;   // even dimensions
+  const size_t size = (size_t)W * H;
+  int x, y, b, i;
+  Dataset* const d = (Dataset*)calloc(1, sizeof(*d));
+  if (d == NULL) {
+    free(rgb);
+    return NULL;
+  }
+  d->name = name;
+  d->width = W;
+  d->height = H;
+  d->uv_width = W / 2;
+  d->uv_height = H / 2;
+  d->rgb = rgb;
+  d->y = (uint8_t*)malloc(size);
+  d->y2 = (uint8_t*)malloc(size);
+  d->a = (uint8_t*)malloc(size);
+  d->u = (uint8_t*)malloc(size / 4);
+  d->v = (uint8_t*)malloc(size / 4);
+  d->u444 = (uint8_t*)malloc(size);
+  d->v444 = (uint8_t*)malloc(size);
+  d->bgr = (uint8_t*)malloc(3 * size);
+  d->rgba = (uint8_t*)malloc(4 * size);
+  d->rgba4444 = (uint16_t*)malloc(2 * size);
+  d->argb = (uint32_t*)malloc(4 * size);
+  d->uv_accum = (uint16_t*)malloc(4 * (W / 2) * sizeof(*d->uv_accum));
+  d->fy = (uint8_t*)malloc(size);
+  d->fu = (uint8_t*)malloc(size / 4);
+  d->fv = (uint8_t*)malloc(size / 4);
+  d->out8 = (uint8_t*)malloc(4 * size);
+  d->out32 = (uint32_t*)malloc(4 * size);
+  for (i = 0; i < 3; ++i) d->histos[i] = VP8LAllocateHistogram(0);
+  if (d->y == NULL || d->y2 == NULL || d->a == NULL || d->u == NULL ||
+      d->v == NULL || d->u444 == NULL || d->v444 == NULL || d->bgr == NULL ||
+      d->rgba == NULL || d->rgba4444 == NULL || d->argb == NULL ||
+      d->uv_accum == NULL || d->fy == NULL || d->fu == NULL ||
+      d->fv == NULL || d->out8 == NULL || d->out32 == NULL ||
+      d->histos[0] == NULL || d->histos[1] == NULL || d->histos[2] == NULL) {
+    DeleteDataset(d);
+    return NULL;
+  }
+
+  // Packed and planar samples, all with a row stride of 'W' pixels.
+  for (y = 0; y < H; ++y) {
+    memmove(rgb + 3 * y * (size_t)W, rgb + 3 * y * (size_t)width, 3 * W);
+    for (x = 0; x < W; ++x) {
+      const uint8_t* const p = rgb + 3 * (x + y * (size_t)W);
+      const int r = p[0], g = p[1], bl = p[2];
+      const int luma = VP8RGBToY(r, g, bl, YUV_HALF);
+      const int alpha = (x * 7 + y * 3) & 0xff;
+      const size_t off = x + y * (size_t)W;
+      d->y[off] = (uint8_t)luma;
+      d->y2[off] = (uint8_t)(luma ^ (Random() & 3));
+      d->a[off] = (uint8_t)alpha;
+      d->u444[off] = (uint8_t)VP8RGBToU(4 * r, 4 * g, 4 * bl, YUV_HALF << 2);
+      d->v444[off] = (uint8_t)VP8RGBToV(4 * r, 4 * g, 4 * bl, YUV_HALF << 2);
+      d->bgr[3 * off + 0] = (uint8_t)bl;
+      d->bgr[3 * off + 1] = (uint8_t)g;
+      d->bgr[3 * off + 2] = (uint8_t)r;
+      d->rgba[4 * off + 0] = (uint8_t)r;
+      d->rgba[4 * off + 1] = (uint8_t)g;
+      d->rgba[4 * off + 2] = (uint8_t)bl;
+      d->rgba[4 * off + 3] = (uint8_t)alpha;
+      d->rgba4444[off] =
+          (uint16_t)(((r >> 4) << 12) | ((g >> 4) << 8) | (bl & 0xf0) |
+                     (alpha >> 4));
+      d->argb[off] = ((uint32_t)alpha << 24) | (r << 16) | (g << 8) | bl;
+    }
+  }
+  for (y = 0; y < H / 2; ++y) {
+    for (x = 0; x < W / 2; ++x) {
+      const size_t off = 2 * x + 2 * y * (size_t)W;
+      d->u[x + y * (W / 2)] = d->u444[off];
+      d->v[x + y * (W / 2)] = d->v444[off];
+    }
+  }
+  for (x = 0; x < 4 * (W / 2); ++x) {
+    d->uv_accum[x] = (uint16_t)(4 * d->rgba[2 * x]);
+  }
+  memcpy(d->fy, d->y, size);
+  memcpy(d->fu, d->u, size / 4);
+  memcpy(d->fv, d->v, size / 4);
+  memset(d->out8, 0, 4 * size);
+  memset(d->out32, 0, 4 * size);
+
+  // Macroblocks, away from the borders.
+  ExpandMatrix(&d->matrix, 24, 30);
+  memset(&d->proba, 128, sizeof(d->proba.coeffs_));
+  d->proba.dirty_ = 1;
+  VP8CalculateLevelCosts(&d->proba);
+  for (b = 0; b < NUM_BLOCKS; ++b) {
+    const int bx = 16 + ((b * 7) % ((W - 48) / 16)) * 16;
+    const int by = 16 + ((b * 13) % ((H - 48) / 16)) * 16;
+    const uint8_t* const luma = d->y + bx + by * W;
+    int16_t tmp[16];
+    d->blk_x[b] = bx;
+    d->blk_y[b] = by;
+    CopyBlock(luma, W, d->src[b], BPS, 16, 16);
+    CopyBlock(luma + 1 + W, W, d->ref[b], BPS, 16, 16);
+    CopyBlock(luma + 1 + W, W, d->work[b], BPS, 16, 16);
+    CopyBlock(luma - 1 - W, W, d->pred[b] + 7, BPS, 24, 17);
+    for (i = 0; i < 96; ++i) d->edge[b][i] = luma[i - 48 - W];
+    for (i = 0; i < 16; ++i) {
+      const int off = (i & 3) * 4 + (i >> 2) * 4 * BPS;
+      VP8FTransform(d->src[b] + off, d->ref[b] + off, d->coeffs[b] + 16 * i);
+    }
+    memcpy(tmp, d->coeffs[b], sizeof(tmp));
+    VP8EncQuantizeBlock(tmp, d->levels[b], &d->matrix);
+    d->res[b].first = 0;
+    d->res[b].coeff_type = 3;
+    d->res[b].prob = d->proba.coeffs_[3];
+    d->res[b].stats = d->proba.stats_[3];
+    d->res[b].costs = d->proba.remapped_costs_[3];
+    VP8SetResidualCoeffs(d->levels[b], &d->res[b]);
+  }
+  for (i = 0; i < 64; ++i) d->dither[i] = (uint8_t)Random();
+
+  // Lossless data.
+  for (i = 0; i < 256; ++i) d->palette[i] = d->argb[Random() % size];
+  for (i = 0; i < 4096; ++i) d->indices[i] = d->y[i % size] & 1;
+  for (i = 0; i < 256; ++i) {
+    d->population[0][i] = d->y[i] * (i & 7);
+    d->population[1][i] = d->y2[i] * (i & 3);
+  }
+  for (i = 0; i < 3; ++i) {
+    VP8LHistogram* const h = d->histos[i];
+    const int num_codes = VP8LHistogramNumCodes(0);
+    for (x = 0; x < num_codes; ++x) h->literal_[x] = Random() & 0xfff;
+    for (x = 0; x < NUM_LITERAL_CODES; ++x) {
+      h->red_[x] = Random() & 0xfff;
+      h->blue_[x] = Random() & 0xfff;
+      h->alpha_[x] = Random() & 0xfff;
+    }
+    for (x = 0; x < NUM_DISTANCE_CODES; ++x) h->distance_[x] = Random() & 0xfff;
+  }
+  return d;
+}
+
+//------------------------------------------------------------------------------
+// Kernels
+
+typedef void (*GenericFunc)(void);
+#define SLOT(ptr) ((GenericFunc*)&(ptr))
+#define MAX_SLOTS 2
+
+typedef enum { PER_BLOCK4, PER_BLOCK8, PER_MB, PER_ROW, PER_TILE, PER_PLANE,
+               PER_CALL } WorkUnit;
+
+typedef struct {
+  const char* name;
+  const char* group;
+  GenericFunc* slots[MAX_SLOTS];   // dispatched pointer(s) exercised
+  void (*run)(int arg, int n);     // calls the kernel 'n' times
+  int arg;                         // mode / index passed to 'run'
+  WorkUnit unit;                   // pixels processed per call
+} Kernel;
+
+#define BLK(i) ((i) & (NUM_BLOCKS - 1))
+#define ROW(i) (2 + (i) % (data->height - 2))
+
+// Decoder transforms and predictors.
+
+static void RunTransform(int arg, int n) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    switch (arg) {
+      case 0: VP8Transform(data->coeffs[b], data->work[b], 1); break;
+      case 1: VP8TransformAC3(data->coeffs[b], data->work[b]); break;
+      case 2: VP8TransformUV(data->coeffs[b], data->work[b]); break;
+      case 3: VP8TransformDC(data->coeffs[b], data->work[b]); break;
+      case 4: VP8TransformDCUV(data->coeffs[b], data->work[b]); break;
+      default: VP8TransformWHT(data->coeffs[b], data->coeffs[BLK(i + 1)]);
+    }
+  }
+}
+
+static void RunPredLuma16(int mode, int n) {
+  int i;
+  for (i = 0; i < n; ++i) VP8PredLuma16[mode](data->pred[BLK(i)] + BPS + 8);
+}
+
+static void RunPredChroma8(int mode, int n) {
+  int i;
+  for (i = 0; i < n; ++i) VP8PredChroma8[mode](data->pred[BLK(i)] + BPS + 8);
+}
+
+static void RunPredLuma4(int mode, int n) {
+  int i;
+  for (i = 0; i < n; ++i) VP8PredLuma4[mode](data->pred[BLK(i)] + BPS + 8);
+}
+
+// In-loop filters, applied in place on a copy of the planes.
+
+static void RunLoopFilter(int arg, int n) {
+  const int stride = data->width, uv_stride = data->uv_width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    uint8_t* const y = data->fy + data->blk_x[b] + data->blk_y[b] * stride;
+    const int uv_off = data->blk_x[b] / 2 + data->blk_y[b] / 2 * uv_stride;
+    uint8_t* const u = data->fu + uv_off;
+    uint8_t* const v = data->fv + uv_off;
+    switch (arg) {
+      case 0: VP8SimpleVFilter16(y, stride, 40); break;
+      case 1: VP8SimpleHFilter16(y, stride, 40); break;
+      case 2: VP8SimpleVFilter16i(y, stride, 40); break;
+      case 3: VP8SimpleHFilter16i(y, stride, 40); break;
+      case 4: VP8VFilter16(y, stride, 40, 20, 2); break;
+      case 5: VP8HFilter16(y, stride, 40, 20, 2); break;
+      case 6: VP8VFilter16i(y, stride, 40, 20, 2); break;
+      case 7: VP8HFilter16i(y, stride, 40, 20, 2); break;
+      case 8: VP8VFilter8(u, v, uv_stride, 40, 20, 2); break;
+      case 9: VP8HFilter8(u, v, uv_stride, 40, 20, 2); break;
+      case 10: VP8VFilter8i(u, v, uv_stride, 40, 20, 2); break;
+      case 11: VP8HFilter8i(u, v, uv_stride, 40, 20, 2); break;
+      default: VP8DitherCombine8x8(data->dither, y, stride);
+    }
+  }
+}
+
+// Encoder transforms, predictors, metrics and quantization.
+
+static const uint16_t kWeightY[16] = {
+  38, 32, 20, 9, 32, 28, 17, 7, 20, 17, 10, 4, 9, 7, 4, 2
+};
+
+static void RunEncTransform(int arg, int n) {
+  int16_t out[16 * 16];
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    switch (arg) {
+      case 0: VP8ITransform(data->ref[b], data->coeffs[b], data->work[b], 1);
+        break;
+      case 1: VP8FTransform(data->src[b], data->ref[b], out); break;
+      case 2: VP8FTransform2(data->src[b], data->ref[b], out); break;
+      default: VP8FTransformWHT(data->coeffs[b], out);
+    }
+  }
+  sink += out[0];
+}
+
+static void RunEncPred(int arg, int n) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    const uint8_t* const edge = data->edge[BLK(i)];
+    switch (arg) {
+      case 0: VP8EncPredLuma4(data->pred_out, edge + 48); break;
+      case 1: VP8EncPredLuma16(data->pred_out, edge, edge + 48); break;
+      default: VP8EncPredChroma8(data->pred_out, edge, edge + 48);
+    }
+  }
+}
+
+static void RunMetric(int arg, int n) {
+  int i, sum = 0;
+  for (i = 0; i < n; ++i) {
+    const uint8_t* const a = data->src[BLK(i)];
+    const uint8_t* const b = data->ref[BLK(i)];
+    switch (arg) {
+      case 0: sum += VP8SSE16x16(a, b); break;
+      case 1: sum += VP8SSE16x8(a, b); break;
+      case 2: sum += VP8SSE8x8(a, b); break;
+      case 3: sum += VP8SSE4x4(a, b); break;
+      case 4: sum += VP8TDisto4x4(a, b, kWeightY); break;
+      default: sum += VP8TDisto16x16(a, b, kWeightY);
+    }
+  }
+  sink += sum;
+}
+
+static void RunCopy(int arg, int n) {
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    if (arg == 0) {
+      VP8Copy4x4(data->src[b], data->work[b]);
+    } else {
+      VP8Copy16x8(data->src[b], data->work[b]);
+    }
+  }
+}
+
+static void RunQuantize(int arg, int n) {
+  int16_t in[32], out[32];
+  int i, nz = 0;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    memcpy(in, data->coeffs[b], sizeof(in));
+    switch (arg) {
+      case 0: nz += VP8EncQuantizeBlock(in, out, &data->matrix); break;
+      case 1: nz += VP8EncQuantize2Blocks(in, out, &data->matrix); break;
+      default: nz += VP8EncQuantizeBlockWHT(in, out, &data->matrix);
+    }
+  }
+  sink += nz;
+}
+
+static void RunHistogram(int arg, int n) {
+  VP8Histogram histo;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    VP8CollectHistogram(data->src[b], data->ref[b], 0, 16, &histo);
+  }
+  sink += histo.max_value;
+}
+
+static void RunResidual(int arg, int n) {
+  int i, cost = 0;
+  for (i = 0; i < n; ++i) {
+    VP8Residual* const res = &data->res[BLK(i)];
+    if (arg == 0) {
+      VP8SetResidualCoeffs(data->levels[BLK(i)], res);
+    } else {
+      cost += VP8GetResidualCost(i & 1, res);
+    }
+  }
+  sink += cost;
+}
+
+static void RunSSIM(int arg, int n) {
+  const int stride = data->width;
+  VP8DistoStats stats;
+  int i;
+  memset(&stats, 0, sizeof(stats));
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    const int off = data->blk_x[b] + data->blk_y[b] * stride;
+    VP8SSIMAccumulate(data->y + off, stride, data->y2 + off, stride, &stats);
+  }
+  sink += stats.xym;
+}
+
+// Lossless.
+
+static void RunLosslessPredictor(int mode, int n) {
+  const int width = data->width;
+  int i, x;
+  uint32_t sum = 0;
+  for (i = 0; i < n; ++i) {
+    const uint32_t* const cur = data->argb + ROW(i) * width;
+    const uint32_t* const top = cur - width;
+    for (x = 0; x < width; ++x) sum += VP8LPredictors[mode](cur[x - 1], top + x);
+  }
+  sink += sum;
+}
+
+static void RunLosslessPredictorSub(int mode, int n) {
+  const int width = data->width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const uint32_t* const cur = data->argb + ROW(i) * width;
+    VP8LPredictorsSub[mode](cur, cur - width, width, data->out32);
+  }
+}
+
+static void RunLosslessRow(int arg, int n) {
+  const int width = data->width;
+  VP8LMultipliers m;
+  int i;
+  m.green_to_red_ = 13;
+  m.green_to_blue_ = 241;
+  m.red_to_blue_ = 7;
+  for (i = 0; i < n; ++i) {
+    const uint32_t* const src = data->argb + ROW(i) * width;
+    uint32_t* const row = data->out32 + ROW(i) * width;
+    switch (arg) {
+      case 0: VP8LAddGreenToBlueAndRed(row, width); break;
+      case 1: VP8LSubtractGreenFromBlueAndRed(row, width); break;
+      case 2: VP8LTransformColor(&m, row, width); break;
+      case 3: VP8LTransformColorInverse(&m, row, width); break;
+      case 4: VP8LConvertBGRAToRGB(src, width, data->out8); break;
+      case 5: VP8LConvertBGRAToRGBA(src, width, data->out8); break;
+      case 6: VP8LConvertBGRAToRGBA4444(src, width, data->out8); break;
+      case 7: VP8LConvertBGRAToRGB565(src, width, data->out8); break;
+      case 8: VP8LConvertBGRAToBGR(src, width, data->out8); break;
+      case 9: VP8LMapColor32b(src, data->palette, row, 0, 1, width); break;
+      case 10:
+        VP8LMapColor8b(data->y + ROW(i) * width, data->palette, data->out8,
+                       0, 1, width);
+        break;
+      default:
+        sink += VP8LVectorMismatch(src, data->argb + ROW(i + 1) * width,
+                                   width);
+    }
+  }
+}
+
+static void RunBundleColorMap(int xbits, int n) {
+  const int width = data->width < 4096 ? data->width : 4096;
+  int i;
+  for (i = 0; i < n; ++i) {
+    VP8LBundleColorMap(data->indices, width, xbits, data->out32);
+  }
+}
+
+static void RunColorStats(int arg, int n) {
+  static const int kG2B[VP8L_MAX_COLOR_CANDIDATES] =
+      { -4, -3, -2, -1, 0, 1, 2, 3, 4 };
+  static const int kR2B[VP8L_MAX_COLOR_CANDIDATES] =
+      { 2, 2, 2, 2, 2, 2, 2, 2, 2 };
+  const int stride = data->width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int b = BLK(i);
+    const uint32_t* const argb =
+        data->argb + data->blk_x[b] + data->blk_y[b] * stride;
+    const int tile_w = (data->blk_x[b] + TILE_SIZE <= data->width) ?
+                       TILE_SIZE : 16;
+    const int tile_h = (data->blk_y[b] + TILE_SIZE <= data->height) ?
+                       TILE_SIZE : 16;
+    switch (arg) {
+      case 0:
+        VP8LCollectColorBlueTransforms(argb, stride, tile_w, tile_h,
+                                       kG2B[i % 9], kR2B[0], data->histo[0]);
+        break;
+      case 1:
+        VP8LCollectColorRedTransforms(argb, stride, tile_w, tile_h,
+                                      kG2B[i % 9], data->histo[0]);
+        break;
+      case 2:
+        VP8LCollectColorBlueTransformsBatch(argb, stride, tile_w, tile_h,
+                                            kG2B, kR2B,
+                                            VP8L_MAX_COLOR_CANDIDATES,
+                                            data->histo);
+        break;
+      default:
+        VP8LCollectColorRedTransformsBatch(argb, stride, tile_w, tile_h,
+                                           kG2B, VP8L_MAX_COLOR_CANDIDATES,
+                                           data->histo);
+    }
+  }
+}
+
+static void RunEntropy(int arg, int n) {
+  const uint32_t* const X = data->population[0];
+  const uint32_t* const Y = data->population[1];
+  double sum = 0.;
+  int i, j;
+  for (i = 0; i < n; ++i) {
+    switch (arg) {
+      case 0:
+        for (j = 256; j < 512; ++j) sum += VP8LFastLog2Slow(j + i);
+        break;
+      case 1:
+        for (j = 256; j < 512; ++j) sum += VP8LFastSLog2Slow(j + i);
+        break;
+      case 2: sum += VP8LExtraCost(X, NUM_DISTANCE_CODES); break;
+      case 3: sum += VP8LExtraCostCombined(X, Y, NUM_DISTANCE_CODES); break;
+      case 4:
+        sum += VP8LCombinedShannonEntropy((const int*)X, (const int*)Y);
+        break;
+      case 5: {
+        VP8LBitEntropy entropy;
+        VP8LStreaks streaks;
+        VP8LGetCombinedEntropyUnrefined(X, Y, 256, &entropy, &streaks);
+        sum += entropy.entropy;
+        break;
+      }
+      default:
+        VP8LHistogramAdd(data->histos[0], data->histos[1], data->histos[2]);
+    }
+  }
+  sink += sum;
+}
+
+// YUV <-> RGB.
+
+static void RunUpsampler(int mode, int n) {
+  const int width = data->width, uv_width = data->uv_width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int row = ROW(i) & ~1;
+    const uint8_t* const top_y = data->y + (row - 1) * width;
+    const uint8_t* const cur_u = data->u + (row / 2) * uv_width;
+    const uint8_t* const cur_v = data->v + (row / 2) * uv_width;
+    WebPUpsamplers[mode](top_y, top_y + width, cur_u - uv_width,
+                         cur_v - uv_width, cur_u, cur_v,
+                         data->out8, data->out8 + 4 * width, width);
+  }
+}
+
+static void RunSampler(int mode, int n) {
+  const int width = data->width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int row = ROW(i);
+    WebPSamplers[mode](data->y + row * width,
+                       data->u + (row / 2) * data->uv_width,
+                       data->v + (row / 2) * data->uv_width,
+                       data->out8, width);
+  }
+}
+
+static void RunYUV444(int mode, int n) {
+  const int width = data->width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int off = ROW(i) * width;
+    WebPYUV444Converters[mode](data->y + off, data->u444 + off,
+                               data->v444 + off, data->out8, width);
+  }
+}
+
+static void RunToYUV(int arg, int n) {
+  const int width = data->width;
+  uint8_t* const y = data->out8;
+  uint8_t* const u = data->out8 + width;
+  uint8_t* const v = u + width / 2;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const size_t off = (size_t)ROW(i) * width;
+    switch (arg) {
+      case 0: WebPConvertARGBToY(data->argb + off, y, width); break;
+      case 1: WebPConvertARGBToUV(data->argb + off, u, v, width, i & 1); break;
+      case 2: WebPConvertRGBA32ToUV(data->uv_accum, u, v, width / 2); break;
+      case 3: WebPConvertRGB24ToY(data->rgb + 3 * off, y, width); break;
+      case 4: WebPConvertBGR24ToY(data->bgr + 3 * off, y, width); break;
+      case 5: {
+        const uint8_t* const rgba = data->rgba + 4 * off;
+        VP8PackARGB(rgba + 3, rgba + 0, rgba + 1, rgba + 2, width,
+                    data->out32);
+        break;
+      }
+      default: {
+        const uint8_t* const rgb = data->rgb + 3 * off;
+        VP8PackRGB(rgb + 0, rgb + 1, rgb + 2, width, 3, data->out32);
+      }
+    }
+  }
+}
+
+// Rescaler: one full plane per call, through the public row loop.
+
+static void RunRescaler(int arg, int n) {
+  const int num_channels = (arg & 1) ? 4 : 1;
+  const int expand = (arg >= 2);
+  const int src_w = expand ? data->width / 2 : data->width;
+  const int src_h = expand ? data->height / 2 : data->height;
+  const int dst_w = expand ? data->width : data->width / 2;
+  const int dst_h = expand ? data->height : data->height / 2;
+  const uint8_t* const src = (num_channels == 4) ? data->rgba : data->y;
+  const int src_stride = data->width * num_channels;
+  rescaler_t* const work =
+      (rescaler_t*)malloc(2 * sizeof(*work) * dst_w * num_channels);
+  WebPRescaler rescaler;
+  int i;
+  if (work == NULL) return;
+  for (i = 0; i < n; ++i) {
+    int y = 0;
+    WebPRescalerInit(&rescaler, src_w, src_h, data->out8,
+                     dst_w, dst_h, dst_w * num_channels, num_channels, work);
+    while (y < src_h) {
+      y += WebPRescalerImport(&rescaler, src_h - y, src + y * src_stride,
+                              src_stride);
+      WebPRescalerExport(&rescaler);
+    }
+  }
+  free(work);
+}
+
+// Alpha processing and alpha-plane filters.
+
+static void RunAlpha(int arg, int n) {
+  const int width = data->width;
+  int i, ret = 0;
+  for (i = 0; i < n; ++i) {
+    const int row = ROW(i);
+    const uint8_t* const alpha = data->a + row * width;
+    uint8_t* const rgba = data->out8 + 4 * row * width;
+    switch (arg) {
+      case 0:
+        memcpy(rgba, data->rgba + 4 * row * width, 4 * width);
+        WebPApplyAlphaMultiply(rgba, 0, width, 1, 4 * width);
+        break;
+      case 1:
+        memcpy(rgba, data->rgba4444 + row * width, 2 * width);
+        WebPApplyAlphaMultiply4444(rgba, width, 1, 2 * width);
+        break;
+      case 2:
+        ret += WebPDispatchAlpha(alpha, width, width, 1, rgba + 3, 4 * width);
+        break;
+      case 3:
+        WebPDispatchAlphaToGreen(alpha, width, width, 1,
+                                 data->out32 + row * width, width);
+        break;
+      case 4:
+        ret += WebPExtractAlpha(data->rgba + 4 * row * width + 3, 4 * width,
+                                width, 1, data->out8, width);
+        break;
+      case 5:
+      case 6:
+        memcpy(data->out32, data->argb + row * width, 4 * width);
+        WebPMultARGBRow(data->out32, width, arg == 6);
+        break;
+      default:
+        memcpy(data->out8, data->y + row * width, width);
+        WebPMultRow(data->out8, alpha, width, arg == 8);
+    }
+  }
+  sink += ret;
+}
+
+static void RunAlphaFilter(int filter, int n) {
+  const int width = data->width, height = data->height;
+  int i;
+  for (i = 0; i < n; ++i) {
+    WebPFilters[filter](data->a, width, height, width, data->out8);
+  }
+}
+
+static void RunAlphaUnfilter(int filter, int n) {
+  const int width = data->width;
+  int i;
+  for (i = 0; i < n; ++i) {
+    const int row = ROW(i);
+    WebPUnfilters[filter](data->a + (row - 1) * width, data->a + row * width,
+                          data->out8, width);
+  }
+}
+
+#define MODE_KERNELS(prefix, table, run, unit)                                 \
+  { prefix "[RGB]", "yuv", { SLOT(table[MV_MODE_RGB]) }, run, MV_MODE_RGB,     \
+    unit },                                                                    \
+  { prefix "[RGBA]", "yuv", { SLOT(table[MV_MODE_RGBA]) }, run, MV_MODE_RGBA,  \
+    unit },                                                                    \
+  { prefix "[BGR]", "yuv", { SLOT(table[MV_MODE_BGR]) }, run, MV_MODE_BGR,     \
+    unit },                                                                    \
+  { prefix "[BGRA]", "yuv", { SLOT(table[MV_MODE_BGRA]) }, run, MV_MODE_BGRA,  \
+    unit },                                                                    \
+  { prefix "[ARGB]", "yuv", { SLOT(table[MV_MODE_ARGB]) }, run, MV_MODE_ARGB,  \
+    unit },                                                                    \
+  { prefix "[RGBA_4444]", "yuv", { SLOT(table[MV_MODE_RGBA_4444]) }, run,      \
+    MV_MODE_RGBA_4444, unit },                                                 \
+  { prefix "[RGB_565]", "yuv", { SLOT(table[MV_MODE_RGB_565]) }, run,          \
+    MV_MODE_RGB_565, unit }
+
+static const Kernel kKernels[] = {
+  // decoder
+  { "VP8Transform", "dec", { SLOT(VP8Transform) }, RunTransform, 0, PER_BLOCK8 },
+  { "VP8TransformAC3", "dec", { SLOT(VP8TransformAC3) }, RunTransform, 1,
+    PER_BLOCK4 },
+  { "VP8TransformUV", "dec", { SLOT(VP8TransformUV) }, RunTransform, 2,
+    PER_BLOCK8 },
+  { "VP8TransformDC", "dec", { SLOT(VP8TransformDC) }, RunTransform, 3,
+    PER_BLOCK4 },
+  { "VP8TransformDCUV", "dec", { SLOT(VP8TransformDCUV) }, RunTransform, 4,
+    PER_BLOCK8 },
+  { "VP8TransformWHT", "dec", { SLOT(VP8TransformWHT) }, RunTransform, 5,
+    PER_MB },
+  { "VP8PredLuma16[DC]", "dec", { SLOT(VP8PredLuma16[DC_PRED]) },
+    RunPredLuma16, DC_PRED, PER_MB },
+  { "VP8PredLuma16[TM]", "dec", { SLOT(VP8PredLuma16[TM_PRED]) },
+    RunPredLuma16, TM_PRED, PER_MB },
+  { "VP8PredLuma16[V]", "dec", { SLOT(VP8PredLuma16[V_PRED]) },
+    RunPredLuma16, V_PRED, PER_MB },
+  { "VP8PredLuma16[H]", "dec", { SLOT(VP8PredLuma16[H_PRED]) },
+    RunPredLuma16, H_PRED, PER_MB },
+  { "VP8PredLuma16[DC_NOTOP]", "dec", { SLOT(VP8PredLuma16[B_DC_PRED_NOTOP]) },
+    RunPredLuma16, B_DC_PRED_NOTOP, PER_MB },
+  { "VP8PredLuma16[DC_NOLEFT]", "dec",
+    { SLOT(VP8PredLuma16[B_DC_PRED_NOLEFT]) },
+    RunPredLuma16, B_DC_PRED_NOLEFT, PER_MB },
+  { "VP8PredLuma16[DC_NOTOPLEFT]", "dec",
+    { SLOT(VP8PredLuma16[B_DC_PRED_NOTOPLEFT]) },
+    RunPredLuma16, B_DC_PRED_NOTOPLEFT, PER_MB },
+  { "VP8PredChroma8[DC]", "dec", { SLOT(VP8PredChroma8[DC_PRED]) },
+    RunPredChroma8, DC_PRED, PER_BLOCK8 },
+  { "VP8PredChroma8[TM]", "dec", { SLOT(VP8PredChroma8[TM_PRED]) },
+    RunPredChroma8, TM_PRED, PER_BLOCK8 },
+  { "VP8PredChroma8[V]", "dec", { SLOT(VP8PredChroma8[V_PRED]) },
+    RunPredChroma8, V_PRED, PER_BLOCK8 },
+  { "VP8PredChroma8[H]", "dec", { SLOT(VP8PredChroma8[H_PRED]) },
+    RunPredChroma8, H_PRED, PER_BLOCK8 },
+  { "VP8PredChroma8[DC_NOTOP]", "dec",
+    { SLOT(VP8PredChroma8[B_DC_PRED_NOTOP]) },
+    RunPredChroma8, B_DC_PRED_NOTOP, PER_BLOCK8 },
+  { "VP8PredChroma8[DC_NOLEFT]", "dec",
+    { SLOT(VP8PredChroma8[B_DC_PRED_NOLEFT]) },
+    RunPredChroma8, B_DC_PRED_NOLEFT, PER_BLOCK8 },
+  { "VP8PredChroma8[DC_NOTOPLEFT]", "dec",
+    { SLOT(VP8PredChroma8[B_DC_PRED_NOTOPLEFT]) },
+    RunPredChroma8, B_DC_PRED_NOTOPLEFT, PER_BLOCK8 },
+  { "VP8PredLuma4[DC]", "dec", { SLOT(VP8PredLuma4[B_DC_PRED]) },
+    RunPredLuma4, B_DC_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[TM]", "dec", { SLOT(VP8PredLuma4[B_TM_PRED]) },
+    RunPredLuma4, B_TM_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[VE]", "dec", { SLOT(VP8PredLuma4[B_VE_PRED]) },
+    RunPredLuma4, B_VE_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[HE]", "dec", { SLOT(VP8PredLuma4[B_HE_PRED]) },
+    RunPredLuma4, B_HE_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[RD]", "dec", { SLOT(VP8PredLuma4[B_RD_PRED]) },
+    RunPredLuma4, B_RD_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[VR]", "dec", { SLOT(VP8PredLuma4[B_VR_PRED]) },
+    RunPredLuma4, B_VR_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[LD]", "dec", { SLOT(VP8PredLuma4[B_LD_PRED]) },
+    RunPredLuma4, B_LD_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[VL]", "dec", { SLOT(VP8PredLuma4[B_VL_PRED]) },
+    RunPredLuma4, B_VL_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[HD]", "dec", { SLOT(VP8PredLuma4[B_HD_PRED]) },
+    RunPredLuma4, B_HD_PRED, PER_BLOCK4 },
+  { "VP8PredLuma4[HU]", "dec", { SLOT(VP8PredLuma4[B_HU_PRED]) },
+    RunPredLuma4, B_HU_PRED, PER_BLOCK4 },
+  { "VP8SimpleVFilter16", "filter", { SLOT(VP8SimpleVFilter16) },
+    RunLoopFilter, 0, PER_MB },
+  { "VP8SimpleHFilter16", "filter", { SLOT(VP8SimpleHFilter16) },
+    RunLoopFilter, 1, PER_MB },
+  { "VP8SimpleVFilter16i", "filter", { SLOT(VP8SimpleVFilter16i) },
+    RunLoopFilter, 2, PER_MB },
+  { "VP8SimpleHFilter16i", "filter", { SLOT(VP8SimpleHFilter16i) },
+    RunLoopFilter, 3, PER_MB },
+  { "VP8VFilter16", "filter", { SLOT(VP8VFilter16) }, RunLoopFilter, 4,
+    PER_MB },
+  { "VP8HFilter16", "filter", { SLOT(VP8HFilter16) }, RunLoopFilter, 5,
+    PER_MB },
+  { "VP8VFilter16i", "filter", { SLOT(VP8VFilter16i) }, RunLoopFilter, 6,
+    PER_MB },
+  { "VP8HFilter16i", "filter", { SLOT(VP8HFilter16i) }, RunLoopFilter, 7,
+    PER_MB },
+  { "VP8VFilter8", "filter", { SLOT(VP8VFilter8) }, RunLoopFilter, 8,
+    PER_BLOCK8 },
+  { "VP8HFilter8", "filter", { SLOT(VP8HFilter8) }, RunLoopFilter, 9,
+    PER_BLOCK8 },
+  { "VP8VFilter8i", "filter", { SLOT(VP8VFilter8i) }, RunLoopFilter, 10,
+    PER_BLOCK8 },
+  { "VP8HFilter8i", "filter", { SLOT(VP8HFilter8i) }, RunLoopFilter, 11,
+    PER_BLOCK8 },
+  { "VP8DitherCombine8x8", "filter", { SLOT(VP8DitherCombine8x8) },
+    RunLoopFilter, 12, PER_BLOCK8 },
+
+  // encoder
+  { "VP8ITransform", "enc", { SLOT(VP8ITransform) }, RunEncTransform, 0,
+    PER_BLOCK8 },
+  { "VP8FTransform", "enc", { SLOT(VP8FTransform) }, RunEncTransform, 1,
+    PER_BLOCK4 },
+  { "VP8FTransform2", "enc", { SLOT(VP8FTransform2) }, RunEncTransform, 2,
+    PER_BLOCK8 },
+  { "VP8FTransformWHT", "enc", { SLOT(VP8FTransformWHT) }, RunEncTransform, 3,
+    PER_MB },
+  { "VP8EncPredLuma4", "enc", { SLOT(VP8EncPredLuma4) }, RunEncPred, 0,
+    PER_BLOCK4 },
+  { "VP8EncPredLuma16", "enc", { SLOT(VP8EncPredLuma16) }, RunEncPred, 1,
+    PER_MB },
+  { "VP8EncPredChroma8", "enc", { SLOT(VP8EncPredChroma8) }, RunEncPred, 2,
+    PER_BLOCK8 },
+  { "VP8SSE16x16", "enc", { SLOT(VP8SSE16x16) }, RunMetric, 0, PER_MB },
+  { "VP8SSE16x8", "enc", { SLOT(VP8SSE16x8) }, RunMetric, 1, PER_BLOCK8 },
+  { "VP8SSE8x8", "enc", { SLOT(VP8SSE8x8) }, RunMetric, 2, PER_BLOCK8 },
+  { "VP8SSE4x4", "enc", { SLOT(VP8SSE4x4) }, RunMetric, 3, PER_BLOCK4 },
+  { "VP8TDisto4x4", "enc", { SLOT(VP8TDisto4x4) }, RunMetric, 4, PER_BLOCK4 },
+  { "VP8TDisto16x16", "enc", { SLOT(VP8TDisto16x16) }, RunMetric, 5, PER_MB },
+  { "VP8Copy4x4", "enc", { SLOT(VP8Copy4x4) }, RunCopy, 0, PER_BLOCK4 },
+  { "VP8Copy16x8", "enc", { SLOT(VP8Copy16x8) }, RunCopy, 1, PER_BLOCK8 },
+  { "VP8EncQuantizeBlock", "enc", { SLOT(VP8EncQuantizeBlock) }, RunQuantize,
+    0, PER_BLOCK4 },
+  { "VP8EncQuantize2Blocks", "enc", { SLOT(VP8EncQuantize2Blocks) },
+    RunQuantize, 1, PER_BLOCK8 },
+  { "VP8EncQuantizeBlockWHT", "enc", { SLOT(VP8EncQuantizeBlockWHT) },
+    RunQuantize, 2, PER_BLOCK4 },
+  { "VP8CollectHistogram", "enc", { SLOT(VP8CollectHistogram) }, RunHistogram,
+    0, PER_MB },
+  { "VP8SetResidualCoeffs", "enc", { SLOT(VP8SetResidualCoeffs) },
+    RunResidual, 0, PER_BLOCK4 },
+  { "VP8GetResidualCost", "enc", { SLOT(VP8GetResidualCost) }, RunResidual, 1,
+    PER_BLOCK4 },
+  { "VP8SSIMAccumulate", "enc", { SLOT(VP8SSIMAccumulate) }, RunSSIM, 0,
+    PER_BLOCK8 },
+
+  // lossless
+  { "VP8LPredictors[0]", "lossless", { SLOT(VP8LPredictors[0]) },
+    RunLosslessPredictor, 0, PER_ROW },
+  { "VP8LPredictors[1]", "lossless", { SLOT(VP8LPredictors[1]) },
+    RunLosslessPredictor, 1, PER_ROW },
+  { "VP8LPredictors[2]", "lossless", { SLOT(VP8LPredictors[2]) },
+    RunLosslessPredictor, 2, PER_ROW },
+  { "VP8LPredictors[3]", "lossless", { SLOT(VP8LPredictors[3]) },
+    RunLosslessPredictor, 3, PER_ROW },
+  { "VP8LPredictors[4]", "lossless", { SLOT(VP8LPredictors[4]) },
+    RunLosslessPredictor, 4, PER_ROW },
+  { "VP8LPredictors[5]", "lossless", { SLOT(VP8LPredictors[5]) },
+    RunLosslessPredictor, 5, PER_ROW },
+  { "VP8LPredictors[6]", "lossless", { SLOT(VP8LPredictors[6]) },
+    RunLosslessPredictor, 6, PER_ROW },
+  { "VP8LPredictors[7]", "lossless", { SLOT(VP8LPredictors[7]) },
+    RunLosslessPredictor, 7, PER_ROW },
+  { "VP8LPredictors[8]", "lossless", { SLOT(VP8LPredictors[8]) },
+    RunLosslessPredictor, 8, PER_ROW },
+  { "VP8LPredictors[9]", "lossless", { SLOT(VP8LPredictors[9]) },
+    RunLosslessPredictor, 9, PER_ROW },
+  { "VP8LPredictors[10]", "lossless", { SLOT(VP8LPredictors[10]) },
+    RunLosslessPredictor, 10, PER_ROW },
+  { "VP8LPredictors[11]", "lossless", { SLOT(VP8LPredictors[11]) },
+    RunLosslessPredictor, 11, PER_ROW },
+  { "VP8LPredictors[12]", "lossless", { SLOT(VP8LPredictors[12]) },
+    RunLosslessPredictor, 12, PER_ROW },
+  { "VP8LPredictors[13]", "lossless", { SLOT(VP8LPredictors[13]) },
+    RunLosslessPredictor, 13, PER_ROW },
+  { "VP8LPredictorsSub[0]", "lossless", { SLOT(VP8LPredictorsSub[0]) },
+    RunLosslessPredictorSub, 0, PER_ROW },
+  { "VP8LPredictorsSub[1]", "lossless", { SLOT(VP8LPredictorsSub[1]) },
+    RunLosslessPredictorSub, 1, PER_ROW },
+  { "VP8LPredictorsSub[2]", "lossless", { SLOT(VP8LPredictorsSub[2]) },
+    RunLosslessPredictorSub, 2, PER_ROW },
+  { "VP8LPredictorsSub[3]", "lossless", { SLOT(VP8LPredictorsSub[3]) },
+    RunLosslessPredictorSub, 3, PER_ROW },
+  { "VP8LPredictorsSub[4]", "lossless", { SLOT(VP8LPredictorsSub[4]) },
+    RunLosslessPredictorSub, 4, PER_ROW },
+  { "VP8LPredictorsSub[5]", "lossless", { SLOT(VP8LPredictorsSub[5]) },
+    RunLosslessPredictorSub, 5, PER_ROW },
+  { "VP8LPredictorsSub[6]", "lossless", { SLOT(VP8LPredictorsSub[6]) },
+    RunLosslessPredictorSub, 6, PER_ROW },
+  { "VP8LPredictorsSub[7]", "lossless", { SLOT(VP8LPredictorsSub[7]) },
+    RunLosslessPredictorSub, 7, PER_ROW },
+  { "VP8LPredictorsSub[8]", "lossless", { SLOT(VP8LPredictorsSub[8]) },
+    RunLosslessPredictorSub, 8, PER_ROW },
+  { "VP8LPredictorsSub[9]", "lossless", { SLOT(VP8LPredictorsSub[9]) },
+    RunLosslessPredictorSub, 9, PER_ROW },
+  { "VP8LPredictorsSub[10]", "lossless", { SLOT(VP8LPredictorsSub[10]) },
+    RunLosslessPredictorSub, 10, PER_ROW },
+  { "VP8LPredictorsSub[11]", "lossless", { SLOT(VP8LPredictorsSub[11]) },
+    RunLosslessPredictorSub, 11, PER_ROW },
+  { "VP8LPredictorsSub[12]", "lossless", { SLOT(VP8LPredictorsSub[12]) },
+    RunLosslessPredictorSub, 12, PER_ROW },
+  { "VP8LPredictorsSub[13]", "lossless", { SLOT(VP8LPredictorsSub[13]) },
+    RunLosslessPredictorSub, 13, PER_ROW },
+  { "VP8LAddGreenToBlueAndRed", "lossless", { SLOT(VP8LAddGreenToBlueAndRed) },
+    RunLosslessRow, 0, PER_ROW },
+  { "VP8LSubtractGreenFromBlueAndRed", "lossless",
+    { SLOT(VP8LSubtractGreenFromBlueAndRed) }, RunLosslessRow, 1, PER_ROW },
+  { "VP8LTransformColor", "lossless", { SLOT(VP8LTransformColor) },
+    RunLosslessRow, 2, PER_ROW },
+  { "VP8LTransformColorInverse", "lossless",
+    { SLOT(VP8LTransformColorInverse) }, RunLosslessRow, 3, PER_ROW },
+  { "VP8LConvertBGRAToRGB", "lossless", { SLOT(VP8LConvertBGRAToRGB) },
+    RunLosslessRow, 4, PER_ROW },
+  { "VP8LConvertBGRAToRGBA", "lossless", { SLOT(VP8LConvertBGRAToRGBA) },
+    RunLosslessRow, 5, PER_ROW },
+  { "VP8LConvertBGRAToRGBA4444", "lossless",
+    { SLOT(VP8LConvertBGRAToRGBA4444) }, RunLosslessRow, 6, PER_ROW },
+  { "VP8LConvertBGRAToRGB565", "lossless", { SLOT(VP8LConvertBGRAToRGB565) },
+    RunLosslessRow, 7, PER_ROW },
+  { "VP8LConvertBGRAToBGR", "lossless", { SLOT(VP8LConvertBGRAToBGR) },
+    RunLosslessRow, 8, PER_ROW },
+  { "VP8LMapColor32b", "lossless", { SLOT(VP8LMapColor32b) }, RunLosslessRow,
+    9, PER_ROW },
+  { "VP8LMapColor8b", "lossless", { SLOT(VP8LMapColor8b) }, RunLosslessRow,
+    10, PER_ROW },
+  { "VP8LVectorMismatch", "lossless", { SLOT(VP8LVectorMismatch) },
+    RunLosslessRow, 11, PER_ROW },
+  { "VP8LBundleColorMap[xbits=1]", "lossless", { SLOT(VP8LBundleColorMap) },
+    RunBundleColorMap, 1, PER_ROW },
+  { "VP8LBundleColorMap[xbits=2]", "lossless", { SLOT(VP8LBundleColorMap) },
+    RunBundleColorMap, 2, PER_ROW },
+  { "VP8LBundleColorMap[xbits=3]", "lossless", { SLOT(VP8LBundleColorMap) },
+    RunBundleColorMap, 3, PER_ROW },
+  { "VP8LCollectColorBlueTransforms", "lossless",
+    { SLOT(VP8LCollectColorBlueTransforms) }, RunColorStats, 0, PER_TILE },
+  { "VP8LCollectColorRedTransforms", "lossless",
+    { SLOT(VP8LCollectColorRedTransforms) }, RunColorStats, 1, PER_TILE },
+  { "VP8LCollectColorBlueTransformsBatch", "lossless",
+    { SLOT(VP8LCollectColorBlueTransformsBatch) }, RunColorStats, 2,
+    PER_TILE },
+  { "VP8LCollectColorRedTransformsBatch", "lossless",
+    { SLOT(VP8LCollectColorRedTransformsBatch) }, RunColorStats, 3,
+    PER_TILE },
+  { "VP8LFastLog2Slow", "lossless", { SLOT(VP8LFastLog2Slow) }, RunEntropy, 0,
+    PER_CALL },
+  { "VP8LFastSLog2Slow", "lossless", { SLOT(VP8LFastSLog2Slow) }, RunEntropy,
+    1, PER_CALL },
+  { "VP8LExtraCost", "lossless", { SLOT(VP8LExtraCost) }, RunEntropy, 2,
+    PER_CALL },
+  { "VP8LExtraCostCombined", "lossless", { SLOT(VP8LExtraCostCombined) },
+    RunEntropy, 3, PER_CALL },
+  { "VP8LCombinedShannonEntropy", "lossless",
+    { SLOT(VP8LCombinedShannonEntropy) }, RunEntropy, 4, PER_CALL },
+  { "VP8LGetCombinedEntropyUnrefined", "lossless",
+    { SLOT(VP8LGetEntropyUnrefinedHelper) }, RunEntropy, 5, PER_CALL },
+  { "VP8LHistogramAdd", "lossless", { SLOT(VP8LHistogramAdd) }, RunEntropy, 6,
+    PER_CALL },
+
+  // yuv <-> rgb
+  MODE_KERNELS("WebPUpsamplers", WebPUpsamplers, RunUpsampler, PER_ROW),
+  MODE_KERNELS("WebPSamplers", WebPSamplers, RunSampler, PER_ROW),
+  MODE_KERNELS("WebPYUV444Converters", WebPYUV444Converters, RunYUV444,
+               PER_ROW),
+  { "WebPConvertARGBToY", "yuv", { SLOT(WebPConvertARGBToY) }, RunToYUV, 0,
+    PER_ROW },
+  { "WebPConvertARGBToUV", "yuv", { SLOT(WebPConvertARGBToUV) }, RunToYUV, 1,
+    PER_ROW },
+  { "WebPConvertRGBA32ToUV", "yuv", { SLOT(WebPConvertRGBA32ToUV) }, RunToYUV,
+    2, PER_ROW },
+  { "WebPConvertRGB24ToY", "yuv", { SLOT(WebPConvertRGB24ToY) }, RunToYUV, 3,
+    PER_ROW },
+  { "WebPConvertBGR24ToY", "yuv", { SLOT(WebPConvertBGR24ToY) }, RunToYUV, 4,
+    PER_ROW },
+  { "VP8PackARGB", "yuv", { SLOT(VP8PackARGB) }, RunToYUV, 5, PER_ROW },
+  { "VP8PackRGB", "yuv", { SLOT(VP8PackRGB) }, RunToYUV, 6, PER_ROW },
+
+  // rescaler
+  { "WebPRescalerShrink[1ch]", "rescaler",
+    { SLOT(WebPRescalerImportRowShrink), SLOT(WebPRescalerExportRowShrink) },
+    RunRescaler, 0, PER_PLANE },
+  { "WebPRescalerShrink[4ch]", "rescaler",
+    { SLOT(WebPRescalerImportRowShrink), SLOT(WebPRescalerExportRowShrink) },
+    RunRescaler, 1, PER_PLANE },
+  { "WebPRescalerExpand[1ch]", "rescaler",
+    { SLOT(WebPRescalerImportRowExpand), SLOT(WebPRescalerExportRowExpand) },
+    RunRescaler, 2, PER_PLANE },
+  { "WebPRescalerExpand[4ch]", "rescaler",
+    { SLOT(WebPRescalerImportRowExpand), SLOT(WebPRescalerExportRowExpand) },
+    RunRescaler, 3, PER_PLANE },
+
+  // alpha
+  { "WebPApplyAlphaMultiply", "alpha", { SLOT(WebPApplyAlphaMultiply) },
+    RunAlpha, 0, PER_ROW },
+  { "WebPApplyAlphaMultiply4444", "alpha",
+    { SLOT(WebPApplyAlphaMultiply4444) }, RunAlpha, 1, PER_ROW },
+  { "WebPDispatchAlpha", "alpha", { SLOT(WebPDispatchAlpha) }, RunAlpha, 2,
+    PER_ROW },
+  { "WebPDispatchAlphaToGreen", "alpha", { SLOT(WebPDispatchAlphaToGreen) },
+    RunAlpha, 3, PER_ROW },
+  { "WebPExtractAlpha", "alpha", { SLOT(WebPExtractAlpha) }, RunAlpha, 4,
+    PER_ROW },
+  { "WebPMultARGBRow", "alpha", { SLOT(WebPMultARGBRow) }, RunAlpha, 5,
+    PER_ROW },
+  { "WebPMultARGBRow[inverse]", "alpha", { SLOT(WebPMultARGBRow) }, RunAlpha,
+    6, PER_ROW },
+  { "WebPMultRow", "alpha", { SLOT(WebPMultRow) }, RunAlpha, 7, PER_ROW },
+  { "WebPMultRow[inverse]", "alpha", { SLOT(WebPMultRow) }, RunAlpha, 8,
+    PER_ROW },
+  { "WebPFilters[HORIZONTAL]", "alpha",
+    { SLOT(WebPFilters[WEBP_FILTER_HORIZONTAL]) }, RunAlphaFilter,
+    WEBP_FILTER_HORIZONTAL, PER_PLANE },
+  { "WebPFilters[VERTICAL]", "alpha",
+    { SLOT(WebPFilters[WEBP_FILTER_VERTICAL]) }, RunAlphaFilter,
+    WEBP_FILTER_VERTICAL, PER_PLANE },
+  { "WebPFilters[GRADIENT]", "alpha",
+    { SLOT(WebPFilters[WEBP_FILTER_GRADIENT]) }, RunAlphaFilter,
+    WEBP_FILTER_GRADIENT, PER_PLANE },
+  { "WebPUnfilters[HORIZONTAL]", "alpha",
+    { SLOT(WebPUnfilters[WEBP_FILTER_HORIZONTAL]) }, RunAlphaUnfilter,
+    WEBP_FILTER_HORIZONTAL, PER_ROW },
+  { "WebPUnfilters[VERTICAL]", "alpha",
+    { SLOT(WebPUnfilters[WEBP_FILTER_VERTICAL]) }, RunAlphaUnfilter,
+    WEBP_FILTER_VERTICAL, PER_ROW },
+  { "WebPUnfilters[GRADIENT]", "alpha",
+    { SLOT(WebPUnfilters[WEBP_FILTER_GRADIENT]) }, RunAlphaUnfilter,
+    WEBP_FILTER_GRADIENT, PER_ROW }
+};
+#define NUM_KERNELS ((int)(sizeof(kKernels) / sizeof(kKernels[0])))
+
+static double PixelsPerCall(const Kernel* const k) {
+  switch (k->unit) {
+    case PER_BLOCK4: return 16.;
+    case PER_BLOCK8: return 64.;
+    case PER_MB: return 256.;
+    case PER_ROW: return data->width;
+    case PER_TILE: return TILE_SIZE * TILE_SIZE;
+    case PER_PLANE: return (double)data->width * data->height;
+    default: return 0.;
+  }
+}
+
+//------------------------------------------------------------------------------
+// Measurement
+
+typedef struct {
+  double min_time;      // minimum duration of one timed run, in seconds
+  int repeats;          // number of timed runs, the median is reported
+  const char* filter;   // only run the kernels whose name contains this
+  int tiers[NUM_TIERS]; // tiers to run
+  int num_tiers;
+} Options;
+
+typedef struct {
+  int valid;                 // false if the kernel is absent at this tier
+  int specialized;           // true if a slot differs from the C version
+  double ns, best_ns;        // median and minimum time per call
+} Result;
+
+static int CompareDouble(const void* a, const void* b) {
+  const double da = *(const double*)a, db = *(const double*)b;
+  return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+static void Measure(const Kernel* const k, const Options* const opts,
+                    Result* const result) {
+  double times[64];
+  const int repeats = (opts->repeats < 64) ? opts->repeats : 64;
+  int n = 1, r;
+  // calibrate the number of calls so that one run lasts at least 'min_time'
+  for (;;) {
+    const double start = Now();
+    double elapsed;
+    k->run(k->arg, n);
+    elapsed = Now() - start;
+    if (elapsed >= opts->min_time || n >= (1 << 28)) break;
+    n = (elapsed * 8 < opts->min_time) ? n * 8 : n * 2;
+  }
+  for (r = 0; r < repeats; ++r) {
+    const double start = Now();
+    k->run(k->arg, n);
+    times[r] = (Now() - start) * 1e9 / n;
+  }
+  qsort(times, repeats, sizeof(times[0]), CompareDouble);
+  result->ns = times[repeats / 2];
+  result->best_ns = times[0];
+}
+
+static void PrintJSONString(const char* s) {
+  putchar('"');
+  for (; *s != '\0'; ++s) {
+    if (*s == '"' || *s == '\\') putchar('\\');
+    putchar(*s);
+  }
+  putchar('"');
+}
+
+static void BenchDataset(const Options* const opts, int* const first) {
+  static Result results[NUM_KERNELS][NUM_TIERS];
+  GenericFunc c_impl[NUM_KERNELS][MAX_SLOTS];
+  int i, j, s;
+
+  memset(results, 0, sizeof(results));
+  SelectTier(&kTiers[0]);
+  for (i = 0; i < NUM_KERNELS; ++i) {
+    for (s = 0; s < MAX_SLOTS; ++s) {
+      c_impl[i][s] = (kKernels[i].slots[s] != NULL) ? *kKernels[i].slots[s]
+                                                    : NULL;
+    }
+  }
+  for (j = 0; j < opts->num_tiers; ++j) {
+    const int tier = opts->tiers[j];
+    SelectTier(&kTiers[tier]);
+    for (i = 0; i < NUM_KERNELS; ++i) {
+      const Kernel* const k = &kKernels[i];
+      Result* const res = &results[i][tier];
+      if (opts->filter != NULL && strstr(k->name, opts->filter) == NULL) {
+        continue;
+      }
+      res->valid = 1;
+      for (s = 0; s < MAX_SLOTS && k->slots[s] != NULL; ++s) {
+        if (*k->slots[s] == NULL) res->valid = 0;
+        if (*k->slots[s] != c_impl[i][s]) res->specialized = 1;
+      }
+      if (res->valid) Measure(k, opts, res);
+    }
+  }
+  RestoreCPUInfo();
+
+  for (i = 0; i < NUM_KERNELS; ++i) {
+    const Kernel* const k = &kKernels[i];
+    const Result* const c_res = &results[i][0];
+    int first_tier = 1;
+    if (opts->filter != NULL && strstr(k->name, opts->filter) == NULL) {
+      continue;
+    }
+    printf("%s\n    {\"name\": ", *first ? "" : ",");
+    *first = 0;
+    PrintJSONString(k->name);
+    printf(", \"group\": \"%s\", \"dataset\": ", k->group);
+    PrintJSONString(data->name);
+    printf(", \"pixels_per_call\": %.0f,\n     \"tiers\": {", PixelsPerCall(k));
+    for (j = 0; j < opts->num_tiers; ++j) {
+      const int tier = opts->tiers[j];
+      const Result* const res = &results[i][tier];
+      const double pixels = PixelsPerCall(k);
+      if (!res->valid) continue;
+      printf("%s\"%s\": {\"ns\": %.2f, \"best_ns\": %.2f, \"specialized\": %s",
+             first_tier ? "" : ", ", kTiers[tier].name, res->ns, res->best_ns,
+             res->specialized ? "true" : "false");
+      if (pixels > 0.) printf(", \"mpix_s\": %.1f", pixels * 1e3 / res->ns);
+      if (c_res->valid && tier != 0) {
+        printf(", \"speedup\": %.2f", c_res->ns / res->ns);
+      }
+      printf("}");
+      first_tier = 0;
+    }
+    printf("}}");
+  }
+}
+
+// Lists, per tier, the kernels that still run their C version.
+static void PrintCoverage(const Options* const opts) {
+  int i, j, s;
+  int first_tier = 1;
+  GenericFunc c_impl[NUM_KERNELS][MAX_SLOTS];
+  SelectTier(&kTiers[0]);
+  for (i = 0; i < NUM_KERNELS; ++i) {
+    for (s = 0; s < MAX_SLOTS; ++s) {
+      c_impl[i][s] = (kKernels[i].slots[s] != NULL) ? *kKernels[i].slots[s]
+                                                    : NULL;
+    }
+  }
+  printf("  \"c_only\": {");
+  for (j = 0; j < opts->num_tiers; ++j) {
+    const int tier = opts->tiers[j];
+    int first = 1;
+    if (tier == 0) continue;
+    SelectTier(&kTiers[tier]);
+    printf("%s\n    \"%s\": [", first_tier ? "" : ",", kTiers[tier].name);
+    first_tier = 0;
+    for (i = 0; i < NUM_KERNELS; ++i) {
+      int specialized = 0;
+      for (s = 0; s < MAX_SLOTS && kKernels[i].slots[s] != NULL; ++s) {
+        if (*kKernels[i].slots[s] != c_impl[i][s]) specialized = 1;
+      }
+      if (specialized) continue;
+      printf("%s", first ? "" : ", ");
+      PrintJSONString(kKernels[i].name);
+      first = 0;
+    }
+    printf("]");
+  }
+  printf("\n  }\n");
+  RestoreCPUInfo();
+}
+
+//------------------------------------------------------------------------------
+
+static void Help(void) {
+  printf("Usage: dsp_bench [options]\n"
+         "Times every dsp kernel at each CPU tier and prints JSON.\n\n"
+         "  -i <file.ppm> .. also run on the pixels of a binary PPM image\n"
+         "  -s <w> <h> ..... dimensions of the synthetic image (512 x 384)\n"
+         "  -tiers <list> .. comma-separated tiers to run (default: all\n"
+         "                   available among C,SSE2,SSE4.1,AVX2,NEON,\n"
+         "                   MIPS32,MIPSdspR2,MSA)\n"
+         "  -filter <str> .. only run kernels whose name contains <str>\n"
+         "  -t <ms> ........ minimum duration of one timed run (10)\n"
+         "  -r <n> ......... number of timed runs, median reported (5)\n");
+}
+
+static int ParseTiers(const char* list, Options* const opts) {
+  opts->num_tiers = 0;
+  while (*list != '\0') {
+    const char* const end = strchr(list, ',');
+    const size_t len = (end != NULL) ? (size_t)(end - list) : strlen(list);
+    int t;
+    for (t = 0; t < NUM_TIERS; ++t) {
+      if (strlen(kTiers[t].name) == len &&
+          !strncmp(kTiers[t].name, list, len)) {
+        break;
+      }
+    }
+    if (t == NUM_TIERS) {
+      fprintf(stderr, "Unknown tier '%.*s'\n", (int)len, list);
+      return 0;
+    }
+    if (!TierIsAvailable(&kTiers[t])) {
+      fprintf(stderr, "Tier '%s' is not supported by this CPU, skipped.\n",
+              kTiers[t].name);
+    } else if (opts->num_tiers < NUM_TIERS) {
+      opts->tiers[opts->num_tiers++] = t;
+    }
+    if (end == NULL) break;
+    list = end + 1;
+  }
+  return 1;
+}
+
+int main(int argc, const char* argv[]) {
+  Options opts;
+  const char* image_file = NULL;
+  int width = 512, height = 384;
+  int first = 1;
+  int c, t;
+
+  real_cpu_info = VP8GetCPUInfo;
+  memset(&opts, 0, sizeof(opts));
+  opts.min_time = 0.010;
+  opts.repeats = 5;
+  for (t = 0; t < NUM_TIERS; ++t) {
+    if (TierIsAvailable(&kTiers[t])) opts.tiers[opts.num_tiers++] = t;
+  }
+  for (c = 1; c < argc; ++c) {
+    if (!strcmp(argv[c], "-h") || !strcmp(argv[c], "-help")) {
+      Help();
+      return 0;
+    } else if (!strcmp(argv[c], "-i") && c + 1 < argc) {
+      image_file = argv[++c];
+    } else if (!strcmp(argv[c], "-s") && c + 2 < argc) {
+      width = atoi(argv[++c]);
+      height = atoi(argv[++c]);
+    } else if (!strcmp(argv[c], "-tiers") && c + 1 < argc) {
+      if (!ParseTiers(argv[++c], &opts)) return 1;
+    } else if (!strcmp(argv[c], "-filter") && c + 1 < argc) {
+      opts.filter = argv[++c];
+    } else if (!strcmp(argv[c], "-t") && c + 1 < argc) {
+      opts.min_time = atof(argv[++c]) * 1e-3;
+    } else if (!strcmp(argv[c], "-r") && c + 1 < argc) {
+      opts.repeats = atoi(argv[++c]);
+    } else {
+      fprintf(stderr, "Unknown option '%s'\n", argv[c]);
+      Help();
+      return 1;
+    }
+  }
+  if (width < 64 || height < 64 || opts.repeats < 1) {
+    fprintf(stderr, "Invalid parameters.\n");
+    return 1;
+  }
+  if (opts.num_tiers == 0) {
+    fprintf(stderr, "No tier to run.\n");
+    return 1;
+  }
+
+  InitAllDsp();
+  printf("{\n  \"tiers\": [");
+  for (t = 0; t < opts.num_tiers; ++t) {
+    printf("%s\"%s\"", t ? ", " : "", kTiers[opts.tiers[t]].name);
+  }
+  printf("],\n  \"kernels\": [");
+
+  {
+    uint8_t* const rgb = (uint8_t*)malloc(3 * (size_t)width * height);
+    if (rgb != NULL) FillSynthetic(rgb, width, height);
+    data = (rgb != NULL) ? NewDataset("synthetic", rgb, width, height) : NULL;
+    if (data == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      return 1;
+    }
+    BenchDataset(&opts, &first);
+    DeleteDataset(data);
+    data = NULL;
+  }
+  if (image_file != NULL) {
+    int w, h;
+    uint8_t* const rgb = ReadPPM(image_file, &w, &h);
+    if (rgb == NULL || w < 64 || h < 64) {
+      fprintf(stderr, "Could not read '%s' (binary PPM, at least 64x64).\n",
+              image_file);
+      free(rgb);
+      return 1;
+    }
+    data = NewDataset(image_file, rgb, w, h);
+    if (data == NULL) {
+      fprintf(stderr, "Out of memory.\n");
+      return 1;
+    }
+    BenchDataset(&opts, &first);
+    DeleteDataset(data);
+    data = NULL;
+  }
+  printf("\n  ],\n");
+  PrintCoverage(&opts);
+  printf("}\n");
+  return 0;
+}
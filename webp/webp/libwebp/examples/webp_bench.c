@@ -0,0 +1,576 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+//  Throughput benchmark over a corpus of WebP files.
+//
+//  Every .webp file found in the given directories (or given directly) is
+//  decoded with a series of configurations: each output colorspace, then
+//  RGBA output scaled down, cropped, incremental and multi-threaded. The
+//  decoded pixels are then re-encoded with each lossy method and each
+//  lossless level, with and without threads.
+//
+//  For each configuration the tool reports the throughput in megapixels of
+//  source image per second, the latency percentiles over all the (image,
+//  iteration) samples and the peak resident memory. On Linux the peak is reset
+//  before each configuration; elsewhere it is the process-wide peak.
+//
+//  Build: make -f makefile.unix examples/webp_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "../src/webp/decode.h"
+#include "../src/webp/encode.h"
+#include "../src/dsp/dsp.h"
+
+static double Now(void) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+//------------------------------------------------------------------------------
+// Resident memory
+
+// Resets the peak resident set size (Linux 4.0+). Returns false if the peak
+// can't be reset, in which case GetPeakRSS() returns the process-wide peak.
+static int ResetPeakRSS(void) {
+  FILE* const f = fopen("/proc/self/clear_refs", "w");
+  int ok;
+  if (f == NULL) return 0;
+  ok = (fputs("5", f) >= 0);
+  ok &= (fclose(f) == 0);
+  return ok;
+}
+
+// Returns the value of 'key' (in kB) from /proc/self/status, or -1.
+static long ReadStatusKB(const char* const key) {
+  char line[256];
+  const size_t len = strlen(key);
+  long value = -1;
+  FILE* const f = fopen("/proc/self/status", "r");
+  if (f == NULL) return -1;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (!strncmp(line, key, len) && line[len] == ':') {
+      value = strtol(line + len + 1, NULL, 10);
+      break;
+    }
+  }
+  fclose(f);
+  return value;
+}
+
+static long GetPeakRSS(void) {
+  const long hwm = ReadStatusKB("VmHWM");
+  struct rusage usage;
+  if (hwm >= 0) return hwm;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+#if defined(__APPLE__)
+  return (long)(usage.ru_maxrss / 1024);   // bytes on OS X
+#else
+  return (long)usage.ru_maxrss;
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Corpus
+
+typedef struct {
+  char* name;
+  uint8_t* data;
+  size_t size;
+  int width, height;
+  uint8_t* rgba;        // decoded pixels, source of the encoding benchmarks
+} Image;
+
+typedef struct {
+  Image* images;
+  int num_images, max_images;
+  double megapixels;    // sum over the corpus
+} Corpus;
+
+static int ReadFile(const char* const name, uint8_t** data, size_t* size) {
+  FILE* const f = fopen(name, "rb");
+  long len;
+  *data = NULL;
+  *size = 0;
+  if (f == NULL) return 0;
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0 ||
+      fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return 0;
+  }
+  *data = (uint8_t*)malloc(len);
+  if (*data == NULL || fread(*data, len, 1, f) != 1) {
+    free(*data);
+    *data = NULL;
+    fclose(f);
+    return 0;
+  }
+  fclose(f);
+  *size = (size_t)len;
+  return 1;
+}
+
+static int AddImage(Corpus* const corpus, const char* const name,
+                    int need_pixels) {
+  Image* img;
+  if (corpus->num_images == corpus->max_images) {
+    const int new_max = 2 * corpus->max_images + 16;
+    Image* const images =
+        (Image*)realloc(corpus->images, new_max * sizeof(*images));
+    if (images == NULL) return 0;
+    corpus->images = images;
+    corpus->max_images = new_max;
+  }
+  img = &corpus->images[corpus->num_images];
+  memset(img, 0, sizeof(*img));
+  if (!ReadFile(name, &img->data, &img->size) ||
+      !WebPGetInfo(img->data, img->size, &img->width, &img->height)) {
+    fprintf(stderr, "Skipping '%s': not a readable WebP file.\n", name);
+    free(img->data);
+    return 1;
+  }
+  if (need_pixels) {
+    img->rgba = WebPDecodeRGBA(img->data, img->size, NULL, NULL);
+    if (img->rgba == NULL) {
+      fprintf(stderr, "Skipping '%s': decoding failed.\n", name);
+      free(img->data);
+      return 1;
+    }
+  }
+  img->name = (char*)malloc(strlen(name) + 1);
+  if (img->name == NULL) return 0;
+  strcpy(img->name, name);
+  corpus->megapixels += img->width * (double)img->height * 1e-6;
+  ++corpus->num_images;
+  return 1;
+}
+
+static int HasWebPExtension(const char* const name) {
+  const size_t len = strlen(name);
+  const char* const ext = name + len - 5;
+  return (len > 5) && ext[0] == '.' &&
+         (ext[1] | 0x20) == 'w' && (ext[2] | 0x20) == 'e' &&
+         (ext[3] | 0x20) == 'b' && (ext[4] | 0x20) == 'p';
+}
+
+static int CompareStrings(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Adds 'path', or the .webp files it contains (sorted, not recursive).
+static int AddPath(Corpus* const corpus, const char* const path,
+                   int need_pixels) {
+  struct stat st;
+  DIR* dir;
+  struct dirent* entry;
+  char** names = NULL;
+  int num = 0, max = 0, i, ok = 1;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "Can't access '%s'.\n", path);
+    return 0;
+  }
+  if (!S_ISDIR(st.st_mode)) return AddImage(corpus, path, need_pixels);
+  dir = opendir(path);
+  if (dir == NULL) return 0;
+  while (ok && (entry = readdir(dir)) != NULL) {
+    if (!HasWebPExtension(entry->d_name)) continue;
+    if (num == max) {
+      char** const tmp = (char**)realloc(names, (2 * max + 16) * sizeof(*tmp));
+      if (tmp == NULL) {
+        ok = 0;
+        break;
+      }
+      names = tmp;
+      max = 2 * max + 16;
+    }
+    names[num] = (char*)malloc(strlen(path) + strlen(entry->d_name) + 2);
+    if (names[num] == NULL) {
+      ok = 0;
+      break;
+    }
+    sprintf(names[num], "%s/%s", path, entry->d_name);
+    ++num;
+  }
+  closedir(dir);
+  if (ok) qsort(names, num, sizeof(*names), CompareStrings);
+  for (i = 0; i < num; ++i) {
+    if (ok) ok = AddImage(corpus, names[i], need_pixels);
+    free(names[i]);
+  }
+  free(names);
+  return ok;
+}
+
+static void ClearCorpus(Corpus* const corpus) {
+  int i;
+  for (i = 0; i < corpus->num_images; ++i) {
+    free(corpus->images[i].name);
+    free(corpus->images[i].data);
+    WebPFree(corpus->images[i].rgba);
+  }
+  free(corpus->images);
+  memset(corpus, 0, sizeof(*corpus));
+}
+
+//------------------------------------------------------------------------------
+// Configurations
+
+typedef enum {
+  DEC_FULL = 0,
+  DEC_SCALED,        // half the source dimensions
+  DEC_CROPPED,       // central quarter of the picture
+  DEC_INCREMENTAL,   // data appended by chunks of kIncrementalChunk bytes
+  DEC_THREADED
+} DecodeKind;
+
+typedef struct {
+  char name[40];
+  int is_encode;
+  // decoding
+  WEBP_CSP_MODE mode;
+  DecodeKind kind;
+  // encoding
+  int lossless;
+  int effort;        // method (lossy) or level (lossless)
+  int threads;
+} BenchConfig;
+
+static const char* const kModeNames[MODE_LAST] = {
+  "RGB", "RGBA", "BGR", "BGRA", "ARGB", "RGBA_4444", "RGB_565",
+  "rgbA", "bgrA", "Argb", "rgbA_4444", "YUV", "YUVA"
+};
+
+static const size_t kIncrementalChunk = 4096;
+
+#define MAX_CONFIGS 64
+
+static int BuildConfigs(int decode, int encode, BenchConfig* const configs) {
+  static const char* const kKindNames[] = {
+    "", "-scaled", "-cropped", "-incremental", "-threads"
+  };
+  int num = 0, i, t;
+  if (decode) {
+    for (i = 0; i < MODE_LAST; ++i) {
+      BenchConfig* const c = &configs[num++];
+      memset(c, 0, sizeof(*c));
+      c->mode = (WEBP_CSP_MODE)i;
+      c->kind = DEC_FULL;
+      snprintf(c->name, sizeof(c->name), "dec-%s", kModeNames[i]);
+    }
+    for (i = DEC_SCALED; i <= DEC_THREADED; ++i) {
+      BenchConfig* const c = &configs[num++];
+      memset(c, 0, sizeof(*c));
+      c->mode = MODE_RGBA;
+      c->kind = (DecodeKind)i;
+      snprintf(c->name, sizeof(c->name), "dec-RGBA%s", kKindNames[i]);
+    }
+  }
+  if (encode) {
+    for (t = 0; t <= 1; ++t) {
+      for (i = 0; i <= 6; ++i) {
+        BenchConfig* const c = &configs[num++];
+        memset(c, 0, sizeof(*c));
+        c->is_encode = 1;
+        c->effort = i;
+        c->threads = t;
+        snprintf(c->name, sizeof(c->name), "enc-lossy-m%d%s", i,
+                 t ? "-threads" : "");
+      }
+      for (i = 0; i <= 9; ++i) {
+        BenchConfig* const c = &configs[num++];
+        memset(c, 0, sizeof(*c));
+        c->is_encode = 1;
+        c->lossless = 1;
+        c->effort = i;
+        c->threads = t;
+        snprintf(c->name, sizeof(c->name), "enc-lossless-z%d%s", i,
+                 t ? "-threads" : "");
+      }
+    }
+  }
+  return num;
+}
+
+static int DecodeOnce(const Image* const img, const BenchConfig* const cfg) {
+  WebPDecoderConfig config;
+  VP8StatusCode status;
+  if (!WebPInitDecoderConfig(&config)) return 0;
+  config.output.colorspace = cfg->mode;
+  switch (cfg->kind) {
+    case DEC_SCALED:
+      config.options.use_scaling = 1;
+      config.options.scaled_width = (img->width + 1) / 2;
+      config.options.scaled_height = (img->height + 1) / 2;
+      break;
+    case DEC_CROPPED:
+      config.options.use_cropping = 1;
+      config.options.crop_left = img->width / 4;
+      config.options.crop_top = img->height / 4;
+      config.options.crop_width = (img->width + 1) / 2;
+      config.options.crop_height = (img->height + 1) / 2;
+      break;
+    case DEC_THREADED:
+      config.options.use_threads = 1;
+      break;
+    default:
+      break;
+  }
+  if (cfg->kind == DEC_INCREMENTAL) {
+    WebPIDecoder* const idec = WebPIDecode(NULL, 0, &config);
+    size_t pos = 0;
+    status = VP8_STATUS_OUT_OF_MEMORY;
+    if (idec != NULL) {
+      do {
+        const size_t chunk = (img->size - pos < kIncrementalChunk) ?
+                             img->size - pos : kIncrementalChunk;
+        status = WebPIAppend(idec, img->data + pos, chunk);
+        pos += chunk;
+      } while (status == VP8_STATUS_SUSPENDED && pos < img->size);
+      WebPIDelete(idec);
+    }
+  } else {
+    status = WebPDecode(img->data, img->size, &config);
+  }
+  WebPFreeDecBuffer(&config.output);
+  return (status == VP8_STATUS_OK);
+}
+
+static int EncodeOnce(const Image* const img, const BenchConfig* const cfg,
+                      float quality, size_t* const coded_size) {
+  WebPConfig config;
+  WebPPicture pic;
+  WebPMemoryWriter writer;
+  int ok;
+  if (!WebPConfigInit(&config) || !WebPPictureInit(&pic)) return 0;
+  if (cfg->lossless) {
+    if (!WebPConfigLosslessPreset(&config, cfg->effort)) return 0;
+  } else {
+    config.quality = quality;
+    config.method = cfg->effort;
+  }
+  config.thread_level = cfg->threads;
+  pic.width = img->width;
+  pic.height = img->height;
+  pic.use_argb = cfg->lossless;
+  WebPMemoryWriterInit(&writer);
+  pic.writer = WebPMemoryWrite;
+  pic.custom_ptr = &writer;
+  ok = WebPPictureImportRGBA(&pic, img->rgba, 4 * img->width) &&
+       WebPEncode(&config, &pic);
+  *coded_size = writer.size;
+  WebPPictureFree(&pic);
+  WebPMemoryWriterClear(&writer);
+  return ok;
+}
+
+//------------------------------------------------------------------------------
+// Measurement
+
+typedef struct {
+  double* latency;       // seconds, one per (iteration, image)
+  int num_samples;
+  int failures;
+  double total_time;
+  double megapixels;     // source megapixels processed
+  double coded_bytes;    // encoding only
+  long base_rss_kb, peak_rss_kb;
+  int rss_is_global;     // true if the peak couldn't be reset
+} Result;
+
+static int CompareDouble(const void* a, const void* b) {
+  const double da = *(const double*)a, db = *(const double*)b;
+  return (da < db) ? -1 : (da > db) ? 1 : 0;
+}
+
+// Nearest-rank percentile of the sorted 'values'.
+static double Percentile(const double* const values, int num, double p) {
+  int rank;
+  if (num == 0) return 0.;
+  rank = (int)(p * num / 100. + 0.999999) - 1;
+  if (rank < 0) rank = 0;
+  if (rank >= num) rank = num - 1;
+  return values[rank];
+}
+
+static int RunConfig(const Corpus* const corpus, const BenchConfig* const cfg,
+                     int iterations, float quality, Result* const res) {
+  int it, i;
+  memset(res, 0, sizeof(*res));
+  res->latency = (double*)malloc(iterations * corpus->num_images *
+                                 sizeof(*res->latency));
+  if (res->latency == NULL) return 0;
+  res->rss_is_global = !ResetPeakRSS();
+  res->base_rss_kb = ReadStatusKB("VmRSS");
+  for (it = 0; it < iterations; ++it) {
+    for (i = 0; i < corpus->num_images; ++i) {
+      const Image* const img = &corpus->images[i];
+      size_t coded_size = 0;
+      const double start = Now();
+      const int ok = cfg->is_encode ?
+                     EncodeOnce(img, cfg, quality, &coded_size) :
+                     DecodeOnce(img, cfg);
+      const double elapsed = Now() - start;
+      if (!ok) {
+        ++res->failures;
+        continue;
+      }
+      res->latency[res->num_samples++] = elapsed;
+      res->total_time += elapsed;
+      res->megapixels += img->width * (double)img->height * 1e-6;
+      res->coded_bytes += coded_size;
+    }
+  }
+  res->peak_rss_kb = GetPeakRSS();
+  qsort(res->latency, res->num_samples, sizeof(*res->latency), CompareDouble);
+  return 1;
+}
+
+static void PrintHeader(int json, const Corpus* const corpus, int iterations) {
+  if (json) {
+    printf("{\n  \"images\": %d,\n  \"megapixels\": %.3f,\n"
+           "  \"iterations\": %d,\n  \"configs\": [",
+           corpus->num_images, corpus->megapixels, iterations);
+  } else {
+    printf("%d images, %.2f MPix, %d iteration(s)\n\n", corpus->num_images,
+           corpus->megapixels, iterations);
+    printf("%-26s %8s %8s %8s %8s %8s %9s %6s\n", "config", "MPix/s",
+           "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)", "peak(MB)", "bpp");
+  }
+}
+
+static void PrintResult(int json, int first, const BenchConfig* const cfg,
+                        const Result* const res) {
+  const double* const lat = res->latency;
+  const int n = res->num_samples;
+  const double mpix_s =
+      (res->total_time > 0.) ? res->megapixels / res->total_time : 0.;
+  const double bpp =
+      (res->megapixels > 0.) ? res->coded_bytes * 8e-6 / res->megapixels : 0.;
+  if (json) {
+    printf("%s\n    {\"name\": \"%s\", \"samples\": %d, \"failures\": %d, "
+           "\"mpix_s\": %.3f,\n     \"latency_ms\": {\"p50\": %.3f, "
+           "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f},\n"
+           "     \"base_rss_kb\": %ld, \"peak_rss_kb\": %ld, "
+           "\"peak_rss_is_global\": %s",
+           first ? "" : ",", cfg->name, n, res->failures, mpix_s,
+           Percentile(lat, n, 50) * 1e3, Percentile(lat, n, 90) * 1e3,
+           Percentile(lat, n, 99) * 1e3, Percentile(lat, n, 100) * 1e3,
+           res->base_rss_kb, res->peak_rss_kb,
+           res->rss_is_global ? "true" : "false");
+    if (cfg->is_encode) printf(", \"bpp\": %.4f", bpp);
+    printf("}");
+  } else {
+    printf("%-26s %8.2f %8.3f %8.3f %8.3f %8.3f %8.1f%s", cfg->name, mpix_s,
+           Percentile(lat, n, 50) * 1e3, Percentile(lat, n, 90) * 1e3,
+           Percentile(lat, n, 99) * 1e3, Percentile(lat, n, 100) * 1e3,
+           res->peak_rss_kb / 1024., res->rss_is_global ? "*" : " ");
+    if (cfg->is_encode) printf(" %6.3f", bpp);
+    if (res->failures > 0) printf("  (%d failures)", res->failures);
+    printf("\n");
+  }
+}
+
+//------------------------------------------------------------------------------
+
+static void Help(void) {
+  printf("Usage: webp_bench [options] <dir | file.webp> ...\n"
+         "Decodes and re-encodes a corpus of WebP files with a series of\n"
+         "configurations and reports throughput, latency and memory.\n\n"
+         "  -n <int> ....... number of passes over the corpus (3)\n"
+         "  -dec ........... only run the decoding configurations\n"
+         "  -enc ........... only run the encoding configurations\n"
+         "  -filter <str> .. only run configurations whose name contains it\n"
+         "  -q <float> ..... quality factor of the lossy encodings (75)\n"
+         "  -json .......... print the results as JSON\n"
+         "  -autotune ...... pick the fastest dsp implementations first\n\n"
+         "  -autotune ...... time the dsp implementations and use the fastest\n\n"
+         "A peak memory marked with '*' is the peak of the whole process.\n");
+}
+
+int main(int argc, const char* argv[]) {
+  Corpus corpus;
+  BenchConfig configs[MAX_CONFIGS];
+  const char* filter = NULL;
+  int iterations = 3;
+  int decode = 1, encode = 1, json = 0, list = 0, autotune = 0;
+  float quality = 75.f;
+  int num_configs, c, i, first = 1, ok = 1;
+
+  memset(&corpus, 0, sizeof(corpus));
+  for (c = 1; c < argc && argv[c][0] == '-'; ++c) {
+    if (!strcmp(argv[c], "-h") || !strcmp(argv[c], "-help")) {
+      Help();
+      return 0;
+    } else if (!strcmp(argv[c], "-n") && c + 1 < argc) {
+      iterations = atoi(argv[++c]);
+    } else if (!strcmp(argv[c], "-dec")) {
+      encode = 0;
+    } else if (!strcmp(argv[c], "-enc")) {
+      decode = 0;
+    } else if (!strcmp(argv[c], "-filter") && c + 1 < argc) {
+      filter = argv[++c];
+    } else if (!strcmp(argv[c], "-q") && c + 1 < argc) {
+      quality = (float)atof(argv[++c]);
+    } else if (!strcmp(argv[c], "-json")) {
+      json = 1;
+    } else if (!strcmp(argv[c], "-list")) {
+      list = 1;
+    } else if (!strcmp(argv[c], "-autotune")) {
+      autotune = 1;
+    } else {
+      fprintf(stderr, "Unknown option '%s'\n", argv[c]);
+      Help();
+      return 1;
+    }
+  }
+  num_configs = BuildConfigs(decode, encode, configs);
+  if (list) {
+    for (i = 0; i < num_configs; ++i) printf("%s\n", configs[i].name);
+    return 0;
+  }
+  if (c == argc || iterations < 1) {
+    Help();
+    return 1;
+  }
+  for (; ok && c < argc; ++c) ok = AddPath(&corpus, argv[c], encode);
+  if (!ok || corpus.num_images == 0) {
+    fprintf(stderr, "No usable input.\n");
+    ClearCorpus(&corpus);
+    return 1;
+  }
+
+  if (autotune) {
+    const int num_replaced = VP8DspAutoTune();
+    if (!json) printf("Auto-tuning replaced %d dsp functions.\n", num_replaced);
+  }
+  PrintHeader(json, &corpus, iterations);
+  for (i = 0; i < num_configs; ++i) {
+    Result res;
+    if (filter != NULL && strstr(configs[i].name, filter) == NULL) continue;
+    if (!RunConfig(&corpus, &configs[i], iterations, quality, &res)) {
+      fprintf(stderr, "Out of memory.\n");
+      ok = 0;
+      break;
+    }
+    PrintResult(json, first, &configs[i], &res);
+    fflush(stdout);
+    free(res.latency);
+    first = 0;
+  }
+  if (json) printf("\n  ]\n}\n");
+  ClearCorpus(&corpus);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+//  Name folding for builds outside of the Xcode project.
+//
+//  The MV_ prefix is only partially applied through src/: some declarations
+//  use the prefixed names while their definitions and callers still use the
+//  upstream ones. This header, force-included by makefile.unix, maps the
+//  prefixed names back to the upstream ones so that the library and the
+//  examples build with a stock compiler. The exported symbols are therefore
+//  the upstream names (WebPDecode(), VP8LDecodeState, ...).
+
+#ifndef WEBP_MV_COMPAT_H_
+#define WEBP_MV_COMPAT_H_
+
+#define MV_ALPHDecoder ALPHDecoder
+#define MV_ALPHNew ALPHNew
+#define MV_MODE_ARGB MODE_ARGB
+#define MV_MODE_Argb MODE_Argb
+#define MV_MODE_BGR MODE_BGR
+#define MV_MODE_BGRA MODE_BGRA
+#define MV_MODE_LAST MODE_LAST
+#define MV_MODE_RGB MODE_RGB
+#define MV_MODE_RGBA MODE_RGBA
+#define MV_MODE_RGBA_4444 MODE_RGBA_4444
+#define MV_MODE_RGB_565 MODE_RGB_565
+#define MV_MODE_YUV MODE_YUV
+#define MV_MODE_YUVA MODE_YUVA
+#define MV_MODE_bgrA MODE_bgrA
+#define MV_MODE_rgbA MODE_rgbA
+#define MV_MODE_rgbA_4444 MODE_rgbA_4444
+#define MV_MVP8LDecodeState VP8LDecodeState
+#define MV_MV_WEBP_CSP_MODE MV_WEBP_CSP_MODE
+#define MV_OutputAlphaFunc OutputAlphaFunc
+#define MV_OutputFunc OutputFunc
+#define MV_OutputRowFunc OutputRowFunc
+#define MV_QuantizeLevels QuantizeLevels
+#define MV_VP8Io VP8Io
+#define MV_VP8LTransform VP8LTransform
+#define MV_VP8StatusCode VP8StatusCode
+#define MV_VP8_STATUS_BITSTREAM_ERROR VP8_STATUS_BITSTREAM_ERROR
+#define MV_VP8_STATUS_INVALID_PARAM VP8_STATUS_INVALID_PARAM
+#define MV_VP8_STATUS_NOT_ENOUGH_DATA VP8_STATUS_NOT_ENOUGH_DATA
+#define MV_VP8_STATUS_OK VP8_STATUS_OK
+#define MV_VP8_STATUS_OUT_OF_MEMORY VP8_STATUS_OUT_OF_MEMORY
+#define MV_VP8_STATUS_SUSPENDED VP8_STATUS_SUSPENDED
+#define MV_VP8_STATUS_UNSUPPORTED_FEATURE VP8_STATUS_UNSUPPORTED_FEATURE
+#define MV_VP8_STATUS_USER_ABORT VP8_STATUS_USER_ABORT
+#define MV_WEBP_DEMUX_DONE WEBP_DEMUX_DONE
+#define MV_WEBP_DEMUX_PARSED_HEADER WEBP_DEMUX_PARSED_HEADER
+#define MV_WEBP_DEMUX_PARSE_ERROR WEBP_DEMUX_PARSE_ERROR
+#define MV_WEBP_DEMUX_PARSING_HEADER WEBP_DEMUX_PARSING_HEADER
+#define MV_WEBP_FF_BACKGROUND_COLOR WEBP_FF_BACKGROUND_COLOR
+#define MV_WEBP_FF_CANVAS_HEIGHT WEBP_FF_CANVAS_HEIGHT
+#define MV_WEBP_FF_CANVAS_WIDTH WEBP_FF_CANVAS_WIDTH
+#define MV_WEBP_FF_FORMAT_FLAGS WEBP_FF_FORMAT_FLAGS
+#define MV_WEBP_FF_FRAME_COUNT WEBP_FF_FRAME_COUNT
+#define MV_WEBP_FF_LOOP_COUNT WEBP_FF_LOOP_COUNT
+#define MV_WebPAllocateDecBuffer WebPAllocateDecBuffer
+#define MV_WebPAnimDecoder WebPAnimDecoder
+#define MV_WebPAnimDecoderDelete WebPAnimDecoderDelete
+#define MV_WebPAnimDecoderGetDemuxer WebPAnimDecoderGetDemuxer
+#define MV_WebPAnimDecoderGetInfo WebPAnimDecoderGetInfo
+#define MV_WebPAnimDecoderGetNext WebPAnimDecoderGetNext
+#define MV_WebPAnimDecoderHasMoreFrames WebPAnimDecoderHasMoreFrames
+#define MV_WebPAnimDecoderNewInternal WebPAnimDecoderNewInternal
+#define MV_WebPAnimDecoderOptions WebPAnimDecoderOptions
+#define MV_WebPAnimDecoderOptionsInit WebPAnimDecoderOptionsInit
+#define MV_WebPAnimDecoderOptionsInitInternal WebPAnimDecoderOptionsInitInternal
+#define MV_WebPAnimDecoderReset WebPAnimDecoderReset
+#define MV_WebPAnimInfo WebPAnimInfo
+#define MV_WebPAvoidSlowMemory WebPAvoidSlowMemory
+#define MV_WebPBitstreamFeatures WebPBitstreamFeatures
+#define MV_WebPChunkIterator WebPChunkIterator
+#define MV_WebPCopyDecBuffer WebPCopyDecBuffer
+#define MV_WebPCopyDecBufferPixels WebPCopyDecBufferPixels
+#define MV_WebPData WebPData
+#define MV_WebPDecBuffer WebPDecBuffer
+#define MV_WebPDecParams WebPDecParams
+#define MV_WebPDecode WebPDecode
+#define MV_WebPDecodeARGB WebPDecodeARGB
+#define MV_WebPDecodeARGBInto WebPDecodeARGBInto
+#define MV_WebPDecodeBGR WebPDecodeBGR
+#define MV_WebPDecodeBGRA WebPDecodeBGRA
+#define MV_WebPDecodeBGRAInto WebPDecodeBGRAInto
+#define MV_WebPDecodeBGRInto WebPDecodeBGRInto
+#define MV_WebPDecodeRGB WebPDecodeRGB
+#define MV_WebPDecodeRGBA WebPDecodeRGBA
+#define MV_WebPDecodeRGBAInto WebPDecodeRGBAInto
+#define MV_WebPDecodeRGBInto WebPDecodeRGBInto
+#define MV_WebPDecodeYUV WebPDecodeYUV
+#define MV_WebPDecodeYUVInto WebPDecodeYUVInto
+#define MV_WebPDecoderConfig WebPDecoderConfig
+#define MV_WebPDecoderOptions WebPDecoderOptions
+#define MV_WebPDemux WebPDemux
+#define MV_WebPDemuxDelete WebPDemuxDelete
+#define MV_WebPDemuxGetChunk WebPDemuxGetChunk
+#define MV_WebPDemuxGetFrame WebPDemuxGetFrame
+#define MV_WebPDemuxGetI WebPDemuxGetI
+#define MV_WebPDemuxInternal WebPDemuxInternal
+#define MV_WebPDemuxNextChunk WebPDemuxNextChunk
+#define MV_WebPDemuxNextFrame WebPDemuxNextFrame
+#define MV_WebPDemuxPartial WebPDemuxPartial
+#define MV_WebPDemuxPrevChunk WebPDemuxPrevChunk
+#define MV_WebPDemuxPrevFrame WebPDemuxPrevFrame
+#define MV_WebPDemuxReleaseChunkIterator WebPDemuxReleaseChunkIterator
+#define MV_WebPDemuxReleaseIterator WebPDemuxReleaseIterator
+#define MV_WebPDemuxState WebPDemuxState
+#define MV_WebPDemuxer WebPDemuxer
+#define MV_WebPFlipBuffer WebPFlipBuffer
+#define MV_WebPFormatFeature WebPFormatFeature
+#define MV_WebPFree WebPFree
+#define MV_WebPFreeDecBuffer WebPFreeDecBuffer
+#define MV_WebPFreeDecParams WebPFreeDecParams
+#define MV_WebPGetDecoderVersion WebPGetDecoderVersion
+#define MV_WebPGetDemuxVersion WebPGetDemuxVersion
+#define MV_WebPGetFeatures WebPGetFeatures
+#define MV_WebPGetFeaturesInternal WebPGetFeaturesInternal
+#define MV_WebPGetInfo WebPGetInfo
+#define MV_WebPGrabDecBuffer WebPGrabDecBuffer
+#define MV_WebPHeaderStructure WebPHeaderStructure
+#define MV_WebPIAppend WebPIAppend
+#define MV_WebPIDecGetRGB WebPIDecGetRGB
+#define MV_WebPIDecGetYUV WebPIDecGetYUV
+#define MV_WebPIDecGetYUVA WebPIDecGetYUVA
+#define MV_WebPIDecode WebPIDecode
+#define MV_WebPIDecodedArea WebPIDecodedArea
+#define MV_WebPIDecoder WebPIDecoder
+#define MV_WebPIDelete WebPIDelete
+#define MV_WebPINewDecoder WebPINewDecoder
+#define MV_WebPINewRGB WebPINewRGB
+#define MV_WebPINewYUV WebPINewYUV
+#define MV_WebPINewYUVA WebPINewYUVA
+#define MV_WebPIUpdate WebPIUpdate
+#define MV_WebPInitCustomIo WebPInitCustomIo
+#define MV_WebPInitDecBuffer WebPInitDecBuffer
+#define MV_WebPInitDecBufferInternal WebPInitDecBufferInternal
+#define MV_WebPInitDecoderConfig WebPInitDecoderConfig
+#define MV_WebPInitDecoderConfigInternal WebPInitDecoderConfigInternal
+#define MV_WebPIoInitFromOptions WebPIoInitFromOptions
+#define MV_WebPIsPremultipliedMode WebPIsPremultipliedMode
+#define MV_WebPIsRGBMode WebPIsRGBMode
+#define MV_WebPIterator WebPIterator
+#define MV_WebPMuxAnimBlend WebPMuxAnimBlend
+#define MV_WebPMuxAnimDispose WebPMuxAnimDispose
+#define MV_WebPParseHeaders WebPParseHeaders
+#define MV_WebPRGBABuffer WebPRGBABuffer
+#define MV_WebPRescaler WebPRescaler
+#define MV_WebPResetDecParams WebPResetDecParams
+#define MV_WebPYUVABuffer WebPYUVABuffer
+
+// Upstream spellings still used by some sources.
+#define WEBP_CSP_MODE MV_WEBP_CSP_MODE
+#define WEBP_DEMUX_ABI_VERSION MV_WEBP_DEMUX_ABI_VERSION
+#define WEBP_MAX_ALLOCABLE_MEMORY MV_WEBP_MAX_ALLOCABLE_MEMORY
+
+#endif  /* WEBP_MV_COMPAT_H_ */
@@ -83,7 +83,9 @@ static VP8StatusCode CheckDecBuffer(const WebPDecBuffer* const buffer) {
 }
 #undef MIN_BUFFER_SIZE
 
-static VP8StatusCode AllocateBuffer(WebPDecBuffer* const buffer) {
+// Sets '*allocated_size' to the size of the memory allocated, if any.
+static VP8StatusCode AllocateBuffer(WebPDecBuffer* const buffer,
+                                    uint64_t* const allocated_size) {
   const int w = buffer->width;
   const int h = buffer->height;
   const MV_WEBP_CSP_MODE mode = buffer->colorspace;
@@ -112,11 +114,12 @@ static VP8StatusCode AllocateBuffer(WebPDecBuffer* const buffer) {
     total_size = size + 2 * uv_size + a_size;
 
     // Security/sanity checks
-    output = (uint8_t*)WebPSafeMalloc(total_size, sizeof(*output));
+    output = (uint8_t*)WebPSafeMallocGlobal(total_size, sizeof(*output));
     if (output == NULL) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
     buffer->private_memory = output;
+    *allocated_size = total_size;
 
     if (!WebPIsRGBMode(mode)) {   // YUVA initialization
       WebPYUVABuffer* const buf = &buffer->u.YUVA;
@@ -169,21 +172,19 @@ VP8StatusCode WebPFlipBuffer(WebPDecBuffer* const buffer) {
   return VP8_STATUS_OK;
 }
 
-VP8StatusCode WebPAllocateDecBuffer(int w, int h,
-                                    const WebPDecoderOptions* const options,
-                                    WebPDecBuffer* const out) {
-  VP8StatusCode status;
-  if (out == NULL || w <= 0 || h <= 0) {
-    return VP8_STATUS_INVALID_PARAM;
-  }
-  if (options != NULL) {    // First, apply options if there is any.
+int WebPGetOutputDimensions(const WebPDecoderOptions* const options,
+                            int* const width, int* const height) {
+  int w = *width;
+  int h = *height;
+  if (w <= 0 || h <= 0) return 0;
+  if (options != NULL) {
     if (options->use_cropping) {
       const int cw = options->crop_width;
       const int ch = options->crop_height;
       const int x = options->crop_left & ~1;
       const int y = options->crop_top & ~1;
       if (x < 0 || y < 0 || cw <= 0 || ch <= 0 || x + cw > w || y + ch > h) {
-        return VP8_STATUS_INVALID_PARAM;   // out of frame boundary.
+        return 0;   // out of frame boundary.
       }
       w = cw;
       h = ch;
@@ -193,18 +194,50 @@ VP8StatusCode WebPAllocateDecBuffer(int w, int h,
       int scaled_height = options->scaled_height;
       if (!WebPRescalerGetScaledDimensions(
               w, h, &scaled_width, &scaled_height)) {
-        return VP8_STATUS_INVALID_PARAM;
+        return 0;
       }
       w = scaled_width;
       h = scaled_height;
     }
   }
+  *width = w;
+  *height = h;
+  return 1;
+}
+
+uint64_t WebPGetDecBufferSize(int width, int height,
+                              MV_WEBP_CSP_MODE colorspace) {
+  uint64_t size;
+  if (width <= 0 || height <= 0 || !IsValidColorspace(colorspace)) return 0;
+  size = (uint64_t)width * kModeBpp[colorspace] * height;
+  if (!WebPIsRGBMode(colorspace)) {
+    size += 2 * (uint64_t)((width + 1) / 2) * ((height + 1) / 2);
+    if (colorspace == MODE_YUVA) size += (uint64_t)width * height;
+  }
+  return size;
+}
+
+VP8StatusCode WebPAllocateDecBuffer(int w, int h,
+                                    const WebPDecoderOptions* const options,
+                                    WebPDecBuffer* const out) {
+  VP8StatusCode status;
+  uint64_t allocated_size = 0;
+  if (out == NULL) {
+    return VP8_STATUS_INVALID_PARAM;
+  }
+  // First, apply options if there is any.
+  if (!WebPGetOutputDimensions(options, &w, &h)) {
+    return VP8_STATUS_INVALID_PARAM;
+  }
   out->width = w;
   out->height = h;
 
   // Then, allocate buffer for real.
-  status = AllocateBuffer(out);
+  status = AllocateBuffer(out, &allocated_size);
   if (status != VP8_STATUS_OK) return status;
+  if (options != NULL && options->stats != NULL) {
+    options->stats->output_bytes += allocated_size;
+  }
 
   // Use the stride trick if vertical flip is needed.
   if (options != NULL && options->flip) {
@@ -228,7 +261,7 @@ int WebPInitDecBufferInternal(WebPDecBuffer* buffer, int version) {
 void WebPFreeDecBuffer(WebPDecBuffer* buffer) {
   if (buffer != NULL) {
     if (buffer->is_external_memory <= 0) {
-      WebPSafeFree(buffer->private_memory);
+      WebPSafeFreeGlobal(buffer->private_memory);
     }
     buffer->private_memory = NULL;
   }
@@ -150,6 +150,10 @@ const char* VP8StatusMessage(VP8Decoder* const dec);
 // Not a mandatory call between calls to VP8Decode().
 void VP8Clear(VP8Decoder* const dec);
 
+// Returns the decoder to the state of a new one, but keeps its working memory
+// for the next picture.
+void VP8Recycle(VP8Decoder* const dec);
+
 // Destroy the decoder object.
 void VP8Delete(VP8Decoder* const dec);
 
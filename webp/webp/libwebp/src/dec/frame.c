@@ -12,6 +12,7 @@
 // Author: Skal (pascal.massimino@gmail.com)
 
 #include <stdlib.h>
+#include "./alphai.h"
 #include "./vp8i.h"
 #include "../utils/utils.h"
 
@@ -78,6 +79,7 @@ static void ReconstructRow(const VP8Decoder* const dec,
   uint8_t* const u_dst = dec->yuv_b_ + U_OFF;
   uint8_t* const v_dst = dec->yuv_b_ + V_OFF;
 
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_RECONSTRUCT);
   // Initialize left-most block.
   for (j = 0; j < 16; ++j) {
     y_dst[j * BPS - 1] = 129;
@@ -188,6 +190,7 @@ static void ReconstructRow(const VP8Decoder* const dec,
       }
     }
   }
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_RECONSTRUCT);
 }
 
 //------------------------------------------------------------------------------
@@ -200,8 +203,8 @@ static void ReconstructRow(const VP8Decoder* const dec,
 //                 U/V, so it's 8 samples total (because of the 2x upsampling).
 static const uint8_t kFilterExtraRows[3] = { 0, 2, 8 };
 
-static void DoFilter(const VP8Decoder* const dec, int mb_x, int mb_y) {
-  const VP8ThreadContext* const ctx = &dec->thread_ctx_;
+static void DoFilter(const VP8Decoder* const dec,
+                     const VP8ThreadContext* const ctx, int mb_x, int mb_y) {
   const int cache_id = ctx->id_;
   const int y_bps = dec->cache_y_stride_;
   const VP8FInfo* const f_info = ctx->f_info_ + mb_x;
@@ -250,12 +253,13 @@ static void DoFilter(const VP8Decoder* const dec, int mb_x, int mb_y) {
 }
 
 // Filter the decoded macroblock row (if needed)
-static void FilterRow(const VP8Decoder* const dec) {
+static void FilterRow(const VP8Decoder* const dec,
+                      const VP8ThreadContext* const ctx) {
   int mb_x;
-  const int mb_y = dec->thread_ctx_.mb_y_;
-  assert(dec->thread_ctx_.filter_row_);
+  const int mb_y = ctx->mb_y_;
+  assert(ctx->filter_row_);
   for (mb_x = dec->tl_mb_x_; mb_x < dec->br_mb_x_; ++mb_x) {
-    DoFilter(dec, mb_x, mb_y);
+    DoFilter(dec, ctx, mb_x, mb_y);
   }
 }
 
@@ -369,11 +373,11 @@ static void Dither8x8(VP8Random* const rg, uint8_t* dst, int bps, int amp) {
   VP8DitherCombine8x8(dither, dst, bps);
 }
 
-static void DitherRow(VP8Decoder* const dec) {
+static void DitherRow(VP8Decoder* const dec,
+                      const VP8ThreadContext* const ctx) {
   int mb_x;
   assert(dec->dither_);
   for (mb_x = dec->tl_mb_x_; mb_x < dec->br_mb_x_; ++mb_x) {
-    const VP8ThreadContext* const ctx = &dec->thread_ctx_;
     const VP8MBData* const data = ctx->mb_data_ + mb_x;
     const int cache_id = ctx->id_;
     const int uv_bps = dec->cache_uv_stride_;
@@ -400,9 +404,9 @@ static void DitherRow(VP8Decoder* const dec) {
 #define MACROBLOCK_VPOS(mb_y)  ((mb_y) * 16)    // vertical position of a MB
 
 // Finalize and transmit a complete row. Return false in case of user-abort.
-static int FinishRow(VP8Decoder* const dec, VP8Io* const io) {
+static int FinishRow(VP8Decoder* const dec,
+                     const VP8ThreadContext* const ctx, VP8Io* const io) {
   int ok = 1;
-  const VP8ThreadContext* const ctx = &dec->thread_ctx_;
   const int cache_id = ctx->id_;
   const int extra_y_rows = kFilterExtraRows[dec->filter_type_];
   const int ysize = extra_y_rows * dec->cache_y_stride_;
@@ -420,13 +424,15 @@ static int FinishRow(VP8Decoder* const dec, VP8Io* const io) {
     ReconstructRow(dec, ctx);
   }
 
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_FILTER);
   if (ctx->filter_row_) {
-    FilterRow(dec);
+    FilterRow(dec, ctx);
   }
 
   if (dec->dither_) {
-    DitherRow(dec);
+    DitherRow(dec, ctx);
   }
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_FILTER);
 
   if (io->put != NULL) {
     int y_start = MACROBLOCK_VPOS(mb_y);
@@ -452,7 +458,9 @@ static int FinishRow(VP8Decoder* const dec, VP8Io* const io) {
     if (dec->alpha_data_ != NULL && y_start < y_end) {
       // TODO(skal): testing presence of alpha with dec->alpha_data_ is not a
       // good idea.
+      WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_ALPHA);
       io->a = VP8DecompressAlphaRows(dec, io, y_start, y_end - y_start);
+      WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_ALPHA);
       if (io->a == NULL) {
         return VP8SetError(dec, VP8_STATUS_BITSTREAM_ERROR,
                            "Could not decode alpha data.");
@@ -479,7 +487,9 @@ static int FinishRow(VP8Decoder* const dec, VP8Io* const io) {
       io->mb_y = y_start - io->crop_top;
       io->mb_w = io->crop_right - io->crop_left;
       io->mb_h = y_end - y_start;
+      WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_OUTPUT);
       ok = io->put(io);
+      WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_OUTPUT);
     }
   }
   // rotate top samples if needed
@@ -498,46 +508,80 @@ static int FinishRow(VP8Decoder* const dec, VP8Io* const io) {
 
 //------------------------------------------------------------------------------
 
+// Worker hook: finishes the queued rows until the ring is empty. Since only
+// the parser relaunches the worker, the 'rows_busy_' flag decides who of the
+// two is in charge of the rows queued while the worker was about to stop.
+static int FinishRows(VP8Decoder* const dec, void* dummy) {
+  int ok = 1;
+  (void)dummy;
+  while (1) {
+    const int tail = dec->rows_tail_;   // only written by this thread
+    if (tail == WebPAtomicLoad(&dec->rows_head_)) {
+      WebPAtomicStore(&dec->rows_busy_, 0);
+      if (tail == WebPAtomicLoad(&dec->rows_head_) ||
+          !WebPAtomicCompareAndSwap(&dec->rows_busy_, 0, 1)) {
+        break;    // the parser will launch us again for the next rows
+      }
+    } else {
+      VP8ThreadContext* const row = &dec->rows_[tail % dec->num_rows_];
+      // After an error, the remaining rows are only dropped.
+      if (ok && !FinishRow(dec, row, &row->io_)) {
+        WebPAtomicStore(&dec->rows_error_, 1);
+        ok = 0;
+      }
+      WebPAtomicStore(&dec->rows_tail_, tail + 1);
+    }
+  }
+  return ok;
+}
+
 int VP8ProcessRow(VP8Decoder* const dec, VP8Io* const io) {
   int ok = 1;
-  VP8ThreadContext* const ctx = &dec->thread_ctx_;
   const int filter_row =
       (dec->filter_type_ > 0) &&
       (dec->mb_y_ >= dec->tl_mb_y_) && (dec->mb_y_ <= dec->br_mb_y_);
   if (dec->mt_method_ == 0) {
+    VP8ThreadContext* const ctx = &dec->thread_ctx_;
     // ctx->id_ and ctx->f_info_ are already set
     ctx->mb_y_ = dec->mb_y_;
     ctx->filter_row_ = filter_row;
     ReconstructRow(dec, ctx);
-    ok = FinishRow(dec, io);
+    ok = FinishRow(dec, ctx, io);
   } else {
+    const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
     WebPWorker* const worker = &dec->worker_;
-    // Finish previous job *before* updating context
-    ok &= WebPGetWorkerInterface()->Sync(worker);
-    assert(worker->status_ == OK);
-    if (ok) {   // spawn a new deblocking/output job
-      ctx->io_ = *io;
-      ctx->id_ = dec->cache_id_;
-      ctx->mb_y_ = dec->mb_y_;
-      ctx->filter_row_ = filter_row;
-      if (dec->mt_method_ == 2) {  // swap macroblock data
-        VP8MBData* const tmp = ctx->mb_data_;
-        ctx->mb_data_ = dec->mb_data_;
-        dec->mb_data_ = tmp;
-      } else {
-        // perform reconstruction directly in main thread
-        ReconstructRow(dec, ctx);
-      }
-      if (filter_row) {            // swap filter info
-        VP8FInfo* const tmp = ctx->f_info_;
-        ctx->f_info_ = dec->f_info_;
-        dec->f_info_ = tmp;
-      }
-      // (reconstruct)+filter in parallel
-      WebPGetWorkerInterface()->Launch(worker);
-      if (++dec->cache_id_ == dec->num_caches_) {
-        dec->cache_id_ = 0;
-      }
+    VP8ThreadContext* row;
+    if (WebPAtomicLoad(&dec->rows_error_)) return 0;
+    if (dec->rows_head_ - WebPAtomicLoad(&dec->rows_tail_) == dec->num_rows_) {
+      // The ring is full: wait for the worker to drain it.
+      if (!winterface->Sync(worker)) return 0;
+    }
+    row = &dec->rows_[dec->rows_head_ % dec->num_rows_];
+    row->io_ = *io;
+    row->id_ = dec->cache_id_;
+    row->mb_y_ = dec->mb_y_;
+    row->filter_row_ = filter_row;
+    if (dec->mt_method_ == 2) {  // swap macroblock data
+      VP8MBData* const tmp = row->mb_data_;
+      row->mb_data_ = dec->mb_data_;
+      dec->mb_data_ = tmp;
+    } else {
+      // perform reconstruction directly in main thread
+      ReconstructRow(dec, row);
+    }
+    if (filter_row) {            // swap filter info
+      VP8FInfo* const tmp = row->f_info_;
+      row->f_info_ = dec->f_info_;
+      dec->f_info_ = tmp;
+    }
+    WebPAtomicStore(&dec->rows_head_, dec->rows_head_ + 1);
+    if (WebPAtomicCompareAndSwap(&dec->rows_busy_, 0, 1)) {
+      // The worker is idle, or about to be: (reconstruct)+filter in parallel.
+      ok = winterface->Sync(worker);
+      if (ok) winterface->Launch(worker);
+    }
+    if (++dec->cache_id_ == dec->num_caches_) {
+      dec->cache_id_ = 0;
     }
   }
   return ok;
@@ -636,9 +680,15 @@ int VP8ExitCritical(VP8Decoder* const dec, VP8Io* const io) {
 // and output process have non-concurrent writing:
 // Decode:  [ 0..15][16..31][ 0..15][16..31][...
 // io->put:         [ 0..15][16..31][ 0..15][...
+// These counts grow by one for each extra row the decoding thread is allowed
+// to queue ahead of the deblocking one (see 'num_rows_').
+// With mt_method_ = 2 however, reconstruction moves to the worker thread as
+// well, and the cache is not shared anymore: one cache line is enough.
 
 #define MT_CACHE_LINES 3
 #define ST_CACHE_LINES 1   // 1 cache row only for single-threaded case
+#define MT_DEFAULT_ROWS 4  // default depth of the rows ring
+#define MT_MAX_ROWS 32
 
 // Initialize multi/single-thread worker
 static int InitThreadContext(VP8Decoder* const dec) {
@@ -650,13 +700,23 @@ static int InitThreadContext(VP8Decoder* const dec) {
                          "thread initialization failed.");
     }
     worker->data1 = dec;
-    worker->data2 = (void*)&dec->thread_ctx_.io_;
-    worker->hook = (WebPWorkerHook)FinishRow;
-    dec->num_caches_ =
-      (dec->filter_type_ > 0) ? MT_CACHE_LINES : MT_CACHE_LINES - 1;
+    worker->data2 = NULL;
+    worker->hook = (WebPWorkerHook)FinishRows;
+    assert(dec->num_rows_ > 0);
+    if (dec->mt_method_ == 2) {
+      dec->num_caches_ = ST_CACHE_LINES;
+    } else {
+      dec->num_caches_ = dec->num_rows_ - 1 +
+          ((dec->filter_type_ > 0) ? MT_CACHE_LINES : MT_CACHE_LINES - 1);
+    }
   } else {
+    dec->num_rows_ = 0;
     dec->num_caches_ = ST_CACHE_LINES;
   }
+  dec->rows_head_ = 0;
+  dec->rows_tail_ = 0;
+  dec->rows_busy_ = 0;
+  dec->rows_error_ = 0;
   return 1;
 }
 
@@ -682,8 +742,51 @@ int VP8GetThreadMethod(const WebPDecoderOptions* const options,
 #endif
 }
 
+int VP8GetThreadRows(const WebPDecoderOptions* const options, int mt_method) {
+  int num_rows = MT_DEFAULT_ROWS;
+  if (mt_method == 0) return 0;
+  if (options != NULL && options->thread_rows > 0) {
+    num_rows = options->thread_rows;
+    if (num_rows > MT_MAX_ROWS) num_rows = MT_MAX_ROWS;
+  }
+  return num_rows;
+}
+
+uint64_t VP8PredictMemory(int width, int height, int has_alpha,
+                          const WebPDecoderOptions* const options) {
+  const int mt_method = VP8GetThreadMethod(options, NULL, width, height);
+  const int num_rows = VP8GetThreadRows(options, mt_method);
+  const int filter_type = 2;   // worst case: complex in-loop filter
+  const int num_caches = (mt_method == 1) ? num_rows - 1 + MT_CACHE_LINES
+                                          : ST_CACHE_LINES;
+  const uint64_t mb_w = (width + 15) >> 4;
+  const uint64_t top_size = sizeof(VP8TopSamples) * mb_w;
+  // Same layout as AllocateMemory() below.
+  uint64_t size = sizeof(VP8Decoder)
+                + 4 * mb_w * sizeof(uint8_t)
+                + top_size
+                + (mb_w + 1) * sizeof(VP8MB)
+                + mb_w * (1 + num_rows) * sizeof(VP8FInfo)
+                + YUV_SIZE * sizeof(uint8_t)
+                + num_rows * sizeof(VP8ThreadContext)
+                + (mt_method == 2 ? 1 + num_rows : 1) * mb_w * sizeof(VP8MBData)
+                + top_size * ((16 * num_caches + kFilterExtraRows[filter_type])
+                              * 3 / 2)
+                + WEBP_ALIGN_CST;
+  if (has_alpha) {
+    // The frame memory reserves one plane, to which the alpha decoder adds its
+    // own plane and the 8b pixels of its lossless stream (paletted alpha being
+    // what the encoder produces).
+    size += 3 * (uint64_t)width * height
+          + sizeof(MV_ALPHDecoder) + sizeof(VP8LDecoder);
+  }
+  return size;
+}
+
 #undef MT_CACHE_LINES
 #undef ST_CACHE_LINES
+#undef MT_DEFAULT_ROWS
+#undef MT_MAX_ROWS
 
 //------------------------------------------------------------------------------
 // Memory setup
@@ -695,13 +798,17 @@ static int AllocateMemory(VP8Decoder* const dec) {
   const size_t intra_pred_mode_size = 4 * mb_w * sizeof(uint8_t);
   const size_t top_size = sizeof(VP8TopSamples) * mb_w;
   const size_t mb_info_size = (mb_w + 1) * sizeof(VP8MB);
+  const int num_rows = dec->num_rows_;
+  // In the multi-threaded case, each entry of the rows ring owns a copy of the
+  // filter strengths and (with mt_method_ = 2) of the reconstruction data.
   const size_t f_info_size =
       (dec->filter_type_ > 0) ?
-          mb_w * (dec->mt_method_ > 0 ? 2 : 1) * sizeof(VP8FInfo)
+          mb_w * (1 + num_rows) * sizeof(VP8FInfo)
         : 0;
   const size_t yuv_size = YUV_SIZE * sizeof(*dec->yuv_b_);
+  const size_t rows_size = num_rows * sizeof(*dec->rows_);
   const size_t mb_data_size =
-      (dec->mt_method_ == 2 ? 2 : 1) * mb_w * sizeof(*dec->mb_data_);
+      (dec->mt_method_ == 2 ? 1 + num_rows : 1) * mb_w * sizeof(*dec->mb_data_);
   const size_t cache_height = (16 * num_caches
                             + kFilterExtraRows[dec->filter_type_]) * 3 / 2;
   const size_t cache_size = top_size * cache_height;
@@ -710,9 +817,10 @@ static int AllocateMemory(VP8Decoder* const dec) {
       (uint64_t)dec->pic_hdr_.width_ * dec->pic_hdr_.height_ : 0ULL;
   const uint64_t needed = (uint64_t)intra_pred_mode_size
                         + top_size + mb_info_size + f_info_size
-                        + yuv_size + mb_data_size
+                        + yuv_size + rows_size + mb_data_size
                         + cache_size + alpha_size + WEBP_ALIGN_CST;
   uint8_t* mem;
+  int i;
 
   if (needed != (size_t)needed) return 0;  // check for overflow
   if (needed > dec->mem_size_) {
@@ -741,25 +849,29 @@ static int AllocateMemory(VP8Decoder* const dec) {
   mem += f_info_size;
   dec->thread_ctx_.id_ = 0;
   dec->thread_ctx_.f_info_ = dec->f_info_;
-  if (dec->mt_method_ > 0) {
-    // secondary cache line. The deblocking process need to make use of the
-    // filtering strength from previous macroblock row, while the new ones
-    // are being decoded in parallel. We'll just swap the pointers.
-    dec->thread_ctx_.f_info_ += mb_w;
-  }
 
   mem = (uint8_t*)WEBP_ALIGN(mem);
   assert((yuv_size & WEBP_ALIGN_CST) == 0);
   dec->yuv_b_ = (uint8_t*)mem;
   mem += yuv_size;
 
+  dec->rows_ = num_rows ? (VP8ThreadContext*)mem : NULL;
+  mem += rows_size;
+
   dec->mb_data_ = (VP8MBData*)mem;
   dec->thread_ctx_.mb_data_ = (VP8MBData*)mem;
-  if (dec->mt_method_ == 2) {
-    dec->thread_ctx_.mb_data_ += mb_w;
-  }
   mem += mb_data_size;
 
+  // The deblocking process needs the filtering strengths of the queued rows,
+  // while the new ones are being decoded in parallel. The parser swaps its
+  // buffers with the ring entries.
+  for (i = 0; i < num_rows; ++i) {
+    VP8ThreadContext* const row = &dec->rows_[i];
+    row->f_info_ = f_info_size ? dec->f_info_ + (1 + i) * mb_w : NULL;
+    row->mb_data_ = (dec->mt_method_ == 2) ? dec->mb_data_ + (1 + i) * mb_w
+                                           : dec->mb_data_;
+  }
+
   dec->cache_y_stride_ = 16 * mb_w;
   dec->cache_uv_stride_ = 8 * mb_w;
   {
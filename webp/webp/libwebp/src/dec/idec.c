@@ -76,6 +76,11 @@ struct WebPIDecoder {
   size_t chunk_size_;      // Compressed VP8/VP8L size extracted from Header.
 
   int last_mb_y_;          // last row reached for intra-mode decoding
+
+  // Allocator of the working memory, or NULL for the default one.
+  const WebPMemoryAllocator* allocator_;
+  WebPMemoryCounter counter_;   // memory accounting, if stats are requested
+  WebPStageTimer timer_;        // stage times, if stats are requested
 };
 
 // MB context to restore in case VP8DecodeMB() fails
@@ -284,6 +289,10 @@ static void RestoreContext(const MBContext* context, VP8Decoder* const dec,
 static VP8StatusCode IDecError(WebPIDecoder* const idec, VP8StatusCode error) {
   if (idec->state_ == STATE_VP8_DATA) {
     VP8Io* const io = &idec->io_;
+    VP8Decoder* const dec = (VP8Decoder*)idec->dec_;
+    if (dec->mt_method_ > 0) {   // let the queued rows finish first
+      WebPGetWorkerInterface()->Sync(&dec->worker_);
+    }
     if (io->teardown != NULL) {
       io->teardown(io);
     }
@@ -313,7 +322,9 @@ static VP8StatusCode DecodeWebPHeaders(WebPIDecoder* const idec) {
   headers.data = data;
   headers.data_size = curr_size;
   headers.have_all_data = 0;
+  WEBP_TIMING_START(idec->params_.timer, WEBP_DEC_STAGE_HEADERS);
   status = WebPParseHeaders(&headers);
+  WEBP_TIMING_STOP(idec->params_.timer, WEBP_DEC_STAGE_HEADERS);
   if (status == VP8_STATUS_NOT_ENOUGH_DATA) {
     return VP8_STATUS_SUSPENDED;  // We haven't found a VP8 chunk yet.
   } else if (status != VP8_STATUS_OK) {
@@ -330,6 +341,7 @@ static VP8StatusCode DecodeWebPHeaders(WebPIDecoder* const idec) {
     idec->dec_ = dec;
     dec->alpha_data_ = headers.alpha_data;
     dec->alpha_data_size_ = headers.alpha_data_size;
+    dec->timer_ = idec->params_.timer;
     ChangeState(idec, STATE_VP8_HEADER, headers.offset);
   } else {
     VP8LDecoder* const dec = VP8LNew();
@@ -337,6 +349,7 @@ static VP8StatusCode DecodeWebPHeaders(WebPIDecoder* const idec) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
     idec->dec_ = dec;
+    dec->timer_ = idec->params_.timer;
     ChangeState(idec, STATE_VP8L_HEADER, headers.offset);
   }
   return VP8_STATUS_OK;
@@ -405,6 +418,7 @@ static VP8StatusCode DecodePartition0(WebPIDecoder* const idec) {
     return VP8_STATUS_SUSPENDED;
   }
 
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_HEADERS);
   if (!VP8GetHeaders(dec, io)) {
     const VP8StatusCode status = dec->status_;
     if (status == VP8_STATUS_SUSPENDED ||
@@ -414,6 +428,7 @@ static VP8StatusCode DecodePartition0(WebPIDecoder* const idec) {
     }
     return IDecError(idec, status);
   }
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_HEADERS);
 
   // Allocate/Verify output buffer now
   dec->status_ = WebPAllocateDecBuffer(io->width, io->height, params->options,
@@ -424,6 +439,7 @@ static VP8StatusCode DecodePartition0(WebPIDecoder* const idec) {
   // This change must be done before calling VP8InitFrame()
   dec->mt_method_ = VP8GetThreadMethod(params->options, NULL,
                                        io->width, io->height);
+  dec->num_rows_ = VP8GetThreadRows(params->options, dec->mt_method_);
   VP8InitDithering(params->options, dec);
 
   dec->status_ = CopyParts0Data(idec);
@@ -453,6 +469,7 @@ static VP8StatusCode DecodeRemaining(WebPIDecoder* const idec) {
 
   assert(dec->ready_);
   for (; dec->mb_y_ < dec->mb_h_; ++dec->mb_y_) {
+    WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_TOKENS);
     if (idec->last_mb_y_ != dec->mb_y_) {
       if (!VP8ParseIntraModeRow(&dec->br_, dec)) {
         // note: normally, error shouldn't occur since we already have the whole
@@ -468,12 +485,19 @@ static VP8StatusCode DecodeRemaining(WebPIDecoder* const idec) {
       MBContext context;
       SaveContext(dec, token_br, &context);
       if (!VP8DecodeMB(dec, token_br)) {
+        WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_TOKENS);
         // We shouldn't fail when MAX_MB data was available
         if (dec->num_parts_minus_one_ == 0 &&
             MemDataSize(&idec->mem_) > MAX_MB_SIZE) {
           return IDecError(idec, VP8_STATUS_BITSTREAM_ERROR);
         }
         RestoreContext(&context, dec, token_br);
+        // The rows queued to the worker thread read the input data, which
+        // can be moved or released before the next call: finish them first.
+        if (dec->mt_method_ > 0 &&
+            !WebPGetWorkerInterface()->Sync(&dec->worker_)) {
+          return IDecError(idec, VP8_STATUS_USER_ABORT);
+        }
         return VP8_STATUS_SUSPENDED;
       }
       // Release buffer only if there is only one partition
@@ -482,6 +506,7 @@ static VP8StatusCode DecodeRemaining(WebPIDecoder* const idec) {
         assert(idec->mem_.start_ <= idec->mem_.end_);
       }
     }
+    WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_TOKENS);
     VP8InitScanline(dec);   // Prepare for next scanline
 
     // Reconstruct, filter and emit the row.
@@ -519,6 +544,7 @@ static VP8StatusCode DecodeVP8LHeader(WebPIDecoder* const idec) {
     return ErrorStatusLossless(idec, dec->status_);
   }
 
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_HEADERS);
   if (!VP8LDecodeHeader(dec, io)) {
     if (dec->status_ == VP8_STATUS_BITSTREAM_ERROR &&
         curr_size < idec->chunk_size_) {
@@ -526,6 +552,7 @@ static VP8StatusCode DecodeVP8LHeader(WebPIDecoder* const idec) {
     }
     return ErrorStatusLossless(idec, dec->status_);
   }
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_HEADERS);
   // Allocate/verify output buffer now.
   dec->status_ = WebPAllocateDecBuffer(io->width, io->height, params->options,
                                        output);
@@ -630,7 +657,14 @@ WebPIDecoder* WebPIDecode(const uint8_t* data, size_t data_size,
   WebPBitstreamFeatures tmp_features;
   WebPBitstreamFeatures* const features =
       (config == NULL) ? &tmp_features : &config->input;
+  WebPMemoryCounter counter;
+  const WebPMemoryAllocator* const allocator = WebPGetDecodingAllocator(
+      (config == NULL) ? NULL : &config->options, &counter);
+  const WebPMemoryAllocator* previous;
   memset(&tmp_features, 0, sizeof(tmp_features));
+  if (config != NULL && config->num_extra_outputs > 0) {
+    return NULL;   // extra outputs are only supported by WebPDecode()
+  }
 
   // Parse the bitstream's features, if requested:
   if (data != NULL && data_size > 0) {
@@ -640,8 +674,10 @@ WebPIDecoder* WebPIDecode(const uint8_t* data, size_t data_size,
   }
 
   // Create an instance of the incremental decoder
+  previous = WebPPushThreadAllocator(allocator);
   idec = (config != NULL) ? NewDecoder(&config->output, features)
                           : NewDecoder(NULL, features);
+  WebPSetThreadAllocator(previous);
   if (idec == NULL) {
     return NULL;
   }
@@ -649,11 +685,20 @@ WebPIDecoder* WebPIDecode(const uint8_t* data, size_t data_size,
   if (config != NULL) {
     idec->params_.options = &config->options;
   }
+  if (allocator == &counter.allocator_) {
+    WebPMemoryCounterCopy(&counter, &idec->counter_);
+    idec->allocator_ = &idec->counter_.allocator_;
+    idec->params_.timer = &idec->timer_;
+  } else {
+    idec->allocator_ = allocator;
+  }
   return idec;
 }
 
 void WebPIDelete(WebPIDecoder* idec) {
+  const WebPMemoryAllocator* previous;
   if (idec == NULL) return;
+  previous = WebPPushThreadAllocator(idec->allocator_);
   if (idec->dec_ != NULL) {
     if (!idec->is_lossless_) {
       if (idec->state_ == STATE_VP8_DATA) {
@@ -668,6 +713,7 @@ void WebPIDelete(WebPIDecoder* idec) {
   ClearMemBuffer(&idec->mem_);
   WebPFreeDecBuffer(&idec->output_);
   WebPSafeFree(idec);
+  WebPSetThreadAllocator(previous);
 }
 
 //------------------------------------------------------------------------------
@@ -762,8 +808,17 @@ static VP8StatusCode IDecCheckStatus(const WebPIDecoder* const idec) {
   return VP8_STATUS_SUSPENDED;
 }
 
+// Reports the memory used and the stage times so far, if requested.
+static void SetStats(const WebPIDecoder* const idec) {
+  if (idec->allocator_ == &idec->counter_.allocator_) {
+    WebPSetDecodingStats(idec->params_.options, &idec->counter_,
+                         &idec->timer_);
+  }
+}
+
 VP8StatusCode WebPIAppend(WebPIDecoder* idec,
                           const uint8_t* data, size_t data_size) {
+  const WebPMemoryAllocator* previous;
   VP8StatusCode status;
   if (idec == NULL || data == NULL) {
     return VP8_STATUS_INVALID_PARAM;
@@ -776,15 +831,18 @@ VP8StatusCode WebPIAppend(WebPIDecoder* idec,
   if (!CheckMemBufferMode(&idec->mem_, MEM_MODE_APPEND)) {
     return VP8_STATUS_INVALID_PARAM;
   }
+  previous = WebPPushThreadAllocator(idec->allocator_);
   // Append data to memory buffer
-  if (!AppendToMemBuffer(idec, data, data_size)) {
-    return VP8_STATUS_OUT_OF_MEMORY;
-  }
-  return IDecode(idec);
+  status = AppendToMemBuffer(idec, data, data_size) ? IDecode(idec)
+                                                    : VP8_STATUS_OUT_OF_MEMORY;
+  WebPSetThreadAllocator(previous);
+  SetStats(idec);
+  return status;
 }
 
 VP8StatusCode WebPIUpdate(WebPIDecoder* idec,
                           const uint8_t* data, size_t data_size) {
+  const WebPMemoryAllocator* previous;
   VP8StatusCode status;
   if (idec == NULL || data == NULL) {
     return VP8_STATUS_INVALID_PARAM;
@@ -797,11 +855,13 @@ VP8StatusCode WebPIUpdate(WebPIDecoder* idec,
   if (!CheckMemBufferMode(&idec->mem_, MEM_MODE_MAP)) {
     return VP8_STATUS_INVALID_PARAM;
   }
+  previous = WebPPushThreadAllocator(idec->allocator_);
   // Make the memory buffer point to the new buffer
-  if (!RemapMemBuffer(idec, data, data_size)) {
-    return VP8_STATUS_INVALID_PARAM;
-  }
-  return IDecode(idec);
+  status = RemapMemBuffer(idec, data, data_size) ? IDecode(idec)
+                                                 : VP8_STATUS_INVALID_PARAM;
+  WebPSetThreadAllocator(previous);
+  SetStats(idec);
+  return status;
 }
 
 //------------------------------------------------------------------------------
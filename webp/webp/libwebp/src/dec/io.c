@@ -583,6 +583,32 @@ static int CustomSetup(VP8Io* io) {
   return 1;
 }
 
+uint64_t WebPPredictCustomIoMemory(int width, int scaled_width,
+                                   int fancy_upsampling,
+                                   MV_WEBP_CSP_MODE colorspace) {
+  const int is_rgb = WebPIsRGBMode(colorspace);
+  const int has_alpha = WebPIsAlphaMode(colorspace);
+  if (scaled_width > 0) {
+    const uint64_t work_size = 2 * (uint64_t)scaled_width;
+    if (is_rgb) {   // see InitRGBRescaler()
+      return (3 + has_alpha) * (work_size * sizeof(rescaler_t)
+                                + (uint64_t)scaled_width);
+    } else {        // see InitYUVRescaler()
+      const uint64_t uv_work_size = 2 * (uint64_t)((scaled_width + 1) >> 1);
+      return (work_size * (1 + has_alpha) + 2 * uv_work_size)
+             * sizeof(rescaler_t);
+    }
+  }
+#ifdef FANCY_UPSAMPLING
+  if (is_rgb && fancy_upsampling) {
+    return (uint64_t)width + 2 * ((width + 1) >> 1);
+  }
+#endif
+  (void)width;
+  (void)fancy_upsampling;
+  return 0;
+}
+
 //------------------------------------------------------------------------------
 
 static int CustomPut(const VP8Io* io) {
@@ -611,13 +637,102 @@ static void CustomTeardown(const VP8Io* io) {
   p->memory = NULL;
 }
 
+//------------------------------------------------------------------------------
+// Multiple outputs
+//
+// The decoder produces the bounding box of all the crop windows, and each
+// output gets its own view of the rows, processed by the hooks above.
+
+static void MultiTeardown(const VP8Io* io) {
+  WebPDecParams* const p = (WebPDecParams*)io->opaque;
+  int i;
+  for (i = 0; i < p->num_extra_outputs; ++i) {
+    WebPDecParams* const extra = &p->extra_outputs[i].params;
+    WebPSafeFree(extra->memory);
+    extra->memory = NULL;
+  }
+  WebPSafeFree(p->views);
+  p->views = NULL;
+  CustomTeardown(io);
+}
+
+static int MultiSetup(VP8Io* io) {
+  WebPDecParams* const p = (WebPDecParams*)io->opaque;
+  const int num_views = 1 + p->num_extra_outputs;
+  int left = io->width, top = io->height, right = 0, bottom = 0;
+  int bypass_filtering = 1;
+  int i;
+
+  p->views = (VP8Io*)WebPSafeMalloc(num_views, sizeof(*p->views));
+  if (p->views == NULL) {
+    return 0;   // memory error
+  }
+  for (i = 0; i < num_views; ++i) {
+    VP8Io* const view = &p->views[i];
+    *view = *io;
+    view->opaque = (i == 0) ? (void*)p : (void*)&p->extra_outputs[i - 1].params;
+    if (!CustomSetup(view)) {
+      MultiTeardown(io);   // not called by the decoder after a failed setup
+      return 0;
+    }
+    if (view->crop_left < left) left = view->crop_left;
+    if (view->crop_top < top) top = view->crop_top;
+    if (view->crop_right > right) right = view->crop_right;
+    if (view->crop_bottom > bottom) bottom = view->crop_bottom;
+    bypass_filtering &= view->bypass_filtering;
+  }
+  io->use_cropping = 1;
+  io->crop_left = left;
+  io->crop_top = top;
+  io->crop_right = right;
+  io->crop_bottom = bottom;
+  io->mb_w = right - left;
+  io->mb_h = bottom - top;
+  io->use_scaling = 0;
+  io->bypass_filtering = bypass_filtering;
+  io->fancy_upsampling = 0;
+  return 1;
+}
+
+static int MultiPut(const VP8Io* io) {
+  WebPDecParams* const p = (WebPDecParams*)io->opaque;
+  const int y_start = io->crop_top + io->mb_y;
+  const int y_end = y_start + io->mb_h;
+  int i;
+  for (i = 0; i <= p->num_extra_outputs; ++i) {
+    VP8Io* const view = &p->views[i];
+    const int top = (y_start > view->crop_top) ? y_start : view->crop_top;
+    const int bottom = (y_end < view->crop_bottom) ? y_end : view->crop_bottom;
+    if (top < bottom) {
+      // Crop windows are snapped to even positions: chroma offsets are exact.
+      const int dx = view->crop_left - io->crop_left;
+      const int dy = top - y_start;
+      assert(!(dx & 1) && !(dy & 1));
+      view->y = io->y + dy * io->y_stride + dx;
+      view->u = io->u + (dy >> 1) * io->uv_stride + (dx >> 1);
+      view->v = io->v + (dy >> 1) * io->uv_stride + (dx >> 1);
+      view->a = (io->a != NULL) ? io->a + dy * io->width + dx : NULL;
+      view->y_stride = io->y_stride;
+      view->uv_stride = io->uv_stride;
+      view->mb_y = top - view->crop_top;
+      view->mb_w = view->crop_right - view->crop_left;
+      view->mb_h = bottom - top;
+      if (!CustomPut(view)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
 //------------------------------------------------------------------------------
 // Main entry point
 
 void WebPInitCustomIo(WebPDecParams* const params, VP8Io* const io) {
-  io->put      = CustomPut;
-  io->setup    = CustomSetup;
-  io->teardown = CustomTeardown;
+  const int multi = (params != NULL && params->num_extra_outputs > 0);
+  io->put      = multi ? MultiPut : CustomPut;
+  io->setup    = multi ? MultiSetup : CustomSetup;
+  io->teardown = multi ? MultiTeardown : CustomTeardown;
   io->opaque   = params;
 }
 
@@ -587,6 +587,7 @@ static int ParseFrame(VP8Decoder* const dec, VP8Io* io) {
     // Parse bitstream for this row.
     VP8BitReader* const token_br =
         &dec->parts_[dec->mb_y_ & dec->num_parts_minus_one_];
+    WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_TOKENS);
     if (!VP8ParseIntraModeRow(&dec->br_, dec)) {
       return VP8SetError(dec, VP8_STATUS_NOT_ENOUGH_DATA,
                          "Premature end-of-partition0 encountered.");
@@ -597,6 +598,7 @@ static int ParseFrame(VP8Decoder* const dec, VP8Io* io) {
                            "Premature end-of-file encountered.");
       }
     }
+    WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_TOKENS);
     VP8InitScanline(dec);   // Prepare for next scanline
 
     // Reconstruct, filter and emit the row.
@@ -664,4 +666,16 @@ void VP8Clear(VP8Decoder* const dec) {
   dec->ready_ = 0;
 }
 
+void VP8Recycle(VP8Decoder* const dec) {
+  void* const mem = dec->mem_;
+  const size_t mem_size = dec->mem_size_;
+  WebPGetWorkerInterface()->End(&dec->worker_);
+  WebPDeallocateAlphaMemory(dec);
+  memset(dec, 0, sizeof(*dec));
+  SetOk(dec);
+  WebPGetWorkerInterface()->Init(&dec->worker_);
+  dec->mem_ = mem;
+  dec->mem_size_ = mem_size;
+}
+
 //------------------------------------------------------------------------------
@@ -164,7 +164,7 @@ typedef struct {
 
 // Persistent information needed by the parallel processing
 typedef struct {
-  int id_;              // cache row to process (in [0..2])
+  int id_;              // cache row to process (in [0..num_caches_-1])
   int mb_y_;            // macroblock position of the row
   int filter_row_;      // true if row-filtering is needed
   VP8FInfo* f_info_;    // filter strengths (swapped with dec->f_info_)
@@ -199,8 +199,16 @@ struct VP8Decoder {
   int mt_method_;      // multi-thread method: 0=off, 1=[parse+recon][filter]
                        // 2=[parse][recon+filter]
   int cache_id_;       // current cache row
-  int num_caches_;     // number of cached rows of 16 pixels (1, 2 or 3)
-  VP8ThreadContext thread_ctx_;  // Thread context
+  int num_caches_;     // number of cached rows of 16 pixels
+  VP8ThreadContext thread_ctx_;  // Thread context (single-threaded case)
+  // Multi-threaded case: the parsed rows are handed over to the worker through
+  // a lock-free single-producer / single-consumer ring of 'num_rows_' entries.
+  VP8ThreadContext* rows_;
+  int num_rows_;
+  volatile int rows_head_;   // number of rows queued (written by the parser)
+  volatile int rows_tail_;   // number of rows finished (written by the worker)
+  volatile int rows_busy_;   // true while the worker drains the ring
+  volatile int rows_error_;  // set by the worker when a row failed
 
   // dimension, in macroblock units.
   int mb_w_, mb_h_;
@@ -263,6 +271,8 @@ struct VP8Decoder {
   uint8_t* alpha_plane_;      // output. Persistent, contains the whole data.
   const uint8_t* alpha_prev_line_;  // last decoded alpha row (or NULL)
   int alpha_dithering_;       // derived from decoding options (0=off, 100=full)
+
+  WebPStageTimer* timer_;     // if not NULL, records the stage times
 };
 
 //------------------------------------------------------------------------------
@@ -296,6 +306,13 @@ int VP8ExitCritical(VP8Decoder* const dec, VP8Io* const io);
 int VP8GetThreadMethod(const WebPDecoderOptions* const options,
                        const WebPHeaderStructure* const headers,
                        int width, int height);
+// Return the number of rows the parser can queue ahead of the worker thread,
+// for the given multi-threading method (0 if it is off).
+int VP8GetThreadRows(const WebPDecoderOptions* const options, int mt_method);
+// Returns an estimate of the peak memory used to decode a 'width' x 'height'
+// frame (output excluded).
+uint64_t VP8PredictMemory(int width, int height, int has_alpha,
+                          const WebPDecoderOptions* const options);
 // Initialize dithering post-process if needed.
 void VP8InitDithering(const WebPDecoderOptions* const options,
                       VP8Decoder* const dec);
@@ -481,6 +481,48 @@ static int ReadHuffmanCodes(VP8LDecoder* const dec, int xsize, int ysize,
   return 0;
 }
 
+//------------------------------------------------------------------------------
+// Memory prediction.
+
+// The number of Huffman groups is only known from the bitstream. Once
+// clustered, the encoder seldom produces more than a few dozen of them.
+#define PREDICTED_NUM_GROUPS 16
+
+// see AllocateAndInitRescaler()
+static uint64_t PredictRescalerMemory(int scaled_width) {
+  if (scaled_width <= 0) return 0;
+  return sizeof(WebPRescaler)
+       + 2 * 4 * (uint64_t)scaled_width * sizeof(rescaler_t)
+       + (uint64_t)scaled_width * sizeof(uint32_t);
+}
+
+uint64_t VP8LPredictMemory(int width, int height, int scaled_width) {
+  const uint64_t num_pixels = (uint64_t)width * height;
+  uint64_t size = sizeof(VP8LDecoder)
+                // pixels_ and argb_cache_, see AllocateInternalBuffers32b()
+                + (num_pixels + width + (uint64_t)width * NUM_ARGB_CACHE_ROWS)
+                  * sizeof(uint32_t)
+                // Huffman tables, with the largest color cache
+                + PREDICTED_NUM_GROUPS
+                  * (kTableSize[MAX_CACHE_BITS] * sizeof(HuffmanCode)
+                     + sizeof(HTreeGroup))
+                // predictor and cross-color data, the encoder sub-sampling
+                // them by 8x8 at least unless the image is tiny
+                + 2 * (num_pixels / 64) * sizeof(uint32_t);
+  return size + PredictRescalerMemory(scaled_width);
+}
+
+uint64_t VP8LPredictExtraOutputMemory(int width, int scaled_width) {
+  uint64_t size = sizeof(VP8LOutput);
+  if (scaled_width > 0) {   // see InitExtraOutputs()
+    size += PredictRescalerMemory(scaled_width)
+          + (uint64_t)width * NUM_ARGB_CACHE_ROWS * sizeof(uint32_t);
+  }
+  return size;
+}
+
+#undef PREDICTED_NUM_GROUPS
+
 //------------------------------------------------------------------------------
 // Scaling.
 
@@ -714,48 +756,102 @@ static void ApplyInverseTransforms(VP8LDecoder* const dec, int num_rows,
   }
 }
 
+// Exchanges the output state of 'dec' with the one of an extra output.
+static void SwapOutput(VP8LDecoder* const dec, VP8LOutput* const out) {
+  const WebPDecBuffer* const output = dec->output_;
+  uint8_t* const rescaler_memory = dec->rescaler_memory;
+  WebPRescaler* const rescaler = dec->rescaler;
+  const int last_out_row = dec->last_out_row_;
+  dec->output_ = out->output_;
+  dec->rescaler_memory = out->rescaler_memory;
+  dec->rescaler = out->rescaler;
+  dec->last_out_row_ = out->last_out_row_;
+  out->output_ = output;
+  out->rescaler_memory = rescaler_memory;
+  out->rescaler = rescaler;
+  out->last_out_row_ = last_out_row;
+}
+
+// Last row needed by the main output and the extra ones.
+static int GetLastRow(const VP8LDecoder* const dec) {
+  int last_row = dec->io_->crop_bottom;
+  int i;
+  for (i = 0; i < dec->num_extra_outputs_; ++i) {
+    const int crop_bottom = dec->extra_outputs_[i].io_.crop_bottom;
+    if (crop_bottom > last_row) last_row = crop_bottom;
+  }
+  return last_row;
+}
+
+// Scales & color-converts the transformed 'rows' up to 'row' into dec->output_,
+// according to the crop and scaling of 'io'.
+static void EmitOutputRows(VP8LDecoder* const dec, VP8Io* const io, int row,
+                           uint32_t* const rows) {
+  uint8_t* rows_data = (uint8_t*)rows;
+  const int in_stride = io->width * sizeof(uint32_t);  // in unit of RGBA
+  if (!SetCropWindow(io, dec->last_row_, row, &rows_data, in_stride)) {
+    // Nothing to output (this time).
+  } else {
+    const WebPDecBuffer* const output = dec->output_;
+    if (WebPIsRGBMode(output->colorspace)) {  // convert to RGBA
+      const WebPRGBABuffer* const buf = &output->u.RGBA;
+      uint8_t* const rgba = buf->rgba + dec->last_out_row_ * buf->stride;
+      const int num_rows_out = io->use_scaling ?
+          EmitRescaledRowsRGBA(dec, rows_data, in_stride, io->mb_h,
+                               rgba, buf->stride) :
+          EmitRows(output->colorspace, rows_data, in_stride,
+                   io->mb_w, io->mb_h, rgba, buf->stride);
+      // Update 'last_out_row_'.
+      dec->last_out_row_ += num_rows_out;
+    } else {                              // convert to YUVA
+      dec->last_out_row_ = io->use_scaling ?
+          EmitRescaledRowsYUVA(dec, rows_data, in_stride, io->mb_h) :
+          EmitRowsYUVA(dec, rows_data, in_stride, io->mb_w, io->mb_h);
+    }
+    assert(dec->last_out_row_ <= output->height);
+  }
+}
+
 // Processes (transforms, scales & color-converts) the rows decoded after the
 // last call.
 static void ProcessRows(VP8LDecoder* const dec, int row) {
   const uint32_t* const rows = dec->pixels_ + dec->width_ * dec->last_row_;
   const int num_rows = row - dec->last_row_;
 
-  assert(row <= dec->io_->crop_bottom);
+  // Called from DecodeImageData(), whose timing is paused meanwhile.
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_ENTROPY);
+  assert(row <= GetLastRow(dec));
   // We can't process more than NUM_ARGB_CACHE_ROWS at a time (that's the size
   // of argb_cache_), but we currently don't need more than that.
   assert(num_rows <= NUM_ARGB_CACHE_ROWS);
   if (num_rows > 0) {    // Emit output.
-    VP8Io* const io = dec->io_;
-    uint8_t* rows_data = (uint8_t*)dec->argb_cache_;
-    const int in_stride = io->width * sizeof(uint32_t);  // in unit of RGBA
-
+    int i;
+    WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_TRANSFORMS);
     ApplyInverseTransforms(dec, num_rows, rows);
-    if (!SetCropWindow(io, dec->last_row_, row, &rows_data, in_stride)) {
-      // Nothing to output (this time).
-    } else {
-      const WebPDecBuffer* const output = dec->output_;
-      if (WebPIsRGBMode(output->colorspace)) {  // convert to RGBA
-        const WebPRGBABuffer* const buf = &output->u.RGBA;
-        uint8_t* const rgba = buf->rgba + dec->last_out_row_ * buf->stride;
-        const int num_rows_out = io->use_scaling ?
-            EmitRescaledRowsRGBA(dec, rows_data, in_stride, io->mb_h,
-                                 rgba, buf->stride) :
-            EmitRows(output->colorspace, rows_data, in_stride,
-                     io->mb_w, io->mb_h, rgba, buf->stride);
-        // Update 'last_out_row_'.
-        dec->last_out_row_ += num_rows_out;
-      } else {                              // convert to YUVA
-        dec->last_out_row_ = io->use_scaling ?
-            EmitRescaledRowsYUVA(dec, rows_data, in_stride, io->mb_h) :
-            EmitRowsYUVA(dec, rows_data, in_stride, io->mb_w, io->mb_h);
+    WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_TRANSFORMS);
+    WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_OUTPUT);
+    // Rescaling premultiplies the rows in place: the extra outputs rescale a
+    // copy of them, and the main output comes last.
+    for (i = 0; i < dec->num_extra_outputs_; ++i) {
+      VP8LOutput* const out = &dec->extra_outputs_[i];
+      uint32_t* out_rows = dec->argb_cache_;
+      if (out->argb_copy_ != NULL) {
+        memcpy(out->argb_copy_, dec->argb_cache_,
+               (size_t)dec->width_ * num_rows * sizeof(*out_rows));
+        out_rows = out->argb_copy_;
       }
-      assert(dec->last_out_row_ <= output->height);
+      SwapOutput(dec, out);
+      EmitOutputRows(dec, &out->io_, row, out_rows);
+      SwapOutput(dec, out);
     }
+    EmitOutputRows(dec, dec->io_, row, dec->argb_cache_);
+    WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_OUTPUT);
   }
 
   // Update 'last_row_'.
   dec->last_row_ = row;
   assert(dec->last_row_ <= dec->height_);
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_ENTROPY);
 }
 
 // Row-processing for the special case when alpha data contains only one
@@ -1311,6 +1407,7 @@ void VP8LClear(VP8LDecoder* const dec) {
 
   WebPSafeFree(dec->pixels_);
   dec->pixels_ = NULL;
+  dec->pixels_size_ = 0;
   for (i = 0; i < dec->next_transform_; ++i) {
     ClearTransform(&dec->transforms_[i]);
   }
@@ -1319,10 +1416,29 @@ void VP8LClear(VP8LDecoder* const dec) {
 
   WebPSafeFree(dec->rescaler_memory);
   dec->rescaler_memory = NULL;
+  for (i = 0; i < dec->num_extra_outputs_; ++i) {
+    WebPSafeFree(dec->extra_outputs_[i].rescaler_memory);
+    WebPSafeFree(dec->extra_outputs_[i].argb_copy_);
+  }
+  WebPSafeFree(dec->extra_outputs_);
+  dec->extra_outputs_ = NULL;
+  dec->num_extra_outputs_ = 0;
 
   dec->output_ = NULL;   // leave no trace behind
 }
 
+void VP8LRecycle(VP8LDecoder* const dec) {
+  uint32_t* const pixels = dec->pixels_;
+  const size_t pixels_size = dec->pixels_size_;
+  dec->pixels_ = NULL;   // kept for the next picture
+  VP8LClear(dec);
+  memset(dec, 0, sizeof(*dec));
+  dec->status_ = VP8_STATUS_OK;
+  dec->state_ = READ_DIM;
+  dec->pixels_ = pixels;
+  dec->pixels_size_ = pixels_size;
+}
+
 void VP8LDelete(VP8LDecoder* const dec) {
   if (dec != NULL) {
     VP8LClear(dec);
@@ -1430,6 +1546,24 @@ static int DecodeImageStream(int xsize, int ysize,
 }
 
 //------------------------------------------------------------------------------
+// Makes dec->pixels_ hold 'num_elements' of 'element_size' bytes. The buffer
+// kept by VP8LRecycle() is re-used if it is large enough.
+static int AllocatePixels(VP8LDecoder* const dec, uint64_t num_elements,
+                          size_t element_size) {
+  const uint64_t size = num_elements * element_size;
+  if (dec->pixels_ == NULL || size > dec->pixels_size_) {
+    WebPSafeFree(dec->pixels_);
+    dec->pixels_size_ = 0;
+    dec->pixels_ = (uint32_t*)WebPSafeMalloc(num_elements, element_size);
+    if (dec->pixels_ == NULL) {
+      dec->status_ = VP8_STATUS_OUT_OF_MEMORY;
+      return 0;
+    }
+    dec->pixels_size_ = (size_t)size;
+  }
+  return 1;
+}
+
 // Allocate internal buffers dec->pixels_ and dec->argb_cache_.
 static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
   const uint64_t num_pixels = (uint64_t)dec->width_ * dec->height_;
@@ -1442,10 +1576,8 @@ static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
       num_pixels + cache_top_pixels + cache_pixels;
 
   assert(dec->width_ <= final_width);
-  dec->pixels_ = (uint32_t*)WebPSafeMalloc(total_num_pixels, sizeof(uint32_t));
-  if (dec->pixels_ == NULL) {
+  if (!AllocatePixels(dec, total_num_pixels, sizeof(uint32_t))) {
     dec->argb_cache_ = NULL;    // for sanity check
-    dec->status_ = VP8_STATUS_OUT_OF_MEMORY;
     return 0;
   }
   dec->argb_cache_ = dec->pixels_ + num_pixels + cache_top_pixels;
@@ -1455,12 +1587,7 @@ static int AllocateInternalBuffers32b(VP8LDecoder* const dec, int final_width) {
 static int AllocateInternalBuffers8b(VP8LDecoder* const dec) {
   const uint64_t total_num_pixels = (uint64_t)dec->width_ * dec->height_;
   dec->argb_cache_ = NULL;    // for sanity check
-  dec->pixels_ = (uint32_t*)WebPSafeMalloc(total_num_pixels, sizeof(uint8_t));
-  if (dec->pixels_ == NULL) {
-    dec->status_ = VP8_STATUS_OUT_OF_MEMORY;
-    return 0;
-  }
-  return 1;
+  return AllocatePixels(dec, total_num_pixels, sizeof(uint8_t));
 }
 
 //------------------------------------------------------------------------------
@@ -1591,6 +1718,59 @@ int VP8LDecodeHeader(VP8LDecoder* const dec, VP8Io* const io) {
   return 0;
 }
 
+// Initializes the dsp functions needed to emit rows into 'output'.
+static void InitOutputDsp(const WebPDecBuffer* const output,
+                          const VP8Io* const io) {
+  if (io->use_scaling || WebPIsPremultipliedMode(output->colorspace)) {
+    // need the alpha-multiply functions for premultiplied output or rescaling
+    WebPInitAlphaProcessing();
+  }
+  if (!WebPIsRGBMode(output->colorspace)) {
+    WebPInitConvertARGBToYUV();
+    if (output->u.YUVA.a != NULL) WebPInitAlphaProcessing();
+  }
+}
+
+// Sets up the crop, scaling and rescaler of the extra outputs of 'params'.
+static int InitExtraOutputs(VP8LDecoder* const dec,
+                            const WebPDecParams* const params) {
+  const int num_outputs = params->num_extra_outputs;
+  int i;
+  assert(dec->extra_outputs_ == NULL);
+  dec->extra_outputs_ =
+      (VP8LOutput*)WebPSafeCalloc(num_outputs, sizeof(*dec->extra_outputs_));
+  if (dec->extra_outputs_ == NULL) {
+    dec->status_ = VP8_STATUS_OUT_OF_MEMORY;
+    return 0;
+  }
+  dec->num_extra_outputs_ = num_outputs;
+  for (i = 0; i < num_outputs; ++i) {
+    VP8LOutput* const out = &dec->extra_outputs_[i];
+    const WebPDecOutput* const extra = &params->extra_outputs[i];
+    out->output_ = extra->params.output;
+    out->io_ = *dec->io_;
+    if (!WebPIoInitFromOptions(&extra->options, &out->io_, MODE_BGRA)) {
+      dec->status_ = VP8_STATUS_INVALID_PARAM;
+      return 0;
+    }
+    if (out->io_.use_scaling) {
+      int ok;
+      SwapOutput(dec, out);
+      ok = AllocateAndInitRescaler(dec, &out->io_);
+      SwapOutput(dec, out);
+      if (!ok) return 0;
+      out->argb_copy_ = (uint32_t*)WebPSafeMalloc(
+          (uint64_t)dec->width_ * NUM_ARGB_CACHE_ROWS, sizeof(uint32_t));
+      if (out->argb_copy_ == NULL) {
+        dec->status_ = VP8_STATUS_OUT_OF_MEMORY;
+        return 0;
+      }
+    }
+    InitOutputDsp(out->output_, &out->io_);
+  }
+  return 1;
+}
+
 int VP8LDecodeImage(VP8LDecoder* const dec) {
   VP8Io* io = NULL;
   WebPDecParams* params = NULL;
@@ -1620,14 +1800,10 @@ int VP8LDecodeImage(VP8LDecoder* const dec) {
     if (!AllocateInternalBuffers32b(dec, io->width)) goto Err;
 
     if (io->use_scaling && !AllocateAndInitRescaler(dec, io)) goto Err;
+    InitOutputDsp(dec->output_, io);
 
-    if (io->use_scaling || WebPIsPremultipliedMode(dec->output_->colorspace)) {
-      // need the alpha-multiply functions for premultiplied output or rescaling
-      WebPInitAlphaProcessing();
-    }
-    if (!WebPIsRGBMode(dec->output_->colorspace)) {
-      WebPInitConvertARGBToYUV();
-      if (dec->output_->u.YUVA.a != NULL) WebPInitAlphaProcessing();
+    if (params->num_extra_outputs > 0 && !InitExtraOutputs(dec, params)) {
+      goto Err;
     }
     if (dec->incremental_) {
       if (dec->hdr_.color_cache_size_ > 0 &&
@@ -1643,12 +1819,21 @@ int VP8LDecodeImage(VP8LDecoder* const dec) {
   }
 
   // Decode.
+  WEBP_TIMING_START(dec->timer_, WEBP_DEC_STAGE_ENTROPY);
   if (!DecodeImageData(dec, dec->pixels_, dec->width_, dec->height_,
-                       io->crop_bottom, ProcessRows)) {
+                       GetLastRow(dec), ProcessRows)) {
     goto Err;
   }
+  WEBP_TIMING_STOP(dec->timer_, WEBP_DEC_STAGE_ENTROPY);
 
   params->last_y = dec->last_out_row_;
+  {
+    int i;
+    for (i = 0; i < dec->num_extra_outputs_; ++i) {
+      params->extra_outputs[i].params.last_y =
+          dec->extra_outputs_[i].last_out_row_;
+    }
+  }
   return 1;
 
  Err:
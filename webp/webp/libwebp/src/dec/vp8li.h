@@ -54,6 +54,17 @@ typedef struct {
   HuffmanCode    *huffman_tables_;
 } VP8LMetadata;
 
+// State of an extra output, swapped with the decoder's own one while emitting
+// its rows (see ProcessRows()).
+typedef struct {
+  const WebPDecBuffer *output_;
+  VP8Io            io_;              // crop & scaling of this output
+  uint8_t         *rescaler_memory;
+  WebPRescaler    *rescaler;
+  int              last_out_row_;
+  uint32_t        *argb_copy_;       // if rescaling, copy of the rows to emit
+} VP8LOutput;
+
 typedef struct VP8LDecoder VP8LDecoder;
 struct VP8LDecoder {
   VP8StatusCode    status_;
@@ -64,6 +75,7 @@ struct VP8LDecoder {
 
   uint32_t        *pixels_;        // Internal data: either uint8_t* for alpha
                                    // or uint32_t* for BGRA.
+  size_t           pixels_size_;   // allocated size of pixels_, in bytes
   uint32_t        *argb_cache_;    // Scratch buffer for temporary BGRA storage.
 
   VP8LBitReader    br_;
@@ -88,6 +100,11 @@ struct VP8LDecoder {
 
   uint8_t         *rescaler_memory;  // Working memory for rescaling work.
   WebPRescaler    *rescaler;         // Common rescaler for all channels.
+
+  WebPStageTimer  *timer_;         // if not NULL, records the stage times
+
+  VP8LOutput      *extra_outputs_;   // more outputs fed with the same rows
+  int              num_extra_outputs_;
 };
 
 //------------------------------------------------------------------------------
@@ -123,9 +140,21 @@ int VP8LDecodeImage(VP8LDecoder* const dec);
 // Preserves the dec->status_ value.
 void VP8LClear(VP8LDecoder* const dec);
 
+// Returns the decoder to the state of a new one, without reallocating it. The
+// pixel buffer is kept, to be re-used by the next picture if large enough.
+void VP8LRecycle(VP8LDecoder* const dec);
+
 // Clears and deallocate a lossless decoder instance.
 void VP8LDelete(VP8LDecoder* const dec);
 
+// Returns an estimate of the peak memory used to decode a 'width' x 'height'
+// image (output excluded), rescaled to 'scaled_width' if not 0.
+uint64_t VP8LPredictMemory(int width, int height, int scaled_width);
+
+// Returns the memory used to feed one more output from a 'width' wide image,
+// rescaled to 'scaled_width' if not 0.
+uint64_t VP8LPredictExtraOutputMemory(int width, int scaled_width);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
@@ -12,10 +12,12 @@
 // Author: Skal (pascal.massimino@gmail.com)
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "./vp8i.h"
 #include "./vp8li.h"
 #include "./webpi.h"
+#include "../utils/thread.h"
 #include "../utils/utils.h"
 #include "../webp/mux_types.h"  // ALPHA_FLAG
 
@@ -444,13 +446,37 @@ void WebPResetDecParams(WebPDecParams* const params) {
 //------------------------------------------------------------------------------
 // "Into" decoding variants
 
-// Main flow
+// Decoders recycled from one picture to the next by WebPDecodeBatch().
+typedef struct {
+  VP8Decoder* vp8_;
+  VP8LDecoder* vp8l_;
+} DecoderCache;
+
+// Main flow. 'cache' is NULL, unless the decoders are to be kept for the next
+// picture.
+// Allocates/checks the output buffer, and the extra ones if any.
+static VP8StatusCode AllocateOutputs(int width, int height,
+                                     WebPDecParams* const params) {
+  VP8StatusCode status =
+      WebPAllocateDecBuffer(width, height, params->options, params->output);
+  int i;
+  for (i = 0; status == VP8_STATUS_OK && i < params->num_extra_outputs; ++i) {
+    WebPDecOutput* const extra = &params->extra_outputs[i];
+    status = WebPAllocateDecBuffer(width, height, &extra->options,
+                                   extra->params.output);
+  }
+  return status;
+}
+
 static VP8StatusCode DecodeInto(const uint8_t* const data, size_t data_size,
-                                WebPDecParams* const params) {
+                                WebPDecParams* const params,
+                                DecoderCache* const cache) {
   VP8StatusCode status;
   VP8Io io;
   WebPHeaderStructure headers;
 
+  assert(params != NULL);
+  WEBP_TIMING_START(params->timer, WEBP_DEC_STAGE_HEADERS);
   headers.data = data;
   headers.data_size = data_size;
   headers.have_all_data = 1;
@@ -459,65 +485,89 @@ static VP8StatusCode DecodeInto(const uint8_t* const data, size_t data_size,
     return status;
   }
 
-  assert(params != NULL);
   VP8InitIo(&io);
   io.data = headers.data + headers.offset;
   io.data_size = headers.data_size - headers.offset;
   WebPInitCustomIo(params, &io);  // Plug the I/O functions.
 
   if (!headers.is_lossless) {
-    VP8Decoder* const dec = VP8New();
+    VP8Decoder* const dec =
+        (cache != NULL && cache->vp8_ != NULL) ? cache->vp8_ : VP8New();
     if (dec == NULL) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
     dec->alpha_data_ = headers.alpha_data;
     dec->alpha_data_size_ = headers.alpha_data_size;
+    dec->timer_ = params->timer;
 
     // Decode bitstream header, update io->width/io->height.
     if (!VP8GetHeaders(dec, &io)) {
       status = dec->status_;   // An error occurred. Grab error status.
     } else {
+      WEBP_TIMING_STOP(params->timer, WEBP_DEC_STAGE_HEADERS);
       // Allocate/check output buffers.
-      status = WebPAllocateDecBuffer(io.width, io.height, params->options,
-                                     params->output);
+      status = AllocateOutputs(io.width, io.height, params);
       if (status == VP8_STATUS_OK) {  // Decode
         // This change must be done before calling VP8Decode()
         dec->mt_method_ = VP8GetThreadMethod(params->options, &headers,
                                              io.width, io.height);
+        dec->num_rows_ = VP8GetThreadRows(params->options,
+                                          dec->mt_method_);
         VP8InitDithering(params->options, dec);
         if (!VP8Decode(dec, &io)) {
           status = dec->status_;
         }
       }
     }
-    VP8Delete(dec);
+    if (cache != NULL) {
+      VP8Recycle(dec);
+      cache->vp8_ = dec;
+    } else {
+      VP8Delete(dec);
+    }
   } else {
-    VP8LDecoder* const dec = VP8LNew();
+    VP8LDecoder* const dec =
+        (cache != NULL && cache->vp8l_ != NULL) ? cache->vp8l_ : VP8LNew();
     if (dec == NULL) {
       return VP8_STATUS_OUT_OF_MEMORY;
     }
+    dec->timer_ = params->timer;
     if (!VP8LDecodeHeader(dec, &io)) {
       status = dec->status_;   // An error occurred. Grab error status.
     } else {
+      WEBP_TIMING_STOP(params->timer, WEBP_DEC_STAGE_HEADERS);
       // Allocate/check output buffers.
-      status = WebPAllocateDecBuffer(io.width, io.height, params->options,
-                                     params->output);
+      status = AllocateOutputs(io.width, io.height, params);
       if (status == VP8_STATUS_OK) {  // Decode
         if (!VP8LDecodeImage(dec)) {
           status = dec->status_;
         }
       }
     }
-    VP8LDelete(dec);
+    if (cache != NULL) {
+      VP8LRecycle(dec);
+      cache->vp8l_ = dec;
+    } else {
+      VP8LDelete(dec);
+    }
   }
 
   if (status != VP8_STATUS_OK) {
+    int i;
     WebPFreeDecBuffer(params->output);
+    for (i = 0; i < params->num_extra_outputs; ++i) {
+      WebPFreeDecBuffer(params->extra_outputs[i].params.output);
+    }
   } else {
     if (params->options != NULL && params->options->flip) {
       // This restores the original stride values if options->flip was used
       // during the call to WebPAllocateDecBuffer above.
+      int i;
       status = WebPFlipBuffer(params->output);
+      for (i = 0; status == VP8_STATUS_OK &&
+                  i < params->num_extra_outputs; ++i) {
+        status = WebPFlipBuffer(params->extra_outputs[i].params.output);
+      }
     }
   }
   return status;
@@ -542,7 +592,7 @@ static uint8_t* DecodeIntoRGBABuffer(MV_WEBP_CSP_MODE colorspace,
   buf.u.RGBA.stride = stride;
   buf.u.RGBA.size   = size;
   buf.is_external_memory = 1;
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   return rgba;
@@ -594,7 +644,7 @@ uint8_t* WebPDecodeYUVInto(const uint8_t* data, size_t data_size,
   output.u.YUVA.v_stride = v_stride;
   output.u.YUVA.v_size   = v_size;
   output.is_external_memory = 1;
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   return luma;
@@ -621,7 +671,7 @@ static uint8_t* Decode(MV_WEBP_CSP_MODE mode, const uint8_t* const data,
   if (height != NULL) *height = output.height;
 
   // Decode
-  if (DecodeInto(data, data_size, &params) != VP8_STATUS_OK) {
+  if (DecodeInto(data, data_size, &params, NULL) != VP8_STATUS_OK) {
     return NULL;
   }
   if (keep_info != NULL) {    // keep track of the side-info
@@ -743,15 +793,28 @@ VP8StatusCode WebPGetFeaturesInternal(const uint8_t* data, size_t data_size,
   return GetFeatures(data, data_size, features);
 }
 
-VP8StatusCode WebPDecode(const uint8_t* data, size_t data_size,
-                         WebPDecoderConfig* config) {
+// The options of an extra output: the shared ones, with its crop & scaling.
+static void GetExtraOutputOptions(const WebPDecoderOptions* const options,
+                                  const WebPDecoderOutput* const output,
+                                  WebPDecoderOptions* const extra_options) {
+  *extra_options = *options;
+  extra_options->use_cropping = output->use_cropping;
+  extra_options->crop_left = output->crop_left;
+  extra_options->crop_top = output->crop_top;
+  extra_options->crop_width = output->crop_width;
+  extra_options->crop_height = output->crop_height;
+  extra_options->use_scaling = output->use_scaling;
+  extra_options->scaled_width = output->scaled_width;
+  extra_options->scaled_height = output->scaled_height;
+}
+
+static VP8StatusCode DecodeWithConfig(const uint8_t* data, size_t data_size,
+                                      WebPDecoderConfig* const config,
+                                      WebPStageTimer* const timer) {
   WebPDecParams params;
+  WebPDecOutput* extras = NULL;
   VP8StatusCode status;
 
-  if (config == NULL) {
-    return VP8_STATUS_INVALID_PARAM;
-  }
-
   status = GetFeatures(data, data_size, &config->input);
   if (status != VP8_STATUS_OK) {
     if (status == VP8_STATUS_NOT_ENOUGH_DATA) {
@@ -763,6 +826,23 @@ VP8StatusCode WebPDecode(const uint8_t* data, size_t data_size,
   WebPResetDecParams(&params);
   params.options = &config->options;
   params.output = &config->output;
+  params.timer = timer;
+  if (config->num_extra_outputs > 0) {
+    int i;
+    if (config->extra_outputs == NULL) return VP8_STATUS_INVALID_PARAM;
+    extras = (WebPDecOutput*)WebPSafeMalloc(config->num_extra_outputs,
+                                            sizeof(*extras));
+    if (extras == NULL) return VP8_STATUS_OUT_OF_MEMORY;
+    for (i = 0; i < config->num_extra_outputs; ++i) {
+      WebPResetDecParams(&extras[i].params);
+      extras[i].params.output = &config->extra_outputs[i].buffer;
+      extras[i].params.options = &extras[i].options;
+      GetExtraOutputOptions(&config->options, &config->extra_outputs[i],
+                            &extras[i].options);
+    }
+    params.extra_outputs = extras;
+    params.num_extra_outputs = config->num_extra_outputs;
+  }
   if (WebPAvoidSlowMemory(params.output, &config->input)) {
     // decoding to slow memory: use a temporary in-mem buffer to decode into.
     WebPDecBuffer in_mem_buffer;
@@ -771,18 +851,235 @@ VP8StatusCode WebPDecode(const uint8_t* data, size_t data_size,
     in_mem_buffer.width = config->input.width;
     in_mem_buffer.height = config->input.height;
     params.output = &in_mem_buffer;
-    status = DecodeInto(data, data_size, &params);
+    status = DecodeInto(data, data_size, &params, NULL);
     if (status == VP8_STATUS_OK) {  // do the slow-copy
       status = WebPCopyDecBufferPixels(&in_mem_buffer, &config->output);
     }
     WebPFreeDecBuffer(&in_mem_buffer);
   } else {
-    status = DecodeInto(data, data_size, &params);
+    status = DecodeInto(data, data_size, &params, NULL);
+  }
+  WebPSafeFree(extras);
+  return status;
+}
+
+const WebPMemoryAllocator* WebPGetDecodingAllocator(
+    const WebPDecoderOptions* const options,
+    WebPMemoryCounter* const counter) {
+  if (options == NULL) return NULL;
+  if (options->stats == NULL) return options->allocator;
+  memset(options->stats, 0, sizeof(*options->stats));
+  WebPMemoryCounterInit(counter, options->allocator);
+  return &counter->allocator_;
+}
+
+void WebPSetDecodingStats(const WebPDecoderOptions* const options,
+                          const WebPMemoryCounter* const counter,
+                          const WebPStageTimer* const timer) {
+  if (options != NULL && options->stats != NULL) {
+    WebPDecoderStats* const stats = options->stats;
+    stats->bytes_allocated = counter->total_bytes_;
+    stats->peak_bytes = counter->peak_bytes_;
+    stats->num_allocations = counter->num_allocs_;
+    WebPStageTimerToNanoseconds(timer, WEBP_DEC_STAGE_NUM, stats->stage_time);
+  }
+}
+
+VP8StatusCode WebPDecode(const uint8_t* data, size_t data_size,
+                         WebPDecoderConfig* config) {
+  WebPMemoryCounter counter;
+  WebPStageTimer timer;
+  const WebPMemoryAllocator* previous;
+  VP8StatusCode status;
+
+  if (config == NULL) {
+    return VP8_STATUS_INVALID_PARAM;
   }
 
+  memset(&timer, 0, sizeof(timer));
+  previous = WebPPushThreadAllocator(
+      WebPGetDecodingAllocator(&config->options, &counter));
+  status = DecodeWithConfig(data, data_size, config,
+                            (config->options.stats != NULL) ? &timer : NULL);
+  WebPSetThreadAllocator(previous);
+  WebPSetDecodingStats(&config->options, &counter, &timer);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+// Batch decoding
+
+typedef struct {
+  WebPDecodeBatchItem* items_;
+  int num_items_;
+  const WebPDecoderOptions* options_;
+  volatile int next_item_;     // index of the next item to decode
+} BatchContext;
+
+static VP8StatusCode DecodeBatchItem(WebPDecodeBatchItem* const item,
+                                     const WebPDecoderOptions* const options,
+                                     DecoderCache* const cache) {
+  WebPDecParams params;
+  VP8StatusCode status;
+  if (item->data == NULL || item->output == NULL) {
+    return VP8_STATUS_INVALID_PARAM;
+  }
+  WebPResetDecParams(&params);
+  params.options = options;
+  params.output = item->output;
+  if (item->output->is_external_memory >= 2) {
+    // Slow memory: same as WebPDecode(), which needs the features to decide.
+    WebPDecoderConfig config;
+    WebPInitDecoderConfig(&config);
+    config.output = *item->output;
+    config.options = *options;
+    status = DecodeWithConfig(item->data, item->data_size, &config, NULL);
+    *item->output = config.output;
+    return status;
+  }
+  status = DecodeInto(item->data, item->data_size, &params, cache);
+  if (status == VP8_STATUS_NOT_ENOUGH_DATA) {
+    status = VP8_STATUS_BITSTREAM_ERROR;   // as WebPDecode() does
+  }
   return status;
 }
 
+// Decodes the items not taken by the other threads yet, with the same
+// decoders all along.
+static int BatchDecodeHook(void* arg1, void* arg2) {
+  BatchContext* const ctx = (BatchContext*)arg1;
+  DecoderCache cache = { NULL, NULL };
+  const WebPMemoryAllocator* const previous =
+      WebPPushThreadAllocator(ctx->options_->allocator);
+  (void)arg2;
+  while (1) {
+    const int i = WebPAtomicLoad(&ctx->next_item_);
+    if (i >= ctx->num_items_) break;
+    if (!WebPAtomicCompareAndSwap(&ctx->next_item_, i, i + 1)) continue;
+    ctx->items_[i].status =
+        DecodeBatchItem(&ctx->items_[i], ctx->options_, &cache);
+  }
+  VP8Delete(cache.vp8_);
+  VP8LDelete(cache.vp8l_);
+  WebPSetThreadAllocator(previous);
+  return 1;
+}
+
+VP8StatusCode WebPDecodeBatch(WebPDecodeBatchItem* items, int num_items,
+                              const WebPDecoderOptions* options,
+                              int num_threads) {
+  WebPDecoderOptions batch_options;
+  BatchContext ctx;
+  WebPTaskGraph* graph = NULL;
+  int i;
+
+  if (items == NULL || num_items < 0) {
+    return VP8_STATUS_INVALID_PARAM;
+  }
+  if (options != NULL) {
+    batch_options = *options;
+  } else {
+    memset(&batch_options, 0, sizeof(batch_options));
+  }
+  batch_options.use_threads = 0;   // the items are the unit of parallelism
+  batch_options.stats = NULL;
+  ctx.items_ = items;
+  ctx.num_items_ = num_items;
+  ctx.options_ = &batch_options;
+  ctx.next_item_ = 0;
+  for (i = 0; i < num_items; ++i) {
+    items[i].status = VP8_STATUS_SUSPENDED;   // not decoded yet
+  }
+
+  if (num_threads > num_items) num_threads = num_items;
+  if (num_threads > 1) graph = WebPTaskGraphNew();
+  if (graph != NULL) {
+    for (i = 0; i < num_threads; ++i) {
+      if (WebPTaskGraphAddTask(graph, BatchDecodeHook, &ctx, NULL,
+                               NULL, 0) < 0) {
+        break;
+      }
+    }
+    WebPTaskGraphRun(graph);
+    WebPTaskGraphDelete(graph);
+  }
+  BatchDecodeHook(&ctx, NULL);   // leftovers, or all items if single-threaded
+
+  for (i = 0; i < num_items; ++i) {
+    if (items[i].status != VP8_STATUS_OK) return items[i].status;
+  }
+  return VP8_STATUS_OK;
+}
+
+size_t WebPPredictDecodeMemory(const WebPDecoderConfig* config) {
+  const WebPBitstreamFeatures* features;
+  const WebPDecoderOptions* options;
+  int in_width;           // width of the decoded area
+  int out_width, out_height;
+  int scaled_width;
+  uint64_t size = 0;
+
+  if (config == NULL) return 0;
+  features = &config->input;
+  options = &config->options;
+  out_width = features->width;
+  out_height = features->height;
+  if (!WebPGetOutputDimensions(options, &out_width, &out_height)) return 0;
+  in_width = options->use_cropping ? options->crop_width : features->width;
+  scaled_width = options->use_scaling ? out_width : 0;
+
+  if (!config->output.is_external_memory) {
+    size = WebPGetDecBufferSize(out_width, out_height,
+                                config->output.colorspace);
+    if (size == 0) return 0;
+  }
+  if (features->format == 2) {
+    size += VP8LPredictMemory(features->width, features->height, scaled_width);
+  } else {
+    const int fancy_upsampling =
+        !options->no_fancy_upsampling && !options->use_scaling;
+    size += VP8PredictMemory(features->width, features->height,
+                             features->has_alpha, options);
+    size += WebPPredictCustomIoMemory(in_width, scaled_width, fancy_upsampling,
+                                      config->output.colorspace);
+  }
+  if (config->num_extra_outputs > 0) {
+    int i;
+    if (config->extra_outputs == NULL) return 0;
+    for (i = 0; i < config->num_extra_outputs; ++i) {
+      const WebPDecoderOutput* const extra = &config->extra_outputs[i];
+      WebPDecoderOptions extra_options;
+      GetExtraOutputOptions(options, extra, &extra_options);
+      out_width = features->width;
+      out_height = features->height;
+      if (!WebPGetOutputDimensions(&extra_options, &out_width, &out_height)) {
+        return 0;
+      }
+      in_width = extra->use_cropping ? extra->crop_width : features->width;
+      scaled_width = extra->use_scaling ? out_width : 0;
+      if (!extra->buffer.is_external_memory) {
+        const uint64_t buffer_size = WebPGetDecBufferSize(
+            out_width, out_height, extra->buffer.colorspace);
+        if (buffer_size == 0) return 0;
+        size += buffer_size;
+      }
+      if (features->format == 2) {
+        size += VP8LPredictExtraOutputMemory(features->width, scaled_width);
+      } else {
+        const int fancy_upsampling =
+            !options->no_fancy_upsampling && !extra->use_scaling;
+        size += WebPPredictCustomIoMemory(in_width, scaled_width,
+                                          fancy_upsampling,
+                                          extra->buffer.colorspace);
+      }
+    }
+    if (features->format != 2) {   // the views of the rows
+      size += (uint64_t)(1 + config->num_extra_outputs) * sizeof(VP8Io);
+    }
+  }
+  return (size == (size_t)size) ? (size_t)size : 0;
+}
+
 //------------------------------------------------------------------------------
 // Cropping and rescaling.
 
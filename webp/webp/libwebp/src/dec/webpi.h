@@ -19,6 +19,7 @@ extern "C" {
 #endif
 
 #include "../utils/rescaler.h"
+#include "../utils/utils.h"
 #include "./decode_vp8.h"
 
 //------------------------------------------------------------------------------
@@ -51,8 +52,19 @@ struct MV_WebPDecParams {
                                  // (this::output) and copy it here.
   MV_WebPDecBuffer tmp_buffer;      // this::output will point to this one in case
                                  // of slow memory.
+  WebPStageTimer* timer;         // if not NULL, records the stage times
+
+  struct WebPDecOutput* extra_outputs;  // more outputs fed with the same rows
+  int num_extra_outputs;
+  MV_VP8Io* views;               // lossy: the view of the rows of each output
 };
 
+// Additional output of a decoding. Transient internal object.
+typedef struct WebPDecOutput {
+  MV_WebPDecParams params;       // output parameters of this picture
+  MV_WebPDecoderOptions options;  // shared options, with its crop & scaling
+} WebPDecOutput;
+
 // Should be called first, before any use of the WebPDecParams object.
 void MV_WebPResetDecParams(MV_WebPDecParams* const params);
 
@@ -87,14 +99,34 @@ MV_VP8StatusCode MV_WebPParseHeaders(MV_WebPHeaderStructure* const headers);
 // Misc utils
 
 // Initializes MV_VP8Io with custom setup, io and teardown functions. The default
-// hooks will use the supplied 'params' as io->opaque handle.
+// hooks will use the supplied 'params' as io->opaque handle. With extra outputs
+// in 'params', the rows are fed to all of them.
 void MV_WebPInitCustomIo(MV_WebPDecParams* const params, MV_VP8Io* const io);
 
+// Returns the memory allocated by the above setup hook to emit rows 'width'
+// samples wide in 'colorspace', rescaled to 'scaled_width' if not 0.
+uint64_t WebPPredictCustomIoMemory(int width, int scaled_width,
+                                   int fancy_upsampling,
+                                   MV_WEBP_CSP_MODE colorspace);
+
 // Setup crop_xxx fields, mb_w and mb_h in io. 'src_colorspace' refers
 // to the *compressed* format, not the output one.
 int MV_WebPIoInitFromOptions(const MV_WebPDecoderOptions* const options,
                           MV_VP8Io* const io, MV_WEBP_CSP_MODE src_colorspace);
 
+// Returns the allocator to install for a decoding with 'options' (possibly
+// NULL). If 'options->stats' is set, the statistics are reset and 'counter' is
+// initialized to do the accounting.
+const WebPMemoryAllocator* WebPGetDecodingAllocator(
+    const MV_WebPDecoderOptions* const options,
+    WebPMemoryCounter* const counter);
+
+// Reports the counts of 'counter' and the stage times of 'timer' in
+// 'options->stats', if set.
+void WebPSetDecodingStats(const MV_WebPDecoderOptions* const options,
+                          const WebPMemoryCounter* const counter,
+                          const WebPStageTimer* const timer);
+
 //------------------------------------------------------------------------------
 // Internal functions regarding MV_WebPDecBuffer memory (in buffer.c).
 // Don't really need to be externally visible for now.
@@ -112,6 +144,16 @@ MV_VP8StatusCode MV_WebPAllocateDecBuffer(int width, int height,
                                     const MV_WebPDecoderOptions* const options,
                                     MV_WebPDecBuffer* const buffer);
 
+// Applies the cropping and scaling of 'options' (possibly NULL) to the
+// dimensions '*width' x '*height'. Returns false in case of invalid options.
+int WebPGetOutputDimensions(const MV_WebPDecoderOptions* const options,
+                            int* const width, int* const height);
+
+// Returns the size of the memory allocated by WebPAllocateDecBuffer() for a
+// 'width' x 'height' output in 'colorspace', or 0 if invalid.
+uint64_t WebPGetDecBufferSize(int width, int height,
+                              MV_WEBP_CSP_MODE colorspace);
+
 // Flip buffer vertically by negating the various strides.
 MV_VP8StatusCode MV_WebPFlipBuffer(MV_WebPDecBuffer* const buffer);
 
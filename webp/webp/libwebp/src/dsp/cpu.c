@@ -11,11 +11,14 @@
 //
 // Author: Christian Duvivier (cduvivier@google.com)
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "./dsp.h"
+#include "../utils/thread.h"
 
 #if defined(WEBP_HAVE_NEON_RTCD)
 #include <stdio.h>
-#include <string.h>
 #endif
 
 #if defined(WEBP_ANDROID_NEON)
@@ -131,7 +134,7 @@ static int x86CPUInfo(CPUFeature feature) {
   }
   return 0;
 }
-VP8CPUInfo VP8GetCPUInfo = x86CPUInfo;
+#define DETECTED_CPU_INFO x86CPUInfo
 #elif defined(WEBP_ANDROID_NEON)  // NB: needs to be before generic NEON test.
 static int AndroidCPUInfo(CPUFeature feature) {
   const AndroidCpuFamily cpu_family = android_getCpuFamily();
@@ -142,7 +145,7 @@ static int AndroidCPUInfo(CPUFeature feature) {
   }
   return 0;
 }
-VP8CPUInfo VP8GetCPUInfo = AndroidCPUInfo;
+#define DETECTED_CPU_INFO AndroidCPUInfo
 #elif defined(WEBP_USE_NEON)
 // define a dummy function to enable turning off NEON at runtime by setting
 // VP8DecGetCPUInfo = NULL
@@ -169,7 +172,7 @@ static int armCPUInfo(CPUFeature feature) {
   return 1;
 #endif
 }
-VP8CPUInfo VP8GetCPUInfo = armCPUInfo;
+#define DETECTED_CPU_INFO armCPUInfo
 #elif defined(WEBP_USE_MIPS32) || defined(WEBP_USE_MIPS_DSP_R2) || \
       defined(WEBP_USE_MSA)
 static int mipsCPUInfo(CPUFeature feature) {
@@ -180,8 +183,145 @@ static int mipsCPUInfo(CPUFeature feature) {
   }
 
 }
-VP8CPUInfo VP8GetCPUInfo = mipsCPUInfo;
-#else
-VP8CPUInfo VP8GetCPUInfo = NULL;
+#define DETECTED_CPU_INFO mipsCPUInfo
 #endif
 
+//------------------------------------------------------------------------------
+// Feature override
+//
+// The detected features are filtered by the mask installed with
+// VP8InstallCPUFeatureMask() and by the WEBP_CPU_FEATURES environment
+// variable, a comma-separated list of feature names: "sse2,sse3" only allows
+// those two, "-avx2" allows all but AVX2, and "none" (or "c") disables them
+// all. The variable is read once, before the detection is first used.
+
+#if defined(DETECTED_CPU_INFO)
+
+static const struct {
+  const char* name_;
+  CPUFeature feature_;
+} kFeatureNames[] = {
+  { "sse2", kSSE2 }, { "sse3", kSSE3 }, { "sse4.1", kSSE4_1 },
+  { "avx", kAVX }, { "avx2", kAVX2 }, { "neon", kNEON },
+  { "mips32", kMIPS32 }, { "mipsdspr2", kMIPSdspR2 }, { "msa", kMSA }
+};
+#define NUM_FEATURE_NAMES \
+    ((int)(sizeof(kFeatureNames) / sizeof(kFeatureNames[0])))
+
+static int NameMatches(const char* const name, size_t len,
+                       const char* const ref) {
+  return (strlen(ref) == len && !strncmp(name, ref, len));
+}
+
+static uint32_t ParseFeatureMask(const char* str) {
+  uint32_t allowed = 0, removed = 0;
+  int has_allowed = 0;
+  while (*str != '\0') {
+    const int remove = (*str == '-');
+    const char* name;
+    size_t len;
+    int i;
+    if (remove) ++str;
+    name = str;
+    while (*str != '\0' && *str != ',') ++str;
+    len = (size_t)(str - name);
+    if (*str == ',') ++str;
+    if (NameMatches(name, len, "none") || NameMatches(name, len, "c")) {
+      has_allowed = 1;
+    } else if (NameMatches(name, len, "all")) {
+      allowed = WEBP_CPU_FEATURES_ALL;
+      has_allowed = 1;
+    }
+    for (i = 0; i < NUM_FEATURE_NAMES; ++i) {
+      if (NameMatches(name, len, kFeatureNames[i].name_)) {
+        const uint32_t bit = WEBP_CPU_FEATURE_BIT(kFeatureNames[i].feature_);
+        if (remove) {
+          removed |= bit;
+        } else {
+          allowed |= bit;
+          has_allowed = 1;
+        }
+      }
+    }
+  }
+  return (has_allowed ? allowed : WEBP_CPU_FEATURES_ALL) & ~removed;
+}
+
+static uint32_t env_features_mask = WEBP_CPU_FEATURES_ALL;
+static WebPOnce env_features_once = WEBP_ONCE_INIT;
+
+static void ReadEnvFeatureMask(void) {
+  const char* const env = getenv("WEBP_CPU_FEATURES");
+  if (env != NULL) env_features_mask = ParseFeatureMask(env);
+}
+
+static int FilteredCPUInfo(CPUFeature feature, uint32_t mask) {
+  if (!(mask & WEBP_CPU_FEATURE_BIT(feature))) return 0;
+  return DETECTED_CPU_INFO(feature);
+}
+
+// Used until a mask is installed: only WEBP_CPU_FEATURES applies.
+static int DefaultCPUInfo(CPUFeature feature) {
+  WebPRunOnce(&env_features_once, ReadEnvFeatureMask);
+  return FilteredCPUInfo(feature, env_features_mask);
+}
+
+// The dsp init functions only re-initialize when VP8GetCPUInfo changes value.
+// Hence two instances of the filtered detection, each with its own copy of the
+// mask, which are alternated each time a mask is installed.
+static uint32_t filter_masks[2] = {
+  WEBP_CPU_FEATURES_ALL, WEBP_CPU_FEATURES_ALL
+};
+static int filter_slot = 0;
+
+static int FilteredCPUInfo0(CPUFeature feature) {
+  return FilteredCPUInfo(feature, filter_masks[0]);
+}
+
+static int FilteredCPUInfo1(CPUFeature feature) {
+  return FilteredCPUInfo(feature, filter_masks[1]);
+}
+
+VP8CPUInfo VP8GetCPUInfo = DefaultCPUInfo;
+
+void VP8InstallCPUFeatureMask(uint32_t mask) {
+  WebPRunOnce(&env_features_once, ReadEnvFeatureMask);
+  filter_slot ^= 1;
+  filter_masks[filter_slot] = mask & env_features_mask;
+  VP8GetCPUInfo = filter_slot ? FilteredCPUInfo1 : FilteredCPUInfo0;
+}
+
+uint32_t VP8GetCPUFeatureMask(void) {
+  if (VP8GetCPUInfo == FilteredCPUInfo0 || VP8GetCPUInfo == FilteredCPUInfo1) {
+    return filter_masks[filter_slot];
+  }
+  WebPRunOnce(&env_features_once, ReadEnvFeatureMask);
+  return env_features_mask;
+}
+
+int VP8HasFilteredCPUInfo(void) {
+  return (VP8GetCPUInfo == DefaultCPUInfo ||
+          VP8GetCPUInfo == FilteredCPUInfo0 ||
+          VP8GetCPUInfo == FilteredCPUInfo1);
+}
+
+#else   // !DETECTED_CPU_INFO
+
+// No detection, nothing to filter.
+VP8CPUInfo VP8GetCPUInfo = NULL;
+
+static uint32_t cpu_features_mask = WEBP_CPU_FEATURES_ALL;
+
+void VP8InstallCPUFeatureMask(uint32_t mask) {
+  cpu_features_mask = mask;
+}
+
+uint32_t VP8GetCPUFeatureMask(void) {
+  return cpu_features_mask;
+}
+
+int VP8HasFilteredCPUInfo(void) {
+  return 0;
+}
+
+#endif  // DETECTED_CPU_INFO
@@ -0,0 +1,520 @@
+// Copyright 2016 Google Inc. All Rights Reserved.
+//
+// Use of this source code is governed by a BSD-style license
+// that can be found in the COPYING file in the root of the source
+// tree. An additional intellectual property rights grant can be found
+// in the file PATENTS. All contributing project authors may
+// be found in the AUTHORS file in the root of the source tree.
+// -----------------------------------------------------------------------------
+//
+// CPU feature mask and auto-tuning of the dsp functions.
+//
+// Both re-initialize the decoding and the encoding functions, hence are kept
+// apart from the detection in cpu.c, which the decoder alone links with.
+
+#include <assert.h>
+#include <string.h>
+
+#include "./dsp.h"
+#include "./lossless.h"
+#include "../enc/vp8enci.h"
+#include "../utils/thread.h"
+#include "../utils/utils.h"
+
+#define NUM_CPU_FEATURES (kMSA + 1)
+
+//------------------------------------------------------------------------------
+// Feature mask
+
+static uint32_t cpu_features_mask = WEBP_CPU_FEATURES_ALL;
+
+// Re-initializes all the modules right away: one left behind would otherwise
+// keep the pointer value of an older mask, and miss the next switch back to
+// that same value.
+static void InitAllModules(void) {
+  VP8DspInit();
+  VP8EncDspInit();
+  VP8EncDspCostInit();
+  VP8SSIMDspInit();
+  VP8EncDspARGBInit();
+  VP8LDspInit();
+  VP8LEncDspInit();
+  WebPInitUpsamplers();
+  WebPInitSamplers();
+  WebPInitYUV444Converters();
+  WebPInitConvertARGBToYUV();
+  WebPRescalerDspInit();
+  WebPInitAlphaProcessing();
+  VP8FiltersInit();
+}
+
+static void InstallFeatureMask(uint32_t mask) {
+  VP8InstallCPUFeatureMask(mask);
+  InitAllModules();
+}
+
+void VP8SetCPUFeatureMask(uint32_t mask) {
+  cpu_features_mask = mask;
+  InstallFeatureMask(mask);
+}
+
+//------------------------------------------------------------------------------
+// Auto-tuning
+//
+// Each allowed feature tier is installed in turn, from plain C to the most
+// specialized one, to collect the implementations picked for the kernels
+// below. The ones with several candidates are timed on synthetic data, and the
+// fastest candidate replaces the default one if it wins by a clear margin.
+
+typedef void (*TuneFunc)(void);
+
+#define TUNE_STRIDE 64    // stride of the plane used by the loop filters
+#define TUNE_WIDTH 512    // length of the rows used by the row kernels
+#define TUNE_REPS 64      // number of runs per timing
+#define TUNE_TRIALS 5     // number of timings per candidate, the best is kept
+#define TUNE_MAX_CANDIDATES (NUM_CPU_FEATURES + 1)
+
+typedef struct {
+  // The arrays are first, and sized so they all stay aligned.
+  uint8_t plane_[TUNE_STRIDE * 32];
+  uint8_t src_[BPS * 16];
+  uint8_t ref_[BPS * 16];
+  uint8_t dst_[BPS * 16];
+  uint8_t y_[2][TUNE_WIDTH];
+  uint8_t u_[2][TUNE_WIDTH / 2];
+  uint8_t v_[2][TUNE_WIDTH / 2];
+  uint8_t rgba_[2][TUNE_WIDTH * 4];
+  uint32_t argb_[TUNE_WIDTH];
+  uint32_t argb_copy_[TUNE_WIDTH];
+  int16_t coeffs_[32];
+  int16_t out_[32];
+  uint16_t weights_[16];
+  VP8Matrix mtx_;
+  VP8LMultipliers multipliers_;
+  uint32_t sink_;   // accumulates the results, so that they are used
+} TuneData;
+
+static const uint16_t kTuneWeights[16] = {
+  38, 32, 20, 9, 32, 28, 17, 7, 20, 17, 10, 4, 9, 7, 4, 2
+};
+
+static uint32_t TuneRandom(uint32_t* const seed) {
+  *seed = *seed * 1664525u + 1013904223u;
+  return *seed >> 16;
+}
+
+// Smooth content with some noise, so that the loop filters and the quantizer
+// take their usual paths.
+static void FillTuneData(TuneData* const d) {
+  uint32_t seed = 0x3c6ef372u;
+  int x, y, i;
+  for (y = 0; y < 32; ++y) {
+    for (x = 0; x < TUNE_STRIDE; ++x) {
+      d->plane_[x + y * TUNE_STRIDE] =
+          96 + ((3 * x + 5 * y) & 63) + (TuneRandom(&seed) & 7);
+    }
+  }
+  for (y = 0; y < 16; ++y) {
+    for (x = 0; x < BPS; ++x) {
+      const int v = 64 + 4 * x + 2 * y + (TuneRandom(&seed) & 15);
+      d->src_[x + y * BPS] = v;
+      d->ref_[x + y * BPS] = v + (TuneRandom(&seed) & 7) - 4;
+      d->dst_[x + y * BPS] = v;
+    }
+  }
+  for (i = 0; i < 2; ++i) {
+    for (x = 0; x < TUNE_WIDTH; ++x) {
+      d->y_[i][x] = 16 + (x & 127) + (TuneRandom(&seed) & 63);
+    }
+    for (x = 0; x < TUNE_WIDTH / 2; ++x) {
+      d->u_[i][x] = 96 + (TuneRandom(&seed) & 63);
+      d->v_[i][x] = 96 + (TuneRandom(&seed) & 63);
+    }
+    for (x = 0; x < TUNE_WIDTH * 4; ++x) d->rgba_[i][x] = TuneRandom(&seed);
+  }
+  for (x = 0; x < TUNE_WIDTH; ++x) {
+    d->argb_[x] = 0xff000000u | (TuneRandom(&seed) << 8) | (x & 0xff);
+    d->argb_copy_[x] = d->argb_[x];
+  }
+  for (i = 0; i < 32; ++i) {
+    d->coeffs_[i] = (int16_t)(((int)(TuneRandom(&seed) & 255) - 128) >>
+                              ((i & 15) >> 2));
+  }
+  memset(d->out_, 0, sizeof(d->out_));
+  memcpy(d->weights_, kTuneWeights, sizeof(d->weights_));
+  for (i = 0; i < 16; ++i) {
+    const int q = (i == 0) ? 20 : 24;
+    d->mtx_.q_[i] = q;
+    d->mtx_.iq_[i] = (1 << QFIX) / q;
+    d->mtx_.bias_[i] = BIAS(110);
+    d->mtx_.zthresh_[i] = ((1 << QFIX) - 1 - d->mtx_.bias_[i]) / d->mtx_.iq_[i];
+    d->mtx_.sharpen_[i] = 0;
+  }
+  d->multipliers_.green_to_red_ = 17;
+  d->multipliers_.green_to_blue_ = 235;
+  d->multipliers_.red_to_blue_ = 9;
+  d->sink_ = 0;
+}
+
+// Accessors for the function pointers, which have different types.
+#define TUNE_ACCESSORS(NAME, TYPE, PTR)                                        \
+static TuneFunc Get##NAME(void) { return (TuneFunc)(PTR); }                    \
+static void Set##NAME(TuneFunc func) { (PTR) = (TYPE)func; }
+
+typedef void (*TuneConvertARGBToYFunc)(const uint32_t* argb, uint8_t* y,
+                                       int width);
+typedef void (*TuneConvertARGBToUVFunc)(const uint32_t* argb, uint8_t* u,
+                                        uint8_t* v, int src_width,
+                                        int do_store);
+typedef void (*TuneConvertRGB24ToYFunc)(const uint8_t* rgb, uint8_t* y,
+                                        int width);
+
+// Decoding.
+
+static void RunTransform(TuneData* const d) {
+  int i;
+  for (i = 0; i < 8; ++i) {
+    VP8Transform(d->coeffs_, d->dst_ + (i & 1) * 8 + (i >> 1) * 4 * BPS, 1);
+  }
+}
+TUNE_ACCESSORS(Transform, VP8DecIdct2, VP8Transform)
+
+#define TUNE_LUMA(I) (d->plane_ + 8 * TUNE_STRIDE + 8 + 16 * (I))
+#define TUNE_CHROMA_U (d->plane_ + 8 * TUNE_STRIDE + 8)
+#define TUNE_CHROMA_V (d->plane_ + 8 * TUNE_STRIDE + 32)
+
+#define TUNE_SIMPLE_FILTER(NAME)                                               \
+static void Run##NAME(TuneData* const d) {                                     \
+  int i;                                                                       \
+  for (i = 0; i < 3; ++i) VP8##NAME(TUNE_LUMA(i), TUNE_STRIDE, 50);            \
+}                                                                              \
+TUNE_ACCESSORS(NAME, VP8SimpleFilterFunc, VP8##NAME)
+
+#define TUNE_LUMA_FILTER(NAME)                                                 \
+static void Run##NAME(TuneData* const d) {                                     \
+  int i;                                                                       \
+  for (i = 0; i < 3; ++i) VP8##NAME(TUNE_LUMA(i), TUNE_STRIDE, 50, 10, 2);     \
+}                                                                              \
+TUNE_ACCESSORS(NAME, VP8LumaFilterFunc, VP8##NAME)
+
+#define TUNE_CHROMA_FILTER(NAME)                                               \
+static void Run##NAME(TuneData* const d) {                                     \
+  VP8##NAME(TUNE_CHROMA_U, TUNE_CHROMA_V, TUNE_STRIDE, 50, 10, 2);             \
+}                                                                              \
+TUNE_ACCESSORS(NAME, VP8ChromaFilterFunc, VP8##NAME)
+
+TUNE_SIMPLE_FILTER(SimpleVFilter16)
+TUNE_SIMPLE_FILTER(SimpleHFilter16)
+TUNE_LUMA_FILTER(VFilter16)
+TUNE_LUMA_FILTER(HFilter16)
+TUNE_LUMA_FILTER(VFilter16i)
+TUNE_LUMA_FILTER(HFilter16i)
+TUNE_CHROMA_FILTER(VFilter8)
+TUNE_CHROMA_FILTER(HFilter8)
+TUNE_CHROMA_FILTER(VFilter8i)
+TUNE_CHROMA_FILTER(HFilter8i)
+
+#ifdef FANCY_UPSAMPLING
+#define TUNE_UPSAMPLER(NAME, MODE)                                             \
+static void Run##NAME(TuneData* const d) {                                     \
+  WebPUpsamplers[MODE](d->y_[0], d->y_[1], d->u_[0], d->v_[0],                 \
+                       d->u_[1], d->v_[1], d->rgba_[0], d->rgba_[1],           \
+                       TUNE_WIDTH);                                            \
+}                                                                              \
+TUNE_ACCESSORS(NAME, WebPUpsampleLinePairFunc, WebPUpsamplers[MODE])
+
+TUNE_UPSAMPLER(UpsampleRgb, MODE_RGB)
+TUNE_UPSAMPLER(UpsampleRgba, MODE_RGBA)
+TUNE_UPSAMPLER(UpsampleBgra, MODE_BGRA)
+#endif
+
+static void RunSampleRgba(TuneData* const d) {
+  WebPSamplers[MODE_RGBA](d->y_[0], d->u_[0], d->v_[0], d->rgba_[0],
+                          TUNE_WIDTH);
+}
+TUNE_ACCESSORS(SampleRgba, WebPSamplerRowFunc, WebPSamplers[MODE_RGBA])
+
+static void RunAddGreenToBlueAndRed(TuneData* const d) {
+  VP8LAddGreenToBlueAndRed(d->argb_, TUNE_WIDTH);
+}
+TUNE_ACCESSORS(AddGreenToBlueAndRed, VP8LProcessBlueAndRedFunc,
+               VP8LAddGreenToBlueAndRed)
+
+static void RunTransformColorInverse(TuneData* const d) {
+  VP8LTransformColorInverse(&d->multipliers_, d->argb_, TUNE_WIDTH);
+}
+TUNE_ACCESSORS(TransformColorInverse, VP8LTransformColorFunc,
+               VP8LTransformColorInverse)
+
+static void RunConvertBGRAToRGBA(TuneData* const d) {
+  VP8LConvertBGRAToRGBA(d->argb_, TUNE_WIDTH, d->rgba_[0]);
+}
+TUNE_ACCESSORS(ConvertBGRAToRGBA, VP8LConvertFunc, VP8LConvertBGRAToRGBA)
+
+static void RunConvertBGRAToRGB(TuneData* const d) {
+  VP8LConvertBGRAToRGB(d->argb_, TUNE_WIDTH, d->rgba_[0]);
+}
+TUNE_ACCESSORS(ConvertBGRAToRGB, VP8LConvertFunc, VP8LConvertBGRAToRGB)
+
+// Encoding.
+
+static void RunFTransform(TuneData* const d) {
+  int i;
+  for (i = 0; i < 16; ++i) {
+    VP8FTransform(d->src_ + VP8DspScan[i], d->ref_ + VP8DspScan[i], d->out_);
+  }
+}
+TUNE_ACCESSORS(FTransform, VP8Fdct, VP8FTransform)
+
+static void RunITransform(TuneData* const d) {
+  int i;
+  for (i = 0; i < 8; ++i) {
+    const int offset = VP8DspScan[2 * i];
+    VP8ITransform(d->ref_ + offset, d->coeffs_, d->dst_ + offset, 1);
+  }
+}
+TUNE_ACCESSORS(ITransform, VP8Idct, VP8ITransform)
+
+static void RunSSE16x16(TuneData* const d) {
+  d->sink_ += VP8SSE16x16(d->src_, d->ref_);
+}
+TUNE_ACCESSORS(SSE16x16, VP8Metric, VP8SSE16x16)
+
+static void RunSSE4x4(TuneData* const d) {
+  int i;
+  for (i = 0; i < 16; ++i) {
+    d->sink_ += VP8SSE4x4(d->src_ + VP8DspScan[i], d->ref_ + VP8DspScan[i]);
+  }
+}
+TUNE_ACCESSORS(SSE4x4, VP8Metric, VP8SSE4x4)
+
+static void RunTDisto4x4(TuneData* const d) {
+  int i;
+  for (i = 0; i < 16; ++i) {
+    d->sink_ += VP8TDisto4x4(d->src_ + VP8DspScan[i], d->ref_ + VP8DspScan[i],
+                             d->weights_);
+  }
+}
+TUNE_ACCESSORS(TDisto4x4, VP8WMetric, VP8TDisto4x4)
+
+static void RunTDisto16x16(TuneData* const d) {
+  d->sink_ += VP8TDisto16x16(d->src_, d->ref_, d->weights_);
+}
+TUNE_ACCESSORS(TDisto16x16, VP8WMetric, VP8TDisto16x16)
+
+static void RunQuantizeBlock(TuneData* const d) {
+  int16_t in[16];
+  int i;
+  for (i = 0; i < 16; ++i) {
+    memcpy(in, d->coeffs_, sizeof(in));
+    d->sink_ += VP8EncQuantizeBlock(in, d->out_, &d->mtx_);
+  }
+}
+TUNE_ACCESSORS(QuantizeBlock, VP8QuantizeBlock, VP8EncQuantizeBlock)
+
+static void RunQuantize2Blocks(TuneData* const d) {
+  int16_t in[32];
+  int i;
+  for (i = 0; i < 8; ++i) {
+    memcpy(in, d->coeffs_, sizeof(in));
+    d->sink_ += VP8EncQuantize2Blocks(in, d->out_, &d->mtx_);
+  }
+}
+TUNE_ACCESSORS(Quantize2Blocks, VP8Quantize2Blocks, VP8EncQuantize2Blocks)
+
+static void RunCollectHistogram(TuneData* const d) {
+  VP8Histogram histo;
+  VP8CollectHistogram(d->ref_, d->src_, 0, 16, &histo);
+  d->sink_ += histo.max_value;
+}
+TUNE_ACCESSORS(CollectHistogram, VP8CHisto, VP8CollectHistogram)
+
+static void RunSubtractGreenFromBlueAndRed(TuneData* const d) {
+  VP8LSubtractGreenFromBlueAndRed(d->argb_, TUNE_WIDTH);
+}
+TUNE_ACCESSORS(SubtractGreenFromBlueAndRed, VP8LProcessBlueAndRedFunc,
+               VP8LSubtractGreenFromBlueAndRed)
+
+static void RunTransformColor(TuneData* const d) {
+  VP8LTransformColor(&d->multipliers_, d->argb_, TUNE_WIDTH);
+}
+TUNE_ACCESSORS(TransformColor, VP8LTransformColorFunc, VP8LTransformColor)
+
+static void RunVectorMismatch(TuneData* const d) {
+  d->sink_ += VP8LVectorMismatch(d->argb_, d->argb_copy_, TUNE_WIDTH);
+}
+TUNE_ACCESSORS(VectorMismatch, VP8LVectorMismatchFunc, VP8LVectorMismatch)
+
+static void RunConvertARGBToY(TuneData* const d) {
+  WebPConvertARGBToY(d->argb_copy_, d->y_[0], TUNE_WIDTH);
+}
+TUNE_ACCESSORS(ConvertARGBToY, TuneConvertARGBToYFunc, WebPConvertARGBToY)
+
+static void RunConvertARGBToUV(TuneData* const d) {
+  WebPConvertARGBToUV(d->argb_copy_, d->u_[0], d->v_[0], TUNE_WIDTH, 1);
+}
+TUNE_ACCESSORS(ConvertARGBToUV, TuneConvertARGBToUVFunc, WebPConvertARGBToUV)
+
+static void RunConvertRGB24ToY(TuneData* const d) {
+  WebPConvertRGB24ToY(d->rgba_[1], d->y_[0], TUNE_WIDTH);
+}
+TUNE_ACCESSORS(ConvertRGB24ToY, TuneConvertRGB24ToYFunc, WebPConvertRGB24ToY)
+
+#undef TUNE_SIMPLE_FILTER
+#undef TUNE_LUMA_FILTER
+#undef TUNE_CHROMA_FILTER
+#undef TUNE_UPSAMPLER
+#undef TUNE_ACCESSORS
+
+typedef struct {
+  TuneFunc (*get_)(void);
+  void (*set_)(TuneFunc func);
+  void (*run_)(TuneData* const d);
+} TunedKernel;
+
+#define TUNED_KERNEL(NAME) { Get##NAME, Set##NAME, Run##NAME }
+
+static const TunedKernel kTunedKernels[] = {
+  TUNED_KERNEL(Transform),
+  TUNED_KERNEL(SimpleVFilter16), TUNED_KERNEL(SimpleHFilter16),
+  TUNED_KERNEL(VFilter16), TUNED_KERNEL(HFilter16),
+  TUNED_KERNEL(VFilter16i), TUNED_KERNEL(HFilter16i),
+  TUNED_KERNEL(VFilter8), TUNED_KERNEL(HFilter8),
+  TUNED_KERNEL(VFilter8i), TUNED_KERNEL(HFilter8i),
+#ifdef FANCY_UPSAMPLING
+  TUNED_KERNEL(UpsampleRgb), TUNED_KERNEL(UpsampleRgba),
+  TUNED_KERNEL(UpsampleBgra),
+#endif
+  TUNED_KERNEL(SampleRgba),
+  TUNED_KERNEL(AddGreenToBlueAndRed), TUNED_KERNEL(TransformColorInverse),
+  TUNED_KERNEL(ConvertBGRAToRGBA), TUNED_KERNEL(ConvertBGRAToRGB),
+  TUNED_KERNEL(FTransform), TUNED_KERNEL(ITransform),
+  TUNED_KERNEL(SSE16x16), TUNED_KERNEL(SSE4x4),
+  TUNED_KERNEL(TDisto4x4), TUNED_KERNEL(TDisto16x16),
+  TUNED_KERNEL(QuantizeBlock), TUNED_KERNEL(Quantize2Blocks),
+  TUNED_KERNEL(CollectHistogram),
+  TUNED_KERNEL(SubtractGreenFromBlueAndRed), TUNED_KERNEL(TransformColor),
+  TUNED_KERNEL(VectorMismatch),
+  TUNED_KERNEL(ConvertARGBToY), TUNED_KERNEL(ConvertARGBToUV),
+  TUNED_KERNEL(ConvertRGB24ToY)
+};
+#undef TUNED_KERNEL
+
+#define NUM_TUNED_KERNELS \
+    ((int)(sizeof(kTunedKernels) / sizeof(kTunedKernels[0])))
+
+typedef struct {
+  TuneFunc funcs_[TUNE_MAX_CANDIDATES];
+  uint64_t ticks_[TUNE_MAX_CANDIDATES];
+  int num_;
+} TuneCandidates;
+
+static void AddCandidate(TuneCandidates* const c, TuneFunc func) {
+  int i;
+  for (i = 0; i < c->num_; ++i) {
+    if (c->funcs_[i] == func) return;
+  }
+  assert(c->num_ < TUNE_MAX_CANDIDATES);
+  c->ticks_[c->num_] = ~(uint64_t)0;
+  c->funcs_[c->num_++] = func;
+}
+
+// Returns the index of the candidate to install. 'data' is restored from
+// 'reference' before each timing, as some kernels work in place.
+static int PickFastest(const TunedKernel* const kernel,
+                       TuneCandidates* const c, int default_index,
+                       TuneData* const data, const TuneData* const reference) {
+  int trial, i, j, fastest = default_index;
+  for (trial = 0; trial < TUNE_TRIALS; ++trial) {
+    for (i = 0; i < c->num_; ++i) {
+      uint64_t start, ticks;
+      memcpy(data, reference, sizeof(*data));
+      kernel->set_(c->funcs_[i]);
+      start = WebPGetTicks();
+      for (j = 0; j < TUNE_REPS; ++j) kernel->run_(data);
+      ticks = WebPGetTicks() - start;
+      if (ticks < c->ticks_[i]) c->ticks_[i] = ticks;
+    }
+  }
+  for (i = 0; i < c->num_; ++i) {
+    if (c->ticks_[i] < c->ticks_[fastest]) fastest = i;
+  }
+  // Timing noise alone should not replace the default: require a 5% gain.
+  if (c->ticks_[fastest] * 20 >= c->ticks_[default_index] * 19) {
+    return default_index;
+  }
+  return fastest;
+}
+
+static int DoAutoTune(void) {
+  TuneCandidates candidates[NUM_TUNED_KERNELS];
+  int defaults[NUM_TUNED_KERNELS];
+  TuneData* data;
+  TuneData* reference;
+  void* memory;
+  uint32_t allowed = 0, tier_mask = 0;
+  int num_replaced = 0;
+  int f, k;
+
+  // Leave VP8GetCPUInfo alone if the application installed its own.
+  if (!VP8HasFilteredCPUInfo()) return 0;
+  memory = WebPSafeMalloc(1ULL, 2 * sizeof(*data) + WEBP_ALIGN_CST);
+  if (memory == NULL) return 0;
+  data = (TuneData*)WEBP_ALIGN(memory);
+  reference = data + 1;
+  FillTuneData(reference);
+
+  VP8InstallCPUFeatureMask(cpu_features_mask);
+  for (f = 0; f < NUM_CPU_FEATURES; ++f) {
+    if (VP8GetCPUInfo((CPUFeature)f)) allowed |= WEBP_CPU_FEATURE_BIT(f);
+  }
+
+  memset(candidates, 0, sizeof(candidates));
+  for (f = -1; f < NUM_CPU_FEATURES; ++f) {
+    if (f >= 0) {
+      if (!(allowed & WEBP_CPU_FEATURE_BIT(f))) continue;
+      tier_mask |= WEBP_CPU_FEATURE_BIT(f);
+    }
+    InstallFeatureMask(tier_mask);
+    for (k = 0; k < NUM_TUNED_KERNELS; ++k) {
+      AddCandidate(&candidates[k], kTunedKernels[k].get_());
+    }
+  }
+
+  InstallFeatureMask(cpu_features_mask);
+  for (k = 0; k < NUM_TUNED_KERNELS; ++k) {
+    const TuneFunc default_func = kTunedKernels[k].get_();
+    TuneCandidates* const c = &candidates[k];
+    for (defaults[k] = 0; c->funcs_[defaults[k]] != default_func;) {
+      ++defaults[k];
+    }
+    if (c->num_ > 1) {
+      const int best =
+          PickFastest(&kTunedKernels[k], c, defaults[k], data, reference);
+      kTunedKernels[k].set_(c->funcs_[best]);
+      if (best != defaults[k]) ++num_replaced;
+    }
+  }
+  WebPSafeFree(memory);
+  return num_replaced;
+}
+
+#undef TUNE_STRIDE
+#undef TUNE_WIDTH
+#undef TUNE_REPS
+#undef TUNE_TRIALS
+#undef TUNE_MAX_CANDIDATES
+
+static WebPOnce autotune_once = WEBP_ONCE_INIT;
+static int autotune_result = 0;
+
+static void AutoTuneOnce(void) {
+  autotune_result = DoAutoTune();
+}
+
+int VP8DspAutoTune(void) {
+  WebPRunOnce(&autotune_once, AutoTuneOnce);
+  return autotune_result;
+}
+
+#undef NUM_CPU_FEATURES
@@ -145,6 +145,38 @@ typedef enum {
 typedef int (*VP8CPUInfo)(CPUFeature feature);
 MV_WEBP_EXTERN(VP8CPUInfo) VP8GetCPUInfo;
 
+// Bit of 'feature' in the masks of VP8SetCPUFeatureMask().
+#define WEBP_CPU_FEATURE_BIT(feature) (1u << (feature))
+#define WEBP_CPU_FEATURES_ALL 0xffffffffu
+
+// Restricts the features reported by VP8GetCPUInfo to those set in 'mask',
+// e.g. to benchmark a lower tier. WEBP_CPU_FEATURES_ALL lifts the restriction.
+// The WEBP_CPU_FEATURES environment variable restricts them further, with a
+// comma-separated list of names: "sse2,sse3", "-avx2" (all but AVX2), "none".
+// The dsp functions, of the decoder and of the encoder, are re-initialized
+// right away, so this must not be called while encoding or decoding. It
+// replaces a VP8GetCPUInfo set by the application, and undoes the auto-tuning.
+MV_WEBP_EXTERN(void) VP8SetCPUFeatureMask(uint32_t mask);
+// Returns the features currently allowed by the mask above and by
+// WEBP_CPU_FEATURES.
+MV_WEBP_EXTERN(uint32_t) VP8GetCPUFeatureMask(void);
+
+// Times the implementations available for the hottest dsp functions, across
+// the allowed feature tiers, and installs the fastest ones. Only the first
+// call does the work (a few tens of milliseconds), and concurrent calls wait
+// for it. It is never run implicitly: the same restrictions as for
+// VP8SetCPUFeatureMask() apply, and neither must be called concurrently with
+// the other. Returns the number of functions which do not use their most
+// specialized implementation anymore.
+MV_WEBP_EXTERN(int) VP8DspAutoTune(void);
+
+// Internal, for the functions above: makes VP8GetCPUInfo report the detected
+// features allowed by 'mask' and by WEBP_CPU_FEATURES. The dsp functions are
+// left as they are.
+void VP8InstallCPUFeatureMask(uint32_t mask);
+// Returns true if VP8GetCPUInfo is the library's own (filtered) detection.
+int VP8HasFilteredCPUInfo(void);
+
 //------------------------------------------------------------------------------
 // Init stub generator
 
@@ -141,6 +141,33 @@ typedef void (*VP8LCollectColorRedTransformsFunc)(
     int green_to_red, int histo[]);
 extern VP8LCollectColorRedTransformsFunc VP8LCollectColorRedTransforms;
 
+// Same as above for several candidate multipliers at once: histos[i] collects
+// the transformed values for the i-th candidate, in a single pass over the
+// tile. At most VP8L_MAX_COLOR_CANDIDATES candidates can be collected.
+#define VP8L_MAX_COLOR_CANDIDATES 9
+typedef void (*VP8LCollectColorBlueTransformsBatchFunc)(
+    const uint32_t* argb, int stride,
+    int tile_width, int tile_height,
+    const int green_to_blue[], const int red_to_blue[], int num_candidates,
+    int histos[][256]);
+extern VP8LCollectColorBlueTransformsBatchFunc
+    VP8LCollectColorBlueTransformsBatch;
+
+typedef void (*VP8LCollectColorRedTransformsBatchFunc)(
+    const uint32_t* argb, int stride,
+    int tile_width, int tile_height,
+    const int green_to_red[], int num_candidates, int histos[][256]);
+extern VP8LCollectColorRedTransformsBatchFunc
+    VP8LCollectColorRedTransformsBatch;
+
+// Computes the residuals of 'num_pixels' pixels of 'in' with respect to one of
+// the 14 spatial predictors, with 'upper' pointing at the matching pixels of
+// the previous row. in[-1] and upper[-1 .. num_pixels] must be readable.
+typedef void (*VP8LPredictorSubFunc)(const uint32_t* in, const uint32_t* upper,
+                                     int num_pixels, uint32_t* out);
+extern VP8LPredictorSubFunc VP8LPredictorsSub[16];
+extern VP8LPredictorSubFunc VP8LPredictorsSub_C[16];
+
 // Expose some C-only fallback functions
 void VP8LTransformColor_C(const VP8LMultipliers* const m,
                           uint32_t* data, int num_pixels);
@@ -156,12 +183,38 @@ void VP8LCollectColorBlueTransforms_C(const uint32_t* argb, int stride,
 //------------------------------------------------------------------------------
 // Image transforms.
 
+// Finds the best predictor for the tiles [tile_x_start, tile_x_end) of the
+// rows [tile_y_start, tile_y_end) and stores it in 'image'. The search favors
+// the residuals already frequent in 'accumulated', the histograms of the
+// residuals of the previously searched tiles, and adds the ones of the range.
+// Only 'argb' is read, so that disjoint ranges can be searched concurrently,
+// each with its own 'accumulated' and 'argb_scratch'.
+void VP8LPredictorImage(int width, int height, int bits,
+                        int tile_x_start, int tile_x_end,
+                        int tile_y_start, int tile_y_end,
+                        int accumulated[4][256],
+                        const uint32_t* const argb,
+                        uint32_t* const argb_scratch, uint32_t* const image,
+                        int near_lossless, int exact, int used_subtract_green);
+// Converts 'argb' to residuals with respect to the predictors stored in
+// 'image' by VP8LPredictorImage(). In low_effort mode, no search is needed
+// and 'image' is filled here.
 void VP8LResidualImage(int width, int height, int bits, int low_effort,
                        uint32_t* const argb, uint32_t* const argb_scratch,
                        uint32_t* const image, int near_lossless, int exact,
                        int used_subtract_green);
 
+// Finds and applies the cross-color transform of the tiles
+// [tile_x_start, tile_x_end) of the rows [tile_y_start, tile_y_end). Like for
+// VP8LPredictorImage(), the search starts from the accumulated histograms of
+// the red and blue values of the previous tiles, which are then updated. It
+// also reads the transform and the pixels of the tiles above and to the left,
+// which must be done when the range is processed concurrently with others.
 void VP8LColorSpaceTransform(int width, int height, int bits, int quality,
+                             int tile_x_start, int tile_x_end,
+                             int tile_y_start, int tile_y_end,
+                             int accumulated_red_histo[256],
+                             int accumulated_blue_histo[256],
                              uint32_t* const argb, uint32_t* image);
 
 //------------------------------------------------------------------------------
@@ -357,8 +410,13 @@ static MV_WEBP_INLINE uint32_t VP8LSubPixels(uint32_t a, uint32_t b) {
   return (alpha_and_green & 0xff00ff00u) | (red_and_blue & 0x00ff00ffu);
 }
 
-void VP8LBundleColorMap(const uint8_t* const row, int width,
-                        int xbits, uint32_t* const dst);
+// Bundles multiple (1, 2, 4 or 8) palette indices of 'row' into the green
+// channel of each 'dst' pixel, 2^'xbits' of them per pixel.
+typedef void (*VP8LBundleColorMapFunc)(const uint8_t* const row, int width,
+                                       int xbits, uint32_t* const dst);
+extern VP8LBundleColorMapFunc VP8LBundleColorMap;
+void VP8LBundleColorMap_C(const uint8_t* const row, int width,
+                          int xbits, uint32_t* const dst);
 
 // Must be called before calling any of the above methods.
 void VP8LEncDspInit(void);
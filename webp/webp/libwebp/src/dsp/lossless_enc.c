@@ -16,7 +16,6 @@
 #include "./dsp.h"
 
 #include <math.h>
-#include <stdlib.h>
 #include "../dec/vp8li.h"
 #include "../utils/endian_inl.h"
 #include "./lossless.h"
@@ -24,6 +23,9 @@
 
 #define MAX_DIFF_COST (1e30f)
 
+// Number of residuals computed in one batch during the predictor search.
+#define RESIDUAL_BATCH_SIZE 64
+
 static const int kPredLowEffort = 11;
 static const uint32_t kMaskAlpha = 0xff000000;
 
@@ -422,14 +424,57 @@ static float CombinedShannonEntropy(const int X[256], const int Y[256]) {
   return (float)retval;
 }
 
-static float PredictionCostSpatialHistogram(const int accumulated[4][256],
-                                            const int tile[4][256]) {
+// Entropy terms of an accumulated histogram, which are shared by all the
+// candidates (predictors or color multipliers) evaluated for a tile.
+typedef struct {
+  float slog2_[256];   // slog2(histo[i])
+  double entropy_;     // -sum(slog2(histo[]))
+  int sum_;
+} HistogramCost;
+
+static void InitHistogramCost(const int histo[256],
+                              HistogramCost* const cost) {
+  int i;
+  cost->entropy_ = 0.;
+  cost->sum_ = 0;
+  for (i = 0; i < 256; ++i) {
+    cost->sum_ += histo[i];
+    cost->slog2_[i] = VP8LFastSLog2(histo[i]);
+    cost->entropy_ -= cost->slog2_[i];
+  }
+}
+
+// Same as CombinedShannonEntropy(X, Y), but only visits the symbols present in
+// the (sparse) tile histogram 'X'. The terms are not summed in the same order,
+// so the result may differ in the last bits: of two candidates with nearly the
+// same cost, the other one can then be picked.
+static float CombinedEntropyWithAccumulated(const int X[256], const int Y[256],
+                                            const HistogramCost* const y_cost) {
+  int i;
+  double retval = y_cost->entropy_;
+  int sumX = 0;
+  for (i = 0; i < 256; ++i) {
+    const int x = X[i];
+    if (x != 0) {
+      const int y = Y[i];
+      sumX += x;
+      retval -= VP8LFastSLog2(x) + VP8LFastSLog2(x + y) - y_cost->slog2_[i];
+    }
+  }
+  retval += VP8LFastSLog2(sumX) + VP8LFastSLog2(sumX + y_cost->sum_);
+  return (float)retval;
+}
+
+static float PredictionCostSpatialHistogram(
+    const int accumulated[4][256], const HistogramCost accumulated_cost[4],
+    const int tile[4][256]) {
   int i;
   double retval = 0;
   for (i = 0; i < 4; ++i) {
     const double kExpValue = 0.94;
     retval += PredictionCostSpatial(tile[i], 1, kExpValue);
-    retval += VP8LCombinedShannonEntropy(tile[i], accumulated[i]);
+    retval += CombinedEntropyWithAccumulated(tile[i], accumulated[i],
+                                             &accumulated_cost[i]);
   }
   return (float)retval;
 }
@@ -552,6 +597,27 @@ static MV_WEBP_INLINE uint32_t Predict(VP8LPredictorFunc pred_func,
   }
 }
 
+// Same as Predict() followed by VP8LSubPixels(), for the 'num_pixels' pixels
+// of row 'y' starting at 'x_start'.
+static void PredictBatch(int mode, int x_start, int y, int num_pixels,
+                         const uint32_t* const current,
+                         const uint32_t* const upper, uint32_t* out) {
+  if (x_start == 0) {
+    if (y == 0) {
+      *out = VP8LSubPixels(current[0], ARGB_BLACK);
+    } else {
+      *out = VP8LSubPixels(current[0], upper[0]);  // Top.
+    }
+    ++x_start;
+    ++out;
+    --num_pixels;
+  }
+  if (y == 0) {
+    mode = 1;  // Left.
+  }
+  VP8LPredictorsSub[mode](current + x_start, upper + x_start, num_pixels, out);
+}
+
 static int MaxDiffBetweenPixels(uint32_t p1, uint32_t p2) {
   const int diff_a = abs((int)(p1 >> 24) - (int)(p2 >> 24));
   const int diff_r = abs((int)((p1 >> 16) & 0xff) - (int)((p2 >> 16) & 0xff));
@@ -719,6 +785,40 @@ static MV_WEBP_INLINE uint32_t GetResidual(int width, int height,
   return residual;
 }
 
+static int HasTransparentPixel(const uint32_t* const argb, int num_pixels) {
+  int i;
+  for (i = 0; i < num_pixels; ++i) {
+    if ((argb[i] & kMaskAlpha) == 0) return 1;
+  }
+  return 0;
+}
+
+// Stores the residuals of pixels [x_start, x_end) of row 'y' in 'out'. Unless
+// some pixels are modified on the way (by near lossless quantization or the
+// cleanup of transparent pixels), the whole segment is predicted in one batch.
+static void GetResiduals(int width, int height,
+                         uint32_t* const upper_row,
+                         uint32_t* const current_row,
+                         const uint8_t* const max_diffs, int mode,
+                         int x_start, int x_end, int y, int max_quantization,
+                         int exact, int used_subtract_green,
+                         uint32_t* const out) {
+  if ((max_quantization == 1 || mode == 0) &&
+      (exact || !HasTransparentPixel(current_row + x_start, x_end - x_start))) {
+    PredictBatch(mode, x_start, y, x_end - x_start, current_row, upper_row,
+                 out);
+  } else {
+    const VP8LPredictorFunc pred_func = VP8LPredictors[mode];
+    int x;
+    for (x = x_start; x < x_end; ++x) {
+      out[x - x_start] =
+          GetResidual(width, height, upper_row, current_row, max_diffs, mode,
+                      pred_func, x, y, max_quantization, exact,
+                      used_subtract_green);
+    }
+  }
+}
+
 // Returns best predictor and updates the accumulated histogram.
 // If max_quantization > 1, assumes that near lossless processing will be
 // applied, quantizing residuals to multiples of quantization levels up to
@@ -758,10 +858,15 @@ static int GetBestPredictorForTile(int width, int height,
   // Need pointers to be able to swap arrays.
   int (*histo_argb)[256] = histo_stack_1;
   int (*best_histo)[256] = histo_stack_2;
+  uint32_t residuals[RESIDUAL_BATCH_SIZE];
+  HistogramCost accumulated_cost[4];
   int i, j;
 
+  for (i = 0; i < 4; ++i) {
+    InitHistogramCost(accumulated[i], &accumulated_cost[i]);
+  }
+
   for (mode = 0; mode < kNumPredModes; ++mode) {
-    const VP8LPredictorFunc pred_func = VP8LPredictors[mode];
     float cur_diff;
     int relative_y;
     memset(histo_argb, 0, sizeof(histo_stack_1));
@@ -792,16 +897,21 @@ static int GetBestPredictorForTile(int width, int height,
                        max_diffs + context_start_x, used_subtract_green);
       }
 
-      for (relative_x = 0; relative_x < max_x; ++relative_x) {
+      for (relative_x = 0; relative_x < max_x;
+           relative_x += RESIDUAL_BATCH_SIZE) {
         const int x = start_x + relative_x;
-        UpdateHisto(histo_argb,
-                    GetResidual(width, height, upper_row, current_row,
-                                max_diffs, mode, pred_func, x, y,
-                                max_quantization, exact, used_subtract_green));
+        const int x_end = x + GetMin(RESIDUAL_BATCH_SIZE, max_x - relative_x);
+        GetResiduals(width, height, upper_row, current_row, max_diffs, mode,
+                     x, x_end, y, max_quantization, exact, used_subtract_green,
+                     residuals);
+        for (i = 0; i < x_end - x; ++i) {
+          UpdateHisto(histo_argb, residuals[i]);
+        }
       }
     }
     cur_diff = PredictionCostSpatialHistogram(
-        (const int (*)[256])accumulated, (const int (*)[256])histo_argb);
+        (const int (*)[256])accumulated, accumulated_cost,
+        (const int (*)[256])histo_argb);
     if (cur_diff < best_diff) {
       int (*tmp)[256] = histo_argb;
       histo_argb = best_histo;
@@ -831,7 +941,7 @@ static void CopyImageWithPrediction(int width, int height,
                                     int low_effort, int max_quantization,
                                     int exact, int used_subtract_green) {
   const int tiles_per_row = VP8LSubSampleSize(width, bits);
-  const int mask = (1 << bits) - 1;
+  const int tile_size = 1 << bits;
   // The width of upper_row and current_row is one pixel larger than image width
   // to allow the top right pixel to point to the leftmost pixel of the next row
   // when at the right edge.
@@ -840,8 +950,6 @@ static void CopyImageWithPrediction(int width, int height,
   uint8_t* current_max_diffs = (uint8_t*)(current_row + width + 1);
   uint8_t* lower_max_diffs = current_max_diffs + width;
   int y;
-  int mode = 0;
-  VP8LPredictorFunc pred_func = NULL;
 
   for (y = 0; y < height; ++y) {
     int x;
@@ -852,11 +960,8 @@ static void CopyImageWithPrediction(int width, int height,
            sizeof(*argb) * (width + (y + 1 < height)));
 
     if (low_effort) {
-      for (x = 0; x < width; ++x) {
-        const uint32_t predict = Predict(VP8LPredictors[kPredLowEffort], x, y,
-                                         current_row, upper_row);
-        argb[y * width + x] = VP8LSubPixels(current_row[x], predict);
-      }
+      PredictBatch(kPredLowEffort, 0, y, width, current_row, upper_row,
+                   argb + y * width);
     } else {
       if (max_quantization > 1) {
         // Compute max_diffs for the lower row now, because that needs the
@@ -870,48 +975,57 @@ static void CopyImageWithPrediction(int width, int height,
                          used_subtract_green);
         }
       }
-      for (x = 0; x < width; ++x) {
-        if ((x & mask) == 0) {
-          mode = (modes[(y >> bits) * tiles_per_row + (x >> bits)] >> 8) & 0xff;
-          pred_func = VP8LPredictors[mode];
-        }
-        argb[y * width + x] = GetResidual(
-            width, height, upper_row, current_row, current_max_diffs, mode,
-            pred_func, x, y, max_quantization, exact, used_subtract_green);
+      for (x = 0; x < width; x += tile_size) {
+        const int mode =
+            (modes[(y >> bits) * tiles_per_row + (x >> bits)] >> 8) & 0xff;
+        GetResiduals(width, height, upper_row, current_row, current_max_diffs,
+                     mode, x, GetMin(x + tile_size, width), y,
+                     max_quantization, exact, used_subtract_green,
+                     argb + y * width + x);
       }
     }
   }
 }
 
-// Finds the best predictor for each tile, and converts the image to residuals
-// with respect to predictions. If near_lossless_quality < 100, applies
-// near lossless processing, shaving off more bits of residuals for lower
-// qualities.
+// Finds the best predictor for each tile of the given range. If
+// near_lossless_quality < 100, assumes near lossless processing will shave off
+// more bits of residuals for lower qualities.
+void VP8LPredictorImage(int width, int height, int bits,
+                        int tile_x_start, int tile_x_end,
+                        int tile_y_start, int tile_y_end,
+                        int accumulated[4][256],
+                        const uint32_t* const argb,
+                        uint32_t* const argb_scratch, uint32_t* const image,
+                        int near_lossless_quality, int exact,
+                        int used_subtract_green) {
+  const int tiles_per_row = VP8LSubSampleSize(width, bits);
+  const int max_quantization = 1 << VP8LNearLosslessBits(near_lossless_quality);
+  int tile_y;
+  for (tile_y = tile_y_start; tile_y < tile_y_end; ++tile_y) {
+    int tile_x;
+    for (tile_x = tile_x_start; tile_x < tile_x_end; ++tile_x) {
+      const int pred = GetBestPredictorForTile(width, height, tile_x, tile_y,
+          bits, accumulated, argb_scratch, argb, max_quantization, exact,
+          used_subtract_green);
+      image[tile_y * tiles_per_row + tile_x] = ARGB_BLACK | (pred << 8);
+    }
+  }
+}
+
+// Converts the image to residuals with respect to predictions. If
+// near_lossless_quality < 100, applies near lossless processing.
 void VP8LResidualImage(int width, int height, int bits, int low_effort,
                        uint32_t* const argb, uint32_t* const argb_scratch,
                        uint32_t* const image, int near_lossless_quality,
                        int exact, int used_subtract_green) {
-  const int tiles_per_row = VP8LSubSampleSize(width, bits);
-  const int tiles_per_col = VP8LSubSampleSize(height, bits);
-  int tile_y;
-  int histo[4][256];
   const int max_quantization = 1 << VP8LNearLosslessBits(near_lossless_quality);
   if (low_effort) {
+    const int tiles_per_row = VP8LSubSampleSize(width, bits);
+    const int tiles_per_col = VP8LSubSampleSize(height, bits);
     int i;
     for (i = 0; i < tiles_per_row * tiles_per_col; ++i) {
       image[i] = ARGB_BLACK | (kPredLowEffort << 8);
     }
-  } else {
-    memset(histo, 0, sizeof(histo));
-    for (tile_y = 0; tile_y < tiles_per_col; ++tile_y) {
-      int tile_x;
-      for (tile_x = 0; tile_x < tiles_per_row; ++tile_x) {
-        const int pred = GetBestPredictorForTile(width, height, tile_x, tile_y,
-            bits, histo, argb_scratch, argb, max_quantization, exact,
-            used_subtract_green);
-        image[tile_y * tiles_per_row + tile_x] = ARGB_BLACK | (pred << 8);
-      }
-    }
   }
 
   CopyImageWithPrediction(width, height, bits, image, argb_scratch, argb,
@@ -919,6 +1033,39 @@ void VP8LResidualImage(int width, int height, int bits, int low_effort,
                           used_subtract_green);
 }
 
+//------------------------------------------------------------------------------
+// Batch residuals for each predictor.
+
+#define GENERATE_PREDICTOR_SUB(PREDICTOR_I)                                    \
+static void PredictorSub##PREDICTOR_I##_C(const uint32_t* in,                  \
+                                          const uint32_t* upper,               \
+                                          int num_pixels, uint32_t* out) {     \
+  int i;                                                                       \
+  for (i = 0; i < num_pixels; ++i) {                                           \
+    const uint32_t pred = VP8LPredictors[(PREDICTOR_I)](in[i - 1], upper + i); \
+    out[i] = VP8LSubPixels(in[i], pred);                                       \
+  }                                                                            \
+}
+
+GENERATE_PREDICTOR_SUB(0)
+GENERATE_PREDICTOR_SUB(1)
+GENERATE_PREDICTOR_SUB(2)
+GENERATE_PREDICTOR_SUB(3)
+GENERATE_PREDICTOR_SUB(4)
+GENERATE_PREDICTOR_SUB(5)
+GENERATE_PREDICTOR_SUB(6)
+GENERATE_PREDICTOR_SUB(7)
+GENERATE_PREDICTOR_SUB(8)
+GENERATE_PREDICTOR_SUB(9)
+GENERATE_PREDICTOR_SUB(10)
+GENERATE_PREDICTOR_SUB(11)
+GENERATE_PREDICTOR_SUB(12)
+GENERATE_PREDICTOR_SUB(13)
+
+#undef GENERATE_PREDICTOR_SUB
+
+//------------------------------------------------------------------------------
+
 void VP8LSubtractGreenFromBlueAndRed_C(uint32_t* argb_data, int num_pixels) {
   int i;
   for (i = 0; i < num_pixels; ++i) {
@@ -994,11 +1141,12 @@ static MV_WEBP_INLINE uint8_t TransformColorBlue(uint8_t green_to_blue,
 }
 
 static float PredictionCostCrossColor(const int accumulated[256],
+                                      const HistogramCost* const cost,
                                       const int counts[256]) {
   // Favor low entropy, locally and globally.
   // Favor small absolute values for PredictionCostSpatial
   static const double kExpValue = 2.4;
-  return VP8LCombinedShannonEntropy(counts, accumulated) +
+  return CombinedEntropyWithAccumulated(counts, accumulated, cost) +
          PredictionCostSpatial(counts, 3, kExpValue);
 }
 
@@ -1014,17 +1162,24 @@ void VP8LCollectColorRedTransforms_C(const uint32_t* argb, int stride,
   }
 }
 
-static float GetPredictionCostCrossColorRed(
-    const uint32_t* argb, int stride, int tile_width, int tile_height,
-    VP8LMultipliers prev_x, VP8LMultipliers prev_y, int green_to_red,
-    const int accumulated_red_histo[256]) {
-  int histo[256] = { 0 };
-  float cur_diff;
-
-  VP8LCollectColorRedTransforms(argb, stride, tile_width, tile_height,
-                                green_to_red, histo);
+static void CollectColorRedTransformsBatch(const uint32_t* argb, int stride,
+                                           int tile_width, int tile_height,
+                                           const int green_to_red[],
+                                           int num_candidates,
+                                           int histos[][256]) {
+  int i;
+  for (i = 0; i < num_candidates; ++i) {
+    VP8LCollectColorRedTransforms(argb, stride, tile_width, tile_height,
+                                  green_to_red[i], histos[i]);
+  }
+}
 
-  cur_diff = PredictionCostCrossColor(accumulated_red_histo, histo);
+static float GetPredictionCostCrossColorRed(
+    const int histo[256], VP8LMultipliers prev_x, VP8LMultipliers prev_y,
+    int green_to_red, const int accumulated_red_histo[256],
+    const HistogramCost* const accumulated_red_cost) {
+  float cur_diff = PredictionCostCrossColor(accumulated_red_histo,
+                                            accumulated_red_cost, histo);
   if ((uint8_t)green_to_red == prev_x.green_to_red_) {
     cur_diff -= 3;  // favor keeping the areas locally similar
   }
@@ -1037,30 +1192,41 @@ static float GetPredictionCostCrossColorRed(
   return cur_diff;
 }
 
+// Coarse to fine search: at each step, both neighbors of the best known value
+// are collected in one pass over the tile (together with the origin, for the
+// first step).
 static void GetBestGreenToRed(
     const uint32_t* argb, int stride, int tile_width, int tile_height,
     VP8LMultipliers prev_x, VP8LMultipliers prev_y, int quality,
-    const int accumulated_red_histo[256], VP8LMultipliers* const best_tx) {
+    const int accumulated_red_histo[256],
+    const HistogramCost* const accumulated_red_cost,
+    VP8LMultipliers* const best_tx) {
   const int kMaxIters = 4 + ((7 * quality) >> 8);  // in range [4..6]
   int green_to_red_best = 0;
-  int iter, offset;
-  float best_diff = GetPredictionCostCrossColorRed(
-      argb, stride, tile_width, tile_height, prev_x, prev_y,
-      green_to_red_best, accumulated_red_histo);
+  float best_diff = MAX_DIFF_COST;
+  int iter;
   for (iter = 0; iter < kMaxIters; ++iter) {
     // ColorTransformDelta is a 3.5 bit fixed point, so 32 is equal to
     // one in color computation. Having initial delta here as 1 is sufficient
     // to explore the range of (-2, 2).
     const int delta = 32 >> iter;
-    // Try a negative and a positive delta from the best known value.
-    for (offset = -delta; offset <= delta; offset += 2 * delta) {
-      const int green_to_red_cur = offset + green_to_red_best;
+    int candidates[3];
+    int histos[3][256];
+    int num = 0;
+    int i;
+    if (iter == 0) candidates[num++] = green_to_red_best;
+    candidates[num++] = green_to_red_best - delta;
+    candidates[num++] = green_to_red_best + delta;
+    memset(histos, 0, num * sizeof(histos[0]));
+    VP8LCollectColorRedTransformsBatch(argb, stride, tile_width, tile_height,
+                                       candidates, num, histos);
+    for (i = 0; i < num; ++i) {
       const float cur_diff = GetPredictionCostCrossColorRed(
-          argb, stride, tile_width, tile_height, prev_x, prev_y,
-          green_to_red_cur, accumulated_red_histo);
+          histos[i], prev_x, prev_y, candidates[i], accumulated_red_histo,
+          accumulated_red_cost);
       if (cur_diff < best_diff) {
         best_diff = cur_diff;
-        green_to_red_best = green_to_red_cur;
+        green_to_red_best = candidates[i];
       }
     }
   }
@@ -1080,17 +1246,26 @@ void VP8LCollectColorBlueTransforms_C(const uint32_t* argb, int stride,
   }
 }
 
-static float GetPredictionCostCrossColorBlue(
-    const uint32_t* argb, int stride, int tile_width, int tile_height,
-    VP8LMultipliers prev_x, VP8LMultipliers prev_y,
-    int green_to_blue, int red_to_blue, const int accumulated_blue_histo[256]) {
-  int histo[256] = { 0 };
-  float cur_diff;
-
-  VP8LCollectColorBlueTransforms(argb, stride, tile_width, tile_height,
-                                 green_to_blue, red_to_blue, histo);
+static void CollectColorBlueTransformsBatch(const uint32_t* argb, int stride,
+                                            int tile_width, int tile_height,
+                                            const int green_to_blue[],
+                                            const int red_to_blue[],
+                                            int num_candidates,
+                                            int histos[][256]) {
+  int i;
+  for (i = 0; i < num_candidates; ++i) {
+    VP8LCollectColorBlueTransforms(argb, stride, tile_width, tile_height,
+                                   green_to_blue[i], red_to_blue[i],
+                                   histos[i]);
+  }
+}
 
-  cur_diff = PredictionCostCrossColor(accumulated_blue_histo, histo);
+static float GetPredictionCostCrossColorBlue(
+    const int histo[256], VP8LMultipliers prev_x, VP8LMultipliers prev_y,
+    int green_to_blue, int red_to_blue, const int accumulated_blue_histo[256],
+    const HistogramCost* const accumulated_blue_cost) {
+  float cur_diff = PredictionCostCrossColor(accumulated_blue_histo,
+                                            accumulated_blue_cost, histo);
   if ((uint8_t)green_to_blue == prev_x.green_to_blue_) {
     cur_diff -= 3;  // favor keeping the areas locally similar
   }
@@ -1114,10 +1289,14 @@ static float GetPredictionCostCrossColorBlue(
 
 #define kGreenRedToBlueNumAxis 8
 #define kGreenRedToBlueMaxIters 7
+// Coarse to fine search: at each step, the 8 neighbors of the best known
+// value are collected in one pass over the tile (together with the origin,
+// for the first step).
 static void GetBestGreenRedToBlue(
     const uint32_t* argb, int stride, int tile_width, int tile_height,
     VP8LMultipliers prev_x, VP8LMultipliers prev_y, int quality,
     const int accumulated_blue_histo[256],
+    const HistogramCost* const accumulated_blue_cost,
     VP8LMultipliers* const best_tx) {
   const int8_t offset[kGreenRedToBlueNumAxis][2] =
       {{0, -1}, {0, 1}, {-1, 0}, {1, 0}, {-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
@@ -1126,29 +1305,37 @@ static void GetBestGreenRedToBlue(
       (quality < 25) ? 1 : (quality > 50) ? kGreenRedToBlueMaxIters : 4;
   int green_to_blue_best = 0;
   int red_to_blue_best = 0;
+  float best_diff = MAX_DIFF_COST;
   int iter;
-  // Initial value at origin:
-  float best_diff = GetPredictionCostCrossColorBlue(
-      argb, stride, tile_width, tile_height, prev_x, prev_y,
-      green_to_blue_best, red_to_blue_best, accumulated_blue_histo);
   for (iter = 0; iter < iters; ++iter) {
     const int delta = delta_lut[iter];
-    int axis;
+    int green_to_blue[kGreenRedToBlueNumAxis + 1];
+    int red_to_blue[kGreenRedToBlueNumAxis + 1];
+    int histos[kGreenRedToBlueNumAxis + 1][256];
+    int num = 0;
+    int axis, i;
+    if (iter == 0) {
+      green_to_blue[num] = green_to_blue_best;
+      red_to_blue[num] = red_to_blue_best;
+      ++num;
+    }
     for (axis = 0; axis < kGreenRedToBlueNumAxis; ++axis) {
-      const int green_to_blue_cur =
-          offset[axis][0] * delta + green_to_blue_best;
-      const int red_to_blue_cur = offset[axis][1] * delta + red_to_blue_best;
+      green_to_blue[num] = offset[axis][0] * delta + green_to_blue_best;
+      red_to_blue[num] = offset[axis][1] * delta + red_to_blue_best;
+      ++num;
+    }
+    memset(histos, 0, num * sizeof(histos[0]));
+    VP8LCollectColorBlueTransformsBatch(argb, stride, tile_width, tile_height,
+                                        green_to_blue, red_to_blue, num,
+                                        histos);
+    for (i = 0; i < num; ++i) {
       const float cur_diff = GetPredictionCostCrossColorBlue(
-          argb, stride, tile_width, tile_height, prev_x, prev_y,
-          green_to_blue_cur, red_to_blue_cur, accumulated_blue_histo);
+          histos[i], prev_x, prev_y, green_to_blue[i], red_to_blue[i],
+          accumulated_blue_histo, accumulated_blue_cost);
       if (cur_diff < best_diff) {
         best_diff = cur_diff;
-        green_to_blue_best = green_to_blue_cur;
-        red_to_blue_best = red_to_blue_cur;
-      }
-      if (quality < 25 && iter == 4) {
-        // Only axis aligned diffs for lower quality.
-        break;  // next iter.
+        green_to_blue_best = green_to_blue[i];
+        red_to_blue_best = red_to_blue[i];
       }
     }
     if (delta == 2 && green_to_blue_best == 0 && red_to_blue_best == 0) {
@@ -1180,13 +1367,17 @@ static VP8LMultipliers GetBestColorTransformForTile(
   const uint32_t* const tile_argb = argb + tile_y_offset * xsize
                                   + tile_x_offset;
   VP8LMultipliers best_tx;
+  HistogramCost accumulated_red_cost, accumulated_blue_cost;
   MultipliersClear(&best_tx);
+  InitHistogramCost(accumulated_red_histo, &accumulated_red_cost);
+  InitHistogramCost(accumulated_blue_histo, &accumulated_blue_cost);
 
   GetBestGreenToRed(tile_argb, xsize, tile_width, tile_height,
-                    prev_x, prev_y, quality, accumulated_red_histo, &best_tx);
+                    prev_x, prev_y, quality, accumulated_red_histo,
+                    &accumulated_red_cost, &best_tx);
   GetBestGreenRedToBlue(tile_argb, xsize, tile_width, tile_height,
                         prev_x, prev_y, quality, accumulated_blue_histo,
-                        &best_tx);
+                        &accumulated_blue_cost, &best_tx);
   return best_tx;
 }
 
@@ -1205,18 +1396,23 @@ static void CopyTileWithColorTransform(int xsize, int ysize,
 }
 
 void VP8LColorSpaceTransform(int width, int height, int bits, int quality,
+                             int tile_x_start, int tile_x_end,
+                             int tile_y_start, int tile_y_end,
+                             int accumulated_red_histo[256],
+                             int accumulated_blue_histo[256],
                              uint32_t* const argb, uint32_t* image) {
   const int max_tile_size = 1 << bits;
   const int tile_xsize = VP8LSubSampleSize(width, bits);
-  const int tile_ysize = VP8LSubSampleSize(height, bits);
-  int accumulated_red_histo[256] = { 0 };
-  int accumulated_blue_histo[256] = { 0 };
   int tile_x, tile_y;
   VP8LMultipliers prev_x, prev_y;
   MultipliersClear(&prev_y);
   MultipliersClear(&prev_x);
-  for (tile_y = 0; tile_y < tile_ysize; ++tile_y) {
-    for (tile_x = 0; tile_x < tile_xsize; ++tile_x) {
+  if (tile_x_start > 0) {
+    ColorCodeToMultipliers(image[tile_y_start * tile_xsize + tile_x_start - 1],
+                           &prev_x);
+  }
+  for (tile_y = tile_y_start; tile_y < tile_y_end; ++tile_y) {
+    for (tile_x = tile_x_start; tile_x < tile_x_end; ++tile_x) {
       int y;
       const int tile_x_offset = tile_x * max_tile_size;
       const int tile_y_offset = tile_y * max_tile_size;
@@ -1237,17 +1433,20 @@ void VP8LColorSpaceTransform(int width, int height, int bits, int quality,
                                  max_tile_size, prev_x, argb);
 
       // Gather accumulated histogram data.
+      // The pixels before the start of the row are not looked at: they belong
+      // to the last tile of the previous row, which may not be done yet.
       for (y = tile_y_offset; y < all_y_max; ++y) {
+        const int ix_start = y * width + 2;
         int ix = y * width + tile_x_offset;
         const int ix_end = ix + all_x_max - tile_x_offset;
         for (; ix < ix_end; ++ix) {
           const uint32_t pix = argb[ix];
-          if (ix >= 2 &&
+          if (ix >= ix_start &&
               pix == argb[ix - 2] &&
               pix == argb[ix - 1]) {
             continue;  // repeated pixels are handled by backward references
           }
-          if (ix >= width + 2 &&
+          if (ix >= ix_start && y > 0 &&
               argb[ix - 2] == argb[ix - width - 2] &&
               argb[ix - 1] == argb[ix - width - 1] &&
               pix == argb[ix - width]) {
@@ -1274,8 +1473,8 @@ static int VectorMismatch(const uint32_t* const array1,
 }
 
 // Bundles multiple (1, 2, 4 or 8) pixels into a single pixel.
-void VP8LBundleColorMap(const uint8_t* const row, int width,
-                        int xbits, uint32_t* const dst) {
+void VP8LBundleColorMap_C(const uint8_t* const row, int width,
+                          int xbits, uint32_t* const dst) {
   int x;
   if (xbits > 0) {
     const int bit_depth = 1 << (3 - xbits);
@@ -1357,6 +1556,8 @@ VP8LTransformColorFunc VP8LTransformColor;
 
 VP8LCollectColorBlueTransformsFunc VP8LCollectColorBlueTransforms;
 VP8LCollectColorRedTransformsFunc VP8LCollectColorRedTransforms;
+VP8LCollectColorBlueTransformsBatchFunc VP8LCollectColorBlueTransformsBatch;
+VP8LCollectColorRedTransformsBatchFunc VP8LCollectColorRedTransformsBatch;
 
 VP8LFastLog2SlowFunc VP8LFastLog2Slow;
 VP8LFastLog2SlowFunc VP8LFastSLog2Slow;
@@ -1370,6 +1571,10 @@ GetEntropyUnrefinedHelperFunc VP8LGetEntropyUnrefinedHelper;
 VP8LHistogramAddFunc VP8LHistogramAdd;
 
 VP8LVectorMismatchFunc VP8LVectorMismatch;
+VP8LBundleColorMapFunc VP8LBundleColorMap;
+
+VP8LPredictorSubFunc VP8LPredictorsSub[16];
+VP8LPredictorSubFunc VP8LPredictorsSub_C[16];
 
 extern void VP8LEncDspInitSSE2(void);
 extern void VP8LEncDspInitSSE41(void);
@@ -1391,6 +1596,8 @@ WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInit(void) {
 
   VP8LCollectColorBlueTransforms = VP8LCollectColorBlueTransforms_C;
   VP8LCollectColorRedTransforms = VP8LCollectColorRedTransforms_C;
+  VP8LCollectColorBlueTransformsBatch = CollectColorBlueTransformsBatch;
+  VP8LCollectColorRedTransformsBatch = CollectColorRedTransformsBatch;
 
   VP8LFastLog2Slow = FastLog2Slow;
   VP8LFastSLog2Slow = FastSLog2Slow;
@@ -1404,6 +1611,25 @@ WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInit(void) {
   VP8LHistogramAdd = HistogramAdd;
 
   VP8LVectorMismatch = VectorMismatch;
+  VP8LBundleColorMap = VP8LBundleColorMap_C;
+
+  VP8LPredictorsSub[0] = PredictorSub0_C;
+  VP8LPredictorsSub[1] = PredictorSub1_C;
+  VP8LPredictorsSub[2] = PredictorSub2_C;
+  VP8LPredictorsSub[3] = PredictorSub3_C;
+  VP8LPredictorsSub[4] = PredictorSub4_C;
+  VP8LPredictorsSub[5] = PredictorSub5_C;
+  VP8LPredictorsSub[6] = PredictorSub6_C;
+  VP8LPredictorsSub[7] = PredictorSub7_C;
+  VP8LPredictorsSub[8] = PredictorSub8_C;
+  VP8LPredictorsSub[9] = PredictorSub9_C;
+  VP8LPredictorsSub[10] = PredictorSub10_C;
+  VP8LPredictorsSub[11] = PredictorSub11_C;
+  VP8LPredictorsSub[12] = PredictorSub12_C;
+  VP8LPredictorsSub[13] = PredictorSub13_C;
+  VP8LPredictorsSub[14] = PredictorSub0_C;  // <- padding security sentinels
+  VP8LPredictorsSub[15] = PredictorSub0_C;
+  memcpy(VP8LPredictorsSub_C, VP8LPredictorsSub, sizeof(VP8LPredictorsSub));
 
   // If defined, use CPUInfo() to overwrite some pointers with faster versions.
   if (VP8GetCPUInfo != NULL) {
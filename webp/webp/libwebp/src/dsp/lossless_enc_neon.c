@@ -126,6 +126,37 @@ static void TransformColor(const VP8LMultipliers* const m,
 
 #undef USE_VTBLQ
 
+//------------------------------------------------------------------------------
+
+static int VectorMismatch(const uint32_t* const array1,
+                          const uint32_t* const array2, int length) {
+  int match_len = 0;
+
+  // Compare 8 pixels per step. The comparisons are narrowed to one byte per
+  // pixel, so that the first zero byte of 'mask' is the first mismatch.
+  while (match_len + 8 <= length) {
+    const uint32x4_t cmp0 = vceqq_u32(vld1q_u32(array1 + match_len),
+                                      vld1q_u32(array2 + match_len));
+    const uint32x4_t cmp1 = vceqq_u32(vld1q_u32(array1 + match_len + 4),
+                                      vld1q_u32(array2 + match_len + 4));
+    const uint8x8_t cmp =
+        vmovn_u16(vcombine_u16(vmovn_u32(cmp0), vmovn_u32(cmp1)));
+    const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(cmp), 0);
+    if (mask != ~(uint64_t)0) {
+      const uint32_t mask_lo = (uint32_t)mask;
+      if (mask_lo != 0xffffffffu) {
+        return match_len + (BitsCtz(~mask_lo) >> 3);
+      }
+      return match_len + 4 + (BitsCtz(~(uint32_t)(mask >> 32)) >> 3);
+    }
+    match_len += 8;
+  }
+  while (match_len < length && array1[match_len] == array2[match_len]) {
+    ++match_len;
+  }
+  return match_len;
+}
+
 //------------------------------------------------------------------------------
 // Entry point
 
@@ -134,6 +165,7 @@ extern void VP8LEncDspInitNEON(void);
 WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInitNEON(void) {
   VP8LSubtractGreenFromBlueAndRed = SubtractGreenFromBlueAndRed;
   VP8LTransformColor = TransformColor;
+  VP8LVectorMismatch = VectorMismatch;
 }
 
 #else  // !WEBP_USE_NEON
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <emmintrin.h>
 #include "./lossless.h"
+#include "../webp/format_constants.h"
 
 // For sign-extended multiplying constants, pre-shifted by 5:
 #define CST_5b(X)  (((int16_t)((uint16_t)X << 8)) >> 5)
@@ -166,6 +167,129 @@ static void CollectColorRedTransforms(const uint32_t* argb, int stride,
     }
   }
 }
+
+// Increments the bins of the 8 16b values. Extracting the indices directly
+// is faster than going through memory.
+static MV_WEBP_INLINE void AddToHisto8(const __m128i values, int histo[]) {
+  ++histo[_mm_extract_epi16(values, 0)];
+  ++histo[_mm_extract_epi16(values, 1)];
+  ++histo[_mm_extract_epi16(values, 2)];
+  ++histo[_mm_extract_epi16(values, 3)];
+  ++histo[_mm_extract_epi16(values, 4)];
+  ++histo[_mm_extract_epi16(values, 5)];
+  ++histo[_mm_extract_epi16(values, 6)];
+  ++histo[_mm_extract_epi16(values, 7)];
+}
+
+// The pixels are loaded and split once, then transformed for each candidate.
+static void CollectColorBlueTransformsBatch(const uint32_t* argb, int stride,
+                                            int tile_width, int tile_height,
+                                            const int green_to_blue[],
+                                            const int red_to_blue[],
+                                            int num_candidates,
+                                            int histos[][256]) {
+  __m128i mults_r[VP8L_MAX_COLOR_CANDIDATES];
+  __m128i mults_g[VP8L_MAX_COLOR_CANDIDATES];
+  const __m128i mask_g = _mm_set1_epi32(0x00ff00);  // green mask
+  const __m128i mask_b = _mm_set1_epi32(0x0000ff);  // blue mask
+  int c, y;
+  assert(num_candidates <= VP8L_MAX_COLOR_CANDIDATES);
+  for (c = 0; c < num_candidates; ++c) {
+    const int r2b = red_to_blue[c], g2b = green_to_blue[c];
+    mults_r[c] = _mm_set_epi16(CST_5b(r2b), 0, CST_5b(r2b), 0,
+                               CST_5b(r2b), 0, CST_5b(r2b), 0);
+    mults_g[c] = _mm_set_epi16(0, CST_5b(g2b), 0, CST_5b(g2b),
+                               0, CST_5b(g2b), 0, CST_5b(g2b));
+  }
+  for (y = 0; y < tile_height; ++y) {
+    const uint32_t* const src = argb + y * stride;
+    int x;
+    for (x = 0; x + SPAN <= tile_width; x += SPAN) {
+      const __m128i in0 = _mm_loadu_si128((__m128i*)&src[x +        0]);
+      const __m128i in1 = _mm_loadu_si128((__m128i*)&src[x + SPAN / 2]);
+      const __m128i A0 = _mm_slli_epi16(in0, 8);        // r 0  | b 0
+      const __m128i A1 = _mm_slli_epi16(in1, 8);
+      const __m128i B0 = _mm_and_si128(in0, mask_g);    // 0 0  | g 0
+      const __m128i B1 = _mm_and_si128(in1, mask_g);
+      for (c = 0; c < num_candidates; ++c) {
+        const __m128i C0 = _mm_mulhi_epi16(A0, mults_r[c]);  // x db | 0 0
+        const __m128i C1 = _mm_mulhi_epi16(A1, mults_r[c]);
+        const __m128i D0 = _mm_mulhi_epi16(B0, mults_g[c]);  // 0 0  | x db
+        const __m128i D1 = _mm_mulhi_epi16(B1, mults_g[c]);
+        const __m128i E0 = _mm_sub_epi8(in0, D0);            // x x  | x b'
+        const __m128i E1 = _mm_sub_epi8(in1, D1);
+        const __m128i F0 = _mm_srli_epi32(C0, 16);           // 0 0  | x db
+        const __m128i F1 = _mm_srli_epi32(C1, 16);
+        const __m128i G0 = _mm_sub_epi8(E0, F0);             // 0 0  | x b'
+        const __m128i G1 = _mm_sub_epi8(E1, F1);
+        const __m128i H0 = _mm_and_si128(G0, mask_b);        // 0 0  | 0 b
+        const __m128i H1 = _mm_and_si128(G1, mask_b);
+        const __m128i I = _mm_packs_epi32(H0, H1);           // 0 b' | 0 b'
+        AddToHisto8(I, histos[c]);
+      }
+    }
+  }
+  {
+    const int left_over = tile_width & (SPAN - 1);
+    if (left_over > 0) {
+      for (c = 0; c < num_candidates; ++c) {
+        VP8LCollectColorBlueTransforms_C(argb + tile_width - left_over, stride,
+                                         left_over, tile_height,
+                                         green_to_blue[c], red_to_blue[c],
+                                         histos[c]);
+      }
+    }
+  }
+}
+
+static void CollectColorRedTransformsBatch(const uint32_t* argb, int stride,
+                                           int tile_width, int tile_height,
+                                           const int green_to_red[],
+                                           int num_candidates,
+                                           int histos[][256]) {
+  __m128i mults_g[VP8L_MAX_COLOR_CANDIDATES];
+  const __m128i mask_g = _mm_set1_epi32(0x00ff00);  // green mask
+  const __m128i mask = _mm_set1_epi32(0xff);
+  int c, y;
+  assert(num_candidates <= VP8L_MAX_COLOR_CANDIDATES);
+  for (c = 0; c < num_candidates; ++c) {
+    const int g2r = green_to_red[c];
+    mults_g[c] = _mm_set_epi16(0, CST_5b(g2r), 0, CST_5b(g2r),
+                               0, CST_5b(g2r), 0, CST_5b(g2r));
+  }
+  for (y = 0; y < tile_height; ++y) {
+    const uint32_t* const src = argb + y * stride;
+    int x;
+    for (x = 0; x + SPAN <= tile_width; x += SPAN) {
+      const __m128i in0 = _mm_loadu_si128((__m128i*)&src[x +        0]);
+      const __m128i in1 = _mm_loadu_si128((__m128i*)&src[x + SPAN / 2]);
+      const __m128i A0 = _mm_and_si128(in0, mask_g);    // 0 0  | g 0
+      const __m128i A1 = _mm_and_si128(in1, mask_g);
+      const __m128i B0 = _mm_srli_epi32(in0, 16);       // 0 0  | x r
+      const __m128i B1 = _mm_srli_epi32(in1, 16);
+      for (c = 0; c < num_candidates; ++c) {
+        const __m128i C0 = _mm_mulhi_epi16(A0, mults_g[c]);  // 0 0  | x dr
+        const __m128i C1 = _mm_mulhi_epi16(A1, mults_g[c]);
+        const __m128i E0 = _mm_sub_epi8(B0, C0);             // x x  | x r'
+        const __m128i E1 = _mm_sub_epi8(B1, C1);
+        const __m128i F0 = _mm_and_si128(E0, mask);          // 0 0  | 0 r'
+        const __m128i F1 = _mm_and_si128(E1, mask);
+        const __m128i I = _mm_packs_epi32(F0, F1);
+        AddToHisto8(I, histos[c]);
+      }
+    }
+  }
+  {
+    const int left_over = tile_width & (SPAN - 1);
+    if (left_over > 0) {
+      for (c = 0; c < num_candidates; ++c) {
+        VP8LCollectColorRedTransforms_C(argb + tile_width - left_over, stride,
+                                        left_over, tile_height,
+                                        green_to_red[c], histos[c]);
+      }
+    }
+  }
+}
 #undef SPAN
 
 //------------------------------------------------------------------------------
@@ -326,55 +450,317 @@ static float CombinedShannonEntropy(const int X[256], const int Y[256]) {
 
 //------------------------------------------------------------------------------
 
+// Returns the number of leading equal pixels among the 4 compared in 'cmp',
+// or 4 if they are all equal.
+static MV_WEBP_INLINE int MatchLength4(const __m128i cmp) {
+  const uint32_t mask = (uint32_t)_mm_movemask_epi8(cmp);
+  return (mask == 0xffff) ? 4 : (BitsCtz(~mask) >> 2);
+}
+
 static int VectorMismatch(const uint32_t* const array1,
                           const uint32_t* const array2, int length) {
-  int match_len;
-
-  if (length >= 12) {
-    __m128i A0 = _mm_loadu_si128((const __m128i*)&array1[0]);
-    __m128i A1 = _mm_loadu_si128((const __m128i*)&array2[0]);
-    match_len = 0;
-    do {
-      // Loop unrolling and early load both provide a speedup of 10% for the
-      // current function. Also, max_limit can be MAX_LENGTH=4096 at most.
-      const __m128i cmpA = _mm_cmpeq_epi32(A0, A1);
-      const __m128i B0 =
-          _mm_loadu_si128((const __m128i*)&array1[match_len + 4]);
-      const __m128i B1 =
-          _mm_loadu_si128((const __m128i*)&array2[match_len + 4]);
-      if (_mm_movemask_epi8(cmpA) != 0xffff) break;
-      match_len += 4;
-
-      {
-        const __m128i cmpB = _mm_cmpeq_epi32(B0, B1);
-        A0 = _mm_loadu_si128((const __m128i*)&array1[match_len + 4]);
-        A1 = _mm_loadu_si128((const __m128i*)&array2[match_len + 4]);
-        if (_mm_movemask_epi8(cmpB) != 0xffff) break;
-        match_len += 4;
-      }
-    } while (match_len + 12 < length);
-  } else {
-    match_len = 0;
-    // Unroll the potential first two loops.
-    if (length >= 4 &&
-        _mm_movemask_epi8(_mm_cmpeq_epi32(
-            _mm_loadu_si128((const __m128i*)&array1[0]),
-            _mm_loadu_si128((const __m128i*)&array2[0]))) == 0xffff) {
-      match_len = 4;
-      if (length >= 8 &&
-          _mm_movemask_epi8(_mm_cmpeq_epi32(
-              _mm_loadu_si128((const __m128i*)&array1[4]),
-              _mm_loadu_si128((const __m128i*)&array2[4]))) == 0xffff)
-        match_len = 8;
+  int match_len = 0;
+
+  // Most matches are short: try the first 4 pixels on their own.
+  if (length >= 4) {
+    const __m128i A = _mm_loadu_si128((const __m128i*)&array1[0]);
+    const __m128i B = _mm_loadu_si128((const __m128i*)&array2[0]);
+    match_len = MatchLength4(_mm_cmpeq_epi32(A, B));
+    if (match_len < 4) return match_len;
+  }
+  // Long runs are compared 8 pixels per step, with a single movemask when
+  // they all match.
+  while (match_len + 8 <= length) {
+    const __m128i A0 = _mm_loadu_si128((const __m128i*)&array1[match_len]);
+    const __m128i B0 = _mm_loadu_si128((const __m128i*)&array2[match_len]);
+    const __m128i A1 = _mm_loadu_si128((const __m128i*)&array1[match_len + 4]);
+    const __m128i B1 = _mm_loadu_si128((const __m128i*)&array2[match_len + 4]);
+    const __m128i cmp0 = _mm_cmpeq_epi32(A0, B0);
+    const __m128i cmp1 = _mm_cmpeq_epi32(A1, B1);
+    if (_mm_movemask_epi8(_mm_and_si128(cmp0, cmp1)) != 0xffff) {
+      const int len0 = MatchLength4(cmp0);
+      return match_len + ((len0 < 4) ? len0 : 4 + MatchLength4(cmp1));
     }
+    match_len += 8;
+  }
+  if (match_len + 4 <= length) {
+    const __m128i A = _mm_loadu_si128((const __m128i*)&array1[match_len]);
+    const __m128i B = _mm_loadu_si128((const __m128i*)&array2[match_len]);
+    const int len = MatchLength4(_mm_cmpeq_epi32(A, B));
+    if (len < 4) return match_len + len;
+    match_len += 4;
   }
-
   while (match_len < length && array1[match_len] == array2[match_len]) {
     ++match_len;
   }
   return match_len;
 }
 
+//------------------------------------------------------------------------------
+// Palette index bundling
+
+static void BundleColorMap(const uint8_t* const row, int width, int xbits,
+                           uint32_t* dst) {
+  int x;
+  assert(xbits >= 0);
+  assert(xbits <= 3);
+  switch (xbits) {
+    case 0: {
+      const __m128i ff = _mm_set1_epi16((short)0xff00);
+      const __m128i zero = _mm_setzero_si128();
+      // Store 0xff000000 | (row[x] << 8).
+      for (x = 0; x + 16 <= width; x += 16, dst += 16) {
+        const __m128i in = _mm_loadu_si128((const __m128i*)&row[x]);
+        const __m128i in_lo = _mm_unpacklo_epi8(zero, in);
+        const __m128i in_hi = _mm_unpackhi_epi8(zero, in);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi16(in_lo, ff));
+        _mm_storeu_si128((__m128i*)&dst[4], _mm_unpackhi_epi16(in_lo, ff));
+        _mm_storeu_si128((__m128i*)&dst[8], _mm_unpacklo_epi16(in_hi, ff));
+        _mm_storeu_si128((__m128i*)&dst[12], _mm_unpackhi_epi16(in_hi, ff));
+      }
+      break;
+    }
+    case 1: {
+      const __m128i ff = _mm_set1_epi16((short)0xff00);
+      const __m128i mul = _mm_set1_epi16(0x110);
+      for (x = 0; x + 16 <= width; x += 16, dst += 8) {
+        // 0b0a (where a/b are 4 bits) -> ba00, once multiplied and masked.
+        const __m128i in = _mm_loadu_si128((const __m128i*)&row[x]);
+        const __m128i tmp = _mm_mullo_epi16(in, mul);
+        const __m128i pack = _mm_and_si128(tmp, ff);
+        _mm_storeu_si128((__m128i*)&dst[0], _mm_unpacklo_epi16(pack, ff));
+        _mm_storeu_si128((__m128i*)&dst[4], _mm_unpackhi_epi16(pack, ff));
+      }
+      break;
+    }
+    case 2: {
+      const __m128i mask_or = _mm_set1_epi32((int)0xff000000u);
+      const __m128i mul_cst = _mm_set1_epi16(0x0104);
+      const __m128i mask_mul = _mm_set1_epi16(0x0f00);
+      for (x = 0; x + 16 <= width; x += 16, dst += 4) {
+        // Each 16-bit lane gathers its two 2-bit indices in bits 8..11, and
+        // the upper lane of each pixel is then shifted down to bits 12..15.
+        const __m128i in = _mm_loadu_si128((const __m128i*)&row[x]);
+        const __m128i mul = _mm_mullo_epi16(in, mul_cst);
+        const __m128i tmp = _mm_and_si128(mul, mask_mul);
+        const __m128i shift = _mm_srli_epi32(tmp, 12);
+        const __m128i pack = _mm_or_si128(shift, tmp);
+        // The copy of the upper indices left in the top byte is covered by
+        // the alpha.
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(pack, mask_or));
+      }
+      break;
+    }
+    default: {
+      for (x = 0; x + 16 <= width; x += 16, dst += 2) {
+        // Moves bit 0 of each byte (a 1-bit index) to its sign bit.
+        const __m128i in = _mm_loadu_si128((const __m128i*)&row[x]);
+        const __m128i shift = _mm_slli_epi64(in, 7);
+        const uint32_t move = _mm_movemask_epi8(shift);
+        dst[0] = 0xff000000u | ((move & 0xff) << 8);
+        dst[1] = 0xff000000u | (move & 0xff00);
+      }
+      break;
+    }
+  }
+  if (x != width) {
+    VP8LBundleColorMap_C(row + x, width - x, xbits, dst);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Batch version of Predictor Transform subtraction
+
+// Truncated average of each byte: (a + b) >> 1.
+static MV_WEBP_INLINE __m128i Average2_m128i(const __m128i a0,
+                                             const __m128i a1) {
+  const __m128i ones = _mm_set1_epi8(1);
+  const __m128i avg1 = _mm_avg_epu8(a0, a1);   // rounds up
+  const __m128i one = _mm_and_si128(_mm_xor_si128(a0, a1), ones);
+  return _mm_sub_epi8(avg1, one);
+}
+
+// Sum of |a - b| over the 4 channels of each pixel.
+static MV_WEBP_INLINE __m128i SumAbsDiffs_m128i(const __m128i a,
+                                                const __m128i b) {
+  const __m128i mask_8b = _mm_set1_epi32(0x00ff00ff);
+  const __m128i mask_16b = _mm_set1_epi32(0x0000ffff);
+  const __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+  const __m128i lo = _mm_and_si128(diff, mask_8b);
+  const __m128i hi = _mm_srli_epi16(diff, 8);
+  const __m128i sum16 = _mm_add_epi16(lo, hi);
+  const __m128i sum32 = _mm_add_epi32(sum16, _mm_srli_epi32(sum16, 16));
+  return _mm_and_si128(sum32, mask_16b);
+}
+
+// Clip255(a + (a - b) / 2) on 16b values.
+static MV_WEBP_INLINE __m128i AddSubtractHalf_m128i(const __m128i a,
+                                                    const __m128i b) {
+  const __m128i A1 = _mm_sub_epi16(a, b);
+  const __m128i BgtA = _mm_cmpgt_epi16(b, a);
+  const __m128i A2 = _mm_sub_epi16(A1, BgtA);   // round towards zero
+  const __m128i A3 = _mm_srai_epi16(A2, 1);
+  return _mm_add_epi16(a, A3);
+}
+
+#define LOAD(P) _mm_loadu_si128((const __m128i*)(P))
+
+// Predictors using a single neighbor.
+#define GENERATE_PREDICTOR_1(X, IN)                                            \
+static void PredictorSub##X(const uint32_t* in, const uint32_t* upper,         \
+                            int num_pixels, uint32_t* out) {                   \
+  int i;                                                                       \
+  for (i = 0; i + 4 <= num_pixels; i += 4) {                                   \
+    const __m128i src = LOAD(&in[i]);                                          \
+    const __m128i pred = LOAD(&(IN));                                          \
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));              \
+  }                                                                            \
+  if (i != num_pixels) {                                                       \
+    VP8LPredictorsSub_C[(X)](in + i, upper + i, num_pixels - i, out + i);      \
+  }                                                                            \
+}
+
+GENERATE_PREDICTOR_1(1, in[i - 1])       // <- L
+GENERATE_PREDICTOR_1(2, upper[i])        // <- T
+GENERATE_PREDICTOR_1(3, upper[i + 1])    // <- TR
+GENERATE_PREDICTOR_1(4, upper[i - 1])    // <- TL
+#undef GENERATE_PREDICTOR_1
+
+// Predictors averaging two neighbors.
+#define GENERATE_PREDICTOR_2(X, A, B)                                          \
+static void PredictorSub##X(const uint32_t* in, const uint32_t* upper,         \
+                            int num_pixels, uint32_t* out) {                   \
+  int i;                                                                       \
+  for (i = 0; i + 4 <= num_pixels; i += 4) {                                   \
+    const __m128i src = LOAD(&in[i]);                                          \
+    const __m128i pred = Average2_m128i(LOAD(&(A)), LOAD(&(B)));               \
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));              \
+  }                                                                            \
+  if (i != num_pixels) {                                                       \
+    VP8LPredictorsSub_C[(X)](in + i, upper + i, num_pixels - i, out + i);      \
+  }                                                                            \
+}
+
+GENERATE_PREDICTOR_2(6, in[i - 1], upper[i - 1])   // <- Avg(L, TL)
+GENERATE_PREDICTOR_2(7, in[i - 1], upper[i])       // <- Avg(L, T)
+GENERATE_PREDICTOR_2(8, upper[i - 1], upper[i])    // <- Avg(TL, T)
+GENERATE_PREDICTOR_2(9, upper[i], upper[i + 1])    // <- Avg(T, TR)
+#undef GENERATE_PREDICTOR_2
+
+static void PredictorSub0(const uint32_t* in, const uint32_t* upper,
+                          int num_pixels, uint32_t* out) {
+  const __m128i black = _mm_set1_epi32(ARGB_BLACK);
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i src = LOAD(&in[i]);
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, black));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[0](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+// Avg(Avg(L, TR), T)
+static void PredictorSub5(const uint32_t* in, const uint32_t* upper,
+                          int num_pixels, uint32_t* out) {
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i src = LOAD(&in[i]);
+    const __m128i avg = Average2_m128i(LOAD(&in[i - 1]), LOAD(&upper[i + 1]));
+    const __m128i pred = Average2_m128i(avg, LOAD(&upper[i]));
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[5](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+// Avg(Avg(L, TL), Avg(T, TR))
+static void PredictorSub10(const uint32_t* in, const uint32_t* upper,
+                           int num_pixels, uint32_t* out) {
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i src = LOAD(&in[i]);
+    const __m128i avg1 = Average2_m128i(LOAD(&in[i - 1]), LOAD(&upper[i - 1]));
+    const __m128i avg2 = Average2_m128i(LOAD(&upper[i]), LOAD(&upper[i + 1]));
+    const __m128i pred = Average2_m128i(avg1, avg2);
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[10](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+// Select(T, L, TL): T if L is closer to TL than T is, L otherwise.
+static void PredictorSub11(const uint32_t* in, const uint32_t* upper,
+                           int num_pixels, uint32_t* out) {
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i L = LOAD(&in[i - 1]);
+    const __m128i T = LOAD(&upper[i]);
+    const __m128i TL = LOAD(&upper[i - 1]);
+    const __m128i src = LOAD(&in[i]);
+    const __m128i pa = SumAbsDiffs_m128i(T, TL);
+    const __m128i pb = SumAbsDiffs_m128i(L, TL);
+    const __m128i use_left = _mm_cmpgt_epi32(pb, pa);
+    const __m128i pred = _mm_or_si128(_mm_and_si128(use_left, L),
+                                      _mm_andnot_si128(use_left, T));
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[11](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+// Clip255(L + T - TL)
+static void PredictorSub12(const uint32_t* in, const uint32_t* upper,
+                           int num_pixels, uint32_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i L = LOAD(&in[i - 1]);
+    const __m128i T = LOAD(&upper[i]);
+    const __m128i TL = LOAD(&upper[i - 1]);
+    const __m128i src = LOAD(&in[i]);
+    const __m128i sum_lo = _mm_add_epi16(_mm_unpacklo_epi8(L, zero),
+                                         _mm_unpacklo_epi8(T, zero));
+    const __m128i sum_hi = _mm_add_epi16(_mm_unpackhi_epi8(L, zero),
+                                         _mm_unpackhi_epi8(T, zero));
+    const __m128i pred_lo = _mm_sub_epi16(sum_lo, _mm_unpacklo_epi8(TL, zero));
+    const __m128i pred_hi = _mm_sub_epi16(sum_hi, _mm_unpackhi_epi8(TL, zero));
+    const __m128i pred = _mm_packus_epi16(pred_lo, pred_hi);
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[12](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+// Clip255(Avg(L, T) + (Avg(L, T) - TL) / 2)
+static void PredictorSub13(const uint32_t* in, const uint32_t* upper,
+                           int num_pixels, uint32_t* out) {
+  const __m128i zero = _mm_setzero_si128();
+  int i;
+  for (i = 0; i + 4 <= num_pixels; i += 4) {
+    const __m128i TL = LOAD(&upper[i - 1]);
+    const __m128i src = LOAD(&in[i]);
+    const __m128i avg = Average2_m128i(LOAD(&in[i - 1]), LOAD(&upper[i]));
+    const __m128i pred_lo =
+        AddSubtractHalf_m128i(_mm_unpacklo_epi8(avg, zero),
+                              _mm_unpacklo_epi8(TL, zero));
+    const __m128i pred_hi =
+        AddSubtractHalf_m128i(_mm_unpackhi_epi8(avg, zero),
+                              _mm_unpackhi_epi8(TL, zero));
+    const __m128i pred = _mm_packus_epi16(pred_lo, pred_hi);
+    _mm_storeu_si128((__m128i*)&out[i], _mm_sub_epi8(src, pred));
+  }
+  if (i != num_pixels) {
+    VP8LPredictorsSub_C[13](in + i, upper + i, num_pixels - i, out + i);
+  }
+}
+
+#undef LOAD
+
 //------------------------------------------------------------------------------
 // Entry point
 
@@ -385,9 +771,29 @@ WEBP_TSAN_IGNORE_FUNCTION void VP8LEncDspInitSSE2(void) {
   VP8LTransformColor = TransformColor;
   VP8LCollectColorBlueTransforms = CollectColorBlueTransforms;
   VP8LCollectColorRedTransforms = CollectColorRedTransforms;
+  VP8LCollectColorBlueTransformsBatch = CollectColorBlueTransformsBatch;
+  VP8LCollectColorRedTransformsBatch = CollectColorRedTransformsBatch;
   VP8LHistogramAdd = HistogramAdd;
   VP8LCombinedShannonEntropy = CombinedShannonEntropy;
   VP8LVectorMismatch = VectorMismatch;
+  VP8LBundleColorMap = BundleColorMap;
+
+  VP8LPredictorsSub[0] = PredictorSub0;
+  VP8LPredictorsSub[1] = PredictorSub1;
+  VP8LPredictorsSub[2] = PredictorSub2;
+  VP8LPredictorsSub[3] = PredictorSub3;
+  VP8LPredictorsSub[4] = PredictorSub4;
+  VP8LPredictorsSub[5] = PredictorSub5;
+  VP8LPredictorsSub[6] = PredictorSub6;
+  VP8LPredictorsSub[7] = PredictorSub7;
+  VP8LPredictorsSub[8] = PredictorSub8;
+  VP8LPredictorsSub[9] = PredictorSub9;
+  VP8LPredictorsSub[10] = PredictorSub10;
+  VP8LPredictorsSub[11] = PredictorSub11;
+  VP8LPredictorsSub[12] = PredictorSub12;
+  VP8LPredictorsSub[13] = PredictorSub13;
+  VP8LPredictorsSub[14] = PredictorSub0;  // <- padding security sentinels
+  VP8LPredictorsSub[15] = PredictorSub0;
 }
 
 #else  // !WEBP_USE_SSE2
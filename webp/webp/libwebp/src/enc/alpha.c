@@ -59,6 +59,7 @@ static int EncodeLossless(const uint8_t* const data, int width, int height,
   picture.height = height;
   picture.use_argb = 1;
   picture.stats = stats;
+  picture.argb_writable = 1;  // the temporary picture can serve as buffer
   if (!WebPPictureAlloc(&picture)) return 0;
 
   // Transfer the alpha values to the green channel.
@@ -83,7 +84,8 @@ static int EncodeLossless(const uint8_t* const data, int width, int height,
   // a decoder bug related to alpha with color cache.
   // See: https://code.google.com/p/webp/issues/detail?id=239
   // Need to re-enable this later.
-  ok = (VP8LEncodeStream(&config, &picture, bw, 0 /*use_cache*/) == VP8_ENC_OK);
+  ok = (VP8LEncodeStream(&config, &picture, bw, 0 /*use_cache*/, NULL, NULL) ==
+        VP8_ENC_OK);
   WebPPictureFree(&picture);
   ok = ok && !bw->error_;
   if (!ok) {
@@ -361,10 +363,12 @@ static int CompressAlphaJob(VP8Encoder* const enc, void* dummy) {
       (config->alpha_filtering == 0) ? WEBP_FILTER_NONE :
       (config->alpha_filtering == 1) ? WEBP_FILTER_FAST :
                                        WEBP_FILTER_BEST;
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_ALPHA);
   if (!EncodeAlpha(enc, config->alpha_quality, config->alpha_compression,
                    filter, effort_level, &alpha_data, &alpha_size)) {
     return 0;
   }
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_ALPHA);
   if (alpha_size != (uint32_t)alpha_size) {  // Sanity check.
     WebPSafeFree(alpha_data);
     return 0;
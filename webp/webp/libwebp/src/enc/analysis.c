@@ -456,7 +456,9 @@ int VP8EncAnalyze(VP8Encoder* const enc) {
     const int total_mb = last_row * enc->mb_w_;
 #ifdef WEBP_USE_THREAD
     const int kMinSplitRow = 2;  // minimal rows needed for mt to be worth it
-    const int do_mt = (enc->thread_level_ > 0) && (split_row >= kMinSplitRow);
+    // Source strips are pulled in order, by a single job.
+    const int do_mt = (enc->thread_level_ > 0) && (split_row >= kMinSplitRow) &&
+                      (enc->strip_ == NULL);
 #else
     const int do_mt = 0;
 #endif
@@ -465,21 +467,30 @@ int VP8EncAnalyze(VP8Encoder* const enc) {
     SegmentJob main_job;
     if (do_mt) {
       SegmentJob side_job;
+      WebPWorker* side_worker = &side_job.worker;
       // Note the use of '&' instead of '&&' because we must call the functions
       // no matter what.
       InitSegmentJob(enc, &main_job, 0, split_row);
       InitSegmentJob(enc, &side_job, split_row, last_row);
+      if (enc->side_worker_ != NULL) {   // run the job in the long-lived thread
+        enc->side_worker_->hook = side_worker->hook;
+        enc->side_worker_->data1 = side_worker->data1;
+        enc->side_worker_->data2 = side_worker->data2;
+        side_worker = enc->side_worker_;
+      }
       // we don't need to call Reset() on main_job.worker, since we're calling
       // WebPWorkerExecute() on it
-      ok &= worker_interface->Reset(&side_job.worker);
+      ok &= worker_interface->Reset(side_worker);
       // launch the two jobs in parallel
       if (ok) {
-        worker_interface->Launch(&side_job.worker);
+        worker_interface->Launch(side_worker);
         worker_interface->Execute(&main_job.worker);
-        ok &= worker_interface->Sync(&side_job.worker);
+        ok &= worker_interface->Sync(side_worker);
         ok &= worker_interface->Sync(&main_job.worker);
       }
-      worker_interface->End(&side_job.worker);
+      if (side_worker == &side_job.worker) {
+        worker_interface->End(side_worker);
+      }
       if (ok) MergeJobs(&side_job, &main_job);  // merge results together
     } else {
       // Even for single-thread case, we use the generic Worker tools.
@@ -499,3 +510,66 @@ int VP8EncAnalyze(VP8Encoder* const enc) {
   return ok;
 }
 
+
+//------------------------------------------------------------------------------
+// Snapshots
+
+static size_t SnapshotPredsSize(const VP8Encoder* const enc) {
+  // all the 4x4 prediction modes, without the constant borders
+  return (4 * enc->mb_h_ - 1) * enc->preds_w_ + 4 * enc->mb_w_;
+}
+
+int VP8EncSaveSnapshot(const VP8Encoder* const enc,
+                       VP8EncSnapshot* const snap) {
+  const size_t info_size = enc->mb_w_ * enc->mb_h_ * sizeof(*enc->mb_info_);
+  const size_t preds_size = SnapshotPredsSize(enc);
+  int s;
+  if (snap->mb_info_ == NULL) {
+    uint8_t* const mem =
+        (uint8_t*)WebPSafeMalloc(1ULL, info_size + preds_size);
+    if (mem == NULL) return 0;
+    snap->mb_info_ = (VP8MBInfo*)mem;
+    snap->preds_ = mem + info_size;
+  }
+  memcpy(snap->mb_info_, enc->mb_info_, info_size);
+  memcpy(snap->preds_, enc->preds_, preds_size);
+  snap->alpha_ = enc->alpha_;
+  snap->uv_alpha_ = enc->uv_alpha_;
+  for (s = 0; s < NUM_MB_SEGMENTS; ++s) {
+    snap->seg_alpha_[s] = enc->dqm_[s].alpha_;
+    snap->seg_beta_[s] = enc->dqm_[s].beta_;
+  }
+  return 1;
+}
+
+int VP8EncRestoreAnalysis(VP8Encoder* const enc,
+                          const VP8EncSnapshot* const snap) {
+  int s;
+  memcpy(enc->mb_info_, snap->mb_info_,
+         enc->mb_w_ * enc->mb_h_ * sizeof(*enc->mb_info_));
+  memcpy(enc->preds_, snap->preds_, SnapshotPredsSize(enc));
+  enc->alpha_ = snap->alpha_;
+  enc->uv_alpha_ = snap->uv_alpha_;
+  for (s = 0; s < NUM_MB_SEGMENTS; ++s) {
+    enc->dqm_[s].alpha_ = snap->seg_alpha_[s];
+    enc->dqm_[s].beta_ = snap->seg_beta_[s];
+  }
+  return WebPReportProgress(enc->pic_, enc->percent_ + 20, &enc->percent_);
+}
+
+void VP8EncRestoreModes(VP8Encoder* const enc,
+                        const VP8EncSnapshot* const snap) {
+  int n;
+  for (n = 0; n < enc->mb_w_ * enc->mb_h_; ++n) {
+    enc->mb_info_[n].type_ = snap->mb_info_[n].type_;
+    enc->mb_info_[n].uv_mode_ = snap->mb_info_[n].uv_mode_;
+  }
+  memcpy(enc->preds_, snap->preds_, SnapshotPredsSize(enc));
+  enc->fixed_modes_ = 1;
+}
+
+void VP8EncSnapshotClear(VP8EncSnapshot* const snap) {
+  WebPSafeFree(snap->mb_info_);
+  snap->mb_info_ = NULL;
+  snap->preds_ = NULL;
+}
@@ -18,6 +18,7 @@
 #include "../dsp/lossless.h"
 #include "../dsp/dsp.h"
 #include "../utils/color_cache.h"
+#include "../utils/thread.h"
 #include "../utils/utils.h"
 
 #define VALUES_IN_BYTE 256
@@ -54,7 +55,7 @@ static const uint8_t plane_to_code_lut[128] = {
  119, 116, 111, 106,  97,  88,  84,  74,  72,  75,  85,  89,  98, 107, 112, 117
 };
 
-static int DistanceToPlaneCode(int xsize, int dist) {
+int VP8LDistanceToPlaneCode(int xsize, int dist) {
   const int yoffset = dist / xsize;
   const int xoffset = dist - yoffset * xsize;
   if (xoffset <= 8 && yoffset < 8) {
@@ -197,6 +198,7 @@ int VP8LHashChainInit(VP8LHashChain* const p, int size) {
       (uint32_t*)WebPSafeMalloc(size, sizeof(*p->offset_length_));
   if (p->offset_length_ == NULL) return 0;
   p->size_ = size;
+  p->thread_level_ = 0;
 
   return 1;
 }
@@ -241,100 +243,320 @@ static MV_WEBP_INLINE int MaxFindCopyLength(int len) {
   return (len < MAX_LENGTH) ? len : MAX_LENGTH;
 }
 
-int VP8LHashChainFill(VP8LHashChain* const p, int quality,
-                      const uint32_t* const argb, int xsize, int ysize) {
-  const int size = xsize * ysize;
-  const int iter_max = GetMaxItersForQuality(quality);
-  const int iter_min = iter_max - quality / 10;
-  const uint32_t window_size = GetWindowSizeForHashChain(quality, xsize);
+// Links each position of [start, end) to the previous position with the same
+// pixel pair hash. 'last' receives the last position of each hash, and
+// 'first' (if not NULL) the first one, within the range.
+static void FillChain(const uint32_t* const argb, int start, int end,
+                      int32_t* const chain, int32_t* const last,
+                      int32_t* const first) {
   int pos;
-  uint32_t base_position;
-  int32_t* hash_to_first_index;
-  // Temporarily use the p->offset_length_ as a hash chain.
-  int32_t* chain = (int32_t*)p->offset_length_;
-  assert(p->size_ != 0);
-  assert(p->offset_length_ != NULL);
-
-  hash_to_first_index =
-      (int32_t*)WebPSafeMalloc(HASH_SIZE, sizeof(*hash_to_first_index));
-  if (hash_to_first_index == NULL) return 0;
-
-  // Set the int32_t array to -1.
-  memset(hash_to_first_index, 0xff, HASH_SIZE * sizeof(*hash_to_first_index));
-  // Fill the chain linking pixels with the same hash.
-  for (pos = 0; pos < size - 1; ++pos) {
+  // Set the int32_t arrays to -1.
+  memset(last, 0xff, HASH_SIZE * sizeof(*last));
+  if (first != NULL) memset(first, 0xff, HASH_SIZE * sizeof(*first));
+  for (pos = start; pos < end; ++pos) {
     const uint32_t hash_code = GetPixPairHash64(argb + pos);
-    chain[pos] = hash_to_first_index[hash_code];
-    hash_to_first_index[hash_code] = pos;
+    chain[pos] = last[hash_code];
+    if (first != NULL && last[hash_code] < 0) first[hash_code] = pos;
+    last[hash_code] = pos;
   }
-  WebPSafeFree(hash_to_first_index);
+}
 
-  // Find the best match interval at each pixel, defined by an offset to the
-  // pixel and a length. The right-most pixel cannot match anything to the right
-  // (hence a best length of 0) and the left-most pixel nothing to the left
-  // (hence an offset of 0).
-  p->offset_length_[0] = p->offset_length_[size - 1] = 0;
-  for (base_position = size - 2 < 0 ? 0 : size - 2; base_position > 0;) {
-    const int max_len = MaxFindCopyLength(size - 1 - base_position);
-    const uint32_t* const argb_start = argb + base_position;
-    int iter = iter_max;
-    int best_length = 0;
-    uint32_t best_distance = 0;
-    const int min_pos =
-        (base_position > window_size) ? base_position - window_size : 0;
-    const int length_max = (max_len < 256) ? max_len : 256;
-    uint32_t max_base_position;
-
-    for (pos = chain[base_position]; pos >= min_pos; pos = chain[pos]) {
-      int curr_length;
-      if (--iter < 0) {
+// State of the match being extended to the left.
+typedef struct {
+  int best_length_;
+  uint32_t best_distance_;
+  uint32_t max_base_position_;
+} MatchState;
+
+typedef struct {
+  const uint32_t* argb_;
+  const int32_t* chain_;
+  int size_;
+  int iter_max_;
+  int iter_min_;
+  uint32_t window_size_;
+} MatchParams;
+
+// Searches the hash chain for the best match at 'base_position'.
+static void SearchMatch(const MatchParams* const params, uint32_t base_position,
+                        MatchState* const state) {
+  const uint32_t* const argb = params->argb_;
+  const int32_t* const chain = params->chain_;
+  const int max_len = MaxFindCopyLength(params->size_ - 1 - base_position);
+  const uint32_t* const argb_start = argb + base_position;
+  const int iter_min = params->iter_min_;
+  int iter = params->iter_max_;
+  int best_length = 0;
+  uint32_t best_distance = 0;
+  const int min_pos = (base_position > params->window_size_) ?
+                      base_position - params->window_size_ : 0;
+  const int length_max = (max_len < 256) ? max_len : 256;
+  int pos;
+
+  for (pos = chain[base_position]; pos >= min_pos; pos = chain[pos]) {
+    int curr_length;
+    if (--iter < 0) {
+      break;
+    }
+    assert(base_position > (uint32_t)pos);
+
+    curr_length =
+        FindMatchLength(argb + pos, argb_start, best_length, max_len);
+    if (best_length < curr_length) {
+      best_length = curr_length;
+      best_distance = base_position - pos;
+      // Stop if we have reached the maximum length. Otherwise, make sure
+      // we have executed a minimum number of iterations depending on the
+      // quality.
+      if ((best_length == MAX_LENGTH) ||
+          (curr_length >= length_max && iter < iter_min)) {
         break;
       }
-      assert(base_position > (uint32_t)pos);
-
-      curr_length =
-          FindMatchLength(argb + pos, argb_start, best_length, max_len);
-      if (best_length < curr_length) {
-        best_length = curr_length;
-        best_distance = base_position - pos;
-        // Stop if we have reached the maximum length. Otherwise, make sure
-        // we have executed a minimum number of iterations depending on the
-        // quality.
-        if ((best_length == MAX_LENGTH) ||
-            (curr_length >= length_max && iter < iter_min)) {
-          break;
+    }
+  }
+  state->best_length_ = best_length;
+  state->best_distance_ = best_distance;
+  state->max_base_position_ = base_position;
+}
+
+// In case the two intervals of the match at base_position + 1 continue
+// matching to the left, updates 'state' to the left-extended match at
+// 'base_position' and returns true.
+static int ExtendMatch(const uint32_t* const argb, uint32_t base_position,
+                       MatchState* const state) {
+  const uint32_t best_distance = state->best_distance_;
+  assert(state->best_length_ <= MAX_LENGTH);
+  assert(best_distance <= WINDOW_SIZE);
+  // Stop if we don't have a match or if we are out of bounds.
+  if (best_distance == 0 || base_position == 0) return 0;
+  // Stop if we cannot extend the matching intervals to the left.
+  if (base_position < best_distance ||
+      argb[base_position - best_distance] != argb[base_position]) {
+    return 0;
+  }
+  // Stop if we are matching at its limit because there could be a closer
+  // matching interval with the same maximum length. Then again, if the
+  // matching interval is as close as possible (best_distance == 1), we will
+  // never find anything better so let's continue.
+  if (state->best_length_ == MAX_LENGTH && best_distance != 1 &&
+      base_position + MAX_LENGTH < state->max_base_position_) {
+    return 0;
+  }
+  if (state->best_length_ < MAX_LENGTH) {
+    ++state->best_length_;
+    state->max_base_position_ = base_position;
+  }
+  return 1;
+}
+
+// Finds the best match interval at each position of [lo, hi], going down from
+// 'hi' (lo > 0). Matches are extended to the left as long as possible, and
+// only searched for otherwise. The state at 'lo' is returned in 'outgoing'.
+// If 'incoming' is not NULL, it is the state of the match at hi + 1 and the
+// positions already hold the output of a call that ignored it: the filling
+// then stops as soon as it agrees with that output, since from there on the
+// states are the same.
+static void FindMatches(const MatchParams* const params, int lo, int hi,
+                        const MatchState* const incoming,
+                        MatchState* const outgoing,
+                        uint32_t* const offset_length) {
+  uint32_t base_position = (uint32_t)hi + 1;
+  int extend = (incoming != NULL);
+  MatchState state;
+  if (incoming != NULL) state = *incoming;
+  assert(lo > 0);
+  while (base_position-- > (uint32_t)lo) {
+    uint32_t value;
+    if (!extend || !ExtendMatch(params->argb_, base_position, &state)) {
+      SearchMatch(params, base_position, &state);
+    }
+    value = (state.best_distance_ << MAX_LENGTH_BITS) |
+            (uint32_t)state.best_length_;
+    if (incoming != NULL && state.best_length_ < MAX_LENGTH &&
+        offset_length[base_position] == value) {
+      return;
+    }
+    offset_length[base_position] = value;
+    extend = 1;
+  }
+  if (outgoing != NULL) *outgoing = state;
+}
+
+// Maximum number of parts the filling is split into. Each part needs two
+// hash tables of HASH_SIZE entries.
+#define MAX_HASH_CHAIN_JOBS 4
+// Below this pixel count per part, the filling is not worth splitting.
+#define MIN_SIZE_PER_JOB (1 << 15)
+
+// Filling of one part of the hash chain.
+typedef struct {
+  WebPWorker worker_;
+  const MatchParams* params_;
+  int32_t* chain_;
+  int start_, end_;        // positions covered by the job
+  int32_t* last_;          // hash tables, see FillChain()
+  int32_t* first_;
+  uint32_t* offset_length_;
+  MatchState state_;       // match state at 'start_'
+} HashChainJob;
+
+static int ChainJobHook(HashChainJob* const job, void* unused) {
+  (void)unused;
+  FillChain(job->params_->argb_, job->start_, job->end_, job->chain_,
+            job->last_, job->first_);
+  return 1;
+}
+
+static int MatchJobHook(HashChainJob* const job, void* unused) {
+  const int lo = (job->start_ > 0) ? job->start_ : 1;
+  (void)unused;
+  FindMatches(job->params_, lo, job->end_ - 1, NULL, &job->state_,
+              job->offset_length_);
+  return 1;
+}
+
+// Returns the number of parts to split the filling of 'size' pixels into.
+// With the thread pool installed, all its threads are used, along with the
+// calling one. Otherwise each part would spawn its own thread, so the work is
+// only split in two, like the other multi-threaded stages of the encoder.
+static int GetNumHashChainJobs(int size) {
+  const WebPWorkerInterface* const pool_interface = WebPGetThreadPoolInterface();
+  int num_jobs = 2;
+  if (WebPGetWorkerInterface()->Launch == pool_interface->Launch) {
+    num_jobs = WebPThreadPoolGetSize() + 1;
+  }
+  if (num_jobs > MAX_HASH_CHAIN_JOBS) num_jobs = MAX_HASH_CHAIN_JOBS;
+  if (num_jobs > size / MIN_SIZE_PER_JOB) num_jobs = size / MIN_SIZE_PER_JOB;
+  return num_jobs;
+}
+
+// Runs 'hook' on all the jobs, the first one in the calling thread.
+static int RunHashChainJobs(HashChainJob* const jobs, int num_jobs,
+                            WebPWorkerHook hook) {
+  const WebPWorkerInterface* const worker_interface = WebPGetWorkerInterface();
+  int ok = 1;
+  int i;
+  for (i = 0; i < num_jobs; ++i) {
+    worker_interface->Init(&jobs[i].worker_);
+    jobs[i].worker_.data1 = &jobs[i];
+    jobs[i].worker_.data2 = NULL;
+    jobs[i].worker_.hook = hook;
+  }
+  for (i = 1; i < num_jobs; ++i) {
+    if (worker_interface->Reset(&jobs[i].worker_)) {
+      worker_interface->Launch(&jobs[i].worker_);
+    } else {
+      worker_interface->Execute(&jobs[i].worker_);   // no thread: run inline
+    }
+  }
+  worker_interface->Execute(&jobs[0].worker_);
+  for (i = 0; i < num_jobs; ++i) {
+    ok &= worker_interface->Sync(&jobs[i].worker_);
+  }
+  for (i = 0; i < num_jobs; ++i) {
+    worker_interface->End(&jobs[i].worker_);
+  }
+  return ok;
+}
+
+// Fills the hash chain using 'num_jobs' threads. Each part of the image is
+// first hashed separately, and the chains of each part are then linked to the
+// last positions of the previous ones. The matches of each part are searched
+// concurrently too, then the left-extension of the matches at the start of
+// each part is carried over into the previous part until both agree. The
+// result is the same as with a single thread.
+static int HashChainFillMT(VP8LHashChain* const p, MatchParams* const params,
+                           int num_jobs) {
+  const int size = params->size_;
+  int32_t* const chain = (int32_t*)WebPSafeMalloc(size, sizeof(*chain));
+  int32_t* const hash_tables =
+      (int32_t*)WebPSafeMalloc(2ULL * num_jobs * HASH_SIZE,
+                               sizeof(*hash_tables));
+  HashChainJob jobs[MAX_HASH_CHAIN_JOBS];
+  int ok = (chain != NULL && hash_tables != NULL);
+  int i, k;
+
+  assert(num_jobs >= 2 && num_jobs <= MAX_HASH_CHAIN_JOBS);
+  if (ok) {
+    memset(jobs, 0, sizeof(jobs));
+    for (k = 0; k < num_jobs; ++k) {
+      jobs[k].params_ = params;
+      jobs[k].chain_ = chain;
+      jobs[k].offset_length_ = p->offset_length_;
+      jobs[k].start_ = (int)((int64_t)size * k / num_jobs);
+      jobs[k].end_ = (int)((int64_t)size * (k + 1) / num_jobs);
+      jobs[k].last_ = hash_tables + 2 * k * HASH_SIZE;
+      // The first part has nothing to be linked to.
+      jobs[k].first_ = (k > 0) ? jobs[k].last_ + HASH_SIZE : NULL;
+    }
+    jobs[num_jobs - 1].end_ = size - 1;
+    ok = RunHashChainJobs(jobs, num_jobs, (WebPWorkerHook)ChainJobHook);
+  }
+  if (ok) {
+    // jobs[0].last_ is updated to the last position of each hash so far.
+    for (k = 1; k < num_jobs; ++k) {
+      for (i = 0; i < HASH_SIZE; ++i) {
+        if (jobs[k].first_[i] >= 0) {
+          chain[jobs[k].first_[i]] = jobs[0].last_[i];
+          jobs[0].last_[i] = jobs[k].last_[i];
         }
       }
     }
-    // We have the best match but in case the two intervals continue matching
-    // to the left, we have the best matches for the left-extended pixels.
-    max_base_position = base_position;
-    while (1) {
-      assert(best_length <= MAX_LENGTH);
-      assert(best_distance <= WINDOW_SIZE);
-      p->offset_length_[base_position] =
-          (best_distance << MAX_LENGTH_BITS) | (uint32_t)best_length;
-      --base_position;
-      // Stop if we don't have a match or if we are out of bounds.
-      if (best_distance == 0 || base_position == 0) break;
-      // Stop if we cannot extend the matching intervals to the left.
-      if (base_position < best_distance ||
-          argb[base_position - best_distance] != argb[base_position]) {
-        break;
-      }
-      // Stop if we are matching at its limit because there could be a closer
-      // matching interval with the same maximum length. Then again, if the
-      // matching interval is as close as possible (best_distance == 1), we will
-      // never find anything better so let's continue.
-      if (best_length == MAX_LENGTH && best_distance != 1 &&
-          base_position + MAX_LENGTH < max_base_position) {
-        break;
-      }
-      if (best_length < MAX_LENGTH) {
-        ++best_length;
-        max_base_position = base_position;
-      }
+    params->chain_ = chain;
+    ok = RunHashChainJobs(jobs, num_jobs, (WebPWorkerHook)MatchJobHook);
+  }
+  if (ok) {
+    // From the last part down, so that the carried-over state cascades. If
+    // the carrying stops early, jobs[k - 1].state_ is already the right one.
+    for (k = num_jobs - 1; k > 0; --k) {
+      const int lo = (jobs[k - 1].start_ > 0) ? jobs[k - 1].start_ : 1;
+      FindMatches(params, lo, jobs[k - 1].end_ - 1, &jobs[k].state_,
+                  &jobs[k - 1].state_, p->offset_length_);
+    }
+  }
+  WebPSafeFree(hash_tables);
+  WebPSafeFree(chain);
+  return ok;
+}
+
+int VP8LHashChainFill(VP8LHashChain* const p, int quality,
+                      const uint32_t* const argb, int xsize, int ysize) {
+  const int size = xsize * ysize;
+  MatchParams params;
+  int num_jobs;
+  assert(p->size_ != 0);
+  assert(p->offset_length_ != NULL);
+
+  params.argb_ = argb;
+  params.size_ = size;
+  params.iter_max_ = GetMaxItersForQuality(quality);
+  params.iter_min_ = params.iter_max_ - quality / 10;
+  params.window_size_ = GetWindowSizeForHashChain(quality, xsize);
+
+  // The right-most pixel cannot match anything to the right (hence a best
+  // length of 0) and the left-most pixel nothing to the left (hence an offset
+  // of 0).
+  p->offset_length_[0] = p->offset_length_[size - 1] = 0;
+  num_jobs = (p->thread_level_ > 0) ? GetNumHashChainJobs(size) : 1;
+  if (num_jobs >= 2) {
+    return HashChainFillMT(p, &params, num_jobs);
+  } else {
+    // Temporarily use the p->offset_length_ as a hash chain: the matches are
+    // found from right to left, and only look at the chain on their left.
+    int32_t* const chain = (int32_t*)p->offset_length_;
+    int32_t* const hash_to_first_index =
+        (int32_t*)WebPSafeMalloc(HASH_SIZE, sizeof(*hash_to_first_index));
+    if (hash_to_first_index == NULL) return 0;
+    // Fill the chain linking pixels with the same hash.
+    FillChain(argb, 0, size - 1, chain, hash_to_first_index, NULL);
+    WebPSafeFree(hash_to_first_index);
+    params.chain_ = chain;
+    // Find the best match interval at each pixel, defined by an offset to the
+    // pixel and a length.
+    if (size > 2) {
+      FindMatches(&params, 1, size - 2, NULL, NULL, p->offset_length_);
     }
+    p->offset_length_[0] = 0;
   }
   return 1;
 }
@@ -1216,7 +1438,7 @@ static int BackwardReferencesHashChainDistanceOnly(
     double prev_cost = cost_manager->costs_[i - 1];
     HashChainFindCopy(hash_chain, i, &offset, &len);
     if (len >= MIN_LENGTH) {
-      const int code = DistanceToPlaneCode(xsize, offset);
+      const int code = VP8LDistanceToPlaneCode(xsize, offset);
       const double offset_cost = GetDistanceCost(cost_model, code);
       const int first_i = i;
       int j_max = 0, interval_ends_index = 0;
@@ -1308,7 +1530,7 @@ static int BackwardReferencesHashChainDistanceOnly(
         int code_min_length;
         double cost_total;
         offset = HashChainFindOffset(hash_chain, i);
-        code_min_length = DistanceToPlaneCode(xsize, offset);
+        code_min_length = VP8LDistanceToPlaneCode(xsize, offset);
         cost_total = prev_cost +
             GetDistanceCost(cost_model, code_min_length) +
             GetLengthCost(cost_model, 1);
@@ -1447,7 +1669,7 @@ static void BackwardReferences2DLocality(int xsize,
   while (VP8LRefsCursorOk(&c)) {
     if (PixOrCopyIsCopy(c.cur_pos)) {
       const int dist = c.cur_pos->argb_or_distance;
-      const int transformed_dist = DistanceToPlaneCode(xsize, dist);
+      const int transformed_dist = VP8LDistanceToPlaneCode(xsize, dist);
       c.cur_pos->argb_or_distance = transformed_dist;
     }
     VP8LRefsCursorNext(&c);
@@ -1455,62 +1677,115 @@ static void BackwardReferences2DLocality(int xsize,
 }
 
 // Returns entropy for the given cache bits.
-static double ComputeCacheEntropy(const uint32_t* argb,
-                                  const VP8LBackwardRefs* const refs,
-                                  int cache_bits) {
-  const int use_color_cache = (cache_bits > 0);
-  int cc_init = 0;
-  double entropy = MAX_ENTROPY;
+// Adds the pixel 'pix' to the ARGB histograms of 'histo'.
+static MV_WEBP_INLINE void AddLiteral(VP8LHistogram* const histo,
+                                      uint32_t pix) {
+  ++histo->blue_[pix & 0xff];
+  ++histo->literal_[(pix >> 8) & 0xff];
+  ++histo->red_[(pix >> 16) & 0xff];
+  ++histo->alpha_[pix >> 24];
+}
+
+// Removes the pixel 'pix' from the ARGB histograms of 'histo'. The counts
+// may wrap around until all the literals are added back by AddLiterals().
+static MV_WEBP_INLINE void RemoveLiteral(VP8LHistogram* const histo,
+                                         uint32_t pix) {
+  --histo->blue_[pix & 0xff];
+  --histo->literal_[(pix >> 8) & 0xff];
+  --histo->red_[(pix >> 16) & 0xff];
+  --histo->alpha_[pix >> 24];
+}
+
+// Adds the ARGB histograms of 'src' to the ones of 'dst'.
+static void AddLiterals(const VP8LHistogram* const src,
+                        VP8LHistogram* const dst) {
+  int i;
+  for (i = 0; i < NUM_LITERAL_CODES; ++i) {
+    dst->blue_[i] += src->blue_[i];
+    dst->literal_[i] += src->literal_[i];
+    dst->red_[i] += src->red_[i];
+    dst->alpha_[i] += src->alpha_[i];
+  }
+}
+
+// Computes the entropy of 'refs' for each color cache size in
+// [0, cache_bits_max], in a single traversal of the refs. The key of a pixel
+// in a cache of b bits is the b top bits of its key in the largest cache.
+static int ComputeCacheEntropies(const uint32_t* argb,
+                                 const VP8LBackwardRefs* const refs,
+                                 int cache_bits_max, double* const entropies) {
+  int ok = 0;
+  int i;
+  const int hash_shift = 32 - cache_bits_max;
   const double kSmallPenaltyForLargeCache = 4.0;
-  VP8LColorCache hashers;
+  VP8LColorCache hashers[MAX_COLOR_CACHE_BITS + 1];
+  uint32_t* colors[MAX_COLOR_CACHE_BITS + 1];
+  VP8LHistogram* histos[MAX_COLOR_CACHE_BITS + 1];
   VP8LRefsCursor c = VP8LRefsCursorInit(refs);
-  VP8LHistogram* histo = VP8LAllocateHistogram(cache_bits);
-  if (histo == NULL) goto Error;
 
-  if (use_color_cache) {
-    cc_init = VP8LColorCacheInit(&hashers, cache_bits);
-    if (!cc_init) goto Error;
+  assert(cache_bits_max > 0 && cache_bits_max <= MAX_COLOR_CACHE_BITS);
+  memset(hashers, 0, sizeof(hashers));
+  memset(histos, 0, sizeof(histos));
+  for (i = 0; i <= cache_bits_max; ++i) {
+    histos[i] = VP8LAllocateHistogram(i);
+    if (histos[i] == NULL) goto Error;
+    if (i > 0 && !VP8LColorCacheInit(&hashers[i], i)) goto Error;
+    colors[i] = hashers[i].colors_;
   }
-  if (!use_color_cache) {
-    while (VP8LRefsCursorOk(&c)) {
-      VP8LHistogramAddSinglePixOrCopy(histo, c.cur_pos);
-      VP8LRefsCursorNext(&c);
-    }
-  } else {
-    while (VP8LRefsCursorOk(&c)) {
-      const PixOrCopy* const v = c.cur_pos;
-      if (PixOrCopyIsLiteral(v)) {
-        const uint32_t pix = *argb++;
-        const uint32_t key = VP8LColorCacheGetIndex(&hashers, pix);
-        if (VP8LColorCacheLookup(&hashers, key) == pix) {
-          ++histo->literal_[NUM_LITERAL_CODES + NUM_LENGTH_CODES + key];
+
+  while (VP8LRefsCursorOk(&c)) {
+    const PixOrCopy* const v = c.cur_pos;
+    if (PixOrCopyIsLiteral(v)) {
+      const uint32_t pix = *argb++;
+      uint32_t key = (kHashMul * pix) >> hash_shift;
+      // The literals are only counted once, in histos[0]: cache hits are
+      // removed from the other histograms instead.
+      AddLiteral(histos[0], pix);
+      for (i = cache_bits_max; i > 0; --i, key >>= 1) {
+        if (colors[i][key] == pix) {
+          ++histos[i]->literal_[NUM_LITERAL_CODES + NUM_LENGTH_CODES + key];
+          RemoveLiteral(histos[i], pix);
         } else {
-          VP8LColorCacheSet(&hashers, key, pix);
-          ++histo->blue_[pix & 0xff];
-          ++histo->literal_[(pix >> 8) & 0xff];
-          ++histo->red_[(pix >> 16) & 0xff];
-          ++histo->alpha_[pix >> 24];
+          colors[i][key] = pix;
         }
-      } else {
-        int len = PixOrCopyLength(v);
-        int code, extra_bits;
-        VP8LPrefixEncodeBits(len, &code, &extra_bits);
-        ++histo->literal_[NUM_LITERAL_CODES + code];
-        VP8LPrefixEncodeBits(PixOrCopyDistance(v), &code, &extra_bits);
-        ++histo->distance_[code];
-        do {
-          VP8LColorCacheInsert(&hashers, *argb++);
-        } while(--len != 0);
       }
-      VP8LRefsCursorNext(&c);
+    } else {
+      int len = PixOrCopyLength(v);
+      int len_code, dist_code, extra_bits;
+      uint32_t prev_pix = ~*argb;
+      VP8LPrefixEncodeBits(len, &len_code, &extra_bits);
+      VP8LPrefixEncodeBits(PixOrCopyDistance(v), &dist_code, &extra_bits);
+      for (i = 0; i <= cache_bits_max; ++i) {
+        ++histos[i]->literal_[NUM_LITERAL_CODES + len_code];
+        ++histos[i]->distance_[dist_code];
+      }
+      do {
+        const uint32_t pix = *argb++;
+        // Inserting the same color again would not change the caches.
+        if (pix != prev_pix) {
+          uint32_t key = (kHashMul * pix) >> hash_shift;
+          for (i = cache_bits_max; i > 0; --i, key >>= 1) {
+            colors[i][key] = pix;
+          }
+          prev_pix = pix;
+        }
+      } while (--len != 0);
     }
+    VP8LRefsCursorNext(&c);
   }
-  entropy = VP8LHistogramEstimateBits(histo) +
-      kSmallPenaltyForLargeCache * cache_bits;
+  for (i = 0; i <= cache_bits_max; ++i) {
+    if (i > 0) AddLiterals(histos[0], histos[i]);
+    entropies[i] = VP8LHistogramEstimateBits(histos[i]) +
+                   kSmallPenaltyForLargeCache * i;
+  }
+  ok = 1;
+
  Error:
-  if (cc_init) VP8LColorCacheClear(&hashers);
-  VP8LFreeHistogram(histo);
-  return entropy;
+  for (i = 0; i <= cache_bits_max; ++i) {
+    VP8LColorCacheClear(&hashers[i]);
+    VP8LFreeHistogram(histos[i]);
+  }
+  return ok;
 }
 
 // Evaluate optimal cache bits for the local color cache.
@@ -1524,10 +1799,8 @@ static int CalculateBestCacheSize(const uint32_t* const argb,
                                   VP8LBackwardRefs* const refs,
                                   int* const lz77_computed,
                                   int* const best_cache_bits) {
-  int eval_low = 1;
-  int eval_high = 1;
-  double entropy_low = MAX_ENTROPY;
-  double entropy_high = MAX_ENTROPY;
+  int i;
+  double entropies[MAX_COLOR_CACHE_BITS + 1];
   const double cost_mul = 5e-4;
   int cache_bits_low = 0;
   int cache_bits_high = (quality <= 25) ? 0 : *best_cache_bits;
@@ -1544,27 +1817,25 @@ static int CalculateBestCacheSize(const uint32_t* const argb,
                               refs)) {
     return 0;
   }
-  // Do a binary search to find the optimal entropy for cache_bits.
-  while (eval_low || eval_high) {
-    if (eval_low) {
-      entropy_low = ComputeCacheEntropy(argb, refs, cache_bits_low);
-      entropy_low += entropy_low * cache_bits_low * cost_mul;
-      eval_low = 0;
-    }
-    if (eval_high) {
-      entropy_high = ComputeCacheEntropy(argb, refs, cache_bits_high);
-      entropy_high += entropy_high * cache_bits_high * cost_mul;
-      eval_high = 0;
-    }
-    if (entropy_high < entropy_low) {
+  if (!ComputeCacheEntropies(argb, refs, cache_bits_high, entropies)) {
+    return 0;
+  }
+  for (i = 0; i <= cache_bits_high; ++i) {
+    entropies[i] += entropies[i] * i * cost_mul;
+  }
+  // All the sizes are evaluated at once, but the choice still follows a
+  // binary search, which doesn't necessarily end on the lowest entropy: the
+  // global minimum was found to give larger files on some images.
+  while (1) {
+    if (entropies[cache_bits_high] < entropies[cache_bits_low]) {
       const int prev_cache_bits_low = cache_bits_low;
       *best_cache_bits = cache_bits_high;
       cache_bits_low = (cache_bits_low + cache_bits_high) / 2;
-      if (cache_bits_low != prev_cache_bits_low) eval_low = 1;
+      if (cache_bits_low == prev_cache_bits_low) break;
     } else {
       *best_cache_bits = cache_bits_low;
       cache_bits_high = (cache_bits_low + cache_bits_high) / 2;
-      if (cache_bits_high != cache_bits_low) eval_high = 1;
+      if (cache_bits_high == cache_bits_low) break;
     }
   }
   *lz77_computed = 1;
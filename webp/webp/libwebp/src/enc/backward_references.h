@@ -124,6 +124,8 @@ struct VP8LHashChain {
   // This is the maximum size of the hash_chain that can be constructed.
   // Typically this is the pixel count (width x height) for a given image.
   int size_;
+  // If non-zero, VP8LHashChainFill() splits its work over several threads.
+  int thread_level_;
 };
 
 // Must be called first, to set size.
@@ -199,6 +201,11 @@ VP8LBackwardRefs* VP8LGetBackwardReferences(
     int low_effort, int* const cache_bits,
     const VP8LHashChain* const hash_chain, VP8LBackwardRefs refs[2]);
 
+// Converts a backward distance into the code stored in the bitstream, where
+// the nearest 2D neighbours (in an image 'xsize' pixels wide) get the
+// smallest codes.
+int VP8LDistanceToPlaneCode(int xsize, int dist);
+
 #ifdef __cplusplus
 }
 #endif
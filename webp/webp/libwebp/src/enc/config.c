@@ -49,6 +49,9 @@ int WebPConfigInitInternal(WebPConfig* config,
   config->thread_level = 0;
   config->low_memory = 0;
   config->near_lossless = 100;
+  config->exhaustive = 0;
+  config->streaming = 0;
+  config->allocator = NULL;
 #ifdef WEBP_EXPERIMENTAL_FEATURES
   config->delta_palettization = 0;
 #endif // WEBP_EXPERIMENTAL_FEATURES
@@ -142,6 +145,10 @@ int WebPValidateConfig(const WebPConfig* config) {
     return 0;
   if (config->exact < 0 || config->exact > 1)
     return 0;
+  if (config->exhaustive < 0 || config->exhaustive > 1)
+    return 0;
+  if (config->streaming < 0 || config->streaming > 1)
+    return 0;
 #ifdef WEBP_EXPERIMENTAL_FEATURES
   if (config->delta_palettization < 0 || config->delta_palettization > 1)
     return 0;
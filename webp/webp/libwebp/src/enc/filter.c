@@ -283,6 +283,13 @@ void VP8AdjustFilterStrength(VP8EncIterator* const it) {
       }
       enc->dqm_[s].fstrength_ = best_level;
     }
+  } else if (enc->config_->autofilter &&
+             enc->warm_ != NULL && enc->warm_->has_filter_) {
+    // The search was skipped: re-use the strengths of the previous encoding.
+    int s;
+    for (s = 0; s < NUM_MB_SEGMENTS; s++) {
+      enc->dqm_[s].fstrength_ = enc->warm_->fstrength_[s];
+    }
   } else if (enc->config_->filter_strength > 0) {
     int max_level = 0;
     int s;
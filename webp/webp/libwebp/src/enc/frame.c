@@ -31,6 +31,20 @@
 // we allow 2k of extra head-room in PARTITION0 limit.
 #define PARTITION0_SIZE_LIMIT ((VP8_MAX_PARTITION0_SIZE - 2048ULL) << 11)
 
+// Rate model used for the search: the size of the coded residuals follows
+// a power-law of the quantizer step, and the PSNR is linear in its log.
+// Both are expressed as linear in 'log_step', the log of the quantizer steps
+// averaged over segments, weighted by each segment's residual bit-cost.
+// For size, the initial slope is deduced from the first pass: each non-zero
+// level costs log2(step ratio) bits more or less when the step changes, and
+// about as much again is won or lost by levels crossing the zero threshold.
+// The slope is then refined using the last two passes.
+#define NZ_SLOPE_FACTOR  2.0    // (total rate change) / (levels' bits change)
+#define PSNR_SLOPE_INIT  -8.7   // d(PSNR) / d(log_step) ~= -20 / ln(10)
+#define MIN_DLOG_STEP    0.05   // minimal step change for refining the slope
+#define SIZE_TOLERANCE   0.01   // relative size error considered on-target
+#define PSNR_TOLERANCE   0.05   // PSNR error (in dB) considered on-target
+
 typedef struct {  // struct for organizing convergence in either size or PSNR
   int is_first;
   float dq;
@@ -38,6 +52,13 @@ typedef struct {  // struct for organizing convergence in either size or PSNR
   double value, last_value;   // PSNR or size
   double target;
   int do_size_search;
+  // rate model
+  uint64_t seg_rate[NUM_MB_SEGMENTS];   // residual bit-cost per segment
+  uint64_t nz_count;                    // number of non-zero levels
+  uint64_t header_size;                 // q-independent part of the size
+  double slope;                         // d(model value) / d(log_step)
+  double model_value, last_model_value;
+  double log_step, last_log_step;
 } PassStats;
 
 static int InitPassStats(const VP8Encoder* const enc, PassStats* const s) {
@@ -53,6 +74,12 @@ static int InitPassStats(const VP8Encoder* const enc, PassStats* const s) {
             : 40.;   // default, just in case
   s->value = s->last_value = 0.;
   s->do_size_search = do_size_search;
+  memset(s->seg_rate, 0, sizeof(s->seg_rate));
+  s->nz_count = 0;
+  s->header_size = 0;
+  s->slope = do_size_search ? 0. : PSNR_SLOPE_INIT;   // 0 = not yet known
+  s->model_value = s->last_model_value = 0.;
+  s->log_step = s->last_log_step = 0.;
   return do_size_search;
 }
 
@@ -60,21 +87,98 @@ static float Clamp(float v, float min, float max) {
   return (v < min) ? min : (v > max) ? max : v;
 }
 
-static float ComputeNextQ(PassStats* const s) {
+// Records the residual bit-cost of the current macroblock for the rate model.
+static void RecordPassRate(PassStats* const s, const VP8EncIterator* const it,
+                           const VP8ModeScore* const rd) {
+  const int16_t* const levels[3] = {
+    rd->y_ac_levels[0], rd->uv_levels[0], rd->y_dc_levels
+  };
+  const int sizes[3] = { 16 * 16, (4 + 4) * 16, 16 };
+  // y_dc_levels only holds meaningful values for i16 macroblocks (for i4 ones,
+  // it still contains the discarded i16 trial).
+  const int num_arrays = (it->mb_->type_ == 1) ? 3 : 2;
+  int i, n;
+  s->seg_rate[it->mb_->segment_] += rd->R;
+  for (i = 0; i < num_arrays; ++i) {
+    for (n = 0; n < sizes[i]; ++n) s->nz_count += (levels[i][n] != 0);
+  }
+}
+
+// Returns the weighted average of the log of the segments' quantizer steps
+// that 'quality' would lead to.
+static double GetLogStep(const VP8Encoder* const enc,
+                         const PassStats* const s, float quality) {
+  int steps[NUM_MB_SEGMENTS];
+  double sum = 0., weight = 0.;
+  int i;
+  VP8GetSegmentQuantSteps(enc, quality, steps);
+  for (i = 0; i < enc->segment_hdr_.num_segments_; ++i) {
+    const double w = (double)s->seg_rate[i] + 1.;
+    sum += w * log((double)steps[i]);
+    weight += w;
+  }
+  return sum / weight;
+}
+
+// Returns the value that the model assumes to be linear in 'log_step'.
+static double GetModelValue(const PassStats* const s, double value) {
+  if (s->do_size_search) {
+    const double residual_size = value - (double)s->header_size;
+    return log(residual_size > 1. ? residual_size : 1.);
+  }
+  return value;
+}
+
+static float ComputeNextQ(const VP8Encoder* const enc, PassStats* const s) {
+  const double target = GetModelValue(s, s->target);
+  const double error = s->do_size_search ? (s->value - s->target) / s->target
+                                         : (s->value - s->target);
+  const double tolerance = s->do_size_search ? SIZE_TOLERANCE : PSNR_TOLERANCE;
   float dq;
-  if (s->is_first) {
-    dq = (s->value > s->target) ? -s->dq : s->dq;
-    s->is_first = 0;
-  } else if (s->value != s->last_value) {
-    const double slope = (s->target - s->value) / (s->last_value - s->value);
-    dq = (float)(slope * (s->last_q - s->q));
+
+  s->model_value = GetModelValue(s, s->value);
+  s->log_step = GetLogStep(enc, s, s->q);
+  if (s->slope == 0.) {
+    uint64_t rate = 0;
+    int i;
+    for (i = 0; i < NUM_MB_SEGMENTS; ++i) rate += s->seg_rate[i];
+    // 'rate' is in 1/256th of bits
+    s->slope = -NZ_SLOPE_FACTOR * 256. / log(2.) *
+               (double)s->nz_count / (double)(rate + 1);
+    if (s->slope > -0.1) s->slope = -0.1;
+  }
+  if (!s->is_first && fabs(s->log_step - s->last_log_step) > MIN_DLOG_STEP) {
+    // refine the slope with the last two measurements
+    const double slope = (s->model_value - s->last_model_value) /
+                         (s->log_step - s->last_log_step);
+    if (slope < 0.) {   // otherwise, the measurements are too noisy
+      s->slope = (slope < -20.) ? -20. : (slope > -0.1) ? -0.1 : slope;
+    }
+  }
+  s->is_first = 0;
+  if (fabs(error) <= tolerance) {
+    dq = 0.;  // we're done
   } else {
-    dq = 0.;  // we're done?!
+    // Search the quality whose log_step hits the target in the model.
+    const double target_log_step =
+        s->log_step + (target - s->model_value) / s->slope;
+    float lo = 0.f, hi = 100.f;
+    int iter;
+    for (iter = 0; iter < 16; ++iter) {   // log_step decreases with quality
+      const float mid = 0.5f * (lo + hi);
+      if (GetLogStep(enc, s, mid) > target_log_step) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    dq = 0.5f * (lo + hi) - s->q;
   }
-  // Limit variable to avoid large swings.
-  s->dq = Clamp(dq, -30.f, 30.f);
+  s->dq = dq;
   s->last_q = s->q;
   s->last_value = s->value;
+  s->last_model_value = s->model_value;
+  s->last_log_step = s->log_step;
   s->q = Clamp(s->q + s->dq, 0.f, 100.f);
   return s->q;
 }
@@ -522,15 +626,17 @@ static double GetPSNR(uint64_t mse, uint64_t size) {
 //  This is used for deciding optimal probabilities. It also modifies the
 //  quantizer value if some target (size, PSNR) was specified.
 
-static void SetLoopParams(VP8Encoder* const enc, float q) {
+static void SetLoopParams(VP8Encoder* const enc, PassStats* const s) {
   // Make sure the quality parameter is inside valid bounds
-  q = Clamp(q, 0.f, 100.f);
+  const float q = Clamp(s->q, 0.f, 100.f);
 
   VP8SetSegmentParams(enc, q);      // setup segment quantizations and filters
   SetSegmentProbas(enc);            // compute segment probabilities
 
   ResetStats(enc);
   ResetSSE(enc);
+  memset(s->seg_rate, 0, sizeof(s->seg_rate));
+  s->nz_count = 0;
 }
 
 static uint64_t OneStatPass(VP8Encoder* const enc, VP8RDLevel rd_opt,
@@ -543,7 +649,7 @@ static uint64_t OneStatPass(VP8Encoder* const enc, VP8RDLevel rd_opt,
   const uint64_t pixel_count = nb_mbs * 384;
 
   VP8IteratorInit(enc, &it);
-  SetLoopParams(enc, s->q);
+  SetLoopParams(enc, s);
   do {
     VP8ModeScore info;
     VP8IteratorImport(&it, NULL);
@@ -552,6 +658,7 @@ static uint64_t OneStatPass(VP8Encoder* const enc, VP8RDLevel rd_opt,
       enc->proba_.nb_skip_++;
     }
     RecordResiduals(&it, &info);
+    RecordPassRate(s, &it, &info);
     size += info.R + info.H;
     size_p0 += info.H;
     distortion += info.D;
@@ -561,6 +668,7 @@ static uint64_t OneStatPass(VP8Encoder* const enc, VP8RDLevel rd_opt,
   } while (VP8IteratorNext(&it) && --nb_mbs > 0);
 
   size_p0 += enc->segment_hdr_.size_;
+  s->header_size = ((size_p0 + 1024) >> 11) + HEADER_SIZE_ESTIMATE;
   if (s->do_size_search) {
     size += FinalizeSkipProba(enc);
     size += FinalizeTokenProbas(&enc->proba_);
@@ -619,7 +727,7 @@ static int StatLoop(VP8Encoder* const enc) {
     }
     // If no target size: just do several pass without changing 'q'
     if (do_search) {
-      ComputeNextQ(&stats);
+      ComputeNextQ(enc, &stats);
       if (fabs(stats.dq) <= DQ_LIMIT) break;
     }
   }
@@ -632,6 +740,22 @@ static int StatLoop(VP8Encoder* const enc) {
   return WebPReportProgress(enc->pic_, final_percent, &enc->percent_);
 }
 
+// Replaces StatLoop() by the probabilities recorded from a previous encoding.
+static int WarmStartLoop(VP8Encoder* const enc) {
+  const WebPEncoderState* const warm = enc->warm_;
+  VP8EncProba* const proba = &enc->proba_;
+  PassStats stats;
+
+  InitPassStats(enc, &stats);
+  SetLoopParams(enc, &stats);
+  memcpy(proba->coeffs_, warm->coeffs_, sizeof(proba->coeffs_));
+  proba->skip_proba_ = warm->skip_proba_;
+  proba->use_skip_proba_ = warm->use_skip_proba_;
+  proba->dirty_ = 1;
+  VP8CalculateLevelCosts(&enc->proba_);  // finalize costs
+  return WebPReportProgress(enc->pic_, enc->percent_ + 20, &enc->percent_);
+}
+
 //------------------------------------------------------------------------------
 // Main loops
 //
@@ -646,7 +770,7 @@ static int PreLoopInitialize(VP8Encoder* const enc) {
       enc->mb_w_ * enc->mb_h_ * average_bytes_per_MB / enc->num_parts_;
   // Initialize the bit-writers
   for (p = 0; ok && p < enc->num_parts_; ++p) {
-    ok = VP8BitWriterInit(enc->parts_ + p, bytes_per_parts);
+    ok = VP8BitWriterReset(enc->parts_ + p, bytes_per_parts);
   }
   if (!ok) {
     VP8EncFreeBitWriters(enc);  // malloc error occurred
@@ -694,34 +818,80 @@ static void ResetAfterSkip(VP8EncIterator* const it) {
   }
 }
 
-int VP8EncLoop(VP8Encoder* const enc) {
-  VP8EncIterator it;
-  int ok = PreLoopInitialize(enc);
-  if (!ok) return 0;
-
-  StatLoop(enc);  // stats-collection loop
-
-  VP8IteratorInit(enc, &it);
-  VP8InitFilter(&it);
+// Codes all the macroblocks. Returns false in case of error or user-abort.
+// '*size_p0' receives the estimated size of partition #0, in 1/256th bits.
+static int CodeLoop(VP8Encoder* const enc, VP8EncIterator* const it,
+                    uint64_t* const size_p0) {
+  int ok;
+  *size_p0 = 0;
+  VP8IteratorInit(enc, it);
+  VP8InitFilter(it);
   do {
     VP8ModeScore info;
     const int dont_use_skip = !enc->proba_.use_skip_proba_;
     const VP8RDLevel rd_opt = enc->rd_opt_level_;
 
-    VP8IteratorImport(&it, NULL);
+    VP8IteratorImport(it, NULL);
     // Warning! order is important: first call VP8Decimate() and
     // *then* decide how to code the skip decision if there's one.
-    if (!VP8Decimate(&it, &info, rd_opt) || dont_use_skip) {
-      CodeResiduals(it.bw_, &it, &info);
+    if (!VP8Decimate(it, &info, rd_opt) || dont_use_skip) {
+      CodeResiduals(it->bw_, it, &info);
     } else {   // reset predictors after a skip
-      ResetAfterSkip(&it);
+      ResetAfterSkip(it);
     }
-    StoreSideInfo(&it);
-    VP8StoreFilterStats(&it);
-    VP8IteratorExport(&it);
-    ok = VP8IteratorProgress(&it, 20);
-    VP8IteratorSaveBoundary(&it);
-  } while (ok && VP8IteratorNext(&it));
+    *size_p0 += info.H;
+    StoreSideInfo(it);
+    VP8StoreFilterStats(it);
+    VP8IteratorExport(it);
+    ok = VP8IteratorProgress(it, 20);
+    VP8IteratorSaveBoundary(it);
+  } while (ok && VP8IteratorNext(it));
+  *size_p0 += enc->segment_hdr_.size_;
+  return ok;
+}
+
+int VP8EncLoop(VP8Encoder* const enc) {
+  VP8EncIterator it;
+  uint64_t size_p0 = 0;
+  const int use_warm = (enc->warm_ != NULL && !enc->do_search_);
+  const int percent_start = enc->percent_;
+  int ok = PreLoopInitialize(enc);
+  if (!ok) return 0;
+
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_STATS);
+  if (use_warm) {
+    ok = WarmStartLoop(enc);
+  } else {
+    ok = StatLoop(enc);  // stats-collection loop
+  }
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_STATS);
+  if (!ok) {
+    VP8EncFreeBitWriters(enc);
+    return 0;
+  }
+
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_CODING);
+  ok = CodeLoop(enc, &it, &size_p0);
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_CODING);
+
+  if (ok && use_warm && size_p0 > PARTITION0_SIZE_LIMIT) {
+    // The recorded statistics don't bound the size of partition #0 the way
+    // StatLoop() does: start over with a regular stats-collection loop.
+    VP8EncFreeBitWriters(enc);
+    memset(enc->block_count_, 0, sizeof(enc->block_count_));
+    enc->percent_ = percent_start;
+    if (!PreLoopInitialize(enc)) return 0;
+    WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_STATS);
+    ok = StatLoop(enc);
+    WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_STATS);
+    if (!ok) {
+      VP8EncFreeBitWriters(enc);
+      return 0;
+    }
+    WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_CODING);
+    ok = CodeLoop(enc, &it, &size_p0);
+    WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_CODING);
+  }
 
   return PostLoopFinalize(&it, ok);
 }
@@ -750,6 +920,12 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
   if (!ok) return 0;
 
   if (max_count < MIN_COUNT) max_count = MIN_COUNT;
+  if (enc->warm_ != NULL) {
+    // Better first guess than the default probabilities for the rd-opt costs,
+    // until the first refresh.
+    memcpy(proba->coeffs_, enc->warm_->coeffs_, sizeof(proba->coeffs_));
+    proba->dirty_ = 1;
+  }
 
   assert(enc->num_parts_ == 1);
   assert(enc->use_tokens_);
@@ -764,13 +940,16 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
     uint64_t size_p0 = 0;
     uint64_t distortion = 0;
     int cnt = max_count;
+    // All passes but the last one only serve the statistics.
+    WEBP_TIMING_START(enc->timer_, is_last_pass ? WEBP_ENC_STAGE_CODING
+                                                : WEBP_ENC_STAGE_STATS);
     VP8IteratorInit(enc, &it);
-    SetLoopParams(enc, stats.q);
+    SetLoopParams(enc, &stats);
     if (is_last_pass) {
       ResetTokenStats(enc);
       VP8InitFilter(&it);  // don't collect stats until last pass (too costly)
     }
-    VP8TBufferClear(&enc->tokens_);
+    VP8TBufferReset(&enc->tokens_, enc->tokens_.page_size_);
     do {
       VP8ModeScore info;
       VP8IteratorImport(&it, NULL);
@@ -785,6 +964,7 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
         WebPEncodingSetError(enc->pic_, VP8_ENC_ERROR_OUT_OF_MEMORY);
         break;
       }
+      RecordPassRate(&stats, &it, &info);
       size_p0 += info.H;
       distortion += info.D;
       if (is_last_pass) {
@@ -795,9 +975,12 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
       }
       VP8IteratorSaveBoundary(&it);
     } while (ok && VP8IteratorNext(&it));
+    WEBP_TIMING_STOP(enc->timer_, is_last_pass ? WEBP_ENC_STAGE_CODING
+                                               : WEBP_ENC_STAGE_STATS);
     if (!ok) break;
 
     size_p0 += enc->segment_hdr_.size_;
+    stats.header_size = ((size_p0 + 1024) >> 11) + HEADER_SIZE_ESTIMATE;
     if (stats.do_size_search) {
       uint64_t size = FinalizeTokenProbas(&enc->proba_);
       size += VP8EstimateTokenSize(&enc->tokens_,
@@ -823,15 +1006,17 @@ int VP8EncTokenLoop(VP8Encoder* const enc) {
       break;   // done
     }
     if (do_search) {
-      ComputeNextQ(&stats);  // Adjust q
+      ComputeNextQ(enc, &stats);  // Adjust q
     }
   }
   if (ok) {
     if (!stats.do_size_search) {
       FinalizeTokenProbas(&enc->proba_);
     }
+    WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_CODING);
     ok = VP8EmitTokens(&enc->tokens_, enc->parts_ + 0,
-                       (const uint8_t*)proba->coeffs_, 1);
+                       (const uint8_t*)proba->coeffs_, !enc->keep_buffers_);
+    WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_CODING);
   }
   ok = ok && WebPReportProgress(enc->pic_, enc->percent_ + 20, &enc->percent_);
   return PostLoopFinalize(&it, ok);
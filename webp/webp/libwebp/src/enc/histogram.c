@@ -566,14 +566,18 @@ static uint32_t MyRand(uint32_t *seed) {
 // -----------------------------------------------------------------------------
 // Histogram pairs priority queue
 
-// Pair of histograms. Negative idx1 value means that pair is out-of-date.
+// Pair of histograms, evaluated when the histograms had the versions 'version1'
+// and 'version2'.
 typedef struct {
   int idx1;
   int idx2;
+  int version1;
+  int version2;
   double cost_diff;
   double cost_combo;
 } HistogramPair;
 
+// Binary min-heap of histogram pairs, ordered by cost_diff.
 typedef struct {
   HistogramPair* queue;
   int size;
@@ -583,12 +587,13 @@ typedef struct {
 static int HistoQueueInit(HistoQueue* const histo_queue, const int max_index) {
   histo_queue->size = 0;
   // max_index^2 for the queue size is safe. If you look at
-  // HistogramCombineGreedy, and imagine that UpdateQueueFront always pushes
-  // data to the queue, you insert at most:
+  // HistogramCombineGreedy, you insert at most:
   // - max_index*(max_index-1)/2 (the first two for loops)
   // - max_index - 1 in the last for loop at the first iteration of the while
   //   loop, max_index - 2 at the second iteration ... therefore
   //   max_index*(max_index-1)/2 overall too
+  // Out-of-date pairs are only dropped once they reach the top of the heap,
+  // so they count towards this bound too.
   histo_queue->max_size = max_index * max_index;
   // We allocate max_size + 1 because the last element at index "size" is
   // used as temporary data (and it could be up to max_size).
@@ -609,16 +614,28 @@ static void SwapHistogramPairs(HistogramPair *p1,
   *p2 = tmp;
 }
 
-// Given a valid priority queue in range [0, queue_size) this function checks
-// whether histo_queue[queue_size] should be accepted and swaps it with the
-// front if it is smaller. Otherwise, it leaves it as is.
-static void UpdateQueueFront(HistoQueue* const histo_queue) {
-  if (histo_queue->queue[histo_queue->size].cost_diff >= 0) return;
+// Returns true if p1 should be popped before p2. Ties are broken on the
+// indices so that the merge order does not depend on the heap layout.
+static MV_WEBP_INLINE int PairIsBetter(const HistogramPair* const p1,
+                                       const HistogramPair* const p2) {
+  if (p1->cost_diff != p2->cost_diff) return (p1->cost_diff < p2->cost_diff);
+  if (p1->idx1 != p2->idx1) return (p1->idx1 < p2->idx1);
+  return (p1->idx2 < p2->idx2);
+}
+
+// Given a valid heap in range [0, queue_size), inserts
+// histo_queue[queue_size] if it brings a cost reduction. Otherwise, it is
+// dropped.
+static void HistoQueuePush(HistoQueue* const histo_queue) {
+  HistogramPair* const queue = histo_queue->queue;
+  int pos = histo_queue->size;
+  if (queue[pos].cost_diff >= 0) return;
 
-  if (histo_queue->queue[histo_queue->size].cost_diff <
-      histo_queue->queue[0].cost_diff) {
-    SwapHistogramPairs(histo_queue->queue,
-                       histo_queue->queue + histo_queue->size);
+  while (pos > 0) {
+    const int parent = (pos - 1) >> 1;
+    if (!PairIsBetter(&queue[pos], &queue[parent])) break;
+    SwapHistogramPairs(&queue[pos], &queue[parent]);
+    pos = parent;
   }
   ++histo_queue->size;
 
@@ -628,10 +645,31 @@ static void UpdateQueueFront(HistoQueue* const histo_queue) {
   assert(histo_queue->size <= histo_queue->max_size);
 }
 
+// Removes the top of the heap.
+static void HistoQueuePop(HistoQueue* const histo_queue) {
+  HistogramPair* const queue = histo_queue->queue;
+  const int size = --histo_queue->size;
+  int pos = 0;
+  assert(size >= 0);
+  queue[0] = queue[size];
+  while (1) {
+    const int left = 2 * pos + 1;
+    const int right = left + 1;
+    int best = pos;
+    if (left < size && PairIsBetter(&queue[left], &queue[best])) best = left;
+    if (right < size && PairIsBetter(&queue[right], &queue[best])) best = right;
+    if (best == pos) break;
+    SwapHistogramPairs(&queue[pos], &queue[best]);
+    pos = best;
+  }
+}
+
 // -----------------------------------------------------------------------------
 
-static void PreparePair(VP8LHistogram** histograms, int idx1, int idx2,
-                        HistogramPair* const pair) {
+// Evaluates the pair (idx1, idx2) into 'pair'. 'versions' holds the current
+// version of each histogram.
+static void PreparePair(VP8LHistogram** histograms, const int* const versions,
+                        int idx1, int idx2, HistogramPair* const pair) {
   VP8LHistogram* h1;
   VP8LHistogram* h2;
   double sum_cost;
@@ -643,6 +681,8 @@ static void PreparePair(VP8LHistogram** histograms, int idx1, int idx2,
   }
   pair->idx1 = idx1;
   pair->idx2 = idx2;
+  pair->version1 = versions[idx1];
+  pair->version2 = versions[idx2];
   h1 = histograms[idx1];
   h2 = histograms[idx2];
   sum_cost = h1->bit_cost_ + h2->bit_cost_;
@@ -660,29 +700,45 @@ static int HistogramCombineGreedy(VP8LHistogramSet* const image_histo) {
   VP8LHistogram** const histograms = image_histo->histograms;
   // Indexes of remaining histograms.
   int* const clusters = WebPSafeMalloc(image_histo_size, sizeof(*clusters));
+  // Number of times each histogram absorbed another one, or -1 once it has
+  // been merged into another one. Pairs evaluated with older versions are
+  // out-of-date and skipped when they reach the top of the queue.
+  int* const versions = WebPSafeMalloc(image_histo_size, sizeof(*versions));
   // Priority queue of histogram pairs.
   HistoQueue histo_queue;
 
-  if (!HistoQueueInit(&histo_queue, image_histo_size) || clusters == NULL) {
+  if (!HistoQueueInit(&histo_queue, image_histo_size) || clusters == NULL ||
+      versions == NULL) {
     goto End;
   }
 
   for (i = 0; i < image_histo_size; ++i) {
     // Initialize clusters indexes.
     clusters[i] = i;
+    versions[i] = 0;
+  }
+  for (i = 0; i < image_histo_size; ++i) {
     for (j = i + 1; j < image_histo_size; ++j) {
       // Initialize positions array.
-      PreparePair(histograms, i, j, &histo_queue.queue[histo_queue.size]);
-      UpdateQueueFront(&histo_queue);
+      PreparePair(histograms, versions, i, j,
+                  &histo_queue.queue[histo_queue.size]);
+      HistoQueuePush(&histo_queue);
     }
   }
 
   while (image_histo_size > 1 && histo_queue.size > 0) {
-    HistogramPair* copy_to;
     const int idx1 = histo_queue.queue[0].idx1;
     const int idx2 = histo_queue.queue[0].idx2;
+    if (histo_queue.queue[0].version1 != versions[idx1] ||
+        histo_queue.queue[0].version2 != versions[idx2]) {
+      HistoQueuePop(&histo_queue);
+      continue;
+    }
     VP8LHistogramAdd(histograms[idx2], histograms[idx1], histograms[idx1]);
     histograms[idx1]->bit_cost_ = histo_queue.queue[0].cost_combo;
+    ++versions[idx1];
+    versions[idx2] = -1;
+    HistoQueuePop(&histo_queue);
     // Remove merged histogram.
     for (i = 0; i + 1 < image_histo_size; ++i) {
       if (clusters[i] >= idx2) {
@@ -691,31 +747,12 @@ static int HistogramCombineGreedy(VP8LHistogramSet* const image_histo) {
     }
     --image_histo_size;
 
-    // Remove pairs intersecting the just combined best pair. This will
-    // therefore pop the head of the queue.
-    copy_to = histo_queue.queue;
-    for (i = 0; i < histo_queue.size; ++i) {
-      HistogramPair* const p = histo_queue.queue + i;
-      if (p->idx1 == idx1 || p->idx2 == idx1 ||
-          p->idx1 == idx2 || p->idx2 == idx2) {
-        // Do not copy the invalid pair.
-        continue;
-      }
-      if (p->cost_diff < histo_queue.queue[0].cost_diff) {
-        // Replace the top of the queue if we found better.
-        SwapHistogramPairs(histo_queue.queue, p);
-      }
-      SwapHistogramPairs(copy_to, p);
-      ++copy_to;
-    }
-    histo_queue.size = (int)(copy_to - histo_queue.queue);
-
     // Push new pairs formed with combined histogram to the queue.
     for (i = 0; i < image_histo_size; ++i) {
       if (clusters[i] != idx1) {
-        PreparePair(histograms, idx1, clusters[i],
+        PreparePair(histograms, versions, idx1, clusters[i],
                     &histo_queue.queue[histo_queue.size]);
-        UpdateQueueFront(&histo_queue);
+        HistoQueuePush(&histo_queue);
       }
     }
   }
@@ -731,6 +768,7 @@ static int HistogramCombineGreedy(VP8LHistogramSet* const image_histo) {
 
  End:
   WebPSafeFree(clusters);
+  WebPSafeFree(versions);
   HistoQueueClear(&histo_queue);
   return ok;
 }
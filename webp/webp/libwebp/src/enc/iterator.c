@@ -124,21 +124,125 @@ static void ImportLine(const uint8_t* src, int src_stride,
   for (; i < total_len; ++i) dst[i] = dst[len - 1];
 }
 
+//------------------------------------------------------------------------------
+// Source strips. Each strip holds the samples of one macroblock row, preceded
+// by the last row of the previous strip (used as top boundary in analysis).
+
+struct VP8EncStrip {
+  uint8_t* rgba_;             // RGBA samples, as filled by the row reader
+  uint16_t* tmp_rgb_;         // scratch area for the RGBA->YUV conversion
+  uint8_t* y_, *u_, *v_;      // YUV samples of the current strip
+  int y_stride_, uv_stride_;
+  int mb_y_;                  // macroblock row currently loaded, or -1
+};
+
+VP8EncStrip* VP8EncStripNew(const WebPPicture* const pic) {
+  const int y_stride = pic->width;
+  const int uv_stride = (pic->width + 1) >> 1;
+  const uint64_t rgba_size = (uint64_t)4 * pic->width * 16;
+  const uint64_t tmp_rgb_size = (uint64_t)4 * uv_stride * sizeof(uint16_t);
+  const uint64_t size = sizeof(VP8EncStrip) + rgba_size + tmp_rgb_size
+                      + (uint64_t)(16 + 1) * y_stride
+                      + (uint64_t)2 * (8 + 1) * uv_stride;
+  uint8_t* mem;
+  VP8EncStrip* const strip = (VP8EncStrip*)WebPSafeMalloc(size, sizeof(*mem));
+  if (strip == NULL) return NULL;
+  mem = (uint8_t*)strip + sizeof(*strip);
+  strip->rgba_ = mem;
+  mem += rgba_size;
+  strip->tmp_rgb_ = (uint16_t*)mem;
+  mem += tmp_rgb_size;
+  strip->y_stride_ = y_stride;
+  strip->uv_stride_ = uv_stride;
+  strip->y_ = mem + y_stride;
+  mem += (16 + 1) * y_stride;
+  strip->u_ = mem + uv_stride;
+  mem += (8 + 1) * uv_stride;
+  strip->v_ = mem + uv_stride;
+  strip->mb_y_ = -1;
+  return strip;
+}
+
+void VP8EncStripDelete(VP8EncStrip* const strip) {
+  WebPSafeFree(strip);
+}
+
+// Pulls the samples of macroblock row 'mb_y' and converts them to YUV.
+static void ReadStrip(const WebPPicture* const pic, VP8EncStrip* const strip,
+                      int mb_y) {
+  const int y = mb_y * 16;
+  const int h = MinSize(pic->height - y, 16);
+  const int uv_h = (h + 1) >> 1;
+  if (pic->error_code == VP8_ENC_OK &&
+      !pic->row_reader(y, h, strip->rgba_, 4 * pic->width, pic)) {
+    WebPEncodingSetError(pic, VP8_ENC_ERROR_USER_ABORT);
+  }
+  if (pic->error_code != VP8_ENC_OK) {   // keep on with neutral samples
+    memset(strip->y_, 128, h * strip->y_stride_);
+    memset(strip->u_, 128, uv_h * strip->uv_stride_);
+    memset(strip->v_, 128, uv_h * strip->uv_stride_);
+  } else {
+    WebPConvertRGBAToYUVRows(strip->rgba_, 4 * pic->width, pic->width, h,
+                             strip->y_, strip->y_stride_,
+                             strip->u_, strip->v_, strip->uv_stride_,
+                             strip->tmp_rgb_);
+  }
+  strip->mb_y_ = mb_y;
+}
+
+static const VP8EncStrip* LoadStrip(const WebPPicture* const pic,
+                                    VP8EncStrip* const strip, int mb_y) {
+  if (strip->mb_y_ != mb_y) {
+    if (mb_y > 0) {
+      const int uv_w = (pic->width + 1) >> 1;
+      // Rows are normally pulled in order. Otherwise, we re-read the previous
+      // strip, just for its last row.
+      if (strip->mb_y_ != mb_y - 1) ReadStrip(pic, strip, mb_y - 1);
+      memcpy(strip->y_ - strip->y_stride_, strip->y_ + 15 * strip->y_stride_,
+             pic->width);
+      memcpy(strip->u_ - strip->uv_stride_, strip->u_ + 7 * strip->uv_stride_,
+             uv_w);
+      memcpy(strip->v_ - strip->uv_stride_, strip->v_ + 7 * strip->uv_stride_,
+             uv_w);
+    }
+    ReadStrip(pic, strip, mb_y);
+  }
+  return strip;
+}
+
+//------------------------------------------------------------------------------
+
 void VP8IteratorImport(VP8EncIterator* const it, uint8_t* tmp_32) {
   const VP8Encoder* const enc = it->enc_;
   const int x = it->x_, y = it->y_;
   const WebPPicture* const pic = enc->pic_;
-  const uint8_t* const ysrc = pic->y + (y * pic->y_stride  + x) * 16;
-  const uint8_t* const usrc = pic->u + (y * pic->uv_stride + x) * 8;
-  const uint8_t* const vsrc = pic->v + (y * pic->uv_stride + x) * 8;
+  const uint8_t* ysrc;
+  const uint8_t* usrc;
+  const uint8_t* vsrc;
+  int y_stride, uv_stride;
   const int w = MinSize(pic->width - x * 16, 16);
   const int h = MinSize(pic->height - y * 16, 16);
   const int uv_w = (w + 1) >> 1;
   const int uv_h = (h + 1) >> 1;
 
-  ImportBlock(ysrc, pic->y_stride,  it->yuv_in_ + Y_OFF_ENC, w, h, 16);
-  ImportBlock(usrc, pic->uv_stride, it->yuv_in_ + U_OFF_ENC, uv_w, uv_h, 8);
-  ImportBlock(vsrc, pic->uv_stride, it->yuv_in_ + V_OFF_ENC, uv_w, uv_h, 8);
+  if (enc->strip_ != NULL) {
+    const VP8EncStrip* const strip = LoadStrip(pic, enc->strip_, y);
+    ysrc = strip->y_ + x * 16;
+    usrc = strip->u_ + x * 8;
+    vsrc = strip->v_ + x * 8;
+    y_stride = strip->y_stride_;
+    uv_stride = strip->uv_stride_;
+  } else {
+    ysrc = pic->y + (y * pic->y_stride  + x) * 16;
+    usrc = pic->u + (y * pic->uv_stride + x) * 8;
+    vsrc = pic->v + (y * pic->uv_stride + x) * 8;
+    y_stride = pic->y_stride;
+    uv_stride = pic->uv_stride;
+  }
+
+  ImportBlock(ysrc, y_stride,  it->yuv_in_ + Y_OFF_ENC, w, h, 16);
+  ImportBlock(usrc, uv_stride, it->yuv_in_ + U_OFF_ENC, uv_w, uv_h, 8);
+  ImportBlock(vsrc, uv_stride, it->yuv_in_ + V_OFF_ENC, uv_w, uv_h, 8);
 
   if (tmp_32 == NULL) return;
 
@@ -149,13 +253,13 @@ void VP8IteratorImport(VP8EncIterator* const it, uint8_t* tmp_32) {
     if (y == 0) {
       it->y_left_[-1] = it->u_left_[-1] = it->v_left_[-1] = 127;
     } else {
-      it->y_left_[-1] = ysrc[- 1 - pic->y_stride];
-      it->u_left_[-1] = usrc[- 1 - pic->uv_stride];
-      it->v_left_[-1] = vsrc[- 1 - pic->uv_stride];
+      it->y_left_[-1] = ysrc[- 1 - y_stride];
+      it->u_left_[-1] = usrc[- 1 - uv_stride];
+      it->v_left_[-1] = vsrc[- 1 - uv_stride];
     }
-    ImportLine(ysrc - 1, pic->y_stride,  it->y_left_, h,   16);
-    ImportLine(usrc - 1, pic->uv_stride, it->u_left_, uv_h, 8);
-    ImportLine(vsrc - 1, pic->uv_stride, it->v_left_, uv_h, 8);
+    ImportLine(ysrc - 1, y_stride,  it->y_left_, h,   16);
+    ImportLine(usrc - 1, uv_stride, it->u_left_, uv_h, 8);
+    ImportLine(vsrc - 1, uv_stride, it->v_left_, uv_h, 8);
   }
 
   it->y_top_  = tmp_32 + 0;
@@ -163,9 +267,9 @@ void VP8IteratorImport(VP8EncIterator* const it, uint8_t* tmp_32) {
   if (y == 0) {
     memset(tmp_32, 127, 32 * sizeof(*tmp_32));
   } else {
-    ImportLine(ysrc - pic->y_stride,  1, tmp_32,          w,   16);
-    ImportLine(usrc - pic->uv_stride, 1, tmp_32 + 16,     uv_w, 8);
-    ImportLine(vsrc - pic->uv_stride, 1, tmp_32 + 16 + 8, uv_w, 8);
+    ImportLine(ysrc - y_stride,  1, tmp_32,          w,   16);
+    ImportLine(usrc - uv_stride, 1, tmp_32 + 16,     uv_w, 8);
+    ImportLine(vsrc - uv_stride, 1, tmp_32 + 16 + 8, uv_w, 8);
   }
 }
 
@@ -183,7 +287,7 @@ static void ExportBlock(const uint8_t* src, uint8_t* dst, int dst_stride,
 
 void VP8IteratorExport(const VP8EncIterator* const it) {
   const VP8Encoder* const enc = it->enc_;
-  if (enc->config_->show_compressed) {
+  if (enc->config_->show_compressed && enc->strip_ == NULL) {
     const int x = it->x_, y = it->y_;
     const uint8_t* const ysrc = it->yuv_out_ + Y_OFF_ENC;
     const uint8_t* const usrc = it->yuv_out_ + U_OFF_ENC;
@@ -69,14 +69,14 @@ int WebPPictureAllocARGB(WebPPicture* const picture, int width, int height) {
 
   assert(picture != NULL);
 
-  WebPSafeFree(picture->memory_argb_);
+  WebPSafeFreeGlobal(picture->memory_argb_);
   WebPPictureResetBufferARGB(picture);
 
   if (width <= 0 || height <= 0) {
     return WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
   }
   // allocate a new buffer.
-  memory = WebPSafeMalloc(argb_size, sizeof(*picture->argb));
+  memory = WebPSafeMallocGlobal(argb_size, sizeof(*picture->argb));
   if (memory == NULL) {
     return WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
   }
@@ -100,7 +100,7 @@ int WebPPictureAllocYUVA(WebPPicture* const picture, int width, int height) {
 
   assert(picture != NULL);
 
-  WebPSafeFree(picture->memory_);
+  WebPSafeFreeGlobal(picture->memory_);
   WebPPictureResetBufferYUVA(picture);
 
   if (uv_csp != WEBP_YUV420) {
@@ -122,7 +122,7 @@ int WebPPictureAllocYUVA(WebPPicture* const picture, int width, int height) {
     return WebPEncodingSetError(picture, VP8_ENC_ERROR_BAD_DIMENSION);
   }
   // allocate a new buffer.
-  mem = (uint8_t*)WebPSafeMalloc(total_size, sizeof(*mem));
+  mem = (uint8_t*)WebPSafeMallocGlobal(total_size, sizeof(*mem));
   if (mem == NULL) {
     return WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
   }
@@ -168,8 +168,8 @@ int WebPPictureAlloc(WebPPicture* picture) {
 
 void WebPPictureFree(WebPPicture* picture) {
   if (picture != NULL) {
-    WebPSafeFree(picture->memory_);
-    WebPSafeFree(picture->memory_argb_);
+    WebPSafeFreeGlobal(picture->memory_);
+    WebPSafeFreeGlobal(picture->memory_argb_);
     WebPPictureResetBuffers(picture);
   }
 }
@@ -196,16 +196,16 @@ int WebPMemoryWrite(const uint8_t* data, size_t data_size,
     uint64_t next_max_size = 2ULL * w->max_size;
     if (next_max_size < next_size) next_max_size = next_size;
     if (next_max_size < 8192ULL) next_max_size = 8192ULL;
-    new_mem = (uint8_t*)WebPSafeMalloc(next_max_size, 1);
+    new_mem = (uint8_t*)WebPSafeMallocGlobal(next_max_size, 1);
     if (new_mem == NULL) {
       return 0;
     }
     if (w->size > 0) {
       memcpy(new_mem, w->mem, w->size);
     }
-    WebPSafeFree(w->mem);
+    WebPSafeFreeGlobal(w->mem);
     w->mem = new_mem;
-    // down-cast is ok, thanks to WebPSafeMalloc
+    // down-cast is ok, thanks to WebPSafeMallocGlobal
     w->max_size = (size_t)next_max_size;
   }
   if (data_size > 0) {
@@ -217,7 +217,7 @@ int WebPMemoryWrite(const uint8_t* data, size_t data_size,
 
 void WebPMemoryWriterClear(WebPMemoryWriter* writer) {
   if (writer != NULL) {
-    WebPSafeFree(writer->mem);
+    WebPSafeFreeGlobal(writer->mem);
     writer->mem = NULL;
     writer->size = 0;
     writer->max_size = 0;
@@ -830,6 +830,109 @@ static MV_WEBP_INLINE void ConvertRowsToUV(const uint16_t* rgb,
   }
 }
 
+// Converts 'height' rows of RGB(A) samples to the Y/U/V planes (and A plane,
+// if 'dst_a' is not NULL), two rows at a time. 'a_ptr' is NULL if the samples
+// are opaque. 'tmp_rgb' must hold 4 * ((width + 1) / 2) values.
+static void ConvertRGBAToYUVARows(const uint8_t* const r_ptr,
+                                  const uint8_t* const g_ptr,
+                                  const uint8_t* const b_ptr,
+                                  const uint8_t* const a_ptr,
+                                  int step, int rgb_stride,
+                                  int width, int height, VP8Random* const rg,
+                                  uint8_t* dst_y, int y_stride,
+                                  uint8_t* dst_u, uint8_t* dst_v, int uv_stride,
+                                  uint8_t* dst_a, int a_stride,
+                                  uint16_t* const tmp_rgb) {
+  const int uv_width = (width + 1) >> 1;
+  const int has_alpha = (a_ptr != NULL);
+  const int use_dsp = (step == 3) && (rg == NULL);  // special function case
+  int y;
+
+  WebPInitConvertARGBToYUV();
+  InitGammaTables();
+
+  // Downsample Y/U/V planes, two rows at a time
+  for (y = 0; y < (height >> 1); ++y) {
+    int rows_have_alpha = has_alpha;
+    const int off1 = (2 * y + 0) * rgb_stride;
+    const int off2 = (2 * y + 1) * rgb_stride;
+    if (use_dsp) {
+      if (r_ptr < b_ptr) {
+        WebPConvertRGB24ToY(r_ptr + off1, dst_y, width);
+        WebPConvertRGB24ToY(r_ptr + off2, dst_y + y_stride, width);
+      } else {
+        WebPConvertBGR24ToY(b_ptr + off1, dst_y, width);
+        WebPConvertBGR24ToY(b_ptr + off2, dst_y + y_stride, width);
+      }
+    } else {
+      ConvertRowToY(r_ptr + off1, g_ptr + off1, b_ptr + off1, step,
+                    dst_y, width, rg);
+      ConvertRowToY(r_ptr + off2, g_ptr + off2, b_ptr + off2, step,
+                    dst_y + y_stride, width, rg);
+    }
+    dst_y += 2 * y_stride;
+    if (has_alpha) {
+      if (dst_a != NULL) {
+        rows_have_alpha &= !WebPExtractAlpha(a_ptr + off1, rgb_stride,
+                                             width, 2, dst_a, a_stride);
+        dst_a += 2 * a_stride;
+      } else {
+        rows_have_alpha &= CheckNonOpaque(a_ptr + off1, width, 2,
+                                          step, rgb_stride);
+      }
+    }
+    // Collect averaged R/G/B(/A)
+    if (!rows_have_alpha) {
+      AccumulateRGB(r_ptr + off1, g_ptr + off1, b_ptr + off1,
+                    step, rgb_stride, tmp_rgb, width);
+    } else {
+      AccumulateRGBA(r_ptr + off1, g_ptr + off1, b_ptr + off1, a_ptr + off1,
+                     rgb_stride, tmp_rgb, width);
+    }
+    // Convert to U/V
+    if (rg == NULL) {
+      WebPConvertRGBA32ToUV(tmp_rgb, dst_u, dst_v, uv_width);
+    } else {
+      ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
+    }
+    dst_u += uv_stride;
+    dst_v += uv_stride;
+  }
+  if (height & 1) {    // extra last row
+    const int off = 2 * y * rgb_stride;
+    int row_has_alpha = has_alpha;
+    if (use_dsp) {
+      if (r_ptr < b_ptr) {
+        WebPConvertRGB24ToY(r_ptr + off, dst_y, width);
+      } else {
+        WebPConvertBGR24ToY(b_ptr + off, dst_y, width);
+      }
+    } else {
+      ConvertRowToY(r_ptr + off, g_ptr + off, b_ptr + off, step,
+                    dst_y, width, rg);
+    }
+    if (row_has_alpha) {
+      row_has_alpha &= (dst_a != NULL) ?
+          !WebPExtractAlpha(a_ptr + off, 0, width, 1, dst_a, 0) :
+          CheckNonOpaque(a_ptr + off, width, 1, step, 0);
+    }
+    // Collect averaged R/G/B(/A)
+    if (!row_has_alpha) {
+      // Collect averaged R/G/B
+      AccumulateRGB(r_ptr + off, g_ptr + off, b_ptr + off,
+                    step, /* rgb_stride = */ 0, tmp_rgb, width);
+    } else {
+      AccumulateRGBA(r_ptr + off, g_ptr + off, b_ptr + off, a_ptr + off,
+                     /* rgb_stride = */ 0, tmp_rgb, width);
+    }
+    if (rg == NULL) {
+      WebPConvertRGBA32ToUV(tmp_rgb, dst_u, dst_v, uv_width);
+    } else {
+      ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
+    }
+  }
+}
+
 static int ImportYUVAFromRGBA(const uint8_t* const r_ptr,
                               const uint8_t* const g_ptr,
                               const uint8_t* const b_ptr,
@@ -839,11 +942,9 @@ static int ImportYUVAFromRGBA(const uint8_t* const r_ptr,
                               float dithering,
                               int use_iterative_conversion,
                               WebPPicture* const picture) {
-  int y;
   const int width = picture->width;
   const int height = picture->height;
   const int has_alpha = CheckNonOpaque(a_ptr, width, height, step, rgb_stride);
-  const int is_rgb = (r_ptr < b_ptr);  // otherwise it's bgr
 
   picture->colorspace = has_alpha ? WEBP_YUV420A : WEBP_YUV420;
   picture->use_argb = 0;
@@ -876,106 +977,38 @@ static int ImportYUVAFromRGBA(const uint8_t* const r_ptr,
     }
   } else {
     const int uv_width = (width + 1) >> 1;
-    int use_dsp = (step == 3);  // use special function in this case
     // temporary storage for accumulated R/G/B values during conversion to U/V
     uint16_t* const tmp_rgb =
         (uint16_t*)WebPSafeMalloc(4 * uv_width, sizeof(*tmp_rgb));
-    uint8_t* dst_y = picture->y;
-    uint8_t* dst_u = picture->u;
-    uint8_t* dst_v = picture->v;
-    uint8_t* dst_a = picture->a;
-
     VP8Random base_rg;
     VP8Random* rg = NULL;
     if (dithering > 0.) {
       VP8InitRandom(&base_rg, dithering);
       rg = &base_rg;
-      use_dsp = 0;   // can't use dsp in this case
     }
-    WebPInitConvertARGBToYUV();
-    InitGammaTables();
-
     if (tmp_rgb == NULL) return 0;  // malloc error
-
-    // Downsample Y/U/V planes, two rows at a time
-    for (y = 0; y < (height >> 1); ++y) {
-      int rows_have_alpha = has_alpha;
-      const int off1 = (2 * y + 0) * rgb_stride;
-      const int off2 = (2 * y + 1) * rgb_stride;
-      if (use_dsp) {
-        if (is_rgb) {
-          WebPConvertRGB24ToY(r_ptr + off1, dst_y, width);
-          WebPConvertRGB24ToY(r_ptr + off2, dst_y + picture->y_stride, width);
-        } else {
-          WebPConvertBGR24ToY(b_ptr + off1, dst_y, width);
-          WebPConvertBGR24ToY(b_ptr + off2, dst_y + picture->y_stride, width);
-        }
-      } else {
-        ConvertRowToY(r_ptr + off1, g_ptr + off1, b_ptr + off1, step,
-                      dst_y, width, rg);
-        ConvertRowToY(r_ptr + off2, g_ptr + off2, b_ptr + off2, step,
-                      dst_y + picture->y_stride, width, rg);
-      }
-      dst_y += 2 * picture->y_stride;
-      if (has_alpha) {
-        rows_have_alpha &= !WebPExtractAlpha(a_ptr + off1, rgb_stride,
-                                             width, 2,
-                                             dst_a, picture->a_stride);
-        dst_a += 2 * picture->a_stride;
-      }
-      // Collect averaged R/G/B(/A)
-      if (!rows_have_alpha) {
-        AccumulateRGB(r_ptr + off1, g_ptr + off1, b_ptr + off1,
-                      step, rgb_stride, tmp_rgb, width);
-      } else {
-        AccumulateRGBA(r_ptr + off1, g_ptr + off1, b_ptr + off1, a_ptr + off1,
-                       rgb_stride, tmp_rgb, width);
-      }
-      // Convert to U/V
-      if (rg == NULL) {
-        WebPConvertRGBA32ToUV(tmp_rgb, dst_u, dst_v, uv_width);
-      } else {
-        ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
-      }
-      dst_u += picture->uv_stride;
-      dst_v += picture->uv_stride;
-    }
-    if (height & 1) {    // extra last row
-      const int off = 2 * y * rgb_stride;
-      int row_has_alpha = has_alpha;
-      if (use_dsp) {
-        if (r_ptr < b_ptr) {
-          WebPConvertRGB24ToY(r_ptr + off, dst_y, width);
-        } else {
-          WebPConvertBGR24ToY(b_ptr + off, dst_y, width);
-        }
-      } else {
-        ConvertRowToY(r_ptr + off, g_ptr + off, b_ptr + off, step,
-                      dst_y, width, rg);
-      }
-      if (row_has_alpha) {
-        row_has_alpha &= !WebPExtractAlpha(a_ptr + off, 0, width, 1, dst_a, 0);
-      }
-      // Collect averaged R/G/B(/A)
-      if (!row_has_alpha) {
-        // Collect averaged R/G/B
-        AccumulateRGB(r_ptr + off, g_ptr + off, b_ptr + off,
-                      step, /* rgb_stride = */ 0, tmp_rgb, width);
-      } else {
-        AccumulateRGBA(r_ptr + off, g_ptr + off, b_ptr + off, a_ptr + off,
-                       /* rgb_stride = */ 0, tmp_rgb, width);
-      }
-      if (rg == NULL) {
-        WebPConvertRGBA32ToUV(tmp_rgb, dst_u, dst_v, uv_width);
-      } else {
-        ConvertRowsToUV(tmp_rgb, dst_u, dst_v, uv_width, rg);
-      }
-    }
+    ConvertRGBAToYUVARows(r_ptr, g_ptr, b_ptr, has_alpha ? a_ptr : NULL,
+                          step, rgb_stride, width, height, rg,
+                          picture->y, picture->y_stride,
+                          picture->u, picture->v, picture->uv_stride,
+                          picture->a, picture->a_stride, tmp_rgb);
     WebPSafeFree(tmp_rgb);
   }
   return 1;
 }
 
+void WebPConvertRGBAToYUVRows(const uint8_t* rgba, int rgba_stride,
+                              int width, int height,
+                              uint8_t* y, int y_stride,
+                              uint8_t* u, uint8_t* v, int uv_stride,
+                              uint16_t* tmp_rgb) {
+  const uint8_t* const a_ptr = rgba + 3;
+  const int has_alpha = CheckNonOpaque(a_ptr, width, height, 4, rgba_stride);
+  ConvertRGBAToYUVARows(rgba + 0, rgba + 1, rgba + 2, has_alpha ? a_ptr : NULL,
+                        4, rgba_stride, width, height, NULL,
+                        y, y_stride, u, v, uv_stride, NULL, 0, tmp_rgb);
+}
+
 #undef SUM4
 #undef SUM2
 #undef SUM4ALPHA
@@ -398,9 +398,10 @@ static void SimplifySegments(VP8Encoder* const enc) {
   }
 }
 
-void VP8SetSegmentParams(VP8Encoder* const enc, float quality) {
+// Maps the 'quality' factor to each segment's quantizer index.
+static void ComputeSegmentQuants(const VP8Encoder* const enc, float quality,
+                                 int quants[NUM_MB_SEGMENTS]) {
   int i;
-  int dq_uv_ac, dq_uv_dc;
   const int num_segments = enc->segment_hdr_.num_segments_;
   const double amp = SNS_TO_DQ * enc->config_->sns_strength / 100. / 128.;
   const double Q = quality / 100.;
@@ -414,7 +415,28 @@ void VP8SetSegmentParams(VP8Encoder* const enc, float quality) {
     const double c = pow(c_base, expn);
     const int q = (int)(127. * (1. - c));
     assert(expn > 0.);
-    enc->dqm_[i].quant_ = clip(q, 0, 127);
+    quants[i] = clip(q, 0, 127);
+  }
+}
+
+void VP8GetSegmentQuantSteps(const VP8Encoder* const enc, float quality,
+                             int steps[NUM_MB_SEGMENTS]) {
+  int i;
+  int quants[NUM_MB_SEGMENTS];
+  ComputeSegmentQuants(enc, quality, quants);
+  for (i = 0; i < enc->segment_hdr_.num_segments_; ++i) {
+    steps[i] = kAcTable[quants[i]];
+  }
+}
+
+void VP8SetSegmentParams(VP8Encoder* const enc, float quality) {
+  int i;
+  int dq_uv_ac, dq_uv_dc;
+  int quants[NUM_MB_SEGMENTS];
+  const int num_segments = enc->segment_hdr_.num_segments_;
+  ComputeSegmentQuants(enc, quality, quants);
+  for (i = 0; i < num_segments; ++i) {
+    enc->dqm_[i].quant_ = quants[i];
   }
 
   // purely indicative in the bitstream (except for the 1-segment case)
@@ -601,6 +623,7 @@ static int TrellisQuantizeBlock(const VP8Encoder* const enc,
   score_t best_score;
   int n, m, p, last;
 
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_TRELLIS);
   {
     score_t cost;
     const int thresh = mtx->q_[1] * mtx->q_[1] / 4;
@@ -720,6 +743,7 @@ static int TrellisQuantizeBlock(const VP8Encoder* const enc,
   memset(in + first, 0, (16 - first) * sizeof(*in));
   memset(out + first, 0, (16 - first) * sizeof(*out));
   if (best_path[0] == -1) {
+    WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_TRELLIS);
     return 0;   // skip!
   }
 
@@ -740,6 +764,7 @@ static int TrellisQuantizeBlock(const VP8Encoder* const enc,
       in[j] = out[n] * mtx->q_[j];
       best_node = node->prev;
     }
+    WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_TRELLIS);
     return (nz != 0);
   }
 }
@@ -1139,6 +1164,41 @@ static void SimpleQuantize(VP8EncIterator* const it, VP8ModeScore* const rd) {
   rd->nz = nz;
 }
 
+// Fills in the header, residual and distortion scores of a macroblock whose
+// modes were imposed (and quantized by SimpleQuantize), so that the rate and
+// distortion bookkeeping done by the callers still sees a complete score.
+static void ScoreFixedModes(VP8EncIterator* const it, VP8ModeScore* const rd) {
+  const VP8Encoder* const enc = it->enc_;
+  const VP8SegmentInfo* const dqm = &enc->dqm_[it->mb_->segment_];
+  const uint8_t* const src = it->yuv_in_;
+  const uint8_t* const dst = it->yuv_out_;
+
+  if (it->mb_->type_ == 1) {
+    const int mode = it->preds_[0];
+    rd->H = VP8FixedCostsI16[mode];
+    rd->R = VP8GetCostLuma16(it, rd);
+  } else {
+    rd->H = 211;  // '211' is the value of VP8BitCost(0, 145)
+    rd->R = 0;
+    VP8IteratorNzToBytes(it);
+    for (it->i4_ = 0; it->i4_ < 16; ++it->i4_) {
+      const int x = (it->i4_ & 3), y = (it->i4_ >> 2);
+      const int mode = it->preds_[x + y * enc->preds_w_];
+      const int left = it->preds_[x - 1 + y * enc->preds_w_];
+      const int top = it->preds_[x + (y - 1) * enc->preds_w_];
+      rd->H += VP8FixedCostsI4[top][left][mode];
+      rd->R += VP8GetCostLuma4(it, rd->y_ac_levels[it->i4_]);
+      it->top_nz_[x] = it->left_nz_[y] = (rd->nz >> it->i4_) & 1;
+    }
+  }
+  rd->H += VP8FixedCostsUV[it->mb_->uv_mode_];
+  rd->R += VP8GetCostUV(it, rd);
+  rd->D = VP8SSE16x16(src + Y_OFF_ENC, dst + Y_OFF_ENC)
+        + VP8SSE16x8(src + U_OFF_ENC, dst + U_OFF_ENC);
+  rd->SD = 0;
+  SetRDScore(dqm->lambda_mode_, rd);
+}
+
 // Refine intra16/intra4 sub-modes based on distortion only (not rate).
 static void RefineUsingDistortion(VP8EncIterator* const it,
                                   int try_both_modes, int refine_uv_mode,
@@ -1259,7 +1319,12 @@ int VP8Decimate(VP8EncIterator* const it, VP8ModeScore* const rd,
   VP8MakeLuma16Preds(it);
   VP8MakeChroma8Preds(it);
 
-  if (rd_opt > RD_OPT_NONE) {
+  if (it->enc_->fixed_modes_) {
+    // Modes were decided beforehand: just quantize and reconstruct.
+    it->do_trellis_ = (rd_opt >= RD_OPT_TRELLIS);
+    SimpleQuantize(it, rd);
+    ScoreFixedModes(it, rd);
+  } else if (rd_opt > RD_OPT_NONE) {
     it->do_trellis_ = (rd_opt >= RD_OPT_TRELLIS_ALL);
     PickBestIntra16(it, rd);
     if (method >= 2) {
@@ -269,7 +269,7 @@ static int GeneratePartition0(VP8Encoder* const enc) {
   uint64_t pos1, pos2, pos3;
 
   pos1 = VP8BitWriterPos(bw);
-  if (!VP8BitWriterInit(bw, mb_size * 7 / 8)) {        // ~7 bits per macroblock
+  if (!VP8BitWriterReset(bw, mb_size * 7 / 8)) {       // ~7 bits per macroblock
     return WebPEncodingSetError(enc->pic_, VP8_ENC_ERROR_OUT_OF_MEMORY);
   }
   VP8PutBitUniform(bw, 0);   // colorspace
@@ -355,7 +355,9 @@ int VP8EncWrite(VP8Encoder* const enc) {
     ok = ok && PutWebPHeaders(enc, size0, vp8_size, riff_size)
             && pic->writer(part0, size0, pic)
             && EmitPartitionsSize(enc, pic);
-    VP8BitWriterWipeOut(bw);    // will free the internal buffer.
+    if (!enc->keep_buffers_) {
+      VP8BitWriterWipeOut(bw);    // will free the internal buffer.
+    }
   }
 
   // Token partitions
@@ -364,7 +366,9 @@ int VP8EncWrite(VP8Encoder* const enc) {
     const size_t size = VP8BitWriterSize(enc->parts_ + p);
     if (size)
       ok = ok && pic->writer(buf, size, pic);
-    VP8BitWriterWipeOut(enc->parts_ + p);    // will free the internal buffer.
+    if (!enc->keep_buffers_) {
+      VP8BitWriterWipeOut(enc->parts_ + p);  // will free the internal buffer.
+    }
     ok = ok && WebPReportProgress(pic, enc->percent_ + percent_per_part,
                                   &enc->percent_);
   }
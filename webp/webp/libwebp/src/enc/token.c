@@ -46,26 +46,52 @@ void VP8TBufferInit(VP8TBuffer* const b, int page_size) {
   b->tokens_ = NULL;
   b->pages_ = NULL;
   b->last_page_ = &b->pages_;
+  b->free_pages_ = NULL;
   b->left_ = 0;
   b->page_size_ = (page_size < MIN_PAGE_SIZE) ? MIN_PAGE_SIZE : page_size;
   b->error_ = 0;
 }
 
+static void FreePages(VP8Tokens* p) {
+  while (p != NULL) {
+    VP8Tokens* const next = p->next_;
+    WebPSafeFree(p);
+    p = next;
+  }
+}
+
 void VP8TBufferClear(VP8TBuffer* const b) {
   if (b != NULL) {
-    VP8Tokens* p = b->pages_;
-    while (p != NULL) {
-      VP8Tokens* const next = p->next_;
-      WebPSafeFree(p);
-      p = next;
-    }
+    FreePages(b->pages_);
+    FreePages(b->free_pages_);
     VP8TBufferInit(b, b->page_size_);
   }
 }
 
+void VP8TBufferReset(VP8TBuffer* const b, int page_size) {
+  VP8Tokens* free_pages = b->free_pages_;
+  if (page_size < MIN_PAGE_SIZE) page_size = MIN_PAGE_SIZE;
+  // Note: 'last_page_' is not used, in case 'b' was moved.
+  while (b->pages_ != NULL) {
+    VP8Tokens* const next = b->pages_->next_;
+    b->pages_->next_ = free_pages;
+    free_pages = b->pages_;
+    b->pages_ = next;
+  }
+  if (page_size != b->page_size_) {
+    FreePages(free_pages);
+    free_pages = NULL;
+  }
+  VP8TBufferInit(b, page_size);
+  b->free_pages_ = free_pages;
+}
+
 static int TBufferNewPage(VP8TBuffer* const b) {
   VP8Tokens* page = NULL;
-  if (!b->error_) {
+  if (b->free_pages_ != NULL) {
+    page = b->free_pages_;
+    b->free_pages_ = page->next_;
+  } else if (!b->error_) {
     const size_t size = sizeof(*page) + b->page_size_ * sizeof(token_t);
     page = (VP8Tokens*)WebPSafeMalloc(1ULL, size);
   }
@@ -274,12 +300,16 @@ size_t VP8EstimateTokenSize(VP8TBuffer* const b, const uint8_t* const probas) {
 
 #else     // DISABLE_TOKEN_BUFFER
 
-void VP8TBufferInit(VP8TBuffer* const b) {
-  (void)b;
+void VP8TBufferInit(VP8TBuffer* const b, int page_size) {
+  (void)page_size;
+  b->error_ = 0;
 }
 void VP8TBufferClear(VP8TBuffer* const b) {
   (void)b;
 }
+void VP8TBufferReset(VP8TBuffer* const b, int page_size) {
+  VP8TBufferInit(b, page_size);
+}
 
 #endif    // !DISABLE_TOKEN_BUFFER
 
@@ -154,6 +154,24 @@ typedef struct {
   int nb_skip_;             // number of skipped blocks
 } VP8EncProba;
 
+// Statistics of a previous encoding, re-used to warm-start the next one.
+struct WebPEncoderState {
+  int is_valid_;            // false until a first encoding is recorded
+  int age_;                 // number of encodings since the last full one
+  // parameters of the recorded encoding: the state is only re-used if the
+  // next encoding matches them, and has no more macroblocks.
+  float quality_;
+  int method_;
+  int num_mbs_;
+  int num_segments_;
+  int filter_strength_, filter_sharpness_, filter_type_, autofilter_;
+  int has_filter_;          // true if fstrength_[] comes from 'autofilter'
+  uint8_t fstrength_[NUM_MB_SEGMENTS];
+  uint8_t skip_proba_;
+  int use_skip_proba_;
+  ProbaArray coeffs_[NUM_TYPES][NUM_BANDS];
+};
+
 // Filter parameters. Not actually used in the code (we don't perform
 // the in-loop filtering), but filled from user's config
 typedef struct {
@@ -286,6 +304,12 @@ void VP8IteratorStartI4(VP8EncIterator* const it);
 int VP8IteratorRotateI4(VP8EncIterator* const it,
                         const uint8_t* const yuv_out);
 
+// Source strips, for pictures pulled through WebPPicture::row_reader
+typedef struct VP8EncStrip VP8EncStrip;  // struct details in iterator.c
+// Returns NULL in case of memory error.
+VP8EncStrip* VP8EncStripNew(const WebPPicture* const pic);
+void VP8EncStripDelete(VP8EncStrip* const strip);
+
 // Non-zero context setup/teardown
 void VP8IteratorNzToBytes(VP8EncIterator* const it);
 void VP8IteratorBytesToNz(VP8EncIterator* const it);
@@ -306,6 +330,7 @@ typedef struct {
 #if !defined(DISABLE_TOKEN_BUFFER)
   VP8Tokens* pages_;        // first page
   VP8Tokens** last_page_;   // last page
+  VP8Tokens* free_pages_;   // recycled pages, used before allocating new ones
   uint16_t* tokens_;        // set to (*last_page_)->tokens_
   int left_;                // how many free tokens left before the page is full
   int page_size_;           // number of tokens per page
@@ -316,6 +341,9 @@ typedef struct {
 // initialize an empty buffer
 void VP8TBufferInit(VP8TBuffer* const b, int page_size);
 void VP8TBufferClear(VP8TBuffer* const b);   // de-allocate pages memory
+// Empties the buffer for a new use with pages of 'page_size' tokens, keeping
+// its pages (if they have this size) for re-use.
+void VP8TBufferReset(VP8TBuffer* const b, int page_size);
 
 #if !defined(DISABLE_TOKEN_BUFFER)
 
@@ -396,8 +424,14 @@ struct VP8Encoder {
   int max_i4_header_bits_;   // partition #0 safeness factor
   int mb_header_limit_;      // rough limit for header bits per MB
   int thread_level_;         // derived from config->thread_level
+  WebPWorker* side_worker_;  // long-lived analysis worker (if NULL, use a
+                             // temporary one)
   int do_search_;            // derived from config->target_XXX
   int use_tokens_;           // if true, use token buffer
+  int keep_buffers_;         // if true, the bit-writers' buffers and the token
+                             // pages are kept for the next encoding
+  int fixed_modes_;          // if true, intra modes are not searched again
+  const WebPEncoderState* warm_;   // statistics to start from (or NULL)
 
   // Memory
   VP8MBInfo* mb_info_;   // contextual macroblock infos (mb_w_ + 1)
@@ -407,8 +441,21 @@ struct VP8Encoder {
   uint8_t*   uv_top_;    // top u/v samples.
                          // U and V are packed into 16 bytes (8 U + 8 V)
   LFStats*   lf_stats_;  // autofilter stats (if NULL, autofilter is off)
+  VP8EncStrip* strip_;   // source strips (if NULL, samples are in pic_)
+
+  WebPStageTimer* timer_;  // if not NULL, records the stage times
 };
 
+// Per-macroblock state (segments, susceptibilities and intra modes) saved
+// from one encoding, to be re-used by another encoding of the same picture.
+typedef struct {
+  VP8MBInfo* mb_info_;   // copy of enc->mb_info_
+  uint8_t* preds_;       // copy of enc->preds_ (without borders)
+  int alpha_, uv_alpha_;
+  int seg_alpha_[NUM_MB_SEGMENTS];
+  int seg_beta_[NUM_MB_SEGMENTS];
+} VP8EncSnapshot;
+
 //------------------------------------------------------------------------------
 // internal functions. Not public.
 
@@ -462,10 +509,26 @@ int WebPReportProgress(const WebPPicture* const pic,
 // Main analysis loop. Decides the segmentations and complexity.
 // Assigns a first guess for Intra16 and uvmode_ prediction modes.
 int VP8EncAnalyze(VP8Encoder* const enc);
+// Saves the macroblock state of 'enc' into 'snap' (which must be zero-ed
+// before first use). Returns false in case of memory error.
+int VP8EncSaveSnapshot(const VP8Encoder* const enc,
+                       VP8EncSnapshot* const snap);
+// Replaces the call to VP8EncAnalyze() by the results saved in 'snap'.
+// Returns false if the progress hook requested an abort.
+int VP8EncRestoreAnalysis(VP8Encoder* const enc,
+                          const VP8EncSnapshot* const snap);
+// Sets the intra modes to the ones saved in 'snap' and turns mode search off.
+void VP8EncRestoreModes(VP8Encoder* const enc,
+                        const VP8EncSnapshot* const snap);
+void VP8EncSnapshotClear(VP8EncSnapshot* const snap);
 
   // in quant.c
 // Sets up segment's quantization values, base_quant_ and filter strengths.
 void VP8SetSegmentParams(VP8Encoder* const enc, float quality);
+// Returns in 'steps[]' the luma-AC quantizer step each segment would use
+// for the given 'quality'. Doesn't modify the encoder's state.
+void VP8GetSegmentQuantSteps(const VP8Encoder* const enc, float quality,
+                             int steps[NUM_MB_SEGMENTS]);
 // Pick best modes and fills the levels. Returns true if skipped.
 int VP8Decimate(VP8EncIterator* const it, VP8ModeScore* const rd,
                 VP8RDLevel rd_opt);
@@ -509,6 +572,15 @@ int WebPPictureAllocARGB(WebPPicture* const picture, int width, int height);
 // Returns false in case of error (invalid param, out-of-memory).
 int WebPPictureAllocYUVA(WebPPicture* const picture, int width, int height);
 
+// Converts 'height' rows of RGBA samples to the Y/U/V planes, the same way
+// WebPPictureImportRGBA() does (alpha is only used to weight the chroma).
+// 'tmp_rgb' is a scratch area of 4 * ((width + 1) / 2) values.
+void WebPConvertRGBAToYUVRows(const uint8_t* rgba, int rgba_stride,
+                              int width, int height,
+                              uint8_t* y, int y_stride,
+                              uint8_t* u, uint8_t* v, int uv_stride,
+                              uint16_t* tmp_rgb);
+
 // Clean-up the RGB samples under fully transparent area, to help lossless
 // compressibility (no guarantee, though). Assumes that pic->use_argb is true.
 void WebPCleanupTransparentAreaLossless(WebPPicture* const pic);
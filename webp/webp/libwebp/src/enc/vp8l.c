@@ -21,7 +21,9 @@
 #include "./vp8li.h"
 #include "../dsp/lossless.h"
 #include "../utils/bit_writer.h"
+#include "../utils/color_cache.h"
 #include "../utils/huffman_encode.h"
+#include "../utils/thread.h"
 #include "../utils/utils.h"
 #include "../webp/format_constants.h"
 
@@ -30,6 +32,7 @@
 #define PALETTE_KEY_RIGHT_SHIFT   22  // Key for 1K buffer.
 // Maximum number of histogram images (sub-blocks).
 #define MAX_HUFF_IMAGE_SIZE       2600
+#define MAX_TRANSFORM_JOBS        4
 
 // Palette reordering for smaller sum of deltas (and for smaller storage).
 
@@ -315,17 +318,49 @@ static int GetTransformBits(int method, int histo_bits) {
   return (histo_bits > max_transform_bits) ? max_transform_bits : histo_bits;
 }
 
+// Allocates the hash chain and backward refs of 'enc', unless they are
+// recycled.
+static int InitHashChainAndRefs(VP8LEncoder* const enc) {
+  const int pix_cnt = enc->pic_->width * enc->pic_->height;
+  // we round the block size up, so we're guaranteed to have
+  // at max MAX_REFS_BLOCK_PER_IMAGE blocks used:
+  int refs_block_size = (pix_cnt - 1) / MAX_REFS_BLOCK_PER_IMAGE + 1;
+
+  // The hash chain (and backward refs blocks) of a recycled encoder are kept.
+  if (enc->hash_chain_.size_ != pix_cnt) {
+    VP8LHashChainClear(&enc->hash_chain_);
+    if (!VP8LHashChainInit(&enc->hash_chain_, pix_cnt)) return 0;
+  }
+  enc->hash_chain_.thread_level_ = enc->thread_level_;
+
+  // palette-friendly input typically uses less literals
+  //  -> reduce block size a bit
+  if (enc->use_palette_) refs_block_size /= 2;
+  if (enc->refs_[0].block_size_ == 0) {
+    VP8LBackwardRefsInit(&enc->refs_[0], refs_block_size);
+    VP8LBackwardRefsInit(&enc->refs_[1], refs_block_size);
+  }
+
+  return 1;
+}
+
+// Returns true if the image is to be encoded in a single pass by
+// EncodeStreamFast(), without hash chain nor backward references.
+static int UseFastEncoding(const VP8LEncoder* const enc) {
+  const WebPConfig* const config = enc->config_;
+#ifdef WEBP_EXPERIMENTAL_FEATURES
+  if (config->delta_palettization) return 0;
+#endif  // WEBP_EXPERIMENTAL_FEATURES
+  return config->streaming && !config->exhaustive && !enc->use_palette_;
+}
+
 static int AnalyzeAndInit(VP8LEncoder* const enc) {
   const WebPPicture* const pic = enc->pic_;
   const int width = pic->width;
   const int height = pic->height;
-  const int pix_cnt = width * height;
   const WebPConfig* const config = enc->config_;
   const int method = config->method;
   const int low_effort = (config->method == 0);
-  // we round the block size up, so we're guaranteed to have
-  // at max MAX_REFS_BLOCK_PER_IMAGE blocks used:
-  int refs_block_size = (pix_cnt - 1) / MAX_REFS_BLOCK_PER_IMAGE + 1;
   assert(pic != NULL && pic->argb != NULL);
 
   enc->use_cross_color_ = 0;
@@ -362,15 +397,7 @@ static int AnalyzeAndInit(VP8LEncoder* const enc) {
     enc->use_cross_color_ = red_and_blue_always_zero ? 0 : enc->use_predict_;
   }
 
-  if (!VP8LHashChainInit(&enc->hash_chain_, pix_cnt)) return 0;
-
-  // palette-friendly input typically uses less literals
-  //  -> reduce block size a bit
-  if (enc->use_palette_) refs_block_size /= 2;
-  VP8LBackwardRefsInit(&enc->refs_[0], refs_block_size);
-  VP8LBackwardRefsInit(&enc->refs_[1], refs_block_size);
-
-  return 1;
+  return UseFastEncoding(enc) ? 1 : InitHashChainAndRefs(enc);
 }
 
 // Returns false in case of memory error.
@@ -630,6 +657,38 @@ static MV_WEBP_INLINE void WriteHuffmanCodeWithExtraBits(
   VP8LPutBits(bw, (bits << depth) | symbol, depth + n_bits);
 }
 
+// Writes a literal, cache index or copy using the five 'codes' of its tile.
+static MV_WEBP_INLINE void StoreToken(VP8LBitWriter* const bw,
+                                   const HuffmanTreeCode* const codes,
+                                   const PixOrCopy* const v) {
+  if (PixOrCopyIsLiteral(v)) {
+    static const int order[] = { 1, 2, 0, 3 };
+    int k;
+    for (k = 0; k < 4; ++k) {
+      const int code = PixOrCopyLiteral(v, order[k]);
+      WriteHuffmanCode(bw, codes + k, code);
+    }
+  } else if (PixOrCopyIsCacheIdx(v)) {
+    const int code = PixOrCopyCacheIdx(v);
+    const int literal_ix = 256 + NUM_LENGTH_CODES + code;
+    WriteHuffmanCode(bw, codes, literal_ix);
+  } else {
+    int bits, n_bits;
+    int code;
+
+    const int distance = PixOrCopyDistance(v);
+    VP8LPrefixEncode(v->len, &code, &n_bits, &bits);
+    WriteHuffmanCodeWithExtraBits(bw, codes, 256 + code, bits, n_bits);
+
+    // Don't write the distance with the extra bits code since
+    // the distance can be up to 18 bits of extra bits, and the prefix
+    // 15 bits, totaling to 33, and our PutBits only supports up to 32 bits.
+    VP8LPrefixEncode(distance, &code, &n_bits, &bits);
+    WriteHuffmanCode(bw, codes + 4, code);
+    VP8LPutBits(bw, bits, n_bits);
+  }
+}
+
 static WebPEncodingError StoreImageToBitMask(
     VP8LBitWriter* const bw, int width, int histo_bits,
     VP8LBackwardRefs* const refs,
@@ -654,33 +713,7 @@ static WebPEncodingError StoreImageToBitMask(
                                        (x >> histo_bits)];
       codes = huffman_codes + 5 * histogram_ix;
     }
-    if (PixOrCopyIsLiteral(v)) {
-      static const int order[] = { 1, 2, 0, 3 };
-      int k;
-      for (k = 0; k < 4; ++k) {
-        const int code = PixOrCopyLiteral(v, order[k]);
-        WriteHuffmanCode(bw, codes + k, code);
-      }
-    } else if (PixOrCopyIsCacheIdx(v)) {
-      const int code = PixOrCopyCacheIdx(v);
-      const int literal_ix = 256 + NUM_LENGTH_CODES + code;
-      WriteHuffmanCode(bw, codes, literal_ix);
-    } else {
-      int bits, n_bits;
-      int code;
-
-      const int distance = PixOrCopyDistance(v);
-      VP8LPrefixEncode(v->len, &code, &n_bits, &bits);
-      WriteHuffmanCodeWithExtraBits(bw, codes, 256 + code, bits, n_bits);
-
-      // Don't write the distance with the extra bits code since
-      // the distance can be up to 18 bits of extra bits, and the prefix
-      // 15 bits, totaling to 33, and our PutBits only supports up to 32 bits.
-      // TODO(jyrki): optimize this further.
-      VP8LPrefixEncode(distance, &code, &n_bits, &bits);
-      WriteHuffmanCode(bw, codes + 4, code);
-      VP8LPutBits(bw, bits, n_bits);
-    }
+    StoreToken(bw, codes, v);
     x += PixOrCopyLength(v);
     while (x >= width) {
       x -= width;
@@ -967,6 +1000,155 @@ static void ApplySubtractGreen(VP8LEncoder* const enc, int width, int height,
   VP8LSubtractGreenFromBlueAndRed(enc->argb_, width * height);
 }
 
+// Transform search over a range of tiles.
+typedef struct {
+  WebPWorker worker_;
+  const VP8LEncoder* enc_;
+  int width_, height_;
+  int tile_x_start_, tile_x_end_;
+  int tile_y_start_, tile_y_end_;
+  uint32_t* argb_scratch_;
+  int quality_;
+  int near_lossless_;
+  int used_subtract_green_;
+  // Histograms of the previously searched tiles, updated by the search. The
+  // cross-color search only uses the red and blue ones.
+  int accumulated_[4][256];
+} TransformJob;
+
+static int PredictorJobHook(TransformJob* const job, void* unused) {
+  const VP8LEncoder* const enc = job->enc_;
+  (void)unused;
+  VP8LPredictorImage(job->width_, job->height_, enc->transform_bits_,
+                     job->tile_x_start_, job->tile_x_end_,
+                     job->tile_y_start_, job->tile_y_end_, job->accumulated_,
+                     enc->argb_, job->argb_scratch_, enc->transform_data_,
+                     job->near_lossless_, enc->config_->exact,
+                     job->used_subtract_green_);
+  return 1;
+}
+
+static int CrossColorJobHook(TransformJob* const job, void* unused) {
+  const VP8LEncoder* const enc = job->enc_;
+  (void)unused;
+  VP8LColorSpaceTransform(job->width_, job->height_, enc->transform_bits_,
+                          job->quality_, job->tile_x_start_, job->tile_x_end_,
+                          job->tile_y_start_, job->tile_y_end_,
+                          job->accumulated_[1], job->accumulated_[3],
+                          enc->argb_, enc->transform_data_);
+  return 1;
+}
+
+// Returns the number of transform searches to run concurrently. Like for the
+// hash chain, all the threads of the pool are used when it is installed, and
+// the work is only split in two otherwise.
+static int GetNumTransformJobs(const VP8LEncoder* const enc) {
+  const WebPWorkerInterface* const pool = WebPGetThreadPoolInterface();
+  int num_jobs = 2;
+  if (enc->thread_level_ <= 0) return 1;
+  if (WebPGetWorkerInterface()->Launch == pool->Launch) {
+    num_jobs = WebPThreadPoolGetSize() + 1;
+  }
+  return (num_jobs > MAX_TRANSFORM_JOBS) ? MAX_TRANSFORM_JOBS : num_jobs;
+}
+
+// Runs 'hook' over all the tiles. A single job searches them in scan order,
+// each tile using the statistics of all the previous ones. With several jobs,
+// the tile rows are split in as many column segments, and row y is searched
+// one segment behind row y - 1: at step s, the job of row y searches its
+// segment s - y. The tiles above and to the left of a segment are then always
+// done, as a scan order search expects, and the statistics of all the earlier
+// steps are gathered between steps. The result does not depend on the
+// scheduling of the threads, and stays close to the one of a single job.
+static int RunTransformJobs(const TransformJob* const params,
+                            WebPWorkerHook hook) {
+  const VP8LEncoder* const enc = params->enc_;
+  const WebPWorkerInterface* const worker_interface = WebPGetWorkerInterface();
+  const int tiles_per_row =
+      VP8LSubSampleSize(params->width_, enc->transform_bits_);
+  const int tiles_per_col =
+      VP8LSubSampleSize(params->height_, enc->transform_bits_);
+  TransformJob jobs[MAX_TRANSFORM_JOBS];
+  int active[MAX_TRANSFORM_JOBS];
+  int accumulated[4][256];
+  int num_jobs = enc->num_transform_jobs_;
+  int ok = 1;
+  int step, i, k, v;
+
+  if (num_jobs > tiles_per_row) num_jobs = tiles_per_row;
+  if (num_jobs > tiles_per_col) num_jobs = tiles_per_col;
+  memset(accumulated, 0, sizeof(accumulated));
+  for (i = 0; i < num_jobs; ++i) {
+    jobs[i] = *params;
+    worker_interface->Init(&jobs[i].worker_);
+    jobs[i].worker_.data1 = &jobs[i];
+    jobs[i].worker_.data2 = NULL;
+    jobs[i].worker_.hook = hook;
+    jobs[i].argb_scratch_ = enc->argb_scratch_ + i * enc->argb_scratch_size_;
+  }
+  if (num_jobs == 1) {
+    jobs[0].tile_x_start_ = 0;
+    jobs[0].tile_x_end_ = tiles_per_row;
+    jobs[0].tile_y_start_ = 0;
+    jobs[0].tile_y_end_ = tiles_per_col;
+    memcpy(jobs[0].accumulated_, accumulated, sizeof(accumulated));
+    worker_interface->Execute(&jobs[0].worker_);
+    ok = worker_interface->Sync(&jobs[0].worker_);
+  } else {
+    // The first job runs in the calling thread.
+    for (i = 1; i < num_jobs; ++i) {
+      if (!worker_interface->Reset(&jobs[i].worker_)) {
+        num_jobs = i;
+        break;
+      }
+    }
+    for (step = 0; ok && step < tiles_per_col + num_jobs - 1; ++step) {
+      for (i = 0; i < num_jobs; ++i) {
+        // The job searching row y also searches rows y + num_jobs, ...
+        const int tile_y = step - ((step - i) % num_jobs + num_jobs) % num_jobs;
+        const int segment = step - tile_y;
+        TransformJob* const job = &jobs[i];
+        active[i] = (tile_y >= 0 && tile_y < tiles_per_col);
+        if (!active[i]) continue;
+        job->tile_x_start_ = segment * tiles_per_row / num_jobs;
+        job->tile_x_end_ = (segment + 1) * tiles_per_row / num_jobs;
+        job->tile_y_start_ = tile_y;
+        job->tile_y_end_ = tile_y + 1;
+        memcpy(job->accumulated_, accumulated, sizeof(accumulated));
+        if (i > 0) worker_interface->Launch(&job->worker_);
+      }
+      if (active[0]) worker_interface->Execute(&jobs[0].worker_);
+      for (i = 0; i < num_jobs; ++i) {
+        if (active[i]) ok &= worker_interface->Sync(&jobs[i].worker_);
+      }
+      // Adds what each job added to the statistics.
+      for (k = 0; k < 4; ++k) {
+        for (v = 0; v < 256; ++v) {
+          int sum = accumulated[k][v];
+          for (i = 0; i < num_jobs; ++i) {
+            if (!active[i]) continue;
+            sum += jobs[i].accumulated_[k][v] - accumulated[k][v];
+          }
+          accumulated[k][v] = sum;
+        }
+      }
+    }
+  }
+  for (i = 0; i < num_jobs; ++i) {
+    worker_interface->End(&jobs[i].worker_);
+  }
+  return ok;
+}
+
+static void InitTransformParams(const VP8LEncoder* const enc,
+                                int width, int height,
+                                TransformJob* const params) {
+  memset(params, 0, sizeof(*params));
+  params->enc_ = enc;
+  params->width_ = width;
+  params->height_ = height;
+}
+
 static WebPEncodingError ApplyPredictFilter(const VP8LEncoder* const enc,
                                             int width, int height,
                                             int quality, int low_effort,
@@ -979,6 +1161,15 @@ static WebPEncodingError ApplyPredictFilter(const VP8LEncoder* const enc,
   const int near_lossless_strength = enc->use_palette_ ? 100
                                    : enc->config_->near_lossless;
 
+  if (!low_effort) {
+    TransformJob params;
+    InitTransformParams(enc, width, height, &params);
+    params.near_lossless_ = near_lossless_strength;
+    params.used_subtract_green_ = used_subtract_green;
+    if (!RunTransformJobs(&params, (WebPWorkerHook)PredictorJobHook)) {
+      return VP8_ENC_ERROR_OUT_OF_MEMORY;
+    }
+  }
   VP8LResidualImage(width, height, pred_bits, low_effort, enc->argb_,
                     enc->argb_scratch_, enc->transform_data_,
                     near_lossless_strength, enc->config_->exact,
@@ -1001,9 +1192,13 @@ static WebPEncodingError ApplyCrossColorFilter(const VP8LEncoder* const enc,
   const int ccolor_transform_bits = enc->transform_bits_;
   const int transform_width = VP8LSubSampleSize(width, ccolor_transform_bits);
   const int transform_height = VP8LSubSampleSize(height, ccolor_transform_bits);
+  TransformJob params;
 
-  VP8LColorSpaceTransform(width, height, ccolor_transform_bits, quality,
-                          enc->argb_, enc->transform_data_);
+  InitTransformParams(enc, width, height, &params);
+  params.quality_ = quality;
+  if (!RunTransformJobs(&params, (WebPWorkerHook)CrossColorJobHook)) {
+    return VP8_ENC_ERROR_OUT_OF_MEMORY;
+  }
   VP8LPutBits(bw, TRANSFORM_PRESENT, 1);
   VP8LPutBits(bw, CROSS_COLOR_TRANSFORM, 2);
   assert(ccolor_transform_bits >= 2);
@@ -1093,10 +1288,11 @@ static void ClearTransformBuffer(VP8LEncoder* const enc) {
 // Flags influencing the memory allocated:
 //  enc->transform_bits_
 //  enc->use_predict_, enc->use_cross_color_
+//  enc->argb_in_place_ (the picture's argb plane is then used as buffer)
 static WebPEncodingError AllocateTransformBuffer(VP8LEncoder* const enc,
                                                  int width, int height) {
   WebPEncodingError err = VP8_ENC_OK;
-  const uint64_t image_size = width * height;
+  const uint64_t image_size = enc->argb_in_place_ ? 0 : width * height;
   // VP8LResidualImage needs room for 2 scanlines of uint32 pixels with an extra
   // pixel in each, plus 2 regular scanlines of bytes.
   // TODO(skal): Clean up by using arithmetic in bytes instead of words.
@@ -1105,6 +1301,8 @@ static WebPEncodingError AllocateTransformBuffer(VP8LEncoder* const enc,
           ? (width + 1) * 2 +
             (width * 2 + sizeof(uint32_t) - 1) / sizeof(uint32_t)
           : 0;
+  // Each concurrent predictor search needs its own scratch rows.
+  const int num_scratch = GetNumTransformJobs(enc);
   const uint64_t transform_data_size =
       (enc->use_predict_ || enc->use_cross_color_)
           ? VP8LSubSampleSize(width, enc->transform_bits_) *
@@ -1114,7 +1312,7 @@ static WebPEncodingError AllocateTransformBuffer(VP8LEncoder* const enc,
       (WEBP_ALIGN_CST + sizeof(uint32_t) - 1) / sizeof(uint32_t);
   const uint64_t mem_size =
       image_size + max_alignment_in_words +
-      argb_scratch_size + max_alignment_in_words +
+      num_scratch * argb_scratch_size + max_alignment_in_words +
       transform_data_size;
   uint32_t* mem = enc->transform_mem_;
   if (mem == NULL || mem_size > enc->transform_mem_size_) {
@@ -1127,10 +1325,12 @@ static WebPEncodingError AllocateTransformBuffer(VP8LEncoder* const enc,
     enc->transform_mem_ = mem;
     enc->transform_mem_size_ = (size_t)mem_size;
   }
-  enc->argb_ = mem;
+  enc->argb_ = enc->argb_in_place_ ? enc->pic_->argb : mem;
   mem = (uint32_t*)WEBP_ALIGN(mem + image_size);
   enc->argb_scratch_ = mem;
-  mem = (uint32_t*)WEBP_ALIGN(mem + argb_scratch_size);
+  enc->argb_scratch_size_ = (size_t)argb_scratch_size;
+  enc->num_transform_jobs_ = num_scratch;
+  mem = (uint32_t*)WEBP_ALIGN(mem + num_scratch * argb_scratch_size);
   enc->transform_data_ = mem;
 
   enc->current_width_ = width;
@@ -1146,10 +1346,12 @@ static WebPEncodingError MakeInputImageCopy(VP8LEncoder* const enc) {
   int y;
   err = AllocateTransformBuffer(enc, width, height);
   if (err != VP8_ENC_OK) return err;
-  for (y = 0; y < height; ++y) {
-    memcpy(enc->argb_ + y * width,
-           picture->argb + y * picture->argb_stride,
-           width * sizeof(*enc->argb_));
+  if (!enc->argb_in_place_) {
+    for (y = 0; y < height; ++y) {
+      memcpy(enc->argb_ + y * width,
+             picture->argb + y * picture->argb_stride,
+             width * sizeof(*enc->argb_));
+    }
   }
   assert(enc->current_width_ == width);
   return VP8_ENC_OK;
@@ -1157,35 +1359,45 @@ static WebPEncodingError MakeInputImageCopy(VP8LEncoder* const enc) {
 
 // -----------------------------------------------------------------------------
 
-static int SearchColor(const uint32_t sorted[], uint32_t color, int hi) {
-  int low = 0;
-  if (sorted[low] == color) return low;  // loop invariant: sorted[low] != color
-  while (1) {
-    const int mid = (low + hi) >> 1;
-    if (sorted[mid] == color) {
-      return mid;
-    } else if (sorted[mid] < color) {
-      low = mid;
-    } else {
-      hi = mid;
-    }
-  }
+// Palette colors are looked up in a small open-addressing hash table, built
+// once per palette. As all the pixels are known to be in the palette, the
+// lookup needs no 'empty slot' test.
+#define PALETTE_HASH_BITS 11
+#define PALETTE_HASH_SIZE (1 << PALETTE_HASH_BITS)
+
+typedef struct {
+  uint32_t colors_[PALETTE_HASH_SIZE];
+  uint8_t indices_[PALETTE_HASH_SIZE];
+} PaletteHash;
+
+static MV_WEBP_INLINE uint32_t PaletteHashKey(uint32_t color) {
+  return (color * kHashMul) >> (32 - PALETTE_HASH_BITS);
 }
 
-// Sort palette in increasing order and prepare an inverse mapping array.
+static MV_WEBP_INLINE int PaletteHashLookup(const PaletteHash* const hash,
+                                         uint32_t color) {
+  uint32_t key = PaletteHashKey(color);
+  while (hash->colors_[key] != color) key = (key + 1) & (PALETTE_HASH_SIZE - 1);
+  return hash->indices_[key];
+}
+
+// Fills the hash table with the 'num_colors' entries of 'palette'.
 static void PrepareMapToPalette(const uint32_t palette[], int num_colors,
-                                uint32_t sorted[], int idx_map[]) {
+                                PaletteHash* const hash) {
+  uint8_t used[PALETTE_HASH_SIZE] = { 0 };
   int i;
-  memcpy(sorted, palette, num_colors * sizeof(*sorted));
-  qsort(sorted, num_colors, sizeof(*sorted), PaletteCompareColorsForQsort);
+  assert(num_colors <= MAX_PALETTE_SIZE);
   for (i = 0; i < num_colors; ++i) {
-    idx_map[SearchColor(sorted, palette[i], num_colors)] = i;
+    uint32_t key = PaletteHashKey(palette[i]);
+    while (used[key]) key = (key + 1) & (PALETTE_HASH_SIZE - 1);
+    used[key] = 1;
+    hash->colors_[key] = palette[i];
+    hash->indices_[key] = i;
   }
 }
 
-static void MapToPalette(const uint32_t sorted_palette[], int num_colors,
+static void MapToPalette(const PaletteHash* const hash,
                          uint32_t* const last_pix, int* const last_idx,
-                         const int idx_map[],
                          const uint32_t* src, uint8_t* dst, int width) {
   int x;
   int prev_idx = *last_idx;
@@ -1193,7 +1405,7 @@ static void MapToPalette(const uint32_t sorted_palette[], int num_colors,
   for (x = 0; x < width; ++x) {
     const uint32_t pix = src[x];
     if (pix != prev_pix) {
-      prev_idx = idx_map[SearchColor(sorted_palette, pix, num_colors)];
+      prev_idx = PaletteHashLookup(hash, pix);
       prev_pix = pix;
     }
     dst[x] = prev_idx;
@@ -1243,14 +1455,12 @@ static WebPEncodingError ApplyPalette(const uint32_t* src, uint32_t src_stride,
     // Use 1 pixel cache for ARGB pixels.
     uint32_t last_pix;
     int last_idx;
-    uint32_t sorted[MAX_PALETTE_SIZE];
-    int idx_map[MAX_PALETTE_SIZE];
-    PrepareMapToPalette(palette, palette_size, sorted, idx_map);
+    PaletteHash hash;
+    PrepareMapToPalette(palette, palette_size, &hash);
     last_pix = palette[0];
     last_idx = 0;
     for (y = 0; y < height; ++y) {
-      MapToPalette(sorted, palette_size, &last_pix, &last_idx,
-                   idx_map, src, tmp_row, width);
+      MapToPalette(&hash, &last_pix, &last_idx, src, tmp_row, width);
       VP8LBundleColorMap(tmp_row, width, xbits, dst);
       src += src_stride;
       dst += dst_stride;
@@ -1354,21 +1564,36 @@ static WebPEncodingError EncodeDeltaPalettePredictorImage(
 // VP8LEncoder
 
 static VP8LEncoder* VP8LEncoderNew(const WebPConfig* const config,
-                                   const WebPPicture* const picture) {
-  VP8LEncoder* const enc = (VP8LEncoder*)WebPSafeCalloc(1ULL, sizeof(*enc));
-  if (enc == NULL) {
-    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    return NULL;
+                                   const WebPPicture* const picture,
+                                   VP8LEncoder** const scratch) {
+  VP8LEncoder* enc = (scratch != NULL) ? *scratch : NULL;
+  if (enc != NULL) {
+    // Recycle the scratch objects, and reset everything else.
+    const VP8LEncoder old = *enc;
+    memset(enc, 0, sizeof(*enc));
+    enc->transform_mem_ = old.transform_mem_;
+    enc->transform_mem_size_ = old.transform_mem_size_;
+    enc->refs_[0] = old.refs_[0];
+    enc->refs_[1] = old.refs_[1];
+    enc->hash_chain_ = old.hash_chain_;
+  } else {
+    enc = (VP8LEncoder*)WebPSafeCalloc(1ULL, sizeof(*enc));
+    if (enc == NULL) {
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      return NULL;
+    }
+    if (scratch != NULL) *scratch = enc;
   }
   enc->config_ = config;
   enc->pic_ = picture;
+  enc->thread_level_ = config->thread_level;
 
   VP8LEncDspInit();
 
   return enc;
 }
 
-static void VP8LEncoderDelete(VP8LEncoder* enc) {
+void VP8LEncoderDelete(VP8LEncoder* enc) {
   if (enc != NULL) {
     VP8LHashChainClear(&enc->hash_chain_);
     VP8LBackwardRefsClear(&enc->refs_[0]);
@@ -1381,16 +1606,476 @@ static void VP8LEncoderDelete(VP8LEncoder* enc) {
 // -----------------------------------------------------------------------------
 // Main call
 
-WebPEncodingError VP8LEncodeStream(const WebPConfig* const config,
-                                   const WebPPicture* const picture,
-                                   VP8LBitWriter* const bw, int use_cache) {
+// Applies the transforms selected in 'enc', writes them and then the
+// transformed image to 'bw'.
+static WebPEncodingError EncodeStreamTransformsAndImage(
+    VP8LEncoder* const enc, VP8LBitWriter* const bw, int use_cache,
+    int use_delta_palettization, size_t byte_position,
+    int* const hdr_size, int* const data_size) {
   WebPEncodingError err = VP8_ENC_OK;
+  const WebPConfig* const config = enc->config_;
   const int quality = (int)config->quality;
   const int low_effort = (config->method == 0);
+  const int height = enc->pic_->height;
+
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_TRANSFORMS);
+  // Encode palette
+  if (enc->use_palette_) {
+    err = EncodePalette(bw, enc);
+    if (err != VP8_ENC_OK) return err;
+    err = MapImageFromPalette(enc, use_delta_palettization);
+    if (err != VP8_ENC_OK) return err;
+  }
+  if (!use_delta_palettization) {
+    // In case image is not packed.
+    if (enc->argb_ == NULL) {
+      err = MakeInputImageCopy(enc);
+      if (err != VP8_ENC_OK) return err;
+    }
+
+    // -------------------------------------------------------------------------
+    // Apply transforms and write transform data.
+
+    if (enc->use_subtract_green_) {
+      ApplySubtractGreen(enc, enc->current_width_, height, bw);
+    }
+
+    if (enc->use_predict_) {
+      err = ApplyPredictFilter(enc, enc->current_width_, height, quality,
+                               low_effort, enc->use_subtract_green_, bw);
+      if (err != VP8_ENC_OK) return err;
+    }
+
+    if (enc->use_cross_color_) {
+      err = ApplyCrossColorFilter(enc, enc->current_width_,
+                                  height, quality, bw);
+      if (err != VP8_ENC_OK) return err;
+    }
+  }
+
+  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_TRANSFORMS);
+
+  // ---------------------------------------------------------------------------
+  // Encode and write the transformed image.
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_ENTROPY);
+  err = EncodeImageInternal(bw, enc->argb_, &enc->hash_chain_, enc->refs_,
+                            enc->current_width_, height, quality, low_effort,
+                            use_cache, &enc->cache_bits_, enc->histo_bits_,
+                            byte_position, hdr_size, data_size);
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_ENTROPY);
+  return err;
+}
+
+static void StoreStats(const VP8LEncoder* const enc,
+                       VP8LBitWriter* const bw, size_t byte_position,
+                       int hdr_size, int data_size) {
+  WebPAuxStats* const stats = enc->pic_->stats;
+  if (stats == NULL) return;
+  stats->lossless_features = 0;
+  if (enc->use_predict_) stats->lossless_features |= 1;
+  if (enc->use_cross_color_) stats->lossless_features |= 2;
+  if (enc->use_subtract_green_) stats->lossless_features |= 4;
+  if (enc->use_palette_) stats->lossless_features |= 8;
+  stats->histogram_bits = enc->histo_bits_;
+  stats->transform_bits = enc->transform_bits_;
+  stats->cache_bits = enc->cache_bits_;
+  stats->palette_size = enc->palette_size_;
+  stats->lossless_size = (int)(VP8LBitWriterNumBytes(bw) - byte_position);
+  stats->lossless_hdr_size = hdr_size;
+  stats->lossless_data_size = data_size;
+}
+
+// -----------------------------------------------------------------------------
+// Single-pass encoding
+//
+// With the fastest setting (method 0 and quality 0), images that do not fit a
+// palette skip the backward references search altogether: after the subtract
+// green and the fixed predictor transforms, each pixel is coded as a run along
+// its left or top neighbour, a color cache index or a literal, with Huffman
+// codes built from a sample of the rows.
+
+#define FAST_TRANSFORM_BITS  9     // largest predictor tile the format allows
+#define FAST_CACHE_BITS      10
+#define FAST_MIN_LENGTH      4     // shortest run worth a copy
+#define FAST_MAX_LENGTH      4096  // longest copy length the format allows
+
+// Stores the single symbol of a Huffman code, which then takes no bits.
+static void StoreSingleSymbolCode(VP8LBitWriter* const bw, int symbol) {
+  VP8LPutBits(bw, 1, 1);  // Small tree marker.
+  VP8LPutBits(bw, 0, 1);  // One symbol.
+  VP8LPutBits(bw, 1, 1);  // Code bit for an 8-bit symbol value.
+  VP8LPutBits(bw, symbol, 8);
+}
+
+// Stores a sub-image whose pixels all have the value 'argb'.
+static void StoreUniformImage(VP8LBitWriter* const bw, uint32_t argb) {
+  VP8LPutBits(bw, 0, 1);  // No color cache.
+  StoreSingleSymbolCode(bw, (argb >> 8) & 0xff);
+  StoreSingleSymbolCode(bw, (argb >> 16) & 0xff);
+  StoreSingleSymbolCode(bw, (argb >> 0) & 0xff);
+  StoreSingleSymbolCode(bw, (argb >> 24) & 0xff);
+  StoreSingleSymbolCode(bw, 0);  // Distance, unused.
+}
+
+// Codes the pixels [start, end) of 'argb'. The tokens are either counted in
+// 'histo' or, if it is NULL, written to 'bw' using 'codes'. 'cache' is NULL
+// when no color cache is used.
+static void FastStoreTokens(const uint32_t* const argb, int width,
+                            int start, int end, VP8LColorCache* const cache,
+                            VP8LHistogram* const histo,
+                            VP8LBitWriter* const bw,
+                            const HuffmanTreeCode* const codes) {
+  const int left_code = VP8LDistanceToPlaneCode(width, 1);
+  const int top_code = VP8LDistanceToPlaneCode(width, width);
+  int i = start;
+  while (i < end) {
+    const int max_len = (end - i < FAST_MAX_LENGTH) ? end - i : FAST_MAX_LENGTH;
+    int rle_len = 0;
+    int top_len = 0;
+    PixOrCopy v;
+    if (i > 0 && argb[i] == argb[i - 1]) {
+      rle_len = VP8LVectorMismatch(argb + i, argb + i - 1, max_len);
+    }
+    if (i >= width && argb[i] == argb[i - width]) {
+      top_len = VP8LVectorMismatch(argb + i, argb + i - width, max_len);
+    }
+    if (rle_len >= top_len && rle_len >= FAST_MIN_LENGTH) {
+      // Repeating the previous pixel leaves the color cache unchanged.
+      v = PixOrCopyCreateCopy(left_code, rle_len);
+    } else if (top_len >= FAST_MIN_LENGTH) {
+      v = PixOrCopyCreateCopy(top_code, top_len);
+      if (cache != NULL) {
+        int k;
+        for (k = 0; k < top_len; ++k) VP8LColorCacheInsert(cache, argb[i + k]);
+      }
+    } else {
+      const uint32_t pix = argb[i];
+      if (cache == NULL) {
+        v = PixOrCopyCreateLiteral(pix);
+      } else {
+        const int key = VP8LColorCacheGetIndex(cache, pix);
+        if (VP8LColorCacheLookup(cache, key) == pix) {
+          v = PixOrCopyCreateCacheIdx(key);
+        } else {
+          v = PixOrCopyCreateLiteral(pix);
+          VP8LColorCacheSet(cache, key, pix);
+        }
+      }
+    }
+    if (histo != NULL) {
+      VP8LHistogramAddSinglePixOrCopy(histo, &v);
+    } else {
+      StoreToken(bw, codes, &v);
+    }
+    i += PixOrCopyLength(&v);
+  }
+}
+
+// Builds the Huffman codes from every 'step'-th row of 'argb'. If rows are
+// skipped, all the symbols get a non-zero count as these rows may use any of
+// them.
+static int FastBuildCodes(const uint32_t* const argb, int width, int height,
+                          int cache_bits, HuffmanTreeCode* const codes) {
+  const int step = 1 + ((width * height) >> 18);
+  VP8LHistogramSet* const histogram_image =
+      VP8LAllocateHistogramSet(1, cache_bits);
+  VP8LColorCache cache;
+  int ok = 0;
+  if (histogram_image == NULL) return 0;
+  if (cache_bits > 0 && !VP8LColorCacheInit(&cache, cache_bits)) goto End;
+  {
+    VP8LHistogram* const histo = histogram_image->histograms[0];
+    const int num_literals = VP8LHistogramNumCodes(cache_bits);
+    int y, k;
+    if (step == 1) {
+      FastStoreTokens(argb, width, 0, width * height,
+                      (cache_bits > 0) ? &cache : NULL, histo, NULL, NULL);
+    } else {
+      for (y = 0; y < height; y += step) {
+        FastStoreTokens(argb, width, y * width, (y + 1) * width,
+                        (cache_bits > 0) ? &cache : NULL, histo, NULL, NULL);
+      }
+      for (k = 0; k < num_literals; ++k) ++histo->literal_[k];
+      for (k = 0; k < NUM_LITERAL_CODES; ++k) {
+        ++histo->red_[k];
+        ++histo->blue_[k];
+        ++histo->alpha_[k];
+      }
+      for (k = 0; k < NUM_DISTANCE_CODES; ++k) ++histo->distance_[k];
+    }
+  }
+  if (cache_bits > 0) VP8LColorCacheClear(&cache);
+  ok = GetHuffBitLengthsAndCodes(histogram_image, codes);
+ End:
+  VP8LFreeHistogramSet(histogram_image);
+  return ok;
+}
+
+static WebPEncodingError EncodeStreamFast(VP8LEncoder* const enc,
+                                          VP8LBitWriter* const bw,
+                                          int use_cache, size_t byte_position,
+                                          int* const hdr_size,
+                                          int* const data_size) {
+  WebPEncodingError err = VP8_ENC_OK;
+  const int width = enc->pic_->width;
+  const int height = enc->pic_->height;
+  const int cache_bits = use_cache ? FAST_CACHE_BITS : 0;
+  HuffmanTreeCode huffman_codes[5] = { { 0, NULL, NULL } };
+  HuffmanTreeToken* tokens = NULL;
+  HuffmanTree* huff_tree = NULL;
+  VP8LColorCache cache;
+  int use_color_cache = 0;
+  int i;
+
+  enc->use_subtract_green_ = 1;
+  enc->use_predict_ = 1;
+  enc->use_cross_color_ = 0;
+  enc->histo_bits_ = 0;
+  enc->transform_bits_ = FAST_TRANSFORM_BITS;
+  enc->cache_bits_ = cache_bits;
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_TRANSFORMS);
+  err = MakeInputImageCopy(enc);
+  if (err != VP8_ENC_OK) goto Error;
+
+  ApplySubtractGreen(enc, width, height, bw);
+  VP8LResidualImage(width, height, FAST_TRANSFORM_BITS, 1, enc->argb_,
+                    enc->argb_scratch_, enc->transform_data_, 100,
+                    enc->config_->exact, 1);
+  VP8LPutBits(bw, TRANSFORM_PRESENT, 1);
+  VP8LPutBits(bw, PREDICTOR_TRANSFORM, 2);
+  VP8LPutBits(bw, FAST_TRANSFORM_BITS - 2, 3);
+  StoreUniformImage(bw, enc->transform_data_[0]);
+  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_TRANSFORMS);
+
+  WEBP_TIMING_START(enc->timer_, WEBP_ENC_STAGE_ENTROPY);
+  if (!FastBuildCodes(enc->argb_, width, height, cache_bits, huffman_codes)) {
+    err = VP8_ENC_ERROR_OUT_OF_MEMORY;
+    goto Error;
+  }
+  huff_tree = (HuffmanTree*)WebPSafeMalloc(3ULL * CODE_LENGTH_CODES,
+                                           sizeof(*huff_tree));
+  tokens = (HuffmanTreeToken*)WebPSafeMalloc(huffman_codes[0].num_symbols,
+                                             sizeof(*tokens));
+  if (huff_tree == NULL || tokens == NULL) {
+    err = VP8_ENC_ERROR_OUT_OF_MEMORY;
+    goto Error;
+  }
+  if (cache_bits > 0) {
+    if (!VP8LColorCacheInit(&cache, cache_bits)) {
+      err = VP8_ENC_ERROR_OUT_OF_MEMORY;
+      goto Error;
+    }
+    use_color_cache = 1;
+    VP8LPutBits(bw, 1, 1);
+    VP8LPutBits(bw, cache_bits, 4);
+  } else {
+    VP8LPutBits(bw, 0, 1);
+  }
+  VP8LPutBits(bw, 0, 1);  // No Huffman image.
+  for (i = 0; i < 5; ++i) {
+    StoreHuffmanCode(bw, huff_tree, tokens, &huffman_codes[i]);
+    ClearHuffmanTreeIfOnlyOneSymbol(&huffman_codes[i]);
+  }
+  *hdr_size = (int)(VP8LBitWriterNumBytes(bw) - byte_position);
+
+  FastStoreTokens(enc->argb_, width, 0, width * height,
+                  use_color_cache ? &cache : NULL, NULL, bw, huffman_codes);
+  *data_size = (int)(VP8LBitWriterNumBytes(bw) - byte_position - *hdr_size);
+  if (bw->error_) err = VP8_ENC_ERROR_OUT_OF_MEMORY;
+  WEBP_TIMING_STOP(enc->timer_, WEBP_ENC_STAGE_ENTROPY);
+
+ Error:
+  if (use_color_cache) VP8LColorCacheClear(&cache);
+  WebPSafeFree(tokens);
+  WebPSafeFree(huff_tree);
+  WebPSafeFree(huffman_codes[0].codes);
+  return err;
+}
+
+// -----------------------------------------------------------------------------
+// Exhaustive search
+
+// Sets the transforms and bits of 'enc' for 'mode'.
+static void SetMode(VP8LEncoder* const enc, EntropyIx mode) {
+  const WebPPicture* const pic = enc->pic_;
+  const int method = enc->config_->method;
+  enc->use_palette_ = (mode == kPalette);
+  enc->use_subtract_green_ = (mode == kSubGreen) || (mode == kSpatialSubGreen);
+  enc->use_predict_ = (mode == kSpatial) || (mode == kSpatialSubGreen);
+  enc->use_cross_color_ = enc->use_predict_;
+  enc->histo_bits_ = GetHistoBits(method, enc->use_palette_,
+                                  pic->width, pic->height);
+  enc->transform_bits_ = GetTransformBits(method, enc->histo_bits_);
+}
+
+// Encodes a subset of the modes and keeps the smallest output.
+typedef struct {
+  WebPWorker worker_;
+  VP8LEncoder* enc_;              // encoder recycled over the modes
+  const VP8LBitWriter* bw_init_;  // stream written so far
+  size_t byte_position_;          // size of 'bw_init_'
+  int use_cache_;
+  const uint32_t* palette_;       // palette found by AnalyzeAndInit(), if any
+  int palette_size_;
+  EntropyIx modes_[kNumEntropyIx];
+  int num_modes_;
+  int use_timer_;
+  WebPStageTimer timer_;          // stage times of the job, if use_timer_
+  // Result.
+  WebPEncodingError err_;
+  VP8LBitWriter bw_;              // smallest stream
+  EntropyIx best_mode_;
+  int cache_bits_;
+  int hdr_size_, data_size_;
+} CrunchJob;
+
+static int CrunchJobHook(CrunchJob* const job, void* unused) {
+  int i;
+  (void)unused;
+  for (i = 0; i < job->num_modes_; ++i) {
+    VP8LEncoder* const enc =
+        VP8LEncoderNew(job->enc_->config_, job->enc_->pic_, &job->enc_);
+    VP8LBitWriter bw;
+    int hdr_size = 0, data_size = 0;
+    // The jobs already run in parallel. Encoding each mode on a single thread
+    // also makes the output independent of thread_level.
+    enc->thread_level_ = 0;
+    enc->timer_ = job->use_timer_ ? &job->timer_ : NULL;
+    SetMode(enc, job->modes_[i]);
+    if (enc->use_palette_) {
+      memcpy(enc->palette_, job->palette_,
+             job->palette_size_ * sizeof(*enc->palette_));
+      enc->palette_size_ = job->palette_size_;
+    }
+    if (!InitHashChainAndRefs(enc) || !VP8LBitWriterClone(job->bw_init_, &bw)) {
+      job->err_ = VP8_ENC_ERROR_OUT_OF_MEMORY;
+      return 0;
+    }
+    job->err_ = EncodeStreamTransformsAndImage(enc, &bw, job->use_cache_, 0,
+                                               job->byte_position_,
+                                               &hdr_size, &data_size);
+    if (job->err_ == VP8_ENC_OK && bw.error_) {
+      job->err_ = VP8_ENC_ERROR_OUT_OF_MEMORY;
+    }
+    if (job->err_ != VP8_ENC_OK) {
+      VP8LBitWriterWipeOut(&bw);
+      return 0;
+    }
+    if (i == 0 ||
+        VP8LBitWriterNumBytes(&bw) < VP8LBitWriterNumBytes(&job->bw_)) {
+      VP8LBitWriterWipeOut(&job->bw_);
+      job->bw_ = bw;
+      job->best_mode_ = job->modes_[i];
+      job->cache_bits_ = enc->cache_bits_;
+      job->hdr_size_ = hdr_size;
+      job->data_size_ = data_size;
+    } else {
+      VP8LBitWriterWipeOut(&bw);
+    }
+  }
+  return 1;
+}
+
+// Encodes the picture of 'enc' with each combination of transforms and
+// replaces the content of 'bw' with the smallest result. The modes are split
+// over two jobs, the second one running on its own thread if thread_level is
+// set. Both jobs read the same picture, which is left untouched.
+static WebPEncodingError EncodeStreamExhaustive(VP8LEncoder* const enc,
+                                                VP8LBitWriter* const bw,
+                                                int use_cache) {
+  const WebPWorkerInterface* const worker_interface = WebPGetWorkerInterface();
+  const size_t byte_position = VP8LBitWriterNumBytes(bw);
+  // Roughly from slowest to fastest, to balance the two jobs.
+  static const EntropyIx kModes[kNumEntropyIx] = {
+    kSpatialSubGreen, kSpatial, kPalette, kSubGreen, kDirect
+  };
+  WebPEncodingError err = VP8_ENC_OK;
+  uint32_t palette[MAX_PALETTE_SIZE];
+  const int palette_size = enc->palette_size_;
+  WebPStageTimer* const timer = enc->timer_;
+  CrunchJob jobs[2];
+  CrunchJob* best;
+  int i, num_modes = 0, ok = 1;
+
+  memcpy(palette, enc->palette_, sizeof(palette));
+  memset(jobs, 0, sizeof(jobs));
+  for (i = 0; i < kNumEntropyIx; ++i) {
+    CrunchJob* const job = &jobs[num_modes & 1];
+    if (kModes[i] == kPalette && palette_size == 0) continue;
+    job->modes_[job->num_modes_++] = kModes[i];
+    ++num_modes;
+  }
+  for (i = 0; i < 2; ++i) {
+    worker_interface->Init(&jobs[i].worker_);
+    jobs[i].worker_.data1 = &jobs[i];
+    jobs[i].worker_.data2 = NULL;
+    jobs[i].worker_.hook = (WebPWorkerHook)CrunchJobHook;
+    jobs[i].bw_init_ = bw;
+    jobs[i].byte_position_ = byte_position;
+    jobs[i].use_cache_ = use_cache;
+    jobs[i].palette_ = palette;
+    jobs[i].palette_size_ = palette_size;
+    jobs[i].use_timer_ = (timer != NULL);
+  }
+  // The first job recycles 'enc', the second one uses its own encoder.
+  jobs[0].enc_ = enc;
+  jobs[1].enc_ = VP8LEncoderNew(enc->config_, enc->pic_, NULL);
+  if (jobs[1].enc_ == NULL) return VP8_ENC_ERROR_OUT_OF_MEMORY;
+
+  if (enc->thread_level_ > 0 && worker_interface->Reset(&jobs[1].worker_)) {
+    worker_interface->Launch(&jobs[1].worker_);
+  } else {
+    worker_interface->Execute(&jobs[1].worker_);
+  }
+  worker_interface->Execute(&jobs[0].worker_);
+  ok &= worker_interface->Sync(&jobs[1].worker_);
+  ok &= worker_interface->Sync(&jobs[0].worker_);
+  worker_interface->End(&jobs[1].worker_);
+  worker_interface->End(&jobs[0].worker_);
+  enc->timer_ = timer;   // was pointing at the first job's timer
+  if (timer != NULL) {
+    for (i = 0; i < WEBP_MAX_TIMED_STAGES; ++i) {
+      timer->ticks_[i] += jobs[0].timer_.ticks_[i] + jobs[1].timer_.ticks_[i];
+    }
+  }
+
+  if (!ok) {
+    err = (jobs[0].err_ != VP8_ENC_OK) ? jobs[0].err_ : jobs[1].err_;
+    goto End;
+  }
+  assert(jobs[0].num_modes_ > 0 && jobs[1].num_modes_ > 0);
+  best = (VP8LBitWriterNumBytes(&jobs[1].bw_) <
+          VP8LBitWriterNumBytes(&jobs[0].bw_)) ? &jobs[1] : &jobs[0];
+  VP8LBitWriterWipeOut(bw);
+  *bw = best->bw_;
+  memset(&best->bw_, 0, sizeof(best->bw_));
+
+  // Reflect the best mode in the encoder used for the statistics.
+  SetMode(best->enc_, best->best_mode_);
+  best->enc_->palette_size_ = best->enc_->use_palette_ ? palette_size : 0;
+  best->enc_->cache_bits_ = best->cache_bits_;
+  StoreStats(best->enc_, bw, byte_position, best->hdr_size_, best->data_size_);
+
+ End:
+  VP8LBitWriterWipeOut(&jobs[0].bw_);
+  VP8LBitWriterWipeOut(&jobs[1].bw_);
+  VP8LEncoderDelete(jobs[1].enc_);
+  return err;
+}
+
+WebPEncodingError VP8LEncodeStream(const WebPConfig* const config,
+                                   const WebPPicture* const picture,
+                                   VP8LBitWriter* const bw, int use_cache,
+                                   VP8LEncoder** const scratch,
+                                   WebPStageTimer* const timer) {
+  WebPEncodingError err = VP8_ENC_OK;
   const int width = picture->width;
   const int height = picture->height;
-  VP8LEncoder* const enc = VP8LEncoderNew(config, picture);
+  VP8LEncoder* const enc = VP8LEncoderNew(config, picture, scratch);
   const size_t byte_position = VP8LBitWriterNumBytes(bw);
+  int use_exhaustive;
   int use_near_lossless = 0;
   int hdr_size = 0;
   int data_size = 0;
@@ -1400,24 +2085,53 @@ WebPEncodingError VP8LEncodeStream(const WebPConfig* const config,
     err = VP8_ENC_ERROR_OUT_OF_MEMORY;
     goto Error;
   }
+  enc->timer_ = timer;
 
   // ---------------------------------------------------------------------------
   // Analyze image (entropy, num_palettes etc)
 
+  WEBP_TIMING_START(timer, WEBP_ENC_STAGE_ANALYSIS);
   if (!AnalyzeAndInit(enc)) {
     err = VP8_ENC_ERROR_OUT_OF_MEMORY;
     goto Error;
   }
+  WEBP_TIMING_STOP(timer, WEBP_ENC_STAGE_ANALYSIS);
+
+  // Near-lossless modifies the picture, which the exhaustive search shares
+  // between its jobs: the two are not combined.
+  use_exhaustive = config->exhaustive && (config->near_lossless == 100);
+#ifdef WEBP_EXPERIMENTAL_FEATURES
+  if (config->delta_palettization) use_exhaustive = 0;
+#endif  // WEBP_EXPERIMENTAL_FEATURES
+  if (use_exhaustive) {
+    err = EncodeStreamExhaustive(enc, bw, use_cache);
+    goto Error;
+  }
+
+  // The transforms are applied directly on the picture if the caller allows
+  // it and its rows are contiguous.
+  enc->argb_in_place_ =
+      picture->argb_writable && (picture->argb_stride == width);
+
+  if (UseFastEncoding(enc)) {
+    err = EncodeStreamFast(enc, bw, use_cache, byte_position,
+                           &hdr_size, &data_size);
+    if (err != VP8_ENC_OK) goto Error;
+    StoreStats(enc, bw, byte_position, hdr_size, data_size);
+    goto Error;
+  }
 
   // Apply near-lossless preprocessing.
   use_near_lossless =
       (config->near_lossless < 100) && !enc->use_palette_ && !enc->use_predict_;
   if (use_near_lossless) {
+    WEBP_TIMING_START(timer, WEBP_ENC_STAGE_TRANSFORMS);
     if (!VP8ApplyNearLossless(width, height, picture->argb,
                               config->near_lossless)) {
       err = VP8_ENC_ERROR_OUT_OF_MEMORY;
       goto Error;
     }
+    WEBP_TIMING_STOP(timer, WEBP_ENC_STAGE_TRANSFORMS);
   }
 
 #ifdef WEBP_EXPERIMENTAL_FEATURES
@@ -1433,80 +2147,28 @@ WebPEncodingError VP8LEncodeStream(const WebPConfig* const config,
     if (enc->use_palette_) {
       err = AllocateTransformBuffer(enc, width, height);
       if (err != VP8_ENC_OK) goto Error;
-      err = EncodeDeltaPalettePredictorImage(bw, enc, quality);
+      err = EncodeDeltaPalettePredictorImage(bw, enc, (int)config->quality);
       if (err != VP8_ENC_OK) goto Error;
       use_delta_palettization = 1;
     }
   }
 #endif  // WEBP_EXPERIMENTAL_FEATURES
 
-  // Encode palette
-  if (enc->use_palette_) {
-    err = EncodePalette(bw, enc);
-    if (err != VP8_ENC_OK) goto Error;
-    err = MapImageFromPalette(enc, use_delta_palettization);
-    if (err != VP8_ENC_OK) goto Error;
-  }
-  if (!use_delta_palettization) {
-    // In case image is not packed.
-    if (enc->argb_ == NULL) {
-      err = MakeInputImageCopy(enc);
-      if (err != VP8_ENC_OK) goto Error;
-    }
-
-    // -------------------------------------------------------------------------
-    // Apply transforms and write transform data.
-
-    if (enc->use_subtract_green_) {
-      ApplySubtractGreen(enc, enc->current_width_, height, bw);
-    }
-
-    if (enc->use_predict_) {
-      err = ApplyPredictFilter(enc, enc->current_width_, height, quality,
-                               low_effort, enc->use_subtract_green_, bw);
-      if (err != VP8_ENC_OK) goto Error;
-    }
-
-    if (enc->use_cross_color_) {
-      err = ApplyCrossColorFilter(enc, enc->current_width_,
-                                  height, quality, bw);
-      if (err != VP8_ENC_OK) goto Error;
-    }
-  }
-
-  VP8LPutBits(bw, !TRANSFORM_PRESENT, 1);  // No more transforms.
-
-  // ---------------------------------------------------------------------------
-  // Encode and write the transformed image.
-  err = EncodeImageInternal(bw, enc->argb_, &enc->hash_chain_, enc->refs_,
-                            enc->current_width_, height, quality, low_effort,
-                            use_cache, &enc->cache_bits_, enc->histo_bits_,
-                            byte_position, &hdr_size, &data_size);
+  err = EncodeStreamTransformsAndImage(enc, bw, use_cache,
+                                       use_delta_palettization, byte_position,
+                                       &hdr_size, &data_size);
   if (err != VP8_ENC_OK) goto Error;
 
-  if (picture->stats != NULL) {
-    WebPAuxStats* const stats = picture->stats;
-    stats->lossless_features = 0;
-    if (enc->use_predict_) stats->lossless_features |= 1;
-    if (enc->use_cross_color_) stats->lossless_features |= 2;
-    if (enc->use_subtract_green_) stats->lossless_features |= 4;
-    if (enc->use_palette_) stats->lossless_features |= 8;
-    stats->histogram_bits = enc->histo_bits_;
-    stats->transform_bits = enc->transform_bits_;
-    stats->cache_bits = enc->cache_bits_;
-    stats->palette_size = enc->palette_size_;
-    stats->lossless_size = (int)(VP8LBitWriterNumBytes(bw) - byte_position);
-    stats->lossless_hdr_size = hdr_size;
-    stats->lossless_data_size = data_size;
-  }
+  StoreStats(enc, bw, byte_position, hdr_size, data_size);
 
  Error:
-  VP8LEncoderDelete(enc);
+  if (scratch == NULL) VP8LEncoderDelete(enc);
   return err;
 }
 
 int VP8LEncodeImage(const WebPConfig* const config,
-                    const WebPPicture* const picture) {
+                    const WebPPicture* const picture,
+                    VP8LEncoder** const scratch, WebPStageTimer* const timer) {
   int width, height;
   int has_alpha;
   size_t coded_size;
@@ -1566,7 +2228,8 @@ int VP8LEncodeImage(const WebPConfig* const config,
   if (!WebPReportProgress(picture, 5, &percent)) goto UserAbort;
 
   // Encode main image stream.
-  err = VP8LEncodeStream(config, picture, &bw, 1 /*use_cache*/);
+  err = VP8LEncodeStream(config, picture, &bw, 1 /*use_cache*/, scratch,
+                         timer);
   if (err != VP8_ENC_OK) goto Error;
 
   // TODO(skal): have a fine-grained progress report in VP8LEncodeStream().
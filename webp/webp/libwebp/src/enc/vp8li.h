@@ -17,6 +17,7 @@
 #include "./backward_references.h"
 #include "./histogram.h"
 #include "../utils/bit_writer.h"
+#include "../utils/utils.h"
 #include "../webp/encode.h"
 #include "../webp/format_constants.h"
 
@@ -27,13 +28,17 @@ extern "C" {
 typedef struct {
   const WebPConfig* config_;      // user configuration and parameters
   const WebPPicture* pic_;        // input picture.
+  int thread_level_;              // derived from config->thread_level
 
   uint32_t* argb_;                // Transformed argb image data.
   uint32_t* argb_scratch_;        // Scratch memory for argb rows
                                   // (used for prediction).
+  size_t    argb_scratch_size_;   // Size of one set of scratch rows, in words.
+  int       num_transform_jobs_;  // Number of sets of scratch rows.
   uint32_t* transform_data_;      // Scratch memory for transform data.
   uint32_t* transform_mem_;       // Currently allocated memory.
   size_t    transform_mem_size_;  // Currently allocated memory size.
+  int       argb_in_place_;       // If true, argb_ is the picture's own plane.
 
   int       current_width_;       // Corresponds to packed image width.
 
@@ -55,6 +60,8 @@ typedef struct {
                                      // LZ77 & RLE coding.
   VP8LHashChain hash_chain_;         // HashChain data for constructing
                                      // backward references.
+
+  WebPStageTimer* timer_;         // if not NULL, records the stage times
 } VP8LEncoder;
 
 //------------------------------------------------------------------------------
@@ -63,14 +70,25 @@ typedef struct {
 // Encodes the picture.
 // Returns 0 if config or picture is NULL or picture doesn't have valid argb
 // input.
+// If 'scratch' is not NULL, the encoder object it points to is recycled
+// (or allocated, if NULL) and kept after the call, together with its large
+// scratch buffers. It must then be released using VP8LEncoderDelete().
+// If 'timer' is not NULL, the time of the lossless stages is added to it.
 int VP8LEncodeImage(const WebPConfig* const config,
-                    const WebPPicture* const picture);
+                    const WebPPicture* const picture,
+                    VP8LEncoder** const scratch, WebPStageTimer* const timer);
 
 // Encodes the main image stream using the supplied bit writer.
 // If 'use_cache' is false, disables the use of color cache.
+// 'scratch' and 'timer' have the same meaning as for VP8LEncodeImage().
 WebPEncodingError VP8LEncodeStream(const WebPConfig* const config,
                                    const WebPPicture* const picture,
-                                   VP8LBitWriter* const bw, int use_cache);
+                                   VP8LBitWriter* const bw, int use_cache,
+                                   VP8LEncoder** const scratch,
+                                   WebPStageTimer* const timer);
+
+// Releases an encoder object kept by VP8LEncodeImage/VP8LEncodeStream().
+void VP8LEncoderDelete(VP8LEncoder* enc);
 
 //------------------------------------------------------------------------------
 
@@ -122,6 +122,133 @@ static void MapConfigToTools(VP8Encoder* const enc) {
   }
 }
 
+//------------------------------------------------------------------------------
+// WebPEncoderContext
+
+struct WebPEncoderContext {
+  uint8_t* mem_;            // memory block holding the last VP8Encoder
+  uint64_t mem_size_;
+  WebPWorker side_worker_;  // analysis thread, kept alive between calls
+  VP8LEncoder* vp8l_enc_;   // recycled lossless encoder (or NULL)
+  VP8BitWriter bw_[1 + MAX_NUM_PARTITIONS];   // recycled buffers of the
+                                              // partition #0 and token ones
+  VP8TBuffer tokens_;       // recycled token pages
+  // Allocator the memory above comes from (NULL for the default one).
+  const WebPMemoryAllocator* allocator_;
+};
+
+WebPEncoderContext* WebPEncoderContextNew(void) {
+  WebPEncoderContext* const ctx =
+      (WebPEncoderContext*)WebPSafeCalloc(1ULL, sizeof(*ctx));
+  if (ctx != NULL) {
+    WebPGetWorkerInterface()->Init(&ctx->side_worker_);
+    VP8TBufferInit(&ctx->tokens_, 0);
+  }
+  return ctx;
+}
+
+// Releases the memory and the thread kept by 'ctx', using the allocator they
+// come from.
+static void ClearEncoderContext(WebPEncoderContext* const ctx) {
+  const WebPMemoryAllocator* const previous =
+      WebPPushThreadAllocator(ctx->allocator_);
+  int i;
+  WebPGetWorkerInterface()->End(&ctx->side_worker_);
+  VP8LEncoderDelete(ctx->vp8l_enc_);
+  ctx->vp8l_enc_ = NULL;
+  WebPSafeFree(ctx->mem_);
+  ctx->mem_ = NULL;
+  ctx->mem_size_ = 0;
+  for (i = 0; i < 1 + MAX_NUM_PARTITIONS; ++i) {
+    VP8BitWriterWipeOut(&ctx->bw_[i]);
+  }
+  VP8TBufferClear(&ctx->tokens_);
+  WebPSetThreadAllocator(previous);
+}
+
+void WebPEncoderContextDelete(WebPEncoderContext* ctx) {
+  if (ctx != NULL) {
+    ClearEncoderContext(ctx);
+    WebPSafeFree(ctx);
+  }
+}
+
+//------------------------------------------------------------------------------
+// WebPEncoderState
+
+WebPEncoderState* WebPEncoderStateNew(void) {
+  return (WebPEncoderState*)WebPSafeCalloc(1ULL, sizeof(WebPEncoderState));
+}
+
+void WebPEncoderStateDelete(WebPEncoderState* state) {
+  WebPSafeFree(state);
+}
+
+void WebPEncoderStateCopy(const WebPEncoderState* src, WebPEncoderState* dst) {
+  if (src != NULL && dst != NULL && src != dst) *dst = *src;
+}
+
+// The statistics are fully re-collected every MAX_STATE_AGE encodings, so
+// that they can follow slow changes in the content.
+#define MAX_STATE_AGE 8
+
+// Returns true if 'state' was recorded with the same parameters as 'enc'.
+// The dimensions may differ, as for the frame rectangles of an animation: the
+// statistics are per coefficient. But those of a smaller picture are too
+// sparse for a larger one, and they then cost more than they save.
+static int SameStateParams(const VP8Encoder* const enc,
+                           const WebPEncoderState* const state) {
+  const WebPConfig* const config = enc->config_;
+  return (state->quality_ == config->quality &&
+          state->method_ == config->method &&
+          enc->mb_w_ * enc->mb_h_ <= state->num_mbs_ &&
+          state->num_segments_ == config->segments &&
+          state->filter_strength_ == config->filter_strength &&
+          state->filter_sharpness_ == config->filter_sharpness &&
+          state->filter_type_ == config->filter_type &&
+          state->autofilter_ == config->autofilter);
+}
+
+// Sets up 'enc' for starting from the statistics in 'state'.
+static void UseState(VP8Encoder* const enc,
+                     const WebPEncoderState* const state) {
+  if (!state->is_valid_ || state->age_ >= MAX_STATE_AGE) return;
+  if (!SameStateParams(enc, state)) return;
+  enc->warm_ = state;
+  if (enc->config_->autofilter && state->has_filter_) {
+    enc->lf_stats_ = NULL;   // no need to search for the filter strength
+  }
+}
+
+static void RecordState(const VP8Encoder* const enc,
+                        WebPEncoderState* const state) {
+  const WebPConfig* const config = enc->config_;
+  const VP8EncProba* const proba = &enc->proba_;
+  memcpy(state->coeffs_, proba->coeffs_, sizeof(state->coeffs_));
+  state->skip_proba_ = proba->skip_proba_;
+  state->use_skip_proba_ = proba->use_skip_proba_;
+  state->has_filter_ = 0;
+  if (config->autofilter) {
+    int s;
+    for (s = 0; s < NUM_MB_SEGMENTS; ++s) {
+      state->fstrength_[s] = enc->dqm_[s].fstrength_;
+    }
+    state->has_filter_ = 1;
+  }
+  state->quality_ = config->quality;
+  state->method_ = config->method;
+  state->num_mbs_ = enc->mb_w_ * enc->mb_h_;
+  state->num_segments_ = config->segments;
+  state->filter_strength_ = config->filter_strength;
+  state->filter_sharpness_ = config->filter_sharpness;
+  state->filter_type_ = config->filter_type;
+  state->autofilter_ = config->autofilter;
+  state->age_ = (enc->warm_ != NULL) ? state->age_ + 1 : 0;
+  state->is_valid_ = 1;
+}
+
+//------------------------------------------------------------------------------
+
 // Memory scaling with dimensions:
 //  memory (bytes) ~= 2.25 * w + 0.0625 * w * h
 //
@@ -141,8 +268,10 @@ static void MapConfigToTools(VP8Encoder* const enc) {
 //              LFStats: 2048
 // Picture size (yuv): 419328
 
+// If 'ctx' is not NULL, the returned object lives in its memory block.
 static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
-                                  WebPPicture* const picture) {
+                                  WebPPicture* const picture,
+                                  WebPEncoderContext* const ctx) {
   VP8Encoder* enc;
   const int use_filter =
       (config->filter_strength > 0) || (config->autofilter > 0);
@@ -193,10 +322,19 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
          mb_w * mb_h * 384 * sizeof(uint8_t));
   printf("===================================\n");
 #endif
-  mem = (uint8_t*)WebPSafeMalloc(size, sizeof(*mem));
-  if (mem == NULL) {
-    WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
-    return NULL;
+  if (ctx != NULL && ctx->mem_ != NULL && ctx->mem_size_ >= size) {
+    mem = ctx->mem_;
+  } else {
+    mem = (uint8_t*)WebPSafeMalloc(size, sizeof(*mem));
+    if (mem == NULL) {
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      return NULL;
+    }
+    if (ctx != NULL) {
+      WebPSafeFree(ctx->mem_);
+      ctx->mem_ = mem;
+      ctx->mem_size_ = size;
+    }
   }
   enc = (VP8Encoder*)mem;
   mem = (uint8_t*)WEBP_ALIGN(mem + sizeof(*enc));
@@ -225,6 +363,16 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
   enc->profile_ = use_filter ? ((config->filter_type == 1) ? 0 : 1) : 2;
   enc->pic_ = picture;
   enc->percent_ = 0;
+  enc->side_worker_ = (ctx != NULL) ? &ctx->side_worker_ : NULL;
+  enc->strip_ = NULL;
+  if (picture->row_reader != NULL) {
+    enc->strip_ = VP8EncStripNew(picture);
+    if (enc->strip_ == NULL) {
+      if (ctx == NULL) WebPSafeFree(enc);
+      WebPEncodingSetError(picture, VP8_ENC_ERROR_OUT_OF_MEMORY);
+      return NULL;
+    }
+  }
 
   MapConfigToTools(enc);
   VP8EncDspInit();
@@ -239,17 +387,36 @@ static VP8Encoder* InitVP8Encoder(const WebPConfig* const config,
   // size based on quality. This is just a crude 1rst-order prediction.
   {
     const float scale = 1.f + config->quality * 5.f / 100.f;  // in [1,6]
-    VP8TBufferInit(&enc->tokens_, (int)(mb_w * mb_h * 4 * scale));
+    const int page_size = (int)(mb_w * mb_h * 4 * scale);
+    if (ctx != NULL) {
+      // Take over the buffers of the previous calls, given back on deletion.
+      enc->keep_buffers_ = 1;
+      enc->bw_ = ctx->bw_[0];
+      memcpy(enc->parts_, ctx->bw_ + 1, sizeof(enc->parts_));
+      memset(ctx->bw_, 0, sizeof(ctx->bw_));
+      enc->tokens_ = ctx->tokens_;
+      VP8TBufferInit(&ctx->tokens_, 0);
+      VP8TBufferReset(&enc->tokens_, page_size);
+    } else {
+      VP8TBufferInit(&enc->tokens_, page_size);
+    }
   }
   return enc;
 }
 
-static int DeleteVP8Encoder(VP8Encoder* enc) {
+static int DeleteVP8Encoder(VP8Encoder* enc, WebPEncoderContext* const ctx) {
   int ok = 1;
   if (enc != NULL) {
     ok = VP8EncDeleteAlpha(enc);
-    VP8TBufferClear(&enc->tokens_);
-    WebPSafeFree(enc);
+    VP8EncStripDelete(enc->strip_);
+    if (ctx != NULL) {   // the encoder and its buffers are kept for next call
+      ctx->bw_[0] = enc->bw_;
+      memcpy(ctx->bw_ + 1, enc->parts_, sizeof(enc->parts_));
+      ctx->tokens_ = enc->tokens_;
+    } else {
+      VP8TBufferClear(&enc->tokens_);
+      WebPSafeFree(enc);
+    }
   }
   return ok;
 }
@@ -313,7 +480,48 @@ int WebPReportProgress(const WebPPicture* const pic,
 }
 //------------------------------------------------------------------------------
 
-int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
+// Lossy analysis and mode decisions shared between the renditions of a
+// picture (cf WebPEncodeRenditions()).
+typedef struct {
+  const WebPConfig* config_;   // config used for the analysis, or NULL
+  VP8EncSnapshot analysis_;    // state right after VP8EncAnalyze()
+  int has_modes_;
+  VP8EncSnapshot modes_;       // final intra modes
+} SharedAnalysis;
+
+// Returns true if the analysis done with config 'a' is valid for 'b' too.
+static int SameAnalysisParams(const WebPConfig* const a,
+                              const WebPConfig* const b) {
+  return (a->method == b->method) && (a->segments == b->segments) &&
+         ((a->preprocessing & 1) == (b->preprocessing & 1)) &&
+         (a->emulate_jpeg_size == b->emulate_jpeg_size);
+}
+
+static int Analyze(VP8Encoder* const enc, SharedAnalysis* const shared) {
+  if (shared == NULL) return VP8EncAnalyze(enc);
+  if (shared->config_ != NULL &&
+      SameAnalysisParams(shared->config_, enc->config_)) {
+    if (!VP8EncRestoreAnalysis(enc, &shared->analysis_)) return 0;
+    // The modes can't be frozen if they're part of a size/PSNR search.
+    if (shared->has_modes_ && !enc->do_search_) {
+      VP8EncRestoreModes(enc, &shared->modes_);
+    }
+    return 1;
+  }
+  if (!VP8EncAnalyze(enc)) return 0;
+  if (shared->config_ == NULL) {
+    if (!VP8EncSaveSnapshot(enc, &shared->analysis_)) {
+      return WebPEncodingSetError(enc->pic_, VP8_ENC_ERROR_OUT_OF_MEMORY);
+    }
+    shared->config_ = enc->config_;
+  }
+  return 1;
+}
+
+static int Encode(WebPEncoderContext* const ctx, const WebPConfig* config,
+                  WebPPicture* pic, SharedAnalysis* const shared) {
+  WebPStageTimer stage_timer;
+  WebPStageTimer* timer = NULL;   // only used if stats are requested
   int ok = 0;
 
   if (pic == NULL)
@@ -328,17 +536,24 @@ int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
   if (pic->width > WEBP_MAX_DIMENSION || pic->height > WEBP_MAX_DIMENSION)
     return WebPEncodingSetError(pic, VP8_ENC_ERROR_BAD_DIMENSION);
 
-  if (pic->stats != NULL) memset(pic->stats, 0, sizeof(*pic->stats));
+  if (pic->stats != NULL) {
+    memset(pic->stats, 0, sizeof(*pic->stats));
+    memset(&stage_timer, 0, sizeof(stage_timer));
+    timer = &stage_timer;
+  }
 
   if (!config->lossless) {
     VP8Encoder* enc = NULL;
 
-    if (!config->exact) {
+    // With a row_reader, samples are only pulled strip by strip during coding.
+    if (pic->row_reader == NULL && !config->exact) {
       WebPCleanupTransparentArea(pic);
     }
 
-    if (pic->use_argb || pic->y == NULL || pic->u == NULL || pic->v == NULL) {
+    if (pic->row_reader == NULL &&
+        (pic->use_argb || pic->y == NULL || pic->u == NULL || pic->v == NULL)) {
       // Make sure we have YUVA samples.
+      WEBP_TIMING_START(timer, WEBP_ENC_STAGE_IMPORT);
       if (config->preprocessing & 4) {
         if (!WebPPictureSmartARGBToYUVA(pic)) {
           return 0;
@@ -356,12 +571,17 @@ int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
           return 0;
         }
       }
+      WEBP_TIMING_STOP(timer, WEBP_ENC_STAGE_IMPORT);
     }
 
-    enc = InitVP8Encoder(config, pic);
+    enc = InitVP8Encoder(config, pic, ctx);
     if (enc == NULL) return 0;  // pic->error is already set.
+    enc->timer_ = timer;
+    if (pic->state != NULL) UseState(enc, pic->state);
     // Note: each of the tasks below account for 20% in the progress report.
-    ok = VP8EncAnalyze(enc);
+    WEBP_TIMING_START(timer, WEBP_ENC_STAGE_ANALYSIS);
+    ok = Analyze(enc, shared);
+    WEBP_TIMING_STOP(timer, WEBP_ENC_STAGE_ANALYSIS);
 
     // Analysis is done, proceed to actual coding.
     ok = ok && VP8EncStartAlpha(enc);   // possibly done in parallel
@@ -371,25 +591,158 @@ int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
       ok = ok && VP8EncTokenLoop(enc);
     }
     ok = ok && VP8EncFinishAlpha(enc);
+    ok = ok && (pic->error_code == VP8_ENC_OK);   // e.g. row_reader failure
 
     ok = ok && VP8EncWrite(enc);
+    if (ok && pic->state != NULL) RecordState(enc, pic->state);
+    if (ok && shared != NULL && !shared->has_modes_ &&
+        shared->config_ != NULL && SameAnalysisParams(shared->config_, config)) {
+      // Failing to keep the modes is not an error: they'd just be searched.
+      shared->has_modes_ = VP8EncSaveSnapshot(enc, &shared->modes_);
+    }
     StoreStats(enc);
     if (!ok) {
       VP8EncFreeBitWriters(enc);
     }
-    ok &= DeleteVP8Encoder(enc);  // must always be called, even if !ok
+    ok &= DeleteVP8Encoder(enc, ctx);  // must always be called, even if !ok
   } else {
+    if (pic->row_reader != NULL) {   // not supported for lossless
+      return WebPEncodingSetError(pic, VP8_ENC_ERROR_INVALID_CONFIGURATION);
+    }
     // Make sure we have ARGB samples.
+    WEBP_TIMING_START(timer, WEBP_ENC_STAGE_IMPORT);
     if (pic->argb == NULL && !WebPPictureYUVAToARGB(pic)) {
       return 0;
     }
+    WEBP_TIMING_STOP(timer, WEBP_ENC_STAGE_IMPORT);
 
     if (!config->exact) {
       WebPCleanupTransparentAreaLossless(pic);
     }
 
-    ok = VP8LEncodeImage(config, pic);  // Sets pic->error in case of problem.
+    // Sets pic->error in case of problem.
+    ok = VP8LEncodeImage(config, pic, (ctx != NULL) ? &ctx->vp8l_enc_ : NULL,
+                         timer);
   }
 
+  if (timer != NULL) {
+    WebPStageTimerToNanoseconds(timer, WEBP_ENC_STAGE_NUM,
+                                pic->stats->stage_time);
+  }
   return ok;
 }
+
+int WebPEncode(const WebPConfig* config, WebPPicture* pic) {
+  WebPAuxStats* const stats = (pic != NULL) ? pic->stats : NULL;
+  const WebPMemoryAllocator* const allocator =
+      (config != NULL) ? config->allocator : NULL;
+  WebPMemoryCounter counter;
+  const WebPMemoryAllocator* previous;
+  int ok;
+  if (stats != NULL) {   // account for the memory used
+    WebPMemoryCounterInit(&counter, allocator);
+    previous = WebPPushThreadAllocator(&counter.allocator_);
+  } else {
+    previous = WebPPushThreadAllocator(allocator);
+  }
+  ok = Encode(NULL, config, pic, NULL);
+  WebPSetThreadAllocator(previous);
+  if (stats != NULL) {
+    stats->bytes_allocated = counter.total_bytes_;
+    stats->peak_bytes = counter.peak_bytes_;
+    stats->num_allocations = counter.num_allocs_;
+  }
+  return ok;
+}
+
+int WebPEncodeWithContext(WebPEncoderContext* ctx,
+                          const WebPConfig* config, WebPPicture* pic) {
+  const WebPMemoryAllocator* const allocator =
+      (config != NULL) ? config->allocator : NULL;
+  const WebPMemoryAllocator* previous;
+  int ok;
+  if (ctx != NULL && ctx->allocator_ != allocator) {
+    // The kept memory goes back to its allocator before using the new one.
+    ClearEncoderContext(ctx);
+    ctx->allocator_ = allocator;
+  }
+  previous = WebPPushThreadAllocator(allocator);
+  ok = Encode(ctx, config, pic, NULL);
+  WebPSetThreadAllocator(previous);
+  return ok;
+}
+
+int WebPEncodeRenditions(WebPPicture* pic,
+                         WebPRendition* renditions, int num_renditions) {
+  WebPWriterFunction const writer = (pic != NULL) ? pic->writer : NULL;
+  void* const custom_ptr = (pic != NULL) ? pic->custom_ptr : NULL;
+  WebPAuxStats* const stats = (pic != NULL) ? pic->stats : NULL;
+  const int argb_writable = (pic != NULL) ? pic->argb_writable : 0;
+  WebPEncodingError error = VP8_ENC_OK;
+  const WebPMemoryAllocator* allocator;
+  const WebPMemoryAllocator* previous;
+  WebPMemoryCounter counter;
+  int use_counter = 0;
+  WebPEncoderContext* ctx;
+  SharedAnalysis shared;
+  int i;
+
+  if (pic == NULL) return 0;
+  if (renditions == NULL || num_renditions <= 0) {
+    return WebPEncodingSetError(pic, VP8_ENC_ERROR_NULL_PARAMETER);
+  }
+  // The memory is shared between renditions: a single allocator (and, if any
+  // statistics are requested, a single counter) serves the whole call.
+  allocator = (renditions[0].config != NULL) ? renditions[0].config->allocator
+                                             : NULL;
+  for (i = 0; i < num_renditions; ++i) {
+    if (renditions[i].stats != NULL) use_counter = 1;
+  }
+  if (use_counter) {
+    WebPMemoryCounterInit(&counter, allocator);
+    previous = WebPPushThreadAllocator(&counter.allocator_);
+  } else {
+    previous = WebPPushThreadAllocator(allocator);
+  }
+  memset(&shared, 0, sizeof(shared));
+  ctx = WebPEncoderContextNew();   // if NULL, we just don't re-use memory
+
+  for (i = 0; i < num_renditions; ++i) {
+    WebPRendition* const r = &renditions[i];
+    // No encoding is running: the counts can be read without locking.
+    const uint64_t total_bytes = use_counter ? counter.total_bytes_ : 0;
+    const int num_allocs = use_counter ? counter.num_allocs_ : 0;
+    if (use_counter) {
+      // Memory kept from the previous renditions counts toward the peak.
+      counter.peak_bytes_ = counter.bytes_;
+    }
+    pic->writer = r->writer;
+    pic->custom_ptr = r->custom_ptr;
+    pic->stats = r->stats;
+    // The argb samples must be kept intact until the last rendition.
+    pic->argb_writable = argb_writable && (i == num_renditions - 1);
+    if (r->writer == NULL) {
+      WebPEncodingSetError(pic, VP8_ENC_ERROR_NULL_PARAMETER);
+    } else {
+      Encode(ctx, r->config, pic, &shared);
+    }
+    if (r->stats != NULL) {
+      r->stats->bytes_allocated = counter.total_bytes_ - total_bytes;
+      r->stats->peak_bytes = counter.peak_bytes_;
+      r->stats->num_allocations = counter.num_allocs_ - num_allocs;
+    }
+    r->error_code = pic->error_code;
+    if (error == VP8_ENC_OK) error = pic->error_code;
+  }
+
+  VP8EncSnapshotClear(&shared.analysis_);
+  VP8EncSnapshotClear(&shared.modes_);
+  WebPEncoderContextDelete(ctx);
+  WebPSetThreadAllocator(previous);
+  pic->writer = writer;
+  pic->custom_ptr = custom_ptr;
+  pic->stats = stats;
+  pic->argb_writable = argb_writable;
+  WebPEncodingSetError(pic, error);
+  return (error == VP8_ENC_OK);
+}
@@ -66,6 +66,16 @@ struct WebPAnimEncoder {
   WebPPicture prev_canvas_;           // Previous canvas.
   WebPPicture prev_canvas_disposed_;  // Previous canvas disposed to background.
 
+  // Statistics carried from one lossy encoding to the next. Each lossy
+  // candidate starts from 'lossy_state_' and records its own statistics in
+  // 'candidate_states_'. Those of the best candidate of the sub-frame and of
+  // the key-frame are kept in 'picked_states_', until one of them becomes the
+  // new 'lossy_state_'.
+  WebPEncoderState* lossy_state_;
+  WebPEncoderState* candidate_states_[2];   // LOSSY_DISP_NONE, LOSSY_DISP_BG
+  WebPEncoderState* picked_states_[2];      // sub-frame, key-frame
+  int picked_lossy_[2];     // True if 'picked_states_[]' was just recorded.
+
   // Encoded data.
   EncodedFrame* encoded_frames_;      // Array of encoded frames.
   size_t size_;             // Number of allocated frames.
@@ -237,6 +247,7 @@ WebPAnimEncoder* WebPAnimEncoderNewInternal(
     int width, int height, const WebPAnimEncoderOptions* enc_options,
     int abi_version) {
   WebPAnimEncoder* enc;
+  int i;
 
   if (MV_WEBP_ABI_IS_INCOMPATIBLE(abi_version, WEBP_MUX_ABI_VERSION)) {
     return NULL;
@@ -294,6 +305,16 @@ WebPAnimEncoder* WebPAnimEncoderNewInternal(
   enc->mux_ = WebPMuxNew();
   if (enc->mux_ == NULL) goto Err;
 
+  enc->lossy_state_ = WebPEncoderStateNew();
+  if (enc->lossy_state_ == NULL) goto Err;
+  for (i = 0; i < 2; ++i) {
+    enc->candidate_states_[i] = WebPEncoderStateNew();
+    enc->picked_states_[i] = WebPEncoderStateNew();
+    if (enc->candidate_states_[i] == NULL || enc->picked_states_[i] == NULL) {
+      goto Err;
+    }
+  }
+
   enc->count_since_key_frame_ = 0;
   enc->first_timestamp_ = 0;
   enc->prev_timestamp_ = 0;
@@ -319,6 +340,7 @@ static void FrameRelease(EncodedFrame* const encoded_frame) {
 
 void WebPAnimEncoderDelete(WebPAnimEncoder* enc) {
   if (enc != NULL) {
+    int s;
     WebPPictureFree(&enc->curr_canvas_copy_);
     WebPPictureFree(&enc->prev_canvas_);
     WebPPictureFree(&enc->prev_canvas_disposed_);
@@ -330,6 +352,11 @@ void WebPAnimEncoderDelete(WebPAnimEncoder* enc) {
       WebPSafeFree(enc->encoded_frames_);
     }
     WebPMuxDelete(enc->mux_);
+    WebPEncoderStateDelete(enc->lossy_state_);
+    for (s = 0; s < 2; ++s) {
+      WebPEncoderStateDelete(enc->candidate_states_[s]);
+      WebPEncoderStateDelete(enc->picked_states_[s]);
+    }
     WebPSafeFree(enc);
   }
 }
@@ -750,10 +777,13 @@ typedef struct {
 } Candidate;
 
 // Generates a candidate encoded frame given a picture and metadata.
+// Lossy encodings are warm-started from 'state', and record their own
+// statistics in it.
 static WebPEncodingError EncodeCandidate(WebPPicture* const sub_frame,
                                          const FrameRect* const rect,
                                          const WebPConfig* const encoder_config,
                                          int use_blending,
+                                         WebPEncoderState* const state,
                                          Candidate* const candidate) {
   WebPConfig config = *encoder_config;
   WebPEncodingError error_code = VP8_ENC_OK;
@@ -779,6 +809,7 @@ static WebPEncodingError EncodeCandidate(WebPPicture* const sub_frame,
     config.autofilter = 0;
     config.filter_strength = 0;
   }
+  sub_frame->state = config.lossless ? NULL : state;
   if (!EncodeFrame(&config, sub_frame, &candidate->mem_)) {
     error_code = sub_frame->error_code;
     goto Err;
@@ -859,10 +890,14 @@ static WebPEncodingError GenerateCandidates(
           IncreaseTransparency(prev_canvas, &params->rect_ll_, curr_canvas);
     }
     error_code = EncodeCandidate(&params->sub_frame_ll_, &params->rect_ll_,
-                                 config_ll, use_blending_ll, candidate_ll);
+                                 config_ll, use_blending_ll, NULL,
+                                 candidate_ll);
     if (error_code != VP8_ENC_OK) return error_code;
   }
   if (candidate_lossy->evaluate_) {
+    WebPEncoderState* const state =
+        enc->candidate_states_[is_dispose_none ? 0 : 1];
+    WebPEncoderStateCopy(enc->lossy_state_, state);
     CopyCurrentCanvas(enc);
     if (use_blending_lossy) {
       enc->curr_canvas_copy_modified_ =
@@ -871,7 +906,8 @@ static WebPEncodingError GenerateCandidates(
     }
     error_code =
         EncodeCandidate(&params->sub_frame_lossy_, &params->rect_lossy_,
-                        config_lossy, use_blending_lossy, candidate_lossy);
+                        config_lossy, use_blending_lossy, state,
+                        candidate_lossy);
     if (error_code != VP8_ENC_OK) return error_code;
     enc->curr_canvas_copy_modified_ = 1;
   }
@@ -1006,6 +1042,14 @@ static void PickBestCandidate(WebPAnimEncoder* const enc,
           SetPreviousDisposeMethod(enc, prev_dispose_method);
         }
         enc->prev_rect_ = candidates[i].rect_;  // save for next frame.
+        if (i == LOSSY_DISP_NONE || i == LOSSY_DISP_BG) {
+          // Keep the statistics of this encoding, see KeepLossyState().
+          const int s = (i == LOSSY_DISP_NONE) ? 0 : 1;
+          WebPEncoderState* const tmp = enc->picked_states_[is_key_frame];
+          enc->picked_states_[is_key_frame] = enc->candidate_states_[s];
+          enc->candidate_states_[s] = tmp;
+          enc->picked_lossy_[is_key_frame] = 1;
+        }
       } else {
         WebPMemoryWriterClear(&candidates[i].mem_);
         candidates[i].evaluate_ = 0;
@@ -1156,6 +1200,17 @@ static int64_t KeyFramePenalty(const EncodedFrame* const encoded_frame) {
           encoded_frame->sub_frame_.bitstream.size);
 }
 
+// The next lossy encodings start from the statistics of the lossy candidate
+// retained for the current frame, if any. Those of the discarded candidates
+// are dropped.
+static void KeepLossyState(WebPAnimEncoder* const enc, int is_key_frame) {
+  if (enc->picked_lossy_[is_key_frame]) {
+    WebPEncoderState* const tmp = enc->lossy_state_;
+    enc->lossy_state_ = enc->picked_states_[is_key_frame];
+    enc->picked_states_[is_key_frame] = tmp;
+  }
+}
+
 static int CacheFrame(WebPAnimEncoder* const enc,
                       const WebPConfig* const config) {
   int ok = 0;
@@ -1165,6 +1220,7 @@ static int CacheFrame(WebPAnimEncoder* const enc,
   EncodedFrame* const encoded_frame = GetFrame(enc, position);
 
   ++enc->count_;
+  enc->picked_lossy_[0] = enc->picked_lossy_[1] = 0;
 
   if (enc->is_first_frame_) {  // Add this as a key-frame.
     error_code = SetFrame(enc, config, 1, encoded_frame, &frame_skipped);
@@ -1225,6 +1281,8 @@ static int CacheFrame(WebPAnimEncoder* const enc,
     }
   }
 
+  KeepLossyState(enc, encoded_frame->is_key_frame_);
+
   // Update previous to previous and previous canvases for next call.
   WebPCopyPixels(enc->curr_canvas_, &enc->prev_canvas_);
   enc->is_first_frame_ = 0;
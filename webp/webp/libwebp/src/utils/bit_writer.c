@@ -171,6 +171,15 @@ int VP8BitWriterInit(VP8BitWriter* const bw, size_t expected_size) {
   return (expected_size > 0) ? BitWriterResize(bw, expected_size) : 1;
 }
 
+int VP8BitWriterReset(VP8BitWriter* const bw, size_t expected_size) {
+  uint8_t* const buf = bw->buf_;
+  const size_t max_pos = bw->max_pos_;
+  VP8BitWriterInit(bw, 0);
+  bw->buf_ = buf;
+  bw->max_pos_ = max_pos;
+  return (expected_size > 0) ? BitWriterResize(bw, expected_size) : 1;
+}
+
 uint8_t* VP8BitWriterFinish(VP8BitWriter* const bw) {
   VP8PutBits(bw, 0, 9 - bw->nb_bits_);
   bw->nb_bits_ = 0;   // pad with zeroes
@@ -246,6 +255,20 @@ void VP8LBitWriterWipeOut(VP8LBitWriter* const bw) {
   }
 }
 
+int VP8LBitWriterClone(const VP8LBitWriter* const src,
+                       VP8LBitWriter* const dst) {
+  const size_t current_size = src->cur_ - src->buf_;
+  assert(src->cur_ >= src->buf_ && src->cur_ <= src->end_);
+  memset(dst, 0, sizeof(*dst));
+  if (!VP8LBitWriterResize(dst, current_size)) return 0;
+  memcpy(dst->buf_, src->buf_, current_size);
+  dst->bits_ = src->bits_;
+  dst->used_ = src->used_;
+  dst->error_ = src->error_;
+  dst->cur_ = dst->buf_ + current_size;
+  return 1;
+}
+
 void VP8LPutBitsFlushBits(VP8LBitWriter* const bw) {
   // If needed, make some room by flushing some bits out.
   if (bw->cur_ + VP8L_WRITER_BYTES > bw->end_) {
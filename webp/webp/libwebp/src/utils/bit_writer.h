@@ -37,6 +37,9 @@ struct VP8BitWriter {
 
 // Initialize the object. Allocates some initial memory based on expected_size.
 int VP8BitWriterInit(VP8BitWriter* const bw, size_t expected_size);
+// Same as VP8BitWriterInit(), but re-uses the internal buffer left by the
+// previous use of the (initialized or zeroed) object, if any.
+int VP8BitWriterReset(VP8BitWriter* const bw, size_t expected_size);
 // Finalize the bitstream coding. Returns a pointer to the internal buffer.
 uint8_t* VP8BitWriterFinish(VP8BitWriter* const bw);
 // Release any pending memory and zeroes the object. Not a mandatory call.
@@ -109,6 +112,10 @@ int VP8LBitWriterInit(VP8LBitWriter* const bw, size_t expected_size);
 uint8_t* VP8LBitWriterFinish(VP8LBitWriter* const bw);
 // Release any pending memory and zeroes the object.
 void VP8LBitWriterWipeOut(VP8LBitWriter* const bw);
+// Initializes 'dst' with a copy of the bits written so far to 'src'.
+// Returns false in case of memory allocation error.
+int VP8LBitWriterClone(const VP8LBitWriter* const src,
+                       VP8LBitWriter* const dst);
 
 // Internal function for VP8LPutBits flushing 32 bits from the written state.
 void VP8LPutBitsFlushBits(VP8LBitWriter* const bw);
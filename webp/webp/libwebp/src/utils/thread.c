@@ -54,6 +54,13 @@ struct WebPWorkerImpl {
   pthread_mutex_t mutex_;
   pthread_cond_t  condition_;
   pthread_t       thread_;
+  // Used by the thread pool, whose lock replaces 'mutex_' and 'thread_':
+  WebPWorker*     worker_;   // owner of this object
+  WebPWorkerImpl* prev_;     // neighbours in the queue holding the task
+  WebPWorkerImpl* next_;
+  int             queue_;    // index of this queue, or -1 if not queued
+  // Allocator of the launching thread, to be used by the hook too.
+  const WebPMemoryAllocator* allocator_;
 };
 
 #if defined(_WIN32)
@@ -213,6 +220,7 @@ static THREADFN ThreadLoop(void* ptr) {
       pthread_cond_wait(&worker->impl_->condition_, &worker->impl_->mutex_);
     }
     if (worker->status_ == WORK) {
+      WebPSetThreadAllocator(worker->impl_->allocator_);
       Execute(worker);
       worker->status_ = OK;
     } else if (worker->status_ == NOT_OK) {   // finish the worker
@@ -241,6 +249,7 @@ static void ChangeState(WebPWorker* const worker,
     }
     // assign new status and release the working thread if needed
     if (new_status != OK) {
+      worker->impl_->allocator_ = WebPGetThreadAllocator();
       worker->status_ = new_status;
       pthread_cond_signal(&worker->impl_->condition_);
     }
@@ -334,6 +343,415 @@ static void End(WebPWorker* const worker) {
   assert(worker->status_ == NOT_OK);
 }
 
+//------------------------------------------------------------------------------
+// Atomics
+
+#if defined(WEBP_USE_THREAD) && defined(_WIN32)
+
+int WebPAtomicLoad(volatile int* const ptr) {
+  return (int)InterlockedCompareExchange((volatile LONG*)ptr, 0, 0);
+}
+
+void WebPAtomicStore(volatile int* const ptr, int value) {
+  InterlockedExchange((volatile LONG*)ptr, (LONG)value);
+}
+
+int WebPAtomicCompareAndSwap(volatile int* const ptr,
+                             int old_value, int new_value) {
+  return (InterlockedCompareExchange((volatile LONG*)ptr, (LONG)new_value,
+                                     (LONG)old_value) == (LONG)old_value);
+}
+
+#elif defined(WEBP_USE_THREAD) && defined(__ATOMIC_SEQ_CST)   // gcc / clang
+
+int WebPAtomicLoad(volatile int* const ptr) {
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+void WebPAtomicStore(volatile int* const ptr, int value) {
+  __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+int WebPAtomicCompareAndSwap(volatile int* const ptr,
+                             int old_value, int new_value) {
+  return __atomic_compare_exchange_n(ptr, &old_value, new_value, 0,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#elif defined(WEBP_USE_THREAD)   // older gcc
+
+int WebPAtomicLoad(volatile int* const ptr) {
+  return __sync_fetch_and_add(ptr, 0);
+}
+
+void WebPAtomicStore(volatile int* const ptr, int value) {
+  __sync_synchronize();
+  *ptr = value;
+  __sync_synchronize();
+}
+
+int WebPAtomicCompareAndSwap(volatile int* const ptr,
+                             int old_value, int new_value) {
+  return __sync_bool_compare_and_swap(ptr, old_value, new_value);
+}
+
+#else   // !WEBP_USE_THREAD
+
+int WebPAtomicLoad(volatile int* const ptr) {
+  return *ptr;
+}
+
+void WebPAtomicStore(volatile int* const ptr, int value) {
+  *ptr = value;
+}
+
+int WebPAtomicCompareAndSwap(volatile int* const ptr,
+                             int old_value, int new_value) {
+  if (*ptr != old_value) return 0;
+  *ptr = new_value;
+  return 1;
+}
+
+#endif  // WEBP_USE_THREAD
+
+//------------------------------------------------------------------------------
+// One-time initialization
+
+#define ONCE_NOT_RUN 0   // must match WEBP_ONCE_INIT
+#define ONCE_RUNNING 1
+#define ONCE_DONE    2
+
+#if defined(WEBP_USE_THREAD) && !defined(_WIN32)
+
+static pthread_mutex_t once_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t once_condition = PTHREAD_COND_INITIALIZER;
+
+void WebPRunOnce(WebPOnce* const once, void (*func)(void)) {
+  if (WebPAtomicLoad(once) == ONCE_DONE) return;
+  pthread_mutex_lock(&once_mutex);
+  if (WebPAtomicLoad(once) == ONCE_NOT_RUN) {
+    WebPAtomicStore(once, ONCE_RUNNING);
+    // The lock is not held by 'func', which may run its own initializations.
+    pthread_mutex_unlock(&once_mutex);
+    func();
+    pthread_mutex_lock(&once_mutex);
+    WebPAtomicStore(once, ONCE_DONE);
+    pthread_cond_broadcast(&once_condition);
+  } else {
+    while (WebPAtomicLoad(once) != ONCE_DONE) {
+      pthread_cond_wait(&once_condition, &once_mutex);
+    }
+  }
+  pthread_mutex_unlock(&once_mutex);
+}
+
+#elif defined(WEBP_USE_THREAD)   // _WIN32: no static mutex initializer
+
+void WebPRunOnce(WebPOnce* const once, void (*func)(void)) {
+  if (WebPAtomicCompareAndSwap(once, ONCE_NOT_RUN, ONCE_RUNNING)) {
+    func();
+    WebPAtomicStore(once, ONCE_DONE);
+  } else {
+    while (WebPAtomicLoad(once) != ONCE_DONE) Sleep(1);   // yields the CPU
+  }
+}
+
+#else   // !WEBP_USE_THREAD
+
+void WebPRunOnce(WebPOnce* const once, void (*func)(void)) {
+  if (*once != ONCE_NOT_RUN) return;
+  *once = ONCE_RUNNING;
+  func();
+  *once = ONCE_DONE;
+}
+
+#endif  // WEBP_USE_THREAD
+
+#undef ONCE_NOT_RUN
+#undef ONCE_RUNNING
+#undef ONCE_DONE
+
+//------------------------------------------------------------------------------
+// Thread pool
+//
+// Each pool thread owns a queue of launched workers. Submissions are spread
+// round-robin over the queues; a thread pops the most recent task of its own
+// queue and, once it runs dry, steals the oldest task of the other queues.
+// A Sync() on a task no thread picked up yet runs it in the calling thread,
+// so tasks may launch and wait on other tasks without dead-locking the pool.
+// The tasks are coarse (whole rows or image passes), so all the queues share
+// a single lock.
+
+#ifdef WEBP_USE_THREAD
+
+#define MAX_POOL_THREADS 64
+
+typedef struct {
+  pthread_t       thread_;
+  pthread_cond_t  condition_;   // signaled when work is queued, or to quit
+  int             idle_;        // true while waiting on 'condition_'
+  WebPWorkerImpl* head_;        // most recently queued task
+  WebPWorkerImpl* tail_;        // oldest queued task
+} PoolThread;
+
+static struct {
+  pthread_mutex_t mutex_;       // guards everything below and the workers'
+                                // status_ while they use the pool
+  int num_threads_;             // 0 if the pool is not running
+  int num_queued_;
+  int next_queue_;              // target of the next submission
+  int quit_;
+  PoolThread threads_[MAX_POOL_THREADS];
+} g_pool;
+
+static void PoolUnlinkTask(WebPWorkerImpl* const task) {
+  PoolThread* const queue = &g_pool.threads_[task->queue_];
+  if (task->prev_ != NULL) {
+    task->prev_->next_ = task->next_;
+  } else {
+    queue->head_ = task->next_;
+  }
+  if (task->next_ != NULL) {
+    task->next_->prev_ = task->prev_;
+  } else {
+    queue->tail_ = task->prev_;
+  }
+  task->prev_ = task->next_ = NULL;
+  task->queue_ = -1;
+  --g_pool.num_queued_;
+}
+
+// Returns the task to run next by thread 'index'. Must be called with the
+// lock held and at least one task queued.
+static WebPWorkerImpl* PoolPopTask(int index) {
+  int i;
+  if (g_pool.threads_[index].head_ != NULL) {
+    WebPWorkerImpl* const task = g_pool.threads_[index].head_;
+    PoolUnlinkTask(task);
+    return task;
+  }
+  for (i = 1; i < g_pool.num_threads_; ++i) {
+    PoolThread* const victim =
+        &g_pool.threads_[(index + i) % g_pool.num_threads_];
+    if (victim->tail_ != NULL) {
+      WebPWorkerImpl* const task = victim->tail_;
+      PoolUnlinkTask(task);
+      return task;
+    }
+  }
+  assert(0);   // 'num_queued_' is out of sync with the queues
+  return NULL;
+}
+
+// Runs an unqueued task and marks it as done. Must be called with the lock
+// held. The task's owner may release it as soon as the lock is dropped.
+static void PoolRunTask(WebPWorkerImpl* const task) {
+  WebPWorker* const worker = task->worker_;
+  const WebPMemoryAllocator* const previous = WebPGetThreadAllocator();
+  WebPSetThreadAllocator(task->allocator_);
+  pthread_mutex_unlock(&g_pool.mutex_);
+  Execute(worker);
+  WebPSetThreadAllocator(previous);
+  pthread_mutex_lock(&g_pool.mutex_);
+  worker->status_ = OK;
+  pthread_cond_signal(&task->condition_);
+}
+
+static THREADFN PoolThreadLoop(void* ptr) {
+  PoolThread* const self = (PoolThread*)ptr;
+  const int index = (int)(self - g_pool.threads_);
+  pthread_mutex_lock(&g_pool.mutex_);
+  while (1) {
+    if (g_pool.num_queued_ > 0) {
+      PoolRunTask(PoolPopTask(index));
+    } else if (g_pool.quit_) {
+      break;
+    } else {
+      self->idle_ = 1;
+      pthread_cond_wait(&self->condition_, &g_pool.mutex_);
+      self->idle_ = 0;
+    }
+  }
+  pthread_mutex_unlock(&g_pool.mutex_);
+  return THREAD_RETURN(NULL);
+}
+
+// Wakes up an idle pool thread, preferably 'index'. Must be called with the
+// lock held.
+static void PoolWakeUp(int index) {
+  int i;
+  for (i = 0; i < g_pool.num_threads_; ++i) {
+    PoolThread* const thread =
+        &g_pool.threads_[(index + i) % g_pool.num_threads_];
+    if (thread->idle_) {
+      thread->idle_ = 0;   // so that the next wake-up goes to another thread
+      pthread_cond_signal(&thread->condition_);
+      return;
+    }
+  }
+}
+
+// Without running pool threads, no task can be queued or in progress: the
+// mutex is then left alone, since it's only valid while the pool runs.
+static int PoolSync(WebPWorker* const worker) {
+  WebPWorkerImpl* const task = worker->impl_;
+  if (task != NULL && g_pool.num_threads_ > 0) {
+    pthread_mutex_lock(&g_pool.mutex_);
+    if (worker->status_ == WORK && task->queue_ >= 0) {
+      PoolUnlinkTask(task);   // nobody picked it up yet: run it ourselves
+      PoolRunTask(task);
+    }
+    while (worker->status_ == WORK) {
+      pthread_cond_wait(&task->condition_, &g_pool.mutex_);
+    }
+    pthread_mutex_unlock(&g_pool.mutex_);
+  }
+  assert(worker->status_ <= OK);
+  return !worker->had_error;
+}
+
+static int PoolReset(WebPWorker* const worker) {
+  int ok = 1;
+  worker->had_error = 0;
+  if (worker->status_ < OK) {
+    WebPWorkerImpl* const task =
+        (WebPWorkerImpl*)WebPSafeCalloc(1, sizeof(*task));
+    if (task == NULL) return 0;
+    if (pthread_cond_init(&task->condition_, NULL)) {
+      WebPSafeFree(task);
+      return 0;
+    }
+    task->worker_ = worker;
+    task->queue_ = -1;
+    worker->impl_ = task;
+    worker->status_ = OK;
+  } else if (worker->status_ > OK) {
+    ok = PoolSync(worker);
+  }
+  assert(!ok || (worker->status_ == OK));
+  return ok;
+}
+
+static void PoolLaunch(WebPWorker* const worker) {
+  WebPWorkerImpl* const task = worker->impl_;
+  PoolThread* queue;
+  int index;
+  if (task == NULL) return;
+  PoolSync(worker);   // finish the previous job, like Launch() does
+  if (g_pool.num_threads_ == 0) {   // pool not running: work synchronously
+    Execute(worker);
+    return;
+  }
+  pthread_mutex_lock(&g_pool.mutex_);
+  index = g_pool.next_queue_;
+  g_pool.next_queue_ = (index + 1) % g_pool.num_threads_;
+  queue = &g_pool.threads_[index];
+  task->queue_ = index;
+  task->allocator_ = WebPGetThreadAllocator();
+  task->prev_ = NULL;
+  task->next_ = queue->head_;
+  if (queue->head_ != NULL) {
+    queue->head_->prev_ = task;
+  } else {
+    queue->tail_ = task;
+  }
+  queue->head_ = task;
+  ++g_pool.num_queued_;
+  worker->status_ = WORK;
+  PoolWakeUp(index);
+  pthread_mutex_unlock(&g_pool.mutex_);
+}
+
+static void PoolEnd(WebPWorker* const worker) {
+  if (worker->impl_ != NULL) {
+    PoolSync(worker);
+    pthread_cond_destroy(&worker->impl_->condition_);
+    WebPSafeFree(worker->impl_);
+    worker->impl_ = NULL;
+  }
+  worker->status_ = NOT_OK;
+}
+
+static void PoolShutdown(int num_threads) {
+  int i;
+  pthread_mutex_lock(&g_pool.mutex_);
+  g_pool.quit_ = 1;
+  for (i = 0; i < num_threads; ++i) {
+    if (g_pool.threads_[i].idle_) {
+      g_pool.threads_[i].idle_ = 0;
+      pthread_cond_signal(&g_pool.threads_[i].condition_);
+    }
+  }
+  pthread_mutex_unlock(&g_pool.mutex_);
+  for (i = 0; i < num_threads; ++i) {
+    pthread_join(g_pool.threads_[i].thread_, NULL);
+    pthread_cond_destroy(&g_pool.threads_[i].condition_);
+  }
+  pthread_mutex_destroy(&g_pool.mutex_);
+  memset(&g_pool, 0, sizeof(g_pool));
+}
+
+int WebPThreadPoolInit(int num_threads) {
+  int i;
+  if (g_pool.num_threads_ > 0) return 0;
+  if (num_threads <= 0 || num_threads > MAX_POOL_THREADS) return 0;
+  memset(&g_pool, 0, sizeof(g_pool));
+  if (pthread_mutex_init(&g_pool.mutex_, NULL)) return 0;
+  for (i = 0; i < num_threads; ++i) {
+    PoolThread* const thread = &g_pool.threads_[i];
+    if (pthread_cond_init(&thread->condition_, NULL)) break;
+    if (pthread_create(&thread->thread_, NULL, PoolThreadLoop, thread)) {
+      pthread_cond_destroy(&thread->condition_);
+      break;
+    }
+  }
+  if (i < num_threads) {
+    PoolShutdown(i);
+    return 0;
+  }
+  g_pool.num_threads_ = num_threads;
+  return 1;
+}
+
+void WebPThreadPoolDelete(void) {
+  if (g_pool.num_threads_ > 0) PoolShutdown(g_pool.num_threads_);
+}
+
+int WebPThreadPoolGetSize(void) {
+  return g_pool.num_threads_;
+}
+
+static const WebPWorkerInterface g_pool_interface = {
+  Init, PoolReset, PoolSync, PoolLaunch, Execute, PoolEnd
+};
+
+const WebPWorkerInterface* WebPGetThreadPoolInterface(void) {
+  return &g_pool_interface;
+}
+
+#else  // !WEBP_USE_THREAD
+
+static const WebPWorkerInterface g_pool_interface = {
+  Init, Reset, Sync, Launch, Execute, End
+};
+
+int WebPThreadPoolInit(int num_threads) {
+  (void)num_threads;
+  return 0;
+}
+
+void WebPThreadPoolDelete(void) {}
+
+int WebPThreadPoolGetSize(void) {
+  return 0;
+}
+
+const WebPWorkerInterface* WebPGetThreadPoolInterface(void) {
+  return &g_pool_interface;
+}
+
+#endif  // WEBP_USE_THREAD
+
 //------------------------------------------------------------------------------
 
 static WebPWorkerInterface g_worker_interface = {
@@ -356,3 +774,295 @@ const WebPWorkerInterface* WebPGetWorkerInterface(void) {
 }
 
 //------------------------------------------------------------------------------
+// Task graph
+
+typedef struct {
+  WebPWorkerHook hook_;
+  void* data1_;
+  void* data2_;
+  int num_pending_deps_;   // dependencies not completed yet (Run() only)
+} WebPGraphTask;
+
+struct WebPTaskGraph {
+  WebPGraphTask* tasks_;
+  int num_tasks_;
+  int max_tasks_;
+  int* edges_;             // (dependency, task) pairs
+  int num_edges_;
+  int max_edges_;
+  // Run() state. 'first_dependent_[i]' is the index in 'dependents_' of the
+  // tasks depending on task i. 'ready_' is a stack of the tasks whose
+  // dependencies are all done. All three live in 'run_mem_'.
+  int* run_mem_;
+  int max_run_mem_;
+  int* first_dependent_;
+  int* dependents_;
+  int* ready_;
+  int num_ready_;
+#ifdef WEBP_USE_THREAD
+  pthread_mutex_t mutex_;      // guards the members below and 'ready_'
+  pthread_cond_t condition_;   // signaled when a task gets ready, or to quit
+  int num_running_;            // tasks being executed
+  int num_idle_;               // runners waiting on 'condition_'
+  int num_starting_;           // helpers launched but not running yet
+  int failed_;                 // true once a hook returned false
+  WebPWorker* helpers_;        // threads taking part in the run, besides the
+  int helpers_size_;           // calling one. They're launched on demand, up
+  int num_helpers_;            // to 'max_helpers_'.
+  int max_helpers_;
+#endif
+};
+
+WebPTaskGraph* WebPTaskGraphNew(void) {
+  return (WebPTaskGraph*)WebPSafeCalloc(1, sizeof(WebPTaskGraph));
+}
+
+void WebPTaskGraphDelete(WebPTaskGraph* const graph) {
+  if (graph != NULL) {
+    WebPSafeFree(graph->tasks_);
+    WebPSafeFree(graph->edges_);
+    WebPSafeFree(graph->run_mem_);
+#ifdef WEBP_USE_THREAD
+    WebPSafeFree(graph->helpers_);
+#endif
+    WebPSafeFree(graph);
+  }
+}
+
+// Grows the '*array' of '*max_size' elements of 'elem_size' bytes so that it
+// can hold 'size' elements. Returns false in case of memory error.
+static int GrowArray(void** const array, int* const max_size, int size,
+                     size_t elem_size) {
+  void* new_array;
+  int new_max_size;
+  if (size <= *max_size) return 1;
+  new_max_size = (2 * *max_size > size) ? 2 * *max_size : size + 8;
+  new_array = WebPSafeMalloc((uint64_t)new_max_size, elem_size);
+  if (new_array == NULL) return 0;
+  if (*array != NULL) memcpy(new_array, *array, *max_size * elem_size);
+  WebPSafeFree(*array);
+  *array = new_array;
+  *max_size = new_max_size;
+  return 1;
+}
+
+int WebPTaskGraphAddTask(WebPTaskGraph* const graph, WebPWorkerHook hook,
+                         void* data1, void* data2,
+                         const int* const deps, int num_deps) {
+  int i;
+  const int id = graph->num_tasks_;
+  WebPGraphTask* task;
+  for (i = 0; i < num_deps; ++i) {
+    if (deps[i] < 0 || deps[i] >= id) return -1;
+  }
+  if (!GrowArray((void**)&graph->tasks_, &graph->max_tasks_, id + 1,
+                 sizeof(*graph->tasks_)) ||
+      !GrowArray((void**)&graph->edges_, &graph->max_edges_,
+                 2 * (graph->num_edges_ + num_deps), sizeof(*graph->edges_))) {
+    return -1;
+  }
+  for (i = 0; i < num_deps; ++i) {
+    graph->edges_[2 * graph->num_edges_ + 0] = deps[i];
+    graph->edges_[2 * graph->num_edges_ + 1] = id;
+    ++graph->num_edges_;
+  }
+  task = &graph->tasks_[id];
+  memset(task, 0, sizeof(*task));
+  task->hook_ = hook;
+  task->data1_ = data1;
+  task->data2_ = data2;
+  ++graph->num_tasks_;
+  return id;
+}
+
+// Dependencies always point to earlier tasks, so the insertion order is a
+// valid execution order.
+static int RunSerially(const WebPTaskGraph* const graph) {
+  int i;
+  for (i = 0; i < graph->num_tasks_; ++i) {
+    const WebPGraphTask* const task = &graph->tasks_[i];
+    if (!task->hook_(task->data1_, task->data2_)) return 0;
+  }
+  return 1;
+}
+
+#ifdef WEBP_USE_THREAD
+
+// Sorts the edges by dependency into 'first_dependent_' / 'dependents_', and
+// stacks the tasks without dependencies in 'ready_', lowest id on top.
+// Returns false in case of memory error.
+static int PrepareRun(WebPTaskGraph* const graph) {
+  const int num_tasks = graph->num_tasks_;
+  int* cursor;
+  int i;
+  if (!GrowArray((void**)&graph->run_mem_, &graph->max_run_mem_,
+                 2 * num_tasks + 1 + graph->num_edges_,
+                 sizeof(*graph->run_mem_))) {
+    return 0;
+  }
+  graph->first_dependent_ = graph->run_mem_;
+  graph->dependents_ = graph->first_dependent_ + num_tasks + 1;
+  graph->ready_ = graph->dependents_ + graph->num_edges_;
+  cursor = graph->ready_;   // used as scratch before being filled
+  memset(graph->first_dependent_, 0,
+         (num_tasks + 1) * sizeof(*graph->first_dependent_));
+  for (i = 0; i < num_tasks; ++i) graph->tasks_[i].num_pending_deps_ = 0;
+  for (i = 0; i < graph->num_edges_; ++i) {
+    ++graph->first_dependent_[graph->edges_[2 * i + 0] + 1];
+    ++graph->tasks_[graph->edges_[2 * i + 1]].num_pending_deps_;
+  }
+  for (i = 0; i < num_tasks; ++i) {
+    graph->first_dependent_[i + 1] += graph->first_dependent_[i];
+    cursor[i] = graph->first_dependent_[i];
+  }
+  for (i = 0; i < graph->num_edges_; ++i) {
+    graph->dependents_[cursor[graph->edges_[2 * i + 0]]++] =
+        graph->edges_[2 * i + 1];
+  }
+  graph->num_ready_ = 0;
+  for (i = num_tasks - 1; i >= 0; --i) {
+    if (graph->tasks_[i].num_pending_deps_ == 0) {
+      graph->ready_[graph->num_ready_++] = i;
+    }
+  }
+  return 1;
+}
+
+static int GraphHelperHook(void* data1, void* data2);
+
+// Launches helpers while there are more ready tasks than runners about to take
+// them. Must be called with the lock held, which is released meanwhile, by a
+// thread keeping the run alive (see RunTasks()).
+static void LaunchHelpers(WebPTaskGraph* const graph) {
+  const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
+  const int first = graph->num_helpers_;
+  int last, i;
+  int num_failed = 0;
+  while (graph->num_ready_ > graph->num_idle_ + graph->num_starting_ &&
+         graph->num_helpers_ < graph->max_helpers_) {
+    WebPWorker* const worker = &graph->helpers_[graph->num_helpers_++];
+    winterface->Init(worker);
+    worker->hook = GraphHelperHook;
+    worker->data1 = graph;
+    worker->data2 = NULL;
+    ++graph->num_starting_;
+  }
+  last = graph->num_helpers_;
+  if (last == first) return;
+  pthread_mutex_unlock(&graph->mutex_);
+  for (i = first; i < last; ++i) {
+    if (winterface->Reset(&graph->helpers_[i])) {
+      winterface->Launch(&graph->helpers_[i]);
+    } else {
+      ++num_failed;
+    }
+  }
+  pthread_mutex_lock(&graph->mutex_);
+  if (num_failed > 0) {
+    graph->num_starting_ -= num_failed;
+    graph->max_helpers_ = graph->num_helpers_;   // don't insist
+  }
+}
+
+// Pops and executes ready tasks until none can get ready anymore. Each task
+// releases its dependents as soon as it's done. Must be called with the lock
+// held. The run can't end while a runner has a task in progress.
+static void RunTasks(WebPTaskGraph* const graph) {
+  while (1) {
+    if (graph->num_ready_ > 0 && !graph->failed_) {
+      const int id = graph->ready_[--graph->num_ready_];
+      const WebPGraphTask* const task = &graph->tasks_[id];
+      int ok, i;
+      ++graph->num_running_;
+      pthread_mutex_unlock(&graph->mutex_);
+      ok = task->hook_(task->data1_, task->data2_);
+      pthread_mutex_lock(&graph->mutex_);
+      if (ok) {
+        for (i = graph->first_dependent_[id];
+             i < graph->first_dependent_[id + 1]; ++i) {
+          const int dependent = graph->dependents_[i];
+          if (--graph->tasks_[dependent].num_pending_deps_ == 0) {
+            graph->ready_[graph->num_ready_++] = dependent;
+            if (graph->num_idle_ > 0) pthread_cond_signal(&graph->condition_);
+          }
+        }
+        LaunchHelpers(graph);
+      } else {
+        graph->failed_ = 1;
+      }
+      --graph->num_running_;
+    } else if (graph->num_running_ == 0) {
+      // Nothing can get ready anymore: pass on the news to the next runner.
+      pthread_cond_signal(&graph->condition_);
+      break;
+    } else {
+      ++graph->num_idle_;
+      pthread_cond_wait(&graph->condition_, &graph->mutex_);
+      --graph->num_idle_;
+    }
+  }
+}
+
+static int GraphHelperHook(void* data1, void* data2) {
+  WebPTaskGraph* const graph = (WebPTaskGraph*)data1;
+  (void)data2;
+  pthread_mutex_lock(&graph->mutex_);
+  --graph->num_starting_;
+  RunTasks(graph);
+  pthread_mutex_unlock(&graph->mutex_);
+  return 1;
+}
+
+int WebPTaskGraphRun(WebPTaskGraph* const graph) {
+  const WebPWorkerInterface* const winterface = WebPGetWorkerInterface();
+  int max_helpers = graph->num_tasks_ - 1;
+  int ok;
+  int i;
+  if (winterface->Launch == PoolLaunch &&
+      max_helpers > g_pool.num_threads_) {
+    max_helpers = g_pool.num_threads_;
+  }
+  if (max_helpers <= 0 || !PrepareRun(graph) ||
+      !GrowArray((void**)&graph->helpers_, &graph->helpers_size_, max_helpers,
+                 sizeof(*graph->helpers_))) {
+    return RunSerially(graph);
+  }
+  if (pthread_mutex_init(&graph->mutex_, NULL)) return RunSerially(graph);
+  if (pthread_cond_init(&graph->condition_, NULL)) {
+    pthread_mutex_destroy(&graph->mutex_);
+    return RunSerially(graph);
+  }
+  graph->num_running_ = 0;
+  graph->num_idle_ = 0;
+  graph->num_starting_ = 0;
+  graph->failed_ = 0;
+  graph->num_helpers_ = 0;
+  graph->max_helpers_ = max_helpers;
+
+  // Helpers are launched as tasks get ready, starting with the initial ones.
+  pthread_mutex_lock(&graph->mutex_);
+  LaunchHelpers(graph);
+  RunTasks(graph);
+  pthread_mutex_unlock(&graph->mutex_);
+
+  // All the runners are done once the calling one is: no more helpers can be
+  // launched.
+  for (i = 0; i < graph->num_helpers_; ++i) {
+    winterface->Sync(&graph->helpers_[i]);
+    winterface->End(&graph->helpers_[i]);
+  }
+  ok = !graph->failed_;
+  pthread_cond_destroy(&graph->condition_);
+  pthread_mutex_destroy(&graph->mutex_);
+  return ok;
+}
+
+#else  // !WEBP_USE_THREAD
+
+int WebPTaskGraphRun(WebPTaskGraph* const graph) {
+  return RunSerially(graph);
+}
+
+#endif  // WEBP_USE_THREAD
+
+//------------------------------------------------------------------------------
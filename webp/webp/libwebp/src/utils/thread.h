@@ -84,6 +84,75 @@ MV_WEBP_EXTERN(int) WebPSetWorkerInterface(
 // Retrieve the currently set thread worker interface.
 MV_WEBP_EXTERN(const WebPWorkerInterface*) WebPGetWorkerInterface(void);
 
+//------------------------------------------------------------------------------
+// Atomic accesses, for lock-free hand-offs between threads. All of them act as
+// full memory barriers.
+
+int WebPAtomicLoad(volatile int* const ptr);
+void WebPAtomicStore(volatile int* const ptr, int value);
+// Sets *ptr to 'new_value' if it is equal to 'old_value'. Returns true if the
+// swap took place.
+int WebPAtomicCompareAndSwap(volatile int* const ptr,
+                             int old_value, int new_value);
+
+//------------------------------------------------------------------------------
+// One-time initialization
+
+// State of a one-time initialization, to be statically set to WEBP_ONCE_INIT.
+typedef volatile int WebPOnce;
+#define WEBP_ONCE_INIT 0
+
+// Calls 'func' if this is the first call for 'once'. The concurrent calls wait
+// for 'func' to return, and the later ones return right away.
+void WebPRunOnce(WebPOnce* const once, void (*func)(void));
+
+//------------------------------------------------------------------------------
+// Thread pool
+
+// Starts a process-wide pool of 'num_threads' threads (at most 64). Returns
+// false in case of error, or if the pool is already running. Like
+// WebPSetWorkerInterface(), this function is not thread-safe.
+MV_WEBP_EXTERN(int) WebPThreadPoolInit(int num_threads);
+
+// Stops the pool. Must not be called while some workers are still launched.
+MV_WEBP_EXTERN(void) WebPThreadPoolDelete(void);
+
+// Returns the number of threads of the pool, or 0 if it is not running.
+MV_WEBP_EXTERN(int) WebPThreadPoolGetSize(void);
+
+// Returns a worker interface running the workers on the pool instead of one
+// thread each. Reset() no longer spawns threads, and Launch() queues the job
+// for the pool threads, or runs it synchronously if the pool is not running.
+// Install it with WebPSetWorkerInterface() to share the pool between all the
+// encoders and decoders of the process.
+MV_WEBP_EXTERN(const WebPWorkerInterface*) WebPGetThreadPoolInterface(void);
+
+//------------------------------------------------------------------------------
+// Task graph
+
+// A set of hooks, each one called once all the hooks it depends on are done.
+// Independent hooks run concurrently through the current worker interface: a
+// hook is started as soon as its last dependency completes.
+typedef struct WebPTaskGraph WebPTaskGraph;
+
+// Returns a new empty graph, or NULL in case of memory error.
+MV_WEBP_EXTERN(WebPTaskGraph*) WebPTaskGraphNew(void);
+
+// Adds a task calling hook(data1, data2) after the 'num_deps' tasks whose ids
+// are listed in 'deps'. Returns the id of the new task, or -1 in case of error
+// or if 'deps' contains an id not returned by a previous call.
+MV_WEBP_EXTERN(int) WebPTaskGraphAddTask(WebPTaskGraph* const graph,
+                                         WebPWorkerHook hook,
+                                         void* data1, void* data2,
+                                         const int* const deps, int num_deps);
+
+// Runs all the tasks. The calling thread takes part in the work. Returns false
+// if a hook returned false, in which case the tasks not started yet are
+// skipped. The graph can be run again.
+MV_WEBP_EXTERN(int) WebPTaskGraphRun(WebPTaskGraph* const graph);
+
+MV_WEBP_EXTERN(void) WebPTaskGraphDelete(WebPTaskGraph* const graph);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
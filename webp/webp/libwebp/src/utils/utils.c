@@ -16,6 +16,7 @@
 #include "../webp/decode.h"
 #include "../webp/encode.h"
 #include "../webp/format_constants.h"  // for MAX_PALETTE_SIZE
+#include "./thread.h"
 #include "./utils.h"
 
 // If PRINT_MEM_INFO is defined, extra info (like total memory used, number of
@@ -183,37 +184,255 @@ static int CheckSizeArgumentsOverflow(uint64_t nmemb, size_t size) {
   return 1;
 }
 
-void* WebPSafeMalloc(uint64_t nmemb, size_t size) {
+//------------------------------------------------------------------------------
+// Allocators
+
+#if !defined(WEBP_USE_THREAD)
+#define WEBP_THREAD_LOCAL
+#elif defined(_MSC_VER)
+#define WEBP_THREAD_LOCAL __declspec(thread)
+#else
+#define WEBP_THREAD_LOCAL __thread
+#endif
+
+// All-NULL methods stand for malloc() and free().
+static WebPMemoryAllocator g_allocator = { NULL, NULL, NULL };
+
+// Allocator of the operation running in the current thread, if any.
+static WEBP_THREAD_LOCAL const WebPMemoryAllocator* g_thread_allocator = NULL;
+
+static void* Alloc(const WebPMemoryAllocator* const allocator, size_t size) {
+  return (allocator->Alloc != NULL) ? allocator->Alloc(allocator->opaque, size)
+                                    : malloc(size);
+}
+
+static void Free(const WebPMemoryAllocator* const allocator, void* const ptr) {
+  if (allocator->Free != NULL) {
+    if (ptr != NULL) allocator->Free(allocator->opaque, ptr);
+  } else {
+    free(ptr);
+  }
+}
+
+static const WebPMemoryAllocator* GetAllocator(void) {
+  return (g_thread_allocator != NULL) ? g_thread_allocator : &g_allocator;
+}
+
+int WebPSetMemoryAllocator(const WebPMemoryAllocator* const allocator) {
+  if (allocator == NULL) {
+    memset(&g_allocator, 0, sizeof(g_allocator));
+    return 1;
+  }
+  if (allocator->Alloc == NULL || allocator->Free == NULL) return 0;
+  g_allocator = *allocator;
+  return 1;
+}
+
+const WebPMemoryAllocator* WebPGetThreadAllocator(void) {
+  return g_thread_allocator;
+}
+
+void WebPSetThreadAllocator(const WebPMemoryAllocator* const allocator) {
+  g_thread_allocator = allocator;
+}
+
+const WebPMemoryAllocator* WebPPushThreadAllocator(
+    const WebPMemoryAllocator* const allocator) {
+  const WebPMemoryAllocator* const previous = g_thread_allocator;
+  if (allocator != NULL) g_thread_allocator = allocator;
+  return previous;
+}
+
+//------------------------------------------------------------------------------
+// Memory accounting
+
+// Each counted block is preceded by its size, on as many bytes as needed to
+// preserve the alignment of malloc().
+#define COUNTER_HEADER_SIZE 16
+
+static void CounterLock(WebPMemoryCounter* const counter) {
+  while (!WebPAtomicCompareAndSwap(&counter->lock_, 0, 1)) {
+  }
+}
+
+static void CounterUnlock(WebPMemoryCounter* const counter) {
+  WebPAtomicStore(&counter->lock_, 0);
+}
+
+static void* CounterAlloc(void* opaque, size_t size) {
+  WebPMemoryCounter* const counter = (WebPMemoryCounter*)opaque;
+  uint8_t* block;
+  if (size > (size_t)-1 - COUNTER_HEADER_SIZE) return NULL;
+  block = (uint8_t*)Alloc(counter->parent_, size + COUNTER_HEADER_SIZE);
+  if (block == NULL) return NULL;
+  *(size_t*)block = size;
+  CounterLock(counter);
+  counter->bytes_ += size;
+  counter->total_bytes_ += size;
+  ++counter->num_allocs_;
+  if (counter->bytes_ > counter->peak_bytes_) {
+    counter->peak_bytes_ = counter->bytes_;
+  }
+  CounterUnlock(counter);
+  return block + COUNTER_HEADER_SIZE;
+}
+
+static void CounterFree(void* opaque, void* ptr) {
+  WebPMemoryCounter* const counter = (WebPMemoryCounter*)opaque;
+  const WebPMemoryAllocator* const parent = counter->parent_;
+  uint8_t* const block = (uint8_t*)ptr - COUNTER_HEADER_SIZE;
+  CounterLock(counter);
+  counter->bytes_ -= *(const size_t*)block;
+  CounterUnlock(counter);
+  // Note: 'counter' may live in the block being freed.
+  Free(parent, block);
+}
+
+void WebPMemoryCounterInit(WebPMemoryCounter* const counter,
+                           const WebPMemoryAllocator* const parent) {
+  assert(counter != NULL);
+  memset(counter, 0, sizeof(*counter));
+  counter->allocator_.Alloc = CounterAlloc;
+  counter->allocator_.Free = CounterFree;
+  counter->allocator_.opaque = counter;
+  counter->parent_ = (parent != NULL) ? parent : GetAllocator();
+}
+
+void WebPMemoryCounterCopy(const WebPMemoryCounter* const src,
+                           WebPMemoryCounter* const dst) {
+  assert(src != NULL && dst != NULL);
+  *dst = *src;
+  dst->allocator_.opaque = dst;
+}
+
+//------------------------------------------------------------------------------
+// Stage timing
+
+#if defined(__APPLE__)
+#include <mach/mach_time.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+uint64_t WebPGetTicks(void) {
+#if defined(__APPLE__)
+  return mach_absolute_time();
+#elif defined(_WIN32)
+  LARGE_INTEGER count;
+  QueryPerformanceCounter(&count);
+  return (uint64_t)count.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#if defined(WEBP_ENABLE_TIMING)
+
+// Number of nanoseconds per tick.
+static double GetTickPeriod(void) {
+#if defined(__APPLE__)
+  mach_timebase_info_data_t timebase;
+  if (mach_timebase_info(&timebase) != KERN_SUCCESS || timebase.denom == 0) {
+    return 1.;
+  }
+  return (double)timebase.numer / timebase.denom;
+#elif defined(_WIN32)
+  LARGE_INTEGER frequency;
+  if (!QueryPerformanceFrequency(&frequency) || frequency.QuadPart == 0) {
+    return 1.;
+  }
+  return 1e9 / (double)frequency.QuadPart;
+#else
+  return 1.;
+#endif
+}
+
+void WebPStageTimerToNanoseconds(const WebPStageTimer* const timer,
+                                 int num_stages, uint64_t* const ns) {
+  const double period = GetTickPeriod();
+  int i;
+  assert(num_stages <= WEBP_MAX_TIMED_STAGES);
+  for (i = 0; i < num_stages; ++i) {
+    ns[i] = (uint64_t)(timer->ticks_[i] * period);
+  }
+}
+
+#else   // !WEBP_ENABLE_TIMING
+
+void WebPStageTimerToNanoseconds(const WebPStageTimer* const timer,
+                                 int num_stages, uint64_t* const ns) {
+  (void)timer;
+  assert(num_stages <= WEBP_MAX_TIMED_STAGES);
+  memset(ns, 0, num_stages * sizeof(*ns));
+}
+
+#endif  // WEBP_ENABLE_TIMING
+
+//------------------------------------------------------------------------------
+
+static void* SafeMalloc(const WebPMemoryAllocator* const allocator,
+                        uint64_t nmemb, size_t size) {
   void* ptr;
   Increment(&num_malloc_calls);
   if (!CheckSizeArgumentsOverflow(nmemb, size)) return NULL;
   assert(nmemb * size > 0);
-  ptr = malloc((size_t)(nmemb * size));
+  ptr = Alloc(allocator, (size_t)(nmemb * size));
   AddMem(ptr, (size_t)(nmemb * size));
   return ptr;
 }
 
+static void SafeFree(const WebPMemoryAllocator* const allocator,
+                     void* const ptr) {
+  if (ptr != NULL) {
+    Increment(&num_free_calls);
+    SubMem(ptr);
+  }
+  Free(allocator, ptr);
+}
+
+void* WebPSafeMalloc(uint64_t nmemb, size_t size) {
+  return SafeMalloc(GetAllocator(), nmemb, size);
+}
+
 void* WebPSafeCalloc(uint64_t nmemb, size_t size) {
+  const WebPMemoryAllocator* const allocator = GetAllocator();
   void* ptr;
   Increment(&num_calloc_calls);
   if (!CheckSizeArgumentsOverflow(nmemb, size)) return NULL;
   assert(nmemb * size > 0);
-  ptr = calloc((size_t)nmemb, size);
+  if (allocator->Alloc == NULL) {
+    ptr = calloc((size_t)nmemb, size);
+  } else {
+    ptr = allocator->Alloc(allocator->opaque, (size_t)(nmemb * size));
+    if (ptr != NULL) memset(ptr, 0, (size_t)(nmemb * size));
+  }
   AddMem(ptr, (size_t)(nmemb * size));
   return ptr;
 }
 
 void WebPSafeFree(void* const ptr) {
-  if (ptr != NULL) {
-    Increment(&num_free_calls);
-    SubMem(ptr);
-  }
-  free(ptr);
+  SafeFree(GetAllocator(), ptr);
+}
+
+void* WebPSafeMallocGlobal(uint64_t nmemb, size_t size) {
+  return SafeMalloc(&g_allocator, nmemb, size);
+}
+
+void WebPSafeFreeGlobal(void* const ptr) {
+  SafeFree(&g_allocator, ptr);
+}
+
+// Public API functions.
+void* WebPMalloc(size_t size) {
+  return (size > 0) ? WebPSafeMallocGlobal(1ULL, size) : NULL;
 }
 
-// Public API function.
 void WebPFree(void* ptr) {
-  free(ptr);
+  Free(&g_allocator, ptr);
 }
 
 //------------------------------------------------------------------------------
@@ -48,6 +48,84 @@ MV_WEBP_EXTERN(void*) WebPSafeCalloc(uint64_t nmemb, size_t size);
 // Companion deallocation function to the above allocations.
 MV_WEBP_EXTERN(void) WebPSafeFree(void* const ptr);
 
+// The functions above use the allocator of the operation running in the
+// calling thread if any, or else the global one (see WebPSetMemoryAllocator()).
+// Memory outliving the operation (returned to the caller, or kept in a
+// context between calls) must use these variants, bound to the global one.
+void* WebPSafeMallocGlobal(uint64_t nmemb, size_t size);
+void WebPSafeFreeGlobal(void* const ptr);
+
+// Returns the allocator of the operation running in the calling thread, or
+// NULL if there is none.
+const WebPMemoryAllocator* WebPGetThreadAllocator(void);
+void WebPSetThreadAllocator(const WebPMemoryAllocator* const allocator);
+// Sets the allocator of the calling thread if 'allocator' is not NULL, and
+// returns the previous one, to be restored with WebPSetThreadAllocator() once
+// the operation is over.
+const WebPMemoryAllocator* WebPPushThreadAllocator(
+    const WebPMemoryAllocator* const allocator);
+
+// Memory accounting. Installed as the allocator of an operation, through its
+// 'allocator_' member, a counter tracks the working memory of the operation.
+// The allocations are forwarded to the 'parent_' allocator.
+typedef struct {
+  WebPMemoryAllocator allocator_;
+  const WebPMemoryAllocator* parent_;
+  volatile int lock_;         // guards the counts below
+  uint64_t bytes_;            // memory currently allocated
+  uint64_t peak_bytes_;       // maximum value reached by 'bytes_'
+  uint64_t total_bytes_;      // cumulated size of all the allocations
+  int num_allocs_;            // number of allocations
+} WebPMemoryCounter;
+
+// Resets the counts. If 'parent' is NULL, the allocator currently in use by
+// the calling thread is used.
+void WebPMemoryCounterInit(WebPMemoryCounter* const counter,
+                           const WebPMemoryAllocator* const parent);
+// Moves the counter 'src' to 'dst'. Only 'dst' must be used afterward.
+void WebPMemoryCounterCopy(const WebPMemoryCounter* const src,
+                           WebPMemoryCounter* const dst);
+
+//------------------------------------------------------------------------------
+// Stage timing
+
+// With WEBP_ENABLE_TIMING defined, the decoders and the encoders accumulate
+// the time spent in each of their stages, when the caller asked for
+// statistics. Otherwise WEBP_TIMING_START/STOP compile to nothing, and the
+// reported times are zero.
+
+#define WEBP_MAX_TIMED_STAGES 8
+
+typedef struct {
+  uint64_t start_[WEBP_MAX_TIMED_STAGES];   // counter value at the stage start
+  uint64_t ticks_[WEBP_MAX_TIMED_STAGES];   // time accumulated per stage
+} WebPStageTimer;
+
+// Returns the value of the platform's monotonic counter, in ticks. Available
+// even without WEBP_ENABLE_TIMING, since the dsp auto-tuning relies on it.
+uint64_t WebPGetTicks(void);
+
+// Converts the time accumulated by the first 'num_stages' stages of 'timer' to
+// nanoseconds, and stores it in 'ns'.
+void WebPStageTimerToNanoseconds(const WebPStageTimer* const timer,
+                                 int num_stages, uint64_t* const ns);
+
+// 'timer' may be NULL, in which case nothing is recorded. A given stage must
+// only be timed by one thread at a time.
+#if defined(WEBP_ENABLE_TIMING)
+#define WEBP_TIMING_START(timer, stage) do {                                   \
+  if ((timer) != NULL) (timer)->start_[(stage)] = WebPGetTicks();              \
+} while (0)
+#define WEBP_TIMING_STOP(timer, stage) do {                                    \
+  if ((timer) != NULL) {                                                       \
+    (timer)->ticks_[(stage)] += WebPGetTicks() - (timer)->start_[(stage)];     \
+  }                                                                            \
+} while (0)
+#else
+#define WEBP_TIMING_START(timer, stage) do {} while (0)
+#define WEBP_TIMING_STOP(timer, stage) do {} while (0)
+#endif
+
 //------------------------------------------------------------------------------
 // Alignment
 
@@ -117,16 +195,26 @@ static MV_WEBP_INLINE void PutLE32(uint8_t* const data, uint32_t val) {
 static MV_WEBP_INLINE int BitsLog2Floor(uint32_t n) {
   return 31 ^ __builtin_clz(n);
 }
+// Returns the number of trailing zero bits of n. n must be > 0.
+static MV_WEBP_INLINE int BitsCtz(uint32_t n) {
+  return __builtin_ctz(n);
+}
 #elif defined(_MSC_VER) && _MSC_VER > 1310 && \
       (defined(_M_X64) || defined(_M_IX86))
 #include <intrin.h>
 #pragma intrinsic(_BitScanReverse)
+#pragma intrinsic(_BitScanForward)
 
 static MV_WEBP_INLINE int BitsLog2Floor(uint32_t n) {
   unsigned long first_set_bit;
   _BitScanReverse(&first_set_bit, n);
   return first_set_bit;
 }
+static MV_WEBP_INLINE int BitsCtz(uint32_t n) {
+  unsigned long first_set_bit;
+  _BitScanForward(&first_set_bit, n);
+  return first_set_bit;
+}
 #else
 static MV_WEBP_INLINE int BitsLog2Floor(uint32_t n) {
   int log = 0;
@@ -143,6 +231,15 @@ static MV_WEBP_INLINE int BitsLog2Floor(uint32_t n) {
   }
   return log;
 }
+
+static MV_WEBP_INLINE int BitsCtz(uint32_t n) {
+  int ctz = 0;
+  while (!(n & 1)) {
+    n >>= 1;
+    ++ctz;
+  }
+  return ctz;
+}
 #endif
 
 //------------------------------------------------------------------------------
@@ -20,7 +20,7 @@
 extern "C" {
 #endif
 
-#define MV_WEBP_DECODER_ABI_VERSION 0x0208    // MAJOR(8b) + MINOR(8b)
+#define MV_WEBP_DECODER_ABI_VERSION 0x0303    // MAJOR(8b) + MINOR(8b)
 
 // Note: forward declaring enumerations is not allowed in (strict) C and C++,
 // the types are left here for reference.
@@ -32,7 +32,10 @@ typedef struct MV_WebPDecBuffer WebPDecBuffer;
 typedef struct MV_WebPIDecoder WebPIDecoder;
 typedef struct MV_WebPBitstreamFeatures WebPBitstreamFeatures;
 typedef struct MV_WebPDecoderOptions WebPDecoderOptions;
+typedef struct WebPDecoderStats WebPDecoderStats;
+typedef struct WebPDecoderOutput WebPDecoderOutput;
 typedef struct MV_WebPDecoderConfig WebPDecoderConfig;
+typedef struct WebPDecodeBatchItem WebPDecodeBatchItem;
 
 // Return the decoder's version number, packed in hexadecimal using 8bits for
 // each of major/minor/revision. E.g: v2.5.7 is 0x020507.
@@ -435,6 +438,35 @@ static MV_WEBP_INLINE MV_VP8StatusCode MV_WebPGetFeatures(
                                  MV_WEBP_DECODER_ABI_VERSION);
 }
 
+// Stages of a decoding, as timed in WebPDecoderStats::stage_time.
+typedef enum WebPDecodingStage {
+  WEBP_DEC_STAGE_HEADERS = 0,   // container and bitstream headers
+  WEBP_DEC_STAGE_TOKENS,        // lossy: parsing of the modes and coefficients
+  WEBP_DEC_STAGE_RECONSTRUCT,   // lossy: prediction and inverse transforms
+  WEBP_DEC_STAGE_FILTER,        // lossy: in-loop filtering and dithering
+  WEBP_DEC_STAGE_ALPHA,         // lossy: decoding of the alpha plane
+  WEBP_DEC_STAGE_ENTROPY,       // lossless: decoding of the pixels
+  WEBP_DEC_STAGE_TRANSFORMS,    // lossless: inverse transforms
+  WEBP_DEC_STAGE_OUTPUT,        // colorspace conversion, upsampling, scaling
+  WEBP_DEC_STAGE_NUM
+} WebPDecodingStage;
+
+// Statistics of a decoding
+struct WebPDecoderStats {
+  uint64_t bytes_allocated;  // cumulated size of the working memory allocations
+  uint64_t peak_bytes;       // maximum amount of working memory used at once
+  uint64_t output_bytes;     // size of the output buffer, if allocated by the
+                             // decoder (not included in the above)
+  int num_allocations;       // number of working memory allocations
+
+  // Time spent in each stage, in nanoseconds. Only measured if the library
+  // was built with WEBP_ENABLE_TIMING, zero otherwise. With threads, stages
+  // overlap and their sum can exceed the duration of the decoding.
+  uint64_t stage_time[WEBP_DEC_STAGE_NUM];
+
+  uint32_t pad[3];           // padding for later use
+};
+
 // Decoding options
 struct MV_WebPDecoderOptions {
   int bypass_filtering;               // if true, skip the in-loop filtering
@@ -449,8 +481,27 @@ struct MV_WebPDecoderOptions {
   int dithering_strength;             // dithering strength (0=Off, 100=full)
   int flip;                           // flip output vertically
   int alpha_dithering_strength;       // alpha dithering strength in [0..100]
+  int thread_rows;                    // number of macroblock rows the parsing
+                                      // thread can get ahead of the filtering
+                                      // one, if use_threads (0=default, 4)
+  const WebPMemoryAllocator* allocator;  // if not NULL, serves the working
+                                      // memory of the decoding (see types.h)
+  WebPDecoderStats* stats;            // if not NULL, receives the memory
+                                      // and timing statistics of the decoding
+
+  uint32_t pad[4];                    // padding for later use
+};
 
-  uint32_t pad[5];                    // padding for later use
+// Additional output of a decoding, see WebPDecoderConfig::extra_outputs.
+struct WebPDecoderOutput {
+  MV_WebPDecBuffer buffer;            // Output buffer, set up as 'output'
+  int use_cropping;                   // cropping and scaling of this output,
+  int crop_left, crop_top;            // with the same meaning as in
+  int crop_width, crop_height;        // WebPDecoderOptions
+  int use_scaling;
+  int scaled_width, scaled_height;
+
+  uint32_t pad[4];                    // padding for later use
 };
 
 // Main object storing the configuration for advanced decoding.
@@ -458,6 +509,14 @@ struct MV_WebPDecoderConfig {
   MV_WebPBitstreamFeatures input;  // Immutable bitstream features (optional)
   MV_WebPDecBuffer output;         // Output buffer (can point to external mem)
   MV_WebPDecoderOptions options;   // Decoding options
+
+  // If not NULL, 'num_extra_outputs' more pictures to produce along 'output',
+  // each with its own colorspace, cropping and scaling (the other options are
+  // shared). The bitstream is decoded only once, and its rows are fed to all
+  // the outputs. The in-loop filtering is skipped only if all the outputs
+  // allow it. Only supported by WebPDecode().
+  WebPDecoderOutput* extra_outputs;
+  int num_extra_outputs;
 };
 
 // Internal, version-checked, entry point
@@ -487,9 +546,50 @@ MV_WEBP_EXTERN(WebPIDecoder*) MV_WebPIDecode(const uint8_t* data, size_t data_si
 // Non-incremental version. This version decodes the full data at once, taking
 // 'config' into account. Returns decoding status (which should be VP8_STATUS_OK
 // if the decoding was successful). Note that 'config' cannot be NULL.
+// The buffers of 'config->extra_outputs', if any, are to be freed with
+// WebPFreeDecBuffer() too. Slow memory is written to directly there.
 MV_WEBP_EXTERN(MV_VP8StatusCode) MV_WebPDecode(const uint8_t* data, size_t data_size,
                                       MV_WebPDecoderConfig* config);
 
+// Returns an estimate of the peak amount of memory needed to decode a
+// bitstream with features 'config->input' (as returned by WebPGetFeatures())
+// using 'config->options', output buffer included unless it is external
+// memory. Returns 0 in case of invalid parameters.
+MV_WEBP_EXTERN(size_t) WebPPredictDecodeMemory(
+    const MV_WebPDecoderConfig* config);
+
+//------------------------------------------------------------------------------
+// Batch decoding
+
+// One picture of a batch.
+struct WebPDecodeBatchItem {
+  const uint8_t* data;         // bitstream to decode
+  size_t data_size;
+  MV_WebPDecBuffer* output;    // output buffer, set up as for WebPDecode():
+                               // colorspace, and possibly external memory
+  MV_VP8StatusCode status;     // decoding status, set by WebPDecodeBatch()
+
+  uint32_t pad[4];             // padding for later use
+};
+
+// Decodes the 'num_items' pictures of 'items' with the same 'options' (which
+// can be NULL). Compared to calling WebPDecode() on each of them, each task
+// keeps its decoders from one picture to the next instead of allocating new
+// ones, along with the main working memory of the lossy decoder and the pixel
+// buffer of the lossless one. The bitstream features are not parsed ahead of
+// decoding either, so the headers are parsed once per picture instead of
+// twice. The per-picture cost is otherwise the same.
+// The pictures are spread over 'num_threads' tasks, which run on the thread
+// pool if WebPGetThreadPoolInterface() is installed, and on as many threads
+// (started once for the whole batch) otherwise. Each picture is decoded by a
+// single thread ('use_threads' is ignored), and 'stats' is not supported.
+// Returns VP8_STATUS_OK if all the pictures were decoded, or the status of the
+// first failed one. The caller still owns the output buffers, to be freed with
+// WebPFreeDecBuffer().
+MV_WEBP_EXTERN(MV_VP8StatusCode) WebPDecodeBatch(
+    WebPDecodeBatchItem* items, int num_items,
+    const MV_WebPDecoderOptions* options, int num_threads);
+
 #ifdef __cplusplus
 }    // extern "C"
 #endif
@@ -279,7 +279,7 @@ MV_WEBP_EXTERN(MV_WebPAnimDecoder*) MV_WebPAnimDecoderNewInternal(
 // Returns:
 //   A pointer to the newly created WebPAnimDecoder object, or NULL in case of
 //   parsing error, invalid option or memory error.
-static MV_WEBP_INLINE MV_WebPAnimDecoder* MV)WebPAnimDecoderNew(
+static MV_WEBP_INLINE MV_WebPAnimDecoder* MV_WebPAnimDecoderNew(
     const MV_WebPData* webp_data, const MV_WebPAnimDecoderOptions* dec_options) {
   return MV_WebPAnimDecoderNewInternal(webp_data, dec_options,
                                     MV_WEBP_DEMUX_ABI_VERSION);
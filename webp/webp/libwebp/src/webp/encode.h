@@ -20,7 +20,7 @@
 extern "C" {
 #endif
 
-#define WEBP_ENCODER_ABI_VERSION 0x0209    // MAJOR(8b) + MINOR(8b)
+#define WEBP_ENCODER_ABI_VERSION 0x0302    // MAJOR(8b) + MINOR(8b)
 
 // Note: forward declaring enumerations is not allowed in (strict) C and C++,
 // the types are left here for reference.
@@ -32,6 +32,7 @@ typedef struct WebPConfig WebPConfig;
 typedef struct WebPPicture WebPPicture;   // main structure for I/O
 typedef struct WebPAuxStats WebPAuxStats;
 typedef struct WebPMemoryWriter WebPMemoryWriter;
+typedef struct WebPEncoderState WebPEncoderState;   // opaque
 
 // Return the encoder's version number, packed in hexadecimal using 8bits for
 // each of major/minor/revision. E.g: v2.5.7 is 0x020507.
@@ -140,12 +141,27 @@ struct WebPConfig {
                           // transparent area. Otherwise, discard this invisible
                           // RGB information for better compression. The default
                           // value is 0.
+  int exhaustive;         // Lossless only: if non-zero, encode with each
+                          // combination of transforms (on two threads if
+                          // thread_level is set) and keep the smallest output.
+                          // Much slower. The default value is 0.
+  int streaming;          // Lossless only: if non-zero, images that don't fit
+                          // a palette skip the search for backward references
+                          // and are coded in a single pass, as runs, color
+                          // cache hits and literals. Much faster, but larger,
+                          // and 'near_lossless' is not applied. Meant for
+                          // real-time screen capture. The default value is 0.
+  const WebPMemoryAllocator* allocator;  // if not NULL, serves the working
+                          // memory of the encoding (see types.h). With
+                          // WebPEncodeWithContext(), the memory kept by the
+                          // context is released first if the allocator
+                          // differs from the previous call's. The default
+                          // value is NULL.
 
 #ifdef WEBP_EXPERIMENTAL_FEATURES
   int delta_palettization;
-  uint32_t pad[2];        // padding for later use
 #else
-  uint32_t pad[3];        // padding for later use
+  uint32_t pad[1];        // padding for later use
 #endif  // WEBP_EXPERIMENTAL_FEATURES
 };
 
@@ -196,8 +212,22 @@ MV_WEBP_EXTERN(int) WebPValidateConfig(const WebPConfig* config);
 
 //------------------------------------------------------------------------------
 // Input / Output
-// Structure for storing auxiliary statistics (mostly for lossy encoding).
 
+// Stages of an encoding, as timed in WebPAuxStats::stage_time.
+typedef enum WebPEncodingStage {
+  WEBP_ENC_STAGE_IMPORT = 0,    // conversion of the input samples
+  WEBP_ENC_STAGE_ANALYSIS,      // segmentation, or choice of the lossless modes
+  WEBP_ENC_STAGE_STATS,         // lossy: statistics and size-search passes
+  WEBP_ENC_STAGE_CODING,        // lossy: final pass, modes and coefficients
+  WEBP_ENC_STAGE_TRELLIS,       // lossy: trellis quantization (part of the two
+                                // stages above)
+  WEBP_ENC_STAGE_ALPHA,         // lossy: compression of the alpha plane
+  WEBP_ENC_STAGE_TRANSFORMS,    // lossless: palette and spatial transforms
+  WEBP_ENC_STAGE_ENTROPY,       // lossless: backward references and coding
+  WEBP_ENC_STAGE_NUM
+} WebPEncodingStage;
+
+// Structure for storing auxiliary statistics (mostly for lossy encoding).
 struct WebPAuxStats {
   int coded_size;         // final size
 
@@ -225,6 +255,17 @@ struct WebPAuxStats {
   int lossless_hdr_size;       // lossless header (transform, huffman etc) size
   int lossless_data_size;      // lossless image data size
 
+  // memory statistics (WebPEncode() and WebPEncodeRenditions() only). The
+  // picture's samples and the coded output are not included.
+  uint64_t bytes_allocated;    // cumulated size of the memory allocations
+  uint64_t peak_bytes;         // maximum amount of memory used at once
+  int num_allocations;         // number of memory allocations
+
+  // Time spent in each stage (see WebPEncodingStage), in nanoseconds. Only
+  // measured if the library was built with WEBP_ENABLE_TIMING, zero otherwise.
+  // With threads, stages overlap and their sum can exceed the encoding time.
+  uint64_t stage_time[WEBP_ENC_STAGE_NUM];
+
   uint32_t pad[2];        // padding for later use
 };
 
@@ -255,6 +296,15 @@ MV_WEBP_EXTERN(void) WebPMemoryWriterClear(WebPMemoryWriter* writer);
 MV_WEBP_EXTERN(int) WebPMemoryWrite(const uint8_t* data, size_t data_size,
                                  const WebPPicture* picture);
 
+// Signature for pulling the source samples by strips, instead of having the
+// whole picture in memory (lossy encoding only). The function must fill
+// 'num_rows' rows of RGBA samples starting at row 'y' into 'rgba', with
+// 'stride' bytes between rows. Strips are requested from top to bottom, but
+// the picture can be scanned several times (once per encoding pass).
+// Must return false in case of error, which aborts the encoding.
+typedef int (*WebPRowReader)(int y, int num_rows, uint8_t* rgba, int stride,
+                             const WebPPicture* picture);
+
 // Progress hook, called from time to time to report progress. It can return
 // false to request an abort of the encoding process, or true otherwise if
 // everything is OK.
@@ -310,7 +360,10 @@ struct WebPPicture {
   // ARGB input (mostly used for input to lossless compression)
   uint32_t* argb;            // Pointer to argb (32 bit) plane.
   int argb_stride;           // This is stride in pixels units, not bytes.
-  uint32_t pad2[3];          // padding for later use
+  int argb_writable;         // Lossless only: if true, the argb plane is used
+                             // as the encoder's work buffer instead of being
+                             // copied, and is left in an unspecified state.
+  uint32_t pad2[2];          // padding for later use
 
   //   OUTPUT
   ///////////////
@@ -344,8 +397,22 @@ struct WebPPicture {
 
   uint32_t pad3[3];       // padding for later use
 
-  // Unused for now
-  uint8_t *pad4, *pad5;
+  // If not NULL, the source samples are pulled through this hook, 16 rows
+  // at a time, and converted to YUV as needed instead of being read from the
+  // y/u/v or argb planes. The peak memory then scales with the width only,
+  // apart from the compressed data. The alpha channel is ignored.
+  // Only supported for lossy encoding.
+  WebPRowReader row_reader;
+
+  // If not NULL, lossy encoding is warm-started from the statistics stored
+  // in this object by a previous encoding (if any), and they're then replaced
+  // by those of the current one. Meant for a sequence of similar pictures,
+  // like animation frames: the statistics pass of methods 0 to 2 and the
+  // filter-strength search of 'autofilter' are skipped. The statistics are
+  // only re-used if the quality, method, segments and filter settings are
+  // unchanged, and if the picture is not larger than the recorded one (in
+  // macroblocks). Not used by lossless.
+  WebPEncoderState* state;
   uint32_t pad6[8];       // padding for later use
 
   // PRIVATE FIELDS
@@ -518,6 +585,62 @@ MV_WEBP_EXTERN(void) WebPBlendAlpha(WebPPicture* pic, uint32_t background_rgb);
 // another is provided but they both incur some loss.
 MV_WEBP_EXTERN(int) WebPEncode(const WebPConfig* config, WebPPicture* picture);
 
+// Encoder context, keeping memory buffers (encoder state, bit-writers, token
+// pages) and worker threads alive between successive calls to
+// WebPEncodeWithContext(). When encoding many pictures of the same dimensions,
+// this saves most of the per-call setup work.
+// A context must not be used by several encodings at the same time.
+typedef struct WebPEncoderContext WebPEncoderContext;
+
+// Returns NULL in case of memory error.
+MV_WEBP_EXTERN(WebPEncoderContext*) WebPEncoderContextNew(void);
+// Releases the context, its buffers and its threads.
+MV_WEBP_EXTERN(void) WebPEncoderContextDelete(WebPEncoderContext* ctx);
+
+// Same as WebPEncode(), but re-using the resources held by 'ctx', if not NULL.
+MV_WEBP_EXTERN(int) WebPEncodeWithContext(WebPEncoderContext* ctx,
+                                          const WebPConfig* config,
+                                          WebPPicture* picture);
+
+// Allocates an empty WebPEncoderState object (cf WebPPicture::state).
+// Returns NULL in case of memory error.
+MV_WEBP_EXTERN(WebPEncoderState*) WebPEncoderStateNew(void);
+MV_WEBP_EXTERN(void) WebPEncoderStateDelete(WebPEncoderState* state);
+// Copies the statistics recorded in 'src' to 'dst', e.g. to try several
+// encodings from the same state and keep only the one of the retained output.
+MV_WEBP_EXTERN(void) WebPEncoderStateCopy(const WebPEncoderState* src,
+                                          WebPEncoderState* dst);
+
+// One of the outputs of WebPEncodeRenditions().
+typedef struct {
+  const WebPConfig* config;       // encoding parameters
+  WebPWriterFunction writer;      // receives the bitstream
+  void* custom_ptr;               // available to 'writer' as
+                                  // picture->custom_ptr
+  WebPAuxStats* stats;            // if not NULL, receives the statistics
+  WebPEncodingError error_code;   // [out] status of this rendition
+} WebPRendition;
+
+// Encodes 'picture' once per entry of 'renditions[]'. The RGB->YUV conversion
+// is done once (with the settings of the first lossy rendition), and lossy
+// renditions with the same method, segments, preprocessing and
+// emulate_jpeg_size settings share the analysis and segmentation. Those
+// without a target size/PSNR also re-use the intra modes picked by the first
+// of them, and only redo the quantization, token coding and bitstream writing.
+// The modes being tuned for the quality of that first rendition, it's best
+// listed first. Renditions of different dimensions need separate calls (on
+// rescaled copies of the picture).
+// The writer, custom_ptr and stats fields of 'picture' are ignored.
+// The working memory being shared between renditions, it's served by the
+// allocator of the first rendition's config (the others' are ignored). The
+// memory statistics of a rendition count its own allocations, but its peak
+// includes the memory kept from the previous renditions.
+// Returns false if any rendition failed, and sets picture->error_code to the
+// first error encountered.
+MV_WEBP_EXTERN(int) WebPEncodeRenditions(WebPPicture* picture,
+                                         WebPRendition* renditions,
+                                         int num_renditions);
+
 //------------------------------------------------------------------------------
 
 #ifdef __cplusplus
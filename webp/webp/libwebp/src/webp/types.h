@@ -49,4 +49,42 @@ typedef long long int int64_t;
 // Macro to check ABI compatibility (same major revision number)
 #define MV_WEBP_ABI_IS_INCOMPATIBLE(a, b) (((a) >> 8) != ((b) >> 8))
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Memory allocator. Alloc() must return memory aligned as malloc() does, or
+// NULL in case of error. Free() is never called with a NULL pointer.
+typedef struct WebPMemoryAllocator WebPMemoryAllocator;
+struct WebPMemoryAllocator {
+  void* (*Alloc)(void* opaque, size_t size);
+  void (*Free)(void* opaque, void* ptr);
+  void* opaque;           // passed as first argument to Alloc() and Free()
+};
+
+// Installs the allocator used by the library in place of malloc() and free().
+// Passing NULL restores these. The contents of the struct are copied. This
+// function is not thread-safe, and must be called before any memory is
+// allocated by the library. Returns false in case of invalid methods.
+// Allocators can also be set per encoding or decoding, through the
+// WebPConfig and WebPDecoderOptions 'allocator' field. These only serve the
+// working memory of the call, which is all released by the time it returns
+// (or by WebPIDelete() for incremental decoding). The memory handed to the
+// caller (decoded samples, encoded data, picture planes...) always comes from
+// the global allocator.
+MV_WEBP_EXTERN(int) WebPSetMemoryAllocator(
+    const WebPMemoryAllocator* const allocator);
+
+// Allocates 'size' bytes with the global allocator. Returns NULL in case of
+// error. The memory must be released with WebPFree().
+MV_WEBP_EXTERN(void*) WebPMalloc(size_t size);
+
+// Releases memory returned by the library, or by WebPMalloc(). With a custom
+// allocator, this must be used instead of free().
+MV_WEBP_EXTERN(void) WebPFree(void* ptr);
+
+#ifdef __cplusplus
+}    // extern "C"
+#endif
+
 #endif  /* WEBP_WEBP_TYPES_H_ */